@@ -0,0 +1,180 @@
+/**
+ * @file   ldgm/bench/ldgm_bench.cpp
+ * @brief  CPU LDGM encode/decode throughput benchmark
+ *
+ * Encodes frames of k packets of given size with the CPU LDGM session,
+ * drops random symbols and decodes them back, for every XOR kernel the CPU
+ * supports, both single-threaded and with the worker pool. Frames that are
+ * reported as recovered are compared with the original.
+ *
+ * Build with "make benchmarks".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "host.h"
+#include "utils/worker.h"
+
+#include "ldgm/src/ldgm-session-cpu.h"
+#include "ldgm/matrix-gen/matrix-generator.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern "C" void exit_uv(int status);
+
+void exit_uv(int status)
+{
+        exit(status);
+}
+
+static const char *kernels[] = { "sse2", "avx2", "avx512" };
+
+int main(int argc, char *argv[])
+{
+        if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+                printf("Usage:\n\t%s [k [m [c [packet_size [loss_pct [threads]]]]]]\n", argv[0]);
+                return 0;
+        }
+        int k = argc > 1 ? atoi(argv[1]) : 256;
+        int m = argc > 2 ? atoi(argv[2]) : 64;
+        int c = argc > 3 ? atoi(argv[3]) : 5;
+        int packet_size = argc > 4 ? atoi(argv[4]) / 4 * 4 : 8192;
+        double loss = argc > 5 ? atof(argv[5]) / 100.0 : 0.05;
+        if (argc > 6) {
+                commandline_params["worker-threads"] = argv[6];
+        }
+        if (k <= 0 || m <= 0 || c <= 0 || packet_size <= 0 || packet_size > 65532) {
+                fprintf(stderr, "Wrong parameters!\n");
+                return 1;
+        }
+
+        char matrix[] = "/tmp/ldgm_bench_matrix-XXXXXX";
+        int fd = mkstemp(matrix);
+        if (fd == -1 || generate_ldgm_matrix(matrix, k, m, c, 1, 0) != 0) {
+                fprintf(stderr, "Unable to generate LDGM matrix!\n");
+                return 1;
+        }
+
+        int frame_size = k * packet_size - 4; // LDGM header is 4 B
+        int iterations = max<long long>(3, (256LL << 20) / frame_size);
+        vector<char> frame(frame_size);
+        mt19937 gen(0xcafe);
+        for (auto &b : frame) {
+                b = (char) gen();
+        }
+        uniform_real_distribution<double> loss_dist(0.0, 1.0);
+
+        printf("k: %d, m: %d, c: %d, packet size: %d B, loss: %.2f%%, threads: %d\n",
+                        k, m, c, packet_size, loss * 100.0, task_pool_size());
+
+        bool ok = true;
+        for (const char *kernel : kernels) {
+                if (!LDGM_session_cpu::set_xor_impl(kernel)) {
+                        continue;
+                }
+                for (bool parallel : { false, true }) {
+                        if (parallel && task_pool_size() == 1) {
+                                continue;
+                        }
+                        LDGM_session_cpu session;
+                        session.set_params(k, m, c);
+                        session.set_pcMatrix(matrix);
+                        if (parallel) {
+                                session.set_parallel_for([](int count, const function<void(int, int)> &fn) {
+                                                parallel_for(0, count, fn);
+                                                });
+                        }
+
+                        duration<double> encode_time{}, decode_time{};
+                        int recovered = 0;
+                        for (int i = 0; i < iterations; ++i) {
+                                int buf_size;
+                                auto t0 = high_resolution_clock::now();
+                                char *buf = session.encode_frame(frame.data(), frame_size, &buf_size);
+                                auto t1 = high_resolution_clock::now();
+                                encode_time += t1 - t0;
+
+                                map<int, int> valid_data;
+                                for (int s = 0; s < k + m; ++s) {
+                                        if (loss_dist(gen) >= loss) {
+                                                valid_data[s * packet_size] = packet_size;
+                                        }
+                                }
+                                int out_size;
+                                t0 = high_resolution_clock::now();
+                                char *out = session.decode_frame(buf, buf_size, &out_size, valid_data);
+                                t1 = high_resolution_clock::now();
+                                decode_time += t1 - t0;
+                                if (out_size != 0) {
+                                        recovered += 1;
+                                        ok = ok && out_size == frame_size
+                                                && memcmp(out, frame.data(), frame_size) == 0;
+                                }
+                                session.free_out_buf(buf);
+                        }
+                        printf("%-6s %-8s encode: %6.2f GB/s, decode: %6.2f GB/s, recovered %d/%d\n",
+                                        kernel, parallel ? "parallel" : "serial",
+                                        (double) frame_size * iterations / encode_time.count() / 1e9,
+                                        (double) frame_size * iterations / decode_time.count() / 1e9,
+                                        recovered, iterations);
+                        fflush(stdout);
+                }
+        }
+
+        close(fd);
+        unlink(matrix);
+
+        if (!ok) {
+                fprintf(stderr, "Recovered frames did not match the input!\n");
+                return 1;
+        }
+        return 0;
+}
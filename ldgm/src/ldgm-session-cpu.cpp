@@ -23,6 +23,13 @@
 #endif
 #include <string.h>
 #include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#include <immintrin.h>
+#define HAVE_XOR_AVX 1
+#endif
 
 #include "ldgm-session-cpu.h"
 #include "timer-util.h"
@@ -134,6 +141,171 @@ xor_using_sse (char* source, char* dest, int packet_size)
     return dest;
 }
 
+#ifdef HAVE_XOR_AVX
+__attribute__((target("avx2")))
+static char*
+xor_using_avx2 (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 128 <= packet_size; i += 128)
+    {
+        __m256i a0 = _mm256_loadu_si256((__m256i *) (source + i));
+        __m256i a1 = _mm256_loadu_si256((__m256i *) (source + i + 32));
+        __m256i a2 = _mm256_loadu_si256((__m256i *) (source + i + 64));
+        __m256i a3 = _mm256_loadu_si256((__m256i *) (source + i + 96));
+        a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((__m256i *) (dest + i)));
+        a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((__m256i *) (dest + i + 32)));
+        a2 = _mm256_xor_si256(a2, _mm256_loadu_si256((__m256i *) (dest + i + 64)));
+        a3 = _mm256_xor_si256(a3, _mm256_loadu_si256((__m256i *) (dest + i + 96)));
+        _mm256_storeu_si256((__m256i *) (dest + i), a0);
+        _mm256_storeu_si256((__m256i *) (dest + i + 32), a1);
+        _mm256_storeu_si256((__m256i *) (dest + i + 64), a2);
+        _mm256_storeu_si256((__m256i *) (dest + i + 96), a3);
+    }
+    for ( ; i + 32 <= packet_size; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((__m256i *) (source + i));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256((__m256i *) (dest + i)));
+        _mm256_storeu_si256((__m256i *) (dest + i), a);
+    }
+    // tail is done here rather than by xor_using_sse() - mixing legacy SSE
+    // code with AVX turned out to be considerably slower
+    for ( ; i < packet_size; i++)
+        dest[i] ^= source[i];
+
+    return dest;
+}
+
+__attribute__((target("avx512f")))
+static char*
+xor_using_avx512 (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 256 <= packet_size; i += 256)
+    {
+        __m512i a0 = _mm512_loadu_si512(source + i);
+        __m512i a1 = _mm512_loadu_si512(source + i + 64);
+        __m512i a2 = _mm512_loadu_si512(source + i + 128);
+        __m512i a3 = _mm512_loadu_si512(source + i + 192);
+        a0 = _mm512_xor_si512(a0, _mm512_loadu_si512(dest + i));
+        a1 = _mm512_xor_si512(a1, _mm512_loadu_si512(dest + i + 64));
+        a2 = _mm512_xor_si512(a2, _mm512_loadu_si512(dest + i + 128));
+        a3 = _mm512_xor_si512(a3, _mm512_loadu_si512(dest + i + 192));
+        _mm512_storeu_si512(dest + i, a0);
+        _mm512_storeu_si512(dest + i + 64, a1);
+        _mm512_storeu_si512(dest + i + 128, a2);
+        _mm512_storeu_si512(dest + i + 192, a3);
+    }
+    for ( ; i + 64 <= packet_size; i += 64)
+    {
+        __m512i a = _mm512_loadu_si512(source + i);
+        _mm512_storeu_si512(dest + i, _mm512_xor_si512(a, _mm512_loadu_si512(dest + i)));
+    }
+    for ( ; i < packet_size; i++)
+        dest[i] ^= source[i];
+
+    return dest;
+}
+#endif
+
+typedef char *(*xor_func_t)(char *source, char *dest, int packet_size);
+
+static const struct xor_impl {
+    const char *name;
+    xor_func_t func;
+} xor_impls[] = {
+#ifdef HAVE_XOR_AVX
+    { "avx512", xor_using_avx512 },
+    { "avx2", xor_using_avx2 },
+#endif
+    { "sse2", xor_using_sse },
+};
+
+static bool
+xor_impl_supported ( const struct xor_impl *impl )
+{
+#ifdef HAVE_XOR_AVX
+    __builtin_cpu_init();
+    if ( impl->func == xor_using_avx512 )
+        return __builtin_cpu_supports("avx512f");
+    if ( impl->func == xor_using_avx2 )
+        return __builtin_cpu_supports("avx2");
+#endif
+    (void) impl;
+    return true;
+}
+
+static const struct xor_impl *
+select_xor_impl ()
+{
+    for ( const auto &impl : xor_impls )
+        if ( xor_impl_supported(&impl) )
+            return &impl;
+    return &xor_impls[sizeof xor_impls / sizeof xor_impls[0] - 1];
+}
+
+/// may be changed by set_xor_impl() while other sessions code on other threads
+static std::atomic<const struct xor_impl *> xor_current(select_xor_impl());
+
+static inline char*
+xor_packet (char* source, char* dest, int packet_size)
+{
+    return xor_current.load(std::memory_order_acquire)->func(source, dest, packet_size);
+}
+
+bool
+LDGM_session_cpu::set_xor_impl ( const char *name )
+{
+    if ( name == NULL )
+    {
+        xor_current.store(select_xor_impl(), std::memory_order_release);
+        return true;
+    }
+    for ( const auto &impl : xor_impls )
+    {
+        if ( strcmp(impl.name, name) == 0 )
+        {
+            if ( !xor_impl_supported(&impl) )
+                return false;
+            xor_current.store(&impl, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *
+LDGM_session_cpu::get_xor_impl ()
+{
+    return xor_current.load(std::memory_order_acquire)->name;
+}
+
+/// XOR work is split into stripes of this many bytes of each packet
+#define XOR_STRIPE 256
+/// below this amount of XORed bytes the work is not worth dispatching
+#define XOR_PARALLEL_MIN_BYTES (256 * 1024)
+
+/**
+ * Runs fn(offset, len) over byte stripes of the packets. Every stripe is
+ * processed by a single thread and the operations inside the stripe keep
+ * their order, so the result is identical to serial processing.
+ */
+void
+LDGM_session_cpu::for_each_stripe ( long long total_bytes, const std::function<void(int, int)> &fn )
+{
+    int stripes = (packet_size + XOR_STRIPE - 1) / XOR_STRIPE;
+    if ( !parallel_for || stripes <= 1 || total_bytes < XOR_PARALLEL_MIN_BYTES )
+    {
+        fn(0, packet_size);
+        return;
+    }
+    const int ps = packet_size;
+    parallel_for(stripes, [&fn, ps](int begin, int end) {
+            int offset = begin * XOR_STRIPE;
+            fn(offset, std::min(end * XOR_STRIPE, ps) - offset);
+            });
+}
+
 void *
 LDGM_session_cpu::alloc_buf (int buf_size)
 {
@@ -150,41 +322,31 @@ LDGM_session_cpu::alloc_buf (int buf_size)
 void
 LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
 {
-//    start encoding
-   // printf ( "packet_size: %d\n", this->packet_size );
-
-    char *parity_packet;
-
-	parity_packet = (char *) aligned_malloc(packet_size, 16);
-	if (!parity_packet)
-	{
-		printf ( "Error while using posix_memalign\n" );
-		return;
-	}
-	memset(parity_packet, 0, packet_size);
-
-    for ( int m = 0; m < param_m; ++m) {
-//	printf ( "m: %d\n", m );
-
-//	printf ( "max w: %d\n", max_row_weight );
-        //Find out which packets to XOR
-        for ( int k = 0; k < max_row_weight+2; ++k) {
-            int idx = pcm[m*(max_row_weight+2) + k];
-//	    printf ( "adept: %d\n", idx );
-            if (idx > -1 && idx < param_k) {
-//		printf ( "xoring idx: %d\n", idx );
-                char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
+    long long nonzero = 0;
+    for ( int i = 0; i < param_m*(max_row_weight+2); ++i)
+        if ( pcm[i] > -1 && pcm[i] < param_k )
+            nonzero++;
+
+    for_each_stripe((nonzero + param_m) * packet_size, [&](int offset, int len) {
+        for ( int m = 0; m < param_m; ++m) {
+            char *parity_packet = parity_ptr + m*packet_size + offset;
+
+            //Apply inverted staircase matrix
+            if ( m > 0 )
+                memcpy(parity_packet, parity_packet - packet_size, len);
+            else
+                memset(parity_packet, 0, len);
+
+            //Find out which packets to XOR
+            for ( int k = 0; k < max_row_weight+2; ++k) {
+                int idx = pcm[m*(max_row_weight+2) + k];
+                if (idx > -1 && idx < param_k) {
+                    char *ptr = data_ptr + idx*packet_size + offset;
+                    xor_packet(ptr, parity_packet, len);
+                }
             }
         }
-
-        //Add the new parity packet to overall parity
-        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
-    }
-
-	aligned_free(parity_packet);
-
-    return ;
+    });
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
 void
@@ -442,15 +604,20 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
 void
 LDGM_session_cpu::iterate ( Tanner_graph *graph )
 {
+    struct recovery {
+        char *dest;
+        std::vector<char *> sources;
+    };
+    std::vector<recovery> recoveries;
+    long long total_bytes = 0;
     map<int, Node>::iterator it_c;
     vector<int> vec;
 
-    static int recovered = 0;
-
     //select the first constraint node
     it_c = graph->nodes.find ( param_k + param_m );
 
-    //iterate through constraint nodes
+    //iterate through constraint nodes - this only decides which packets are
+    //recoverable, the data are XORed afterwards in the same order
     while ( it_c != graph->nodes.end() ) {
         //iterate the node's neighbours to find out how many of them are not decoded
         map<int, Node>::iterator it_v;
@@ -460,60 +627,39 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
             if ( !it_v->second.isDone() )
                 vec.push_back(*j);
         }
-//	printf ( "node %d has %d undecoded neighbours\n", it_c->first, vec.size() );
 
         //we can restore the missing packet
         if ( vec.size() == 1)
         {
             int r_index = vec.front();
-
-//	    if ( r_index == 0 )
-//	    {
-//		printf ( "repairing first block\n" );
-//	    }
             it_v = graph->nodes.find(r_index);
-            memset(it_v->second.getDataPtr(), 0, packet_size);
-            char *r_data = it_v->second.getDataPtr();
+            recovery r;
+            r.dest = it_v->second.getDataPtr();
             //find other nodes connected to this constraint node and XOR their values
-            int count = 0;
             for(vector<int>::iterator j = it_c->second.neighbours.begin();
                     j != it_c->second.neighbours.end(); ++j)
             {
                 if ( *j != r_index )
-                {
-//		    printf ( "decode, packet_size: %d\n", packet_size );
-                    char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
-                    //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
-                    count++;
-                }
+                    r.sources.push_back((graph->nodes.find(*j))->second.getDataPtr());
             }
-            /*           //validate recovered packet
-             *          for ( int i = 0; i < param_k; ++i) {
-             *              if(!memcmp(r_data, lost_ptr + i*packet_size, packet_size)) {
-             *                  printf ( "packet ok\n" );
-             *                  break;
-             *              }
-             *          }
-             */
-            if ( count > 0 )
+            if ( r.sources.size() > 0 )
                 it_v->second.setDone(true);
-            recovered++;
-            /*           printf ( "restored data: \n" );
-             *          for ( int  i = 0; i < packet_size; ++i)
-             *              printf ( "%2d|", (unsigned char)(*(it_v->second.getDataPtr() + i)) );
-             *          printf ( "---\n" );
-             */
-
-
+            total_bytes += (r.sources.size() + 1) * packet_size;
+            recoveries.push_back(std::move(r));
         }
         vec.clear();
 
         ++it_c;
     }
-//    printf ( "recovered: %d\n", recovered );
 
-    return;
+    if ( recoveries.empty() )
+        return;
 
+    for_each_stripe(total_bytes, [&recoveries](int offset, int len) {
+        for ( const auto &r : recoveries ) {
+            memset(r.dest + offset, 0, len);
+            for ( char *src : r.sources )
+                xor_packet(src + offset, r.dest + offset, len);
+        }
+    });
 }
-
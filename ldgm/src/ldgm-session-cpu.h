@@ -20,9 +20,18 @@
 #ifndef  LDGM_SESSION_CPU_INC
 #define  LDGM_SESSION_CPU_INC
 
+#include <functional>
+
 #include "ldgm-session.h"
 //#include "timer-util.h"
 
+/**
+ * Executor used to split XOR work among threads. It must call fn(begin, end)
+ * for disjoint subranges covering [0, count) and return once all of them
+ * have finished.
+ */
+typedef std::function<void(int count, const std::function<void(int, int)> &fn)> ldgm_parallel_for_t;
+
 /*
  * =====================================================================================
  *        Class:  LDGM_session_cpu
@@ -61,6 +70,25 @@ class LDGM_session_cpu : public LDGM_session
 	void *
 		alloc_buf(int size);
 
+	/**
+	 * Sets the executor for encoding and iterative decoding. Packets are
+	 * split into byte stripes processed independently. If not set, all
+	 * work is done in the calling thread.
+	 */
+	void
+	    set_parallel_for ( ldgm_parallel_for_t pf ) { parallel_for = pf; }
+
+	/**
+	 * Selects XOR kernel - "sse2", "avx2" or "avx512" (or NULL for the
+	 * best supported one). Affects all CPU sessions.
+	 *
+	 * @return false if the kernel is unknown or unsupported by the CPU
+	 */
+	static bool
+	    set_xor_impl ( const char *name );
+	static const char *
+	    get_xor_impl ();
+
     protected:
 	/* ====================  DATA MEMBERS  ======================================= */
 
@@ -68,6 +96,10 @@ class LDGM_session_cpu : public LDGM_session
 	/* ====================  DATA MEMBERS  ======================================= */
     double elapsed_sum;
 	long no_frames;
+	ldgm_parallel_for_t parallel_for;
+
+	void
+	    for_each_stripe ( long long total_bytes, const std::function<void(int, int)> &fn );
 
 }; /* -----  end of class LDGM_session_cpu  ----- */
 
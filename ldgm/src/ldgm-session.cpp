@@ -34,41 +34,74 @@ using namespace std;
  * Description:  constructor
  *--------------------------------------------------------------------------------------
  */
-void
-LDGM_session::set_pcMatrix ( char* fname)
+int *
+LDGM_session::read_pcMatrix ( const char* fname, unsigned int *k, unsigned int *m,
+        unsigned int *columns )
 {
     FILE *f;
 
     f = fopen(fname, "rb");
     if (!f)
     {
-        printf ( "Error opening matrix file\n" );
-        printf ( "exiting\n" );
-        abort();
+        throw string("Error opening matrix file ") + fname;
     }
     unsigned int k_f, m_f, w_f;
-    if (fscanf(f, "%d %d %d", &k_f, &m_f, &w_f) != 3) {
+    if (fscanf(f, "%u %u %u", &k_f, &m_f, &w_f) != 3) {
+        fclose(f);
+        throw string("Parity matrix read error!");
+    }
+    if (fseek (f, 1, SEEK_CUR ) != 0) {
+            perror("fseek");
+    }
+
+    int *matrix = (int*) malloc(w_f*m_f*sizeof(int));
+    if (fread ( matrix, sizeof(int), w_f*m_f, f) != w_f*m_f) {
+        free(matrix);
+        fclose(f);
         throw string("Parity matrix read error!");
     }
+    fclose(f);
+
+    *k = k_f;
+    *m = m_f;
+    *columns = w_f;
+    return matrix;
+}
+
+void
+LDGM_session::set_pcm ( const int *matrix, unsigned int columns )
+{
+    free(pcm);
+    pcm = (int*) malloc(columns*param_m*sizeof(int));
+    memcpy(pcm, matrix, columns*param_m*sizeof(int));
+    this->max_row_weight = columns - 2; //columns stores number of columns in adjacency list
+}
+
+void
+LDGM_session::set_pcMatrix ( char* fname)
+{
+    unsigned int k_f, m_f, w_f;
+    int *matrix;
+    try {
+        matrix = read_pcMatrix(fname, &k_f, &m_f, &w_f);
+    } catch (string const &err) {
+        printf ( "%s\n", err.c_str() );
+        printf ( "exiting\n" );
+        abort();
+    }
 //    printf ( "In matrix file: K %d M %d Columns %d\n", k_f, m_f, w_f );
 
     if ( k_f != param_k || m_f != param_m)
     {
+        free(matrix);
         ostringstream oss;
         oss << "Parity matrix size mismatch\nExpected K = " << param_k << "% M = " << param_m <<
                 "\nReceived K = " << k_f << ", M = " << m_f << "\n";
         throw oss.str();
     }
-    if (fseek (f, 1, SEEK_CUR ) != 0) {
-            perror("fseek");
-    }
 
-    pcm = (int*) malloc(w_f*param_m*sizeof(int));
-    for ( int i = 0; i < (int)w_f*param_m; i++) {
-        if (fread ( pcm+i, sizeof(int), 1, f) != 1) {
-            throw string("Parity matrix read error!");
-        }
-    }
+    free(pcm);
+    pcm = matrix;
     this->max_row_weight = w_f - 2; //w_f stores number of columns in adjacency list
 
     /*     for ( int i = 0; i < param_m; i++)
@@ -79,13 +112,6 @@ LDGM_session::set_pcMatrix ( char* fname)
      *     }
      */
 
-
-
-
-    fclose(f);
-
-
-
     /*
      *     this->max_row_weight = 0;
      *     int max_weight = 0;
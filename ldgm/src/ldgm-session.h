@@ -45,6 +45,9 @@ class LDGM_session : public Coding_session
         }
 	virtual ~LDGM_session ();                      /* destructor **/
 
+        /// size of the frame header, its first int32 is the frame size
+        static const int HEADER_SIZE = 4;
+
 	/* ====================  ACCESSORS     ======================================= */
 	/**
 	 * This method checks whether the given graph needs further decoding
@@ -64,6 +67,24 @@ class LDGM_session : public Coding_session
 	void
 	    set_pcMatrix ( char * matrix );
 
+	/**
+	 * Sets compact parity check matrix as returned by read_pcMatrix()
+	 * (the matrix is copied). Parameters must be set before.
+	 */
+	void
+	    set_pcm ( const int *matrix, unsigned int columns );
+
+	/**
+	 * Reads compact parity check matrix from a file created by
+	 * generate_ldgm_matrix().
+	 *
+	 * @return malloc'ed array of m * columns ints
+	 * @throws std::string on error
+	 */
+	static int *
+	    read_pcMatrix ( const char *fname, unsigned int *k, unsigned int *m,
+		    unsigned int *columns );
+
 	/* ====================  OPERATORS     ======================================= */
 
 	void
@@ -121,8 +142,6 @@ class LDGM_session : public Coding_session
 	double elapsed_sum2;
 	long no_frames2;
 
-        static const int HEADER_SIZE = 4;
-
     private:
 
 
@@ -10,6 +10,11 @@
 #include <string.h>
 #include <assert.h>
 
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#include <immintrin.h>
+#define HAVE_ADDMUL_AVX2 1
+#endif
+
 /*
  * Primitive polynomials - see Lin & Costello, Appendix A,
  * and  Lee & Messerschmitt, p. 453.
@@ -65,6 +70,14 @@ static gf gf_mul_table[256][256];
 #define GF_MULC0(c) __gf_mulc_ = gf_mul_table[c]
 #define GF_ADDMULC(dst, x) dst ^= __gf_mulc_[x]
 
+/*
+ * gf_mul_nibble[c][0][x] = c * x and gf_mul_nibble[c][1][x] = c * (x << 4)
+ * for x < 16. Since multiplication distributes over addition (xor),
+ * c * x = gf_mul_nibble[c][0][x & 15] ^ gf_mul_nibble[c][1][x >> 4], which
+ * allows a vector of bytes to be multiplied with two table lookups (pshufb).
+ */
+static gf gf_mul_nibble[256][2][16] __attribute__((aligned(16)));
+
 /*
  * Generate GF(2**m) from the irreducible polynomial p(X) in p[0]..p[m]
  * Lookup tables:
@@ -84,6 +97,12 @@ _init_mul_table(void) {
 
   for (j = 0; j < 256; j++)
       gf_mul_table[0][j] = gf_mul_table[j][0] = 0;
+
+  for (i = 0; i < 256; i++)
+      for (j = 0; j < 16; j++) {
+          gf_mul_nibble[i][0][j] = gf_mul_table[i][j];
+          gf_mul_nibble[i][1][j] = gf_mul_table[i][j << 4];
+      }
 }
 
 #define NEW_GF_MATRIX(rows, cols) \
@@ -166,7 +185,7 @@ generate_gf (void) {
  * calls are unfrequent in my typical apps so I did not bother.
  */
 #define addmul(dst, src, c, sz)                 \
-    if (c != 0) _addmul1(dst, src, c, sz)
+    if (c != 0) addmul_impl(dst, src, c, sz)
 
 #define UNROLL 16               /* 1, 4, 8, 16 */
 static void
@@ -205,6 +224,69 @@ _addmul1(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
         GF_ADDMULC (*dst, *src);
 }
 
+#ifdef __SSSE3__
+/*
+ * SSSE3 version of _addmul1() using split nibble tables (see gf_mul_nibble)
+ */
+static void
+_addmul1_ssse3(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
+    const __m128i lo = _mm_load_si128((const __m128i *) gf_mul_nibble[c][0]);
+    const __m128i hi = _mm_load_si128((const __m128i *) gf_mul_nibble[c][1]);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i;
+
+    for (i = 0; i + 16 <= sz; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i prod = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, mask)),
+                _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+        _mm_storeu_si128((__m128i *) (dst + i),
+                _mm_xor_si128(_mm_loadu_si128((const __m128i *) (dst + i)), prod));
+    }
+    if (i < sz)
+        _addmul1(dst + i, src + i, c, sz - i);
+}
+#endif
+
+#ifdef HAVE_ADDMUL_AVX2
+/*
+ * AVX2 version of _addmul1(), tables are broadcast to both 128-bit lanes
+ */
+__attribute__((target("avx2"))) static void
+_addmul1_avx2(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_nibble[c][0]));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_nibble[c][1]));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i;
+
+    for (i = 0; i + 64 <= sz; i += 64) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *) (src + i + 32));
+        __m256i p0 = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x0, mask)),
+                _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x0, 4), mask)));
+        __m256i p1 = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x1, mask)),
+                _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x1, 4), mask)));
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (dst + i)), p0));
+        _mm256_storeu_si256((__m256i *) (dst + i + 32),
+                _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (dst + i + 32)), p1));
+    }
+    for (; i + 32 <= sz; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask)),
+                _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (dst + i)), p));
+    }
+    if (i < sz)
+        _addmul1(dst + i, src + i, c, sz - i);
+}
+#endif
+
+/*
+ * the fastest addmul implementation supported by the CPU, set by init_fec()
+ */
+static void (*addmul_impl)(gf*restrict dst, const gf*restrict src, gf c, size_t sz) = _addmul1;
+
 /*
  * computes C = AB where A is n*k, B is k*m, C is n*m
  */
@@ -400,6 +482,14 @@ static void
 init_fec (void) {
     generate_gf();
     _init_mul_table();
+#ifdef __SSSE3__
+    addmul_impl = _addmul1_ssse3;
+#endif
+#ifdef HAVE_ADDMUL_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        addmul_impl = _addmul1_avx2;
+#endif
     fec_initialized = 1;
 }
 
@@ -494,8 +584,9 @@ fec_encode(const fec_t* code, const gf*restrict const*restrict const src, gf*res
  *
  * @param matrix a space allocated for a k by k matrix
  */
-static void
-build_decode_matrix_into_space(const fec_t*restrict const code, const unsigned*const restrict index, const unsigned k, gf*restrict const matrix) {
+void
+fec_build_decode_matrix(const fec_t*restrict const code, const unsigned*const restrict index, gf*restrict const matrix) {
+    const unsigned k = code->k;
     unsigned char i;
     gf* p;
     for (i=0, p=matrix; i < k; i++, p += k) {
@@ -512,17 +603,22 @@ build_decode_matrix_into_space(const fec_t*restrict const code, const unsigned*c
 void
 fec_decode(const fec_t* code, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t sz) {
     gf* m_dec = (gf*)alloca(code->k * code->k);
+    fec_build_decode_matrix(code, index, m_dec);
+    fec_decode_with_matrix(code, m_dec, inpkts, outpkts, index, 0, sz);
+}
+
+void
+fec_decode_with_matrix(const fec_t* code, const gf*restrict const m_dec, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t offset, size_t sz) {
     unsigned char outix=0;
     unsigned char row=0;
     unsigned char col=0;
-    build_decode_matrix_into_space(code, index, code->k, m_dec);
 
     for (row=0; row<code->k; row++) {
         assert ((index[row] >= code->k) || (index[row] == row)); /* If the block whose number is i is present, then it is required to be in the i'th element. */
         if (index[row] >= code->k) {
-            memset(outpkts[outix], 0, sz);
+            memset(outpkts[outix] + offset, 0, sz);
             for (col=0; col < code->k; col++)
-                addmul(outpkts[outix], inpkts[col], m_dec[row * code->k + col], sz);
+                addmul(outpkts[outix] + offset, inpkts[col] + offset, m_dec[row * code->k + col], sz);
             outix++;
         }
     }
@@ -42,6 +42,20 @@ void fec_encode(const fec_t* code, const gf*restrict const*restrict const src, g
  */
 void fec_decode(const fec_t* code, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t sz);
 
+/**
+ * Builds k*k decode matrix for fec_decode_with_matrix().
+ * @param index an array of the blocknums of the packets in inpkts (see fec_decode())
+ * @param matrix space for k*k matrix
+ */
+void fec_build_decode_matrix(const fec_t* code, const unsigned*restrict const index, gf*restrict const matrix);
+
+/**
+ * Same as fec_decode() but uses decode matrix created by fec_build_decode_matrix()
+ * and reconstructs only bytes [offset, offset + sz) of the output packets. This
+ * allows decoding of a single set of packets to be split among multiple threads.
+ */
+void fec_decode_with_matrix(const fec_t* code, const gf*restrict const matrix, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t offset, size_t sz);
+
 #if defined(_MSC_VER)
 #define alloca _alloca
 #else
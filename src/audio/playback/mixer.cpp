@@ -52,6 +52,9 @@
 #include "rtp/rtp.h"
 #include "transmit.h"
 #include "utils/audio_buffer.h"
+#include "utils/worker.h"
+
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <iostream>
@@ -60,14 +63,20 @@
 #include <thread>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define SAMPLE_RATE 48000
 #define BPS     2 /// @todo 4?
-#define CHANNELS 1
 #define FRAMES_PER_SEC 25
 static_assert(SAMPLE_RATE % FRAMES_PER_SEC == 0, "Sample rate not divisible by frames per sec!");
 #define SAMPLES_PER_FRAME (SAMPLE_RATE / FRAMES_PER_SEC)
 
 #define PARTICIPANT_TIMEOUT_S 60
+/// participants silent for this number of frames share the encoded whole mix
+#define LISTENER_THRESHOLD_FRAMES FRAMES_PER_SEC
+#define LISTENER_SEND_CHUNK 16
 typedef int16_t sample_type_source;
 typedef int32_t sample_type_mixed;
 static_assert(sizeof(sample_type_source) == BPS, "sample_type source doesn't match BPS");
@@ -122,9 +131,9 @@ static void mixer_dummy_rtp_callback(struct rtp *session [[gnu::unused]], rtp_ev
 }
 
 struct am_participant {
-        am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss, string const & audio_codec) {
+        am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss, string const & audio_codec, int channels) {
                 assert(l != nullptr && ss != nullptr);
-                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, CHANNELS, get_commandline_param("low-latency-audio") ? 50 : 5);
+                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, channels, get_commandline_param("low-latency-audio") ? 50 : 5);
                 assert(m_buffer != NULL);
                 struct sockaddr *sa = (struct sockaddr *) ss;
                 assert(ss->ss_family == AF_INET || ss->ss_family == AF_INET6);
@@ -140,6 +149,13 @@ struct am_participant {
                         LOG(LOG_LEVEL_ERROR) << "Audio coder init failed!\n";
                         throw 1;
                 }
+
+                m_input.resize(SAMPLES_PER_FRAME * channels);
+                m_output.resize(SAMPLES_PER_FRAME * channels);
+                m_frame.init(channels, AC_PCM, BPS, SAMPLE_RATE);
+                for (int i = 0; i < channels; ++i) {
+                        m_frame.resize(i, SAMPLES_PER_FRAME * BPS);
+                }
         }
         ~am_participant() {
                 if (m_tx_session) {
@@ -161,6 +177,10 @@ struct am_participant {
 		m_network_device = move(other.m_network_device);
 		m_tx_session = move(other.m_tx_session);
 		last_seen = move(other.last_seen);
+		m_input = move(other.m_input);
+		m_output = move(other.m_output);
+		m_frame = move(other.m_frame);
+		m_silent_frames = other.m_silent_frames;
 		other.m_audio_coder = nullptr;
 		other.m_buffer = nullptr;
 		other.m_tx_session = nullptr;
@@ -175,20 +195,53 @@ struct am_participant {
         struct rtp *m_network_device;
         struct tx *m_tx_session;
         chrono::steady_clock::time_point last_seen;
+
+        // used only by the mixer worker
+        vector<sample_type_source> m_input;  ///< interleaved samples received in the current frame
+        vector<sample_type_source> m_output; ///< interleaved mix sent to the participant (multichannel only)
+        audio_frame2 m_frame;                ///< uncompressed mix sent to the participant
+        int m_silent_frames = 0;             ///< number of consecutive silent input frames
 };
 
-template<typename source_t, typename intermediate_t>
-class generic_mix_algo {
-public:
-        virtual intermediate_t add_to_mix(intermediate_t dst, source_t sample) {
-                return dst + sample;
+/**
+ * Adds src to the mix.
+ * @returns true if src contains a non-zero sample
+ */
+static bool mix_add(sample_type_mixed *mix, const sample_type_source *src, int count)
+{
+        int i = 0;
+        bool nonzero = false;
+#ifdef __SSE2__
+        static_assert(sizeof(sample_type_source) == 2 && sizeof(sample_type_mixed) == 4, "SSE mixing assumes 16-bit samples mixed in 32 bits");
+        __m128i any = _mm_setzero_si128();
+        for ( ; i + 8 <= count; i += 8) {
+                __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+                // sign-extend to 32 bits
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+                __m128i *dst = (__m128i *)(mix + i);
+                _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), lo));
+                _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), hi));
+                any = _mm_or_si128(any, s);
         }
-
-        virtual intermediate_t get_mixed_without_source_sample(intermediate_t mix, source_t source_sample) {
-                return mix - source_sample;
+        nonzero = _mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF;
+#endif
+        for ( ; i < count; ++i) {
+                mix[i] += src[i];
+                nonzero = nonzero || src[i] != 0;
         }
+        return nonzero;
+}
 
-        virtual intermediate_t normalize(intermediate_t sample) = 0;
+class generic_mix_algo {
+public:
+        virtual ~generic_mix_algo() = default;
+        /**
+         * Computes the signal for the participant who contributed src to
+         * the mix, ie. dst[i] = normalize(mix[i] - src[i]).
+         */
+        virtual void get_mixed_without_source(sample_type_source *dst, const sample_type_mixed *mix,
+                        const sample_type_source *src, int count) = 0;
 };
 
 /**
@@ -197,12 +250,28 @@ public:
  * non-normalized mixed value can be out-of-bounds while resulting value with
  * substracted with substracted source may be ok.
  */
-template<typename source_t, typename intermediate_t>
-class linear_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
+class linear_mix_algo : public generic_mix_algo {
 public:
-        intermediate_t normalize(intermediate_t sample) override {
-                // clamp the value since linear mixer doesn't normalize values
-                return min<intermediate_t>(max<intermediate_t>(sample, numeric_limits<source_t>::min()), numeric_limits<source_t>::max());
+        void get_mixed_without_source(sample_type_source *dst, const sample_type_mixed *mix,
+                        const sample_type_source *src, int count) override {
+                int i = 0;
+#ifdef __SSE2__
+                for ( ; i + 8 <= count; i += 8) {
+                        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+                        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+                        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+                        const __m128i *m = (const __m128i *)(mix + i);
+                        lo = _mm_sub_epi32(_mm_loadu_si128(m), lo);
+                        hi = _mm_sub_epi32(_mm_loadu_si128(m + 1), hi);
+                        // saturating pack does the clamping
+                        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+                }
+#endif
+                for ( ; i < count; ++i) {
+                        dst[i] = min<sample_type_mixed>(max<sample_type_mixed>(mix[i] - src[i],
+                                                numeric_limits<sample_type_source>::min()),
+                                        numeric_limits<sample_type_source>::max());
+                }
         }
 };
 
@@ -213,19 +282,50 @@ public:
  * http://www.voidcn.com/blog/caohongfei881/article/p-3815311.html
  * Threshold is 0.5.
  */
-template<typename source_t, typename intermediate_t>
-class logarithmic_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
+class logarithmic_mix_algo : public generic_mix_algo {
 public:
         static constexpr double t = 0.5;
         static constexpr double alpha = 5.71144;
-        intermediate_t normalize(intermediate_t sample) override {
-		if (sample >= numeric_limits<source_t>::min() / 2 &&
-				sample <= numeric_limits<source_t>::max() / 2) {
+        static constexpr sample_type_mixed lower = numeric_limits<sample_type_source>::min() / 2;
+        static constexpr sample_type_mixed upper = numeric_limits<sample_type_source>::max() / 2;
+
+        void get_mixed_without_source(sample_type_source *dst, const sample_type_mixed *mix,
+                        const sample_type_source *src, int count) override {
+                int i = 0;
+#ifdef __SSE2__
+                const __m128i vlower = _mm_set1_epi32(lower - 1);
+                const __m128i vupper = _mm_set1_epi32(upper + 1);
+                for ( ; i + 8 <= count; i += 8) {
+                        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+                        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+                        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+                        const __m128i *m = (const __m128i *)(mix + i);
+                        lo = _mm_sub_epi32(_mm_loadu_si128(m), lo);
+                        hi = _mm_sub_epi32(_mm_loadu_si128(m + 1), hi);
+                        __m128i in_range = _mm_and_si128(
+                                        _mm_and_si128(_mm_cmpgt_epi32(lo, vlower), _mm_cmplt_epi32(lo, vupper)),
+                                        _mm_and_si128(_mm_cmpgt_epi32(hi, vlower), _mm_cmplt_epi32(hi, vupper)));
+                        if (_mm_movemask_epi8(in_range) == 0xFFFF) { // common case - below threshold
+                                _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+                        } else {
+                                for (int j = i; j < i + 8; ++j) {
+                                        dst[j] = normalize(mix[j] - src[j]);
+                                }
+                        }
+                }
+#endif
+                for ( ; i < count; ++i) {
+                        dst[i] = normalize(mix[i] - src[i]);
+                }
+        }
+private:
+        static sample_type_mixed normalize(sample_type_mixed sample) {
+		if (sample >= lower && sample <= upper) {
 			return sample;
 		} else {
-                        double sample_norm = (double) sample / numeric_limits<source_t>::max();
-                        double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<source_t>::max();
-                        return ret;
+                        double sample_norm = (double) sample / numeric_limits<sample_type_source>::max();
+                        double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<sample_type_source>::max();
+                        return min<double>(max<double>(ret, numeric_limits<sample_type_source>::min()), numeric_limits<sample_type_source>::max());
                 }
         }
 };
@@ -243,13 +343,19 @@ struct state_audio_mixer final {
                                 } else if (strncmp(item, "algo=", strlen("algo=")) == 0) {
                                         string algo = item + strlen("algo=");
                                         if (algo == "linear") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new linear_mix_algo<sample_type_source, sample_type_mixed>());
+                                                mixing_algorithm = decltype(mixing_algorithm)(new linear_mix_algo());
                                         } else if (algo == "logarithmic") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new logarithmic_mix_algo<sample_type_source, sample_type_mixed>());
+                                                mixing_algorithm = decltype(mixing_algorithm)(new logarithmic_mix_algo());
                                         } else {
                                                 LOG(LOG_LEVEL_ERROR) << "Unknown mixing algorithm: " << algo << "\n";
                                                 throw 1;
                                         }
+                                } else if (strncmp(item, "channels=", strlen("channels=")) == 0) {
+                                        channels = atoi(item + strlen("channels="));
+                                        if (channels <= 0) {
+                                                LOG(LOG_LEVEL_ERROR) << "Wrong channel count: " << item + strlen("channels=") << "\n";
+                                                throw 1;
+                                        }
                                 } else {
                                         LOG(LOG_LEVEL_ERROR) << "Unknown option: " << item << "\n";
                                         throw 1;
@@ -258,19 +364,25 @@ struct state_audio_mixer final {
                         }
                 }
 
-                struct audio_codec_state *audio_coder =
-                        audio_codec_init_cfg(audio_codec.c_str(), AUDIO_CODER);
-                if (!audio_coder) {
+                listener_coder = audio_codec_init_cfg(audio_codec.c_str(), AUDIO_CODER);
+                if (!listener_coder) {
                         LOG(LOG_LEVEL_ERROR) << "Audio coder init failed!\n";
                         throw 1;
-                } else {
-                        audio_codec_done(audio_coder);
+                }
+
+                mixed.resize(SAMPLES_PER_FRAME * channels);
+                silence.resize(SAMPLES_PER_FRAME * channels);
+                listener_output.resize(SAMPLES_PER_FRAME * channels);
+                listener_frame.init(channels, AC_PCM, BPS, SAMPLE_RATE);
+                for (int i = 0; i < channels; ++i) {
+                        listener_frame.resize(i, SAMPLES_PER_FRAME * BPS);
                 }
 
                 thread_id = thread(&state_audio_mixer::worker, this);
         }
         ~state_audio_mixer() {
                 thread_id.join();
+                audio_codec_done(listener_coder);
         }
         state_audio_mixer(state_audio_mixer const&)            = delete;
         state_audio_mixer& operator=(state_audio_mixer const&) = delete;
@@ -281,17 +393,54 @@ struct state_audio_mixer final {
 
         struct socket_udp_local *recv_socket{};
         string audio_codec{"PCM"};
+        int channels = 1;
 private:
+        void mix_for(audio_frame2 &frame, vector<sample_type_source> &output, const sample_type_source *source);
+
         thread thread_id;
-        unique_ptr<generic_mix_algo<sample_type_source, sample_type_mixed>> mixing_algorithm{new linear_mix_algo<sample_type_source, sample_type_mixed>()};
+        unique_ptr<generic_mix_algo> mixing_algorithm{new linear_mix_algo()};
+
+        // buffers reused by the worker across frames
+        vector<sample_type_mixed> mixed;
+        vector<sample_type_source> silence;
+        vector<am_participant *> speakers;
+        vector<am_participant *> listeners;
+
+        /// listeners get all the same mix so it is encoded only once for them
+        struct audio_codec_state *listener_coder;
+        audio_frame2 listener_frame;
+        vector<sample_type_source> listener_output;
 };
 
+/**
+ * Fills frame with the mix without the source signal. Output is an interleaved
+ * buffer used as an intermediate for the multichannel case.
+ */
+void state_audio_mixer::mix_for(audio_frame2 &frame, vector<sample_type_source> &output, const sample_type_source *source)
+{
+        if (channels == 1) {
+                mixing_algorithm->get_mixed_without_source(reinterpret_cast<sample_type_source *>(const_cast<char *>(frame.get_data(0))),
+                                mixed.data(), source, SAMPLES_PER_FRAME);
+                return;
+        }
+        mixing_algorithm->get_mixed_without_source(output.data(), mixed.data(), source, SAMPLES_PER_FRAME * channels);
+        for (int ch = 0; ch < channels; ++ch) {
+                auto dst = reinterpret_cast<sample_type_source *>(const_cast<char *>(frame.get_data(ch)));
+                const sample_type_source *src = output.data() + ch;
+                for (int i = 0; i < SAMPLES_PER_FRAME; ++i) {
+                        dst[i] = *src;
+                        src += channels;
+                }
+        }
+}
+
 void state_audio_mixer::worker()
 {
         chrono::steady_clock::time_point next_frame_time = chrono::steady_clock::now();
 
         static_assert(SAMPLES_PER_FRAME * 1000ll % SAMPLE_RATE == 0, "Sample rate is not evenly divisible by number of samples in frame");
         const chrono::milliseconds interval(SAMPLES_PER_FRAME*1000ll/SAMPLE_RATE);
+        const size_t data_len_source = SAMPLES_PER_FRAME * sizeof(sample_type_source) * channels;
 
         while (!should_exit) {
                 this_thread::sleep_until(next_frame_time);
@@ -304,6 +453,13 @@ void state_audio_mixer::worker()
                         next_frame_time = now;
                 }
 
+                fill(mixed.begin(), mixed.end(), 0);
+                speakers.clear();
+                listeners.clear();
+
+                // The lock is held only while reading participant buffers. Participants
+                // are removed only here and map insertion doesn't invalidate pointers
+                // so the participants can be processed after it is released.
                 unique_lock<mutex> plk(participants_lock);
                 // check timeouts
                 for (auto it = participants.cbegin(); it != participants.cend(); )
@@ -315,56 +471,59 @@ void state_audio_mixer::worker()
                         }
                 }
 
-                size_t data_len_source = SAMPLES_PER_FRAME * sizeof(sample_type_source) * CHANNELS;
-                vector<sample_type_mixed> mixed(SAMPLES_PER_FRAME * CHANNELS);
-                vector<audio_frame2> participant_frames(participants.size());
-                int participant_index = 0;
-
-                // mix all together
                 for (auto & p : participants) {
-                        participant_frames[participant_index].init(CHANNELS, AC_PCM, BPS, SAMPLE_RATE);
-                        static_assert(CHANNELS == 1, "Currently only one channel is implemented here.");
-                        participant_frames[participant_index].resize(0, data_len_source);
-                        char *particip_data = (char *) participant_frames[participant_index].get_data(0);
+                        char *particip_data = (char *) p.second.m_input.data();
                         int ret = audio_buffer_read(p.second.m_buffer, particip_data, data_len_source);
-                        memset(particip_data, 0, data_len_source - ret);
-
-                        sample_type_source *src = (sample_type_source *) particip_data;
-                        auto dst = mixed.begin();
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *dst = mixing_algorithm->add_to_mix(*dst, *src);
-                                ++dst;
-                                ++src;
-                        }
-                        participant_index++;
+                        memset(particip_data + ret, 0, data_len_source - ret);
+                        speakers.push_back(&p.second);
                 }
+                plk.unlock();
 
-                // substract each source signal from the mix coming to that participant
-                for (auto & pb : participant_frames) {
-                        auto mix = mixed.begin();
-                        sample_type_source *part = (sample_type_source *) pb.get_data(0);
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *part = mixing_algorithm->normalize(mixing_algorithm->get_mixed_without_source_sample(*mix, *part));
-                                ++mix;
-                                ++part;
+                // mix all together
+                for (auto it = speakers.begin(); it != speakers.end(); ) {
+                        am_participant *p = *it;
+                        if (mix_add(mixed.data(), p->m_input.data(), SAMPLES_PER_FRAME * channels)) {
+                                p->m_silent_frames = 0;
+                        } else {
+                                p->m_silent_frames += 1;
+                        }
+                        if (p->m_silent_frames >= LISTENER_THRESHOLD_FRAMES) {
+                                listeners.push_back(p);
+                                it = speakers.erase(it);
+                        } else {
+                                ++it;
                         }
                 }
 
-                // send
-                participant_index = 0;
-                for (auto & p : participants) {
-
-			audio_frame2 *uncompressed = &participant_frames[participant_index];
-			const audio_frame2 *compressed = NULL;
-			while((compressed = audio_codec_compress(p.second.m_audio_coder, uncompressed))) {
-				audio_tx_send(p.second.m_tx_session, p.second.m_network_device, compressed);
-				uncompressed = NULL;
-			}
-
-
-                        participant_index++;
+                // listeners hear the whole mix - encode it once and send it to all of them
+                if (!listeners.empty()) {
+                        mix_for(listener_frame, listener_output, silence.data());
+                        audio_frame2 *uncompressed = &listener_frame;
+                        const audio_frame2 *compressed = NULL;
+                        while ((compressed = audio_codec_compress(listener_coder, uncompressed))) {
+                                parallel_for(0, (int) listeners.size(), [&](int begin, int end) {
+                                        for (int i = begin; i < end; ++i) {
+                                                audio_tx_send(listeners[i]->m_tx_session, listeners[i]->m_network_device, compressed);
+                                        }
+                                }, LISTENER_SEND_CHUNK);
+                                uncompressed = NULL;
+                        }
                 }
-                plk.unlock();
+
+                // substract each source signal from the mix coming to that participant, encode and send
+                parallel_for(0, (int) speakers.size(), [this](int begin, int end) {
+                        for (int i = begin; i < end; ++i) {
+                                am_participant *p = speakers[i];
+                                mix_for(p->m_frame, p->m_output, p->m_input.data());
+
+                                audio_frame2 *uncompressed = &p->m_frame;
+                                const audio_frame2 *compressed = NULL;
+                                while((compressed = audio_codec_compress(p->m_audio_coder, uncompressed))) {
+                                        audio_tx_send(p->m_tx_session, p->m_network_device, compressed);
+                                        uncompressed = NULL;
+                                }
+                        }
+                });
         }
 }
 
@@ -375,10 +534,12 @@ static void audio_play_mixer_help(const char *driver_name [[gnu::unused]])
 static void usage()
 {
         printf("Usage:\n"
-               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}]\n"
+               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}][:channels=<n>]\n"
                "\n"
                "<codec>\n"
                "\taudio codec to use\n"
+               "<n>\n"
+               "\tnumber of mixed channels (default 1)\n"
                "linear\n"
                "\tlinear sum of signals (with clamping)\n"
                "logarithmic\n"
@@ -393,7 +554,9 @@ static void usage()
                "2)\tUses default port for receiving, therefore if you want to use it\n"
                "\ton machine that is a part of the conference, you should use something like:\n"
                "\t\t%s -s <your_capture> -P 5004:5004:5010:5006\n"
-               "\tfor the " PACKAGE_NAME " instance that is part of the conference (not mixer!)\n",
+               "\tfor the " PACKAGE_NAME " instance that is part of the conference (not mixer!)\n"
+               "3)\tParticipants that are silent for a while receive a single shared\n"
+               "\tencoding of the whole mix.\n",
                uv_argv[0], uv_argv[0]);
 }
 
@@ -425,7 +588,7 @@ static void audio_play_mixer_put_frame(void *state, struct audio_frame *frame [[
         auto ss = *(struct sockaddr_storage *) frame->network_source;
 
         if (s->participants.find(ss) == s->participants.end()) {
-                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec});
+                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec, s->channels});
         }
 
         audio_buffer_write(s->participants.at(ss).m_buffer, frame->data, frame->data_len);
@@ -446,7 +609,7 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 if (*len >= sizeof(struct audio_desc)) {
-                        struct audio_desc desc { BPS, SAMPLE_RATE, CHANNELS, AC_PCM };
+                        struct audio_desc desc { BPS, SAMPLE_RATE, s->channels, AC_PCM };
                         memcpy(data, &desc, sizeof desc);
                         *len = sizeof desc;
                         return true;
@@ -474,9 +637,10 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         }
 }
 
-static int audio_play_mixer_reconfigure(void *state [[gnu::unused]], struct audio_desc desc)
+static int audio_play_mixer_reconfigure(void *state, struct audio_desc desc)
 {
-        audio_desc requested{BPS, SAMPLE_RATE, CHANNELS, AC_PCM};
+        struct state_audio_mixer *s = (struct state_audio_mixer *) state;
+        audio_desc requested{BPS, SAMPLE_RATE, s->channels, AC_PCM};
         assert(desc == requested);
         return TRUE;
 }
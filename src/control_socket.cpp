@@ -57,6 +57,7 @@
 #include "module.h"
 #include "rtp/net_udp.h" // socket_error
 #include "tv.h"
+#include "utils/metrics.h"
 #include "utils/net.h"
 
 #define DEFAULT_CONTROL_PORT 5054
@@ -552,6 +553,13 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
         } else if(strcasecmp(message, "bye") == 0) {
                 ret = CONTROL_CLOSE_HANDLE;
                 resp = new_response(RESPONSE_OK, NULL);
+        } else if (strcasecmp(message, "metrics") == 0) {
+                // snapshot may exceed send_response() buffer, write it directly
+                std::string reply = std::string("200 OK ") + metrics_snapshot_json() + "\r\n";
+                if (write_all(client_fd, reply.c_str(), reply.length()) < 0) {
+                        perror("Unable to write response");
+                }
+                return ret;
         } else if(strcmp(message, "dump-tree") == 0) {
                 dump_tree(s->root_module, 0);
                 resp = new_response(RESPONSE_OK, NULL);
@@ -47,9 +47,32 @@
 #include "compat/platform_time.h"
 #include "debug.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 #include "host.h"
 #include "rang.hpp"
 
+#define LOG_ASYNC_TEXT_LEN 240            ///< longer messages are written synchronously
+#define LOG_ASYNC_DEFAULT_RECORDS 256     ///< default per-thread ring length
+#define LOG_ASYNC_POLL_MS 10
+#define LOG_ASYNC_RATE_BURST 20           ///< similar messages written per second
+
+using namespace std;
+using namespace std::chrono;
+
+ADD_TO_PARAM(log_async, "log-async",
+         "* log-async[=<records>]\n"
+         "  Format log messages on the calling thread and write them from a background\n"
+         "  thread. Repeated messages are coalesced and rate-limited. <records> is the\n"
+         "  per-thread queue length, messages are dropped (and counted) if it overflows.\n");
+
 static void _dprintf(const char *format, ...)
 {
         if (log_level < LOG_LEVEL_DEBUG) {
@@ -73,6 +96,400 @@ static void _dprintf(const char *format, ...)
 #endif                          /* WIN32 */
 }
 
+static void print_record(int level, const char *timestamp, const char *text)
+{
+        rang::fg color = rang::fg::reset;
+        rang::style style = rang::style::reset;
+
+        switch (level) {
+        case LOG_LEVEL_FATAL:   color = rang::fg::red; style = rang::style::bold; break;
+        case LOG_LEVEL_ERROR:   color = rang::fg::red; break;
+        case LOG_LEVEL_WARNING: color = rang::fg::yellow; break;
+        case LOG_LEVEL_NOTICE:  color = rang::fg::green; break;
+        }
+
+        std::cerr << style << color << timestamp <<
+                text << rang::style::reset << rang::fg::reset;
+}
+
+#define TIMESTAMP_LEN (3 /* "[] " */ + 20 /* 64b int dec */ + 1 /* dot */ + 3 /* ms */)
+
+/// @param time_ms  message time, 0 for current time
+static void format_timestamp(char *timestamp, unsigned long long time_ms)
+{
+        timestamp[0] = '\0';
+        if (log_level >= LOG_LEVEL_VERBOSE) {
+                if (time_ms == 0) {
+                        time_ms = time_since_epoch_in_ms();
+                }
+                sprintf(timestamp, "[%llu.%03llu] ", time_ms / 1000,
+                                time_ms % 1000);
+        }
+}
+
+/**
+ * @defgroup log_async Asynchronous logging
+ *
+ * Each logging thread owns a single-producer/single-consumer ring of
+ * preformatted records so that log_msg() never blocks on console I/O nor on
+ * a lock. A writer thread drains the rings, coalesces identical consecutive
+ * messages, rate-limits messages that differ only in numbers and writes the
+ * rest to stderr. When a ring is full, the record is dropped and counted.
+ * @{
+ */
+struct log_record {
+        unsigned long long seq;                 ///< global order of records
+        int level;
+        unsigned long long time_ms;
+        char text[LOG_ASYNC_TEXT_LEN];
+};
+
+struct log_ring {
+        explicit log_ring(size_t size) : records(size) {}
+        vector<log_record> records;             ///< size is a power of 2
+        atomic<size_t> head{0};                 ///< written by the owning thread
+        atomic<size_t> tail{0};                 ///< written by the writer
+        atomic<unsigned long long> dropped{0};
+        atomic<bool> orphaned{false};           ///< owning thread has exited
+};
+
+struct log_async_state {
+        size_t ring_size;
+        thread writer;
+
+        mutex lock;                             ///< protects members below
+        vector<log_ring *> rings;
+        condition_variable cv;                  ///< wakes the writer
+        condition_variable flushed_cv;
+        unsigned long long flush_req = 0;
+        unsigned long long flush_done = 0;
+        bool should_exit = false;
+        bool exited = false;
+};
+
+/// kept allocated after log_async_stop() - rings may still be referenced
+static atomic<log_async_state *> log_async{nullptr};
+static atomic<unsigned long long> log_async_dropped{0};
+static atomic<unsigned long long> log_async_seq{0};
+
+/// marks the ring orphaned when the owning thread exits
+struct log_ring_owner {
+        log_ring *ring = nullptr;
+        ~log_ring_owner() {
+                if (ring != nullptr) {
+                        ring->orphaned.store(true, memory_order_release);
+                }
+        }
+};
+
+/**
+ * Writer-side state - coalescing of repeated messages and rate limiting.
+ * Used only from the writer thread.
+ */
+class log_writer {
+public:
+        void process(const log_record &rec) {
+                auto now = steady_clock::now();
+                if (rec.level == last_level && last_text == rec.text) {
+                        repeats += 1;
+                        return;
+                }
+                flush_repeats();
+
+                if (rec.level != LOG_LEVEL_FATAL) {
+                        auto &rate = rates[similarity_key(rec)];
+                        if (now - rate.window_start >= seconds(1)) {
+                                report_suppressed(rate);
+                                rate.window_start = now;
+                                rate.count = 0;
+                        }
+                        if (++rate.count > LOG_ASYNC_RATE_BURST) {
+                                if (rate.suppressed++ == 0) {
+                                        rate.level = rec.level;
+                                        rate.sample = rec.text;
+                                }
+                                return;
+                        }
+                }
+
+                char timestamp[TIMESTAMP_LEN + 1];
+                format_timestamp(timestamp, rec.time_ms);
+                print_record(rec.level, timestamp, rec.text);
+                last_level = rec.level;
+                last_text = rec.text;
+                last_print = now;
+        }
+
+        /// called periodically - writes pending summaries
+        void tick(unsigned long long dropped_total) {
+                auto now = steady_clock::now();
+                if (repeats > 0 && now - last_print >= seconds(1)) {
+                        flush_repeats();
+                }
+                if (now - last_tick < seconds(1)) {
+                        return;
+                }
+                last_tick = now;
+                for (auto it = rates.begin(); it != rates.end(); ) {
+                        if (now - it->second.window_start >= seconds(1)) {
+                                report_suppressed(it->second);
+                        }
+                        if (now - it->second.window_start >= seconds(10)) {
+                                it = rates.erase(it);
+                        } else {
+                                ++it;
+                        }
+                }
+                if (dropped_total > dropped_reported) {
+                        char msg[128];
+                        snprintf(msg, sizeof msg, "Logging queue overflow - %llu messages dropped (%llu total).\n",
+                                        dropped_total - dropped_reported, dropped_total);
+                        write_summary(LOG_LEVEL_WARNING, msg);
+                        dropped_reported = dropped_total;
+                }
+        }
+
+        /// writes the pending "repeated" summary before a synchronous message
+        void flush_repeats() {
+                if (repeats == 0) {
+                        return;
+                }
+                char msg[128];
+                snprintf(msg, sizeof msg, "Last message repeated %u time%s.\n", repeats, repeats > 1 ? "s" : "");
+                write_summary(last_level, msg);
+                repeats = 0;
+                last_print = steady_clock::now();
+        }
+
+        void finish(unsigned long long dropped_total) {
+                flush_repeats();
+                last_tick = {};
+                for (auto &rate : rates) {
+                        report_suppressed(rate.second);
+                }
+                tick(dropped_total);
+        }
+
+private:
+        struct rate_state {
+                steady_clock::time_point window_start;
+                int count = 0;
+                int suppressed = 0;
+                int level = 0;
+                string sample;
+        };
+
+        static uint32_t similarity_key(const log_record &rec) {
+                // FNV-1a ignoring digits so that eg. varying counters share the key
+                uint32_t hash = 2166136261u ^ (uint32_t) rec.level;
+                for (const char *c = rec.text; *c != '\0'; ++c) {
+                        if (*c >= '0' && *c <= '9') {
+                                continue;
+                        }
+                        hash = (hash ^ (unsigned char) *c) * 16777619u;
+                }
+                return hash;
+        }
+
+        void write_summary(int level, const char *text) {
+                char timestamp[TIMESTAMP_LEN + 1];
+                format_timestamp(timestamp, 0);
+                print_record(level, timestamp, text);
+        }
+
+        void report_suppressed(rate_state &rate) {
+                if (rate.suppressed == 0) {
+                        return;
+                }
+                string msg = "Suppressed " + to_string(rate.suppressed) + " message" +
+                        (rate.suppressed > 1 ? "s" : "") + " similar to: " + rate.sample;
+                if (msg.back() != '\n') {
+                        msg += '\n';
+                }
+                write_summary(rate.level, msg.c_str());
+                rate.suppressed = 0;
+                rate.sample.clear();
+        }
+
+        int last_level = -1;
+        string last_text;
+        unsigned repeats = 0;
+        steady_clock::time_point last_print;
+        steady_clock::time_point last_tick;
+        unordered_map<uint32_t, rate_state> rates;
+        unsigned long long dropped_reported = 0;
+};
+
+static void log_async_writer(log_async_state *s)
+{
+        log_writer writer;
+        unsigned long long dropped_orphans = 0;
+        unsigned long long last_req = 0;
+        unique_lock<mutex> lk(s->lock);
+        while (true) {
+                bool exiting = s->should_exit;
+                unsigned long long req = s->flush_req;
+                vector<log_ring *> rings = s->rings;
+                lk.unlock();
+
+                // merge the rings in the order the records were created
+                struct pending {
+                        log_ring *ring;
+                        size_t tail, head;
+                        const log_record &front() const {
+                                return ring->records[tail & (ring->records.size() - 1)];
+                        }
+                };
+                vector<pending> pend;
+                unsigned long long dropped = dropped_orphans;
+                for (auto r : rings) {
+                        pend.push_back({r, r->tail.load(memory_order_relaxed), r->head.load(memory_order_acquire)});
+                        dropped += r->dropped.load(memory_order_relaxed);
+                }
+                while (true) {
+                        pending *next = nullptr;
+                        for (auto &p : pend) {
+                                if (p.tail != p.head && (next == nullptr || p.front().seq < next->front().seq)) {
+                                        next = &p;
+                                }
+                        }
+                        if (next == nullptr) {
+                                break;
+                        }
+                        writer.process(next->front());
+                        next->ring->tail.store(++next->tail, memory_order_release);
+                }
+                log_async_dropped.store(dropped, memory_order_relaxed);
+                if (exiting) {
+                        writer.finish(dropped);
+                } else {
+                        if (req != last_req) {
+                                writer.flush_repeats();
+                                last_req = req;
+                        }
+                        writer.tick(dropped);
+                }
+                std::cerr.flush();
+
+                lk.lock();
+                for (auto it = s->rings.begin(); it != s->rings.end(); ) {
+                        log_ring *r = *it;
+                        if (r->orphaned.load(memory_order_acquire) &&
+                                        r->head.load(memory_order_acquire) == r->tail.load(memory_order_relaxed)) {
+                                dropped_orphans += r->dropped.load(memory_order_relaxed);
+                                delete r;
+                                it = s->rings.erase(it);
+                        } else {
+                                ++it;
+                        }
+                }
+                s->flush_done = req;
+                s->flushed_cv.notify_all();
+                if (exiting) {
+                        break;
+                }
+                s->cv.wait_for(lk, milliseconds(LOG_ASYNC_POLL_MS),
+                                [s, req] { return s->should_exit || s->flush_req != req; });
+        }
+        s->exited = true;
+        s->flushed_cv.notify_all();
+}
+
+/**
+ * @retval true  message was queued (or dropped because the ring is full)
+ * @retval false message doesn't fit a record and needs to be written synchronously
+ */
+static bool log_async_push(log_async_state *s, int level, const char *format, va_list ap)
+{
+        static thread_local log_ring_owner owner;
+        log_ring *r = owner.ring;
+        if (r == nullptr) {
+                r = new log_ring(s->ring_size);
+                lock_guard<mutex> lk(s->lock);
+                s->rings.push_back(r);
+                owner.ring = r;
+        }
+
+        size_t head = r->head.load(memory_order_relaxed);
+        size_t used = head - r->tail.load(memory_order_acquire);
+        if (used == r->records.size()) {
+                r->dropped.fetch_add(1, memory_order_relaxed);
+                return true;
+        }
+        log_record &rec = r->records[head & (r->records.size() - 1)];
+        int len = vsnprintf(rec.text, sizeof rec.text, format, ap);
+        if (len < 0) {
+                return true;
+        }
+        if (len >= (int) sizeof rec.text) {
+                return false;
+        }
+        rec.seq = log_async_seq.fetch_add(1, memory_order_relaxed);
+        rec.level = level;
+        rec.time_ms = log_level >= LOG_LEVEL_VERBOSE ? time_since_epoch_in_ms() : 0;
+        r->head.store(head + 1, memory_order_release);
+        if (used + 1 > r->records.size() / 2) {
+                s->cv.notify_one();
+        }
+        return true;
+}
+
+/// waits until all records queued so far are written
+static void log_async_flush(log_async_state *s)
+{
+        unique_lock<mutex> lk(s->lock);
+        unsigned long long req = ++s->flush_req;
+        s->cv.notify_one();
+        s->flushed_cv.wait(lk, [s, req] { return s->exited || s->flush_done >= req; });
+}
+
+static void log_async_stop()
+{
+        log_async_state *s = log_async.exchange(nullptr);
+        if (s == nullptr) {
+                return;
+        }
+        {
+                lock_guard<mutex> lk(s->lock);
+                s->should_exit = true;
+        }
+        s->cv.notify_one();
+        s->writer.join();
+}
+
+bool log_init_async(void)
+{
+        const char *param = get_commandline_param("log-async");
+        if (param == nullptr || log_async.load() != nullptr) {
+                return true;
+        }
+        int records = LOG_ASYNC_DEFAULT_RECORDS;
+        if (strlen(param) > 0) {
+                records = atoi(param);
+                if (records <= 0) {
+                        log_msg(LOG_LEVEL_ERROR, "Wrong log-async queue length: %s\n", param);
+                        return false;
+                }
+        }
+        size_t ring_size = 1;
+        while (ring_size < (size_t) records) {
+                ring_size *= 2;
+        }
+
+        auto s = new log_async_state();
+        s->ring_size = ring_size;
+        s->writer = thread(log_async_writer, s);
+        log_async.store(s, memory_order_release);
+        atexit(log_async_stop);
+        return true;
+}
+
+unsigned long long log_get_dropped_records(void)
+{
+        return log_async_dropped.load(memory_order_relaxed);
+}
+/// @}
+
 void log_msg(int level, const char *format, ...)
 {
         va_list ap;
@@ -81,6 +498,20 @@ void log_msg(int level, const char *format, ...)
                 return;
         }
 
+        log_async_state *async = log_async.load(memory_order_acquire);
+        if (async != nullptr) {
+                if (level != LOG_LEVEL_FATAL) {
+                        va_start(ap, format);
+                        bool queued = log_async_push(async, level, format, ap);
+                        va_end(ap);
+                        if (queued) {
+                                return;
+                        }
+                }
+                // keep ordering with already queued messages
+                log_async_flush(async);
+        }
+
 #if 0 // WIN32
         if (log_level == LOG_LEVEL_DEBUG) {
                 char msg[65535];
@@ -94,23 +525,8 @@ void log_msg(int level, const char *format, ...)
         }
 #endif                          /* WIN32 */
 
-        rang::fg color = rang::fg::reset;
-        rang::style style = rang::style::reset;
-
-        switch (level) {
-        case LOG_LEVEL_FATAL:   color = rang::fg::red; style = rang::style::bold; break;
-        case LOG_LEVEL_ERROR:   color = rang::fg::red; break;
-        case LOG_LEVEL_WARNING: color = rang::fg::yellow; break;
-        case LOG_LEVEL_NOTICE:  color = rang::fg::green; break;
-        }
-
-        auto timestamp = (char *) alloca((3 /* "[] " */ + 20 /* 64b int dec */ + 1 /* dot */ + 3 /* ms */) /* time */ + 1);
-        timestamp[0] = '\0';
-        if (log_level >= LOG_LEVEL_VERBOSE) {
-                unsigned long long time_ms = time_since_epoch_in_ms();
-                sprintf(timestamp, "[%llu.%03llu] ", time_ms / 1000,
-                                time_ms % 1000);
-        }
+        auto timestamp = (char *) alloca(TIMESTAMP_LEN + 1);
+        format_timestamp(timestamp, 0);
 
         // get number of required bytes
         va_start(ap, format);
@@ -126,8 +542,7 @@ void log_msg(int level, const char *format, ...)
         }
         va_end(ap);
 
-        std::cerr << style << color << timestamp <<
-                buffer << rang::style::reset << rang::fg::reset;
+        print_record(level, timestamp, buffer);
 }
 
 /**
@@ -55,6 +55,13 @@ void debug_dump(void*lp, int len);
 ///#define debug_msg(...) log_msg(LOG_LEVEL_DEBUG, "[pid/%d +%d %s] ", getpid(), __LINE__, __FILE__), log_msg(LOG_LEVEL_DEBUG, __VA_ARGS__)
 #define debug_msg(...) log_msg(LOG_LEVEL_DEBUG, __VA_ARGS__)
 void log_msg(int log_level, const char *format, ...);
+/**
+ * Switches log_msg() to asynchronous mode if requested with "--param log-async".
+ * @retval false wrong parameter value
+ */
+bool log_init_async(void);
+/// @returns number of messages dropped by the asynchronous logger so far
+unsigned long long log_get_dropped_records(void);
 
 #ifdef __cplusplus
 }
@@ -68,7 +75,7 @@ class Logger
 public:
         inline Logger(int l) : level(l) {}
         inline ~Logger() {
-                log_msg(level, os.str().c_str());
+                log_msg(level, "%s", os.str().c_str());
         }
         inline std::ostringstream& Get() {
                 return os;
@@ -7,6 +7,7 @@
 #include "hd-rum-translator/hd-rum-decompress.h"
 #include "hd-rum-translator/hd-rum-recompress.h"
 
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <iostream>
@@ -137,16 +138,26 @@ void hd_rum_decompress_set_active(void *state, void *recompress_port, bool activ
         for (auto && port : s->output_ports) {
                 if (port.state == recompress_port) {
                         port.active = active;
+                        recompress_set_active(port.state, active);
                 }
         }
 }
 
-ssize_t hd_rum_decompress_write(void *state, void *buf, size_t count)
+ssize_t hd_rum_decompress_write(void *state, void *packet, size_t count)
 {
         struct state_transcoder_decompress *s = (struct state_transcoder_decompress *) state;
 
-        return rtp_send_raw_rtp_data(s->video_rxtx->m_network_devices[0],
-                        (char *) buf, count);
+        if (rtp_is_multithreaded(s->video_rxtx->m_network_devices[0])) {
+                // dropped if the decoder doesn't keep up, as with the loopback socket
+                rtp_inject_data(s->video_rxtx->m_network_devices[0], (char *) packet, count);
+                return count;
+        }
+
+        // receiver is not multithreaded (MSW) - pass it through the loopback socket
+        ssize_t ret = rtp_send_raw_rtp_data(s->video_rxtx->m_network_devices[0],
+                        (char *) packet + RTP_PACKET_HEADER_SIZE, count);
+        free(packet);
+        return ret;
 }
 
 void state_transcoder_decompress::worker()
@@ -171,9 +182,19 @@ void state_transcoder_decompress::worker()
                         output_ports.emplace_back(msg.new_recompress_state, true);
                         break;
                 case message::FRAME:
-                        for (unsigned int i = 0; i < output_ports.size(); ++i) {
-                                if (output_ports[i].active)
-                                        recompress_process_async(output_ports[i].state, msg.frame);
+                        {
+                                // ports with equal settings share the encoder, feed it only once
+                                vector<void *> encoders;
+                                for (unsigned int i = 0; i < output_ports.size(); ++i) {
+                                        if (!output_ports[i].active) {
+                                                continue;
+                                        }
+                                        void *encoder = recompress_get_encoder(output_ports[i].state);
+                                        if (find(encoders.begin(), encoders.end(), encoder) == encoders.end()) {
+                                                encoders.push_back(encoder);
+                                                recompress_process_async(output_ports[i].state, msg.frame);
+                                        }
+                                }
                         }
                         break;
                 }
@@ -10,7 +10,16 @@ struct hd_rum_output_conf{
         const char *arg;
 };
 
-ssize_t hd_rum_decompress_write(void *state, void *buf, size_t count);
+/**
+ * Passes a received packet to the transcoding receiver (in-process, without
+ * the loopback socket if possible).
+ *
+ * @param packet malloc'ed buffer of at least RTP_MAX_PACKET_LEN bytes with
+ *               the datagram at offset RTP_PACKET_HEADER_SIZE, ownership is
+ *               taken
+ * @param count  length of the datagram
+ */
+ssize_t hd_rum_decompress_write(void *state, void *packet, size_t count);
 void *hd_rum_decompress_init(struct module *parent, struct hd_rum_output_conf conf, const char *capture_filter);
 void hd_rum_decompress_done(void *state);
 void hd_rum_decompress_set_active(void *decompress_state, void *recompress_state, bool active);
@@ -8,32 +8,57 @@
 
 #include "debug.h"
 #include "host.h"
+#include "rtp/net_udp.h"
 #include "rtp/rtp.h"
 
 #include "video_rxtx/ultragrid_rtp.h"
 
+#include <algorithm>
 #include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 using namespace std;
 
-struct state_recompress {
-        state_recompress(unique_ptr<ultragrid_rtp_video_rxtx> && vr, string const & h, int tp)
-                : video_rxtx(std::move(vr)), host(h), t0(chrono::system_clock::now()),
-                frames(0), tx_port(tp) {
-        }
+/*
+ * Output ports with the same compression, FEC, MTU and bitrate share one
+ * video_rxtx (encoder + packetizer). It sends to the first port of the group
+ * (primary) directly and the packets are mirrored to the other ports (see
+ * rtp_add_mirror()).
+ */
+struct recompress_output_port;
 
+struct state_recompress {
         unique_ptr<ultragrid_rtp_video_rxtx> video_rxtx;
-        string host;
+        string compress;
+        string fec;
+        int mtu;
+        long long bitrate;
+
+        vector<recompress_output_port *> ports; ///< first one is the primary
 
         chrono::system_clock::time_point t0;
         int frames;
+};
+
+struct recompress_output_port {
+        struct state_recompress *encoder;
+        struct module *parent;
+        string host;
+        int rx_port;
         int tx_port;
+        socket_udp *mirror; ///< socket to the port if it is not the primary one
+        bool active;
 };
 
-void *recompress_init(struct module *parent,
-                const char *host, const char *compress, unsigned short rx_port,
-                unsigned short tx_port, int mtu, char *fec, long long bitrate)
+static mutex recompress_lock; ///< guards the list and port membership
+static vector<state_recompress *> recompress_encoders;
+
+static ultragrid_rtp_video_rxtx *create_video_rxtx(struct recompress_output_port *port,
+                const char *compress, int mtu, const char *fec, long long bitrate)
 {
         int force_ip_version = 0;
         chrono::steady_clock::time_point start_time(chrono::steady_clock::now());
@@ -41,7 +66,7 @@ void *recompress_init(struct module *parent,
         map<string, param_u> params;
 
         // common
-        params["parent"].ptr = parent;
+        params["parent"].ptr = port->parent;
         params["exporter"].ptr = NULL;
         params["compression"].ptr = (void *) compress;
         params["rxtx_mode"].i = MODE_SENDER;
@@ -49,9 +74,9 @@ void *recompress_init(struct module *parent,
 
         //RTP
         params["mtu"].i = mtu;
-        params["receiver"].ptr = (void *) host;
-        params["rx_port"].i = rx_port;
-        params["tx_port"].i = tx_port;
+        params["receiver"].ptr = (void *) port->host.c_str();
+        params["rx_port"].i = port->rx_port;
+        params["tx_port"].i = port->tx_port;
         params["force_ip_version"].i = force_ip_version;
         params["mcast_if"].ptr = (void *) NULL;
         params["fec"].ptr = (void *) fec;
@@ -66,25 +91,96 @@ void *recompress_init(struct module *parent,
 
         try {
                 auto rxtx = video_rxtx::create("ultragrid_rtp", params);
-                if (strchr(host, ':') != NULL) {
-                        rxtx->m_port_id = string("[") + host + "]:" + to_string(tx_port);
+                if (port->host.find(':') != string::npos) {
+                        rxtx->m_port_id = "[" + port->host + "]:" + to_string(port->tx_port);
                 } else {
-                        rxtx->m_port_id = string(host) + ":" + to_string(tx_port);
+                        rxtx->m_port_id = port->host + ":" + to_string(port->tx_port);
                 }
-
-                return new state_recompress(
-                                decltype(state_recompress::video_rxtx)(dynamic_cast<ultragrid_rtp_video_rxtx *>(rxtx)),
-                                host,
-                                tx_port
-                                );
+                return dynamic_cast<ultragrid_rtp_video_rxtx *>(rxtx);
         } catch (...) {
                 return nullptr;
         }
 }
 
+/// applies port activity to the encoder, recompress_lock must be held
+static void update_port_output(struct recompress_output_port *port)
+{
+        if (!port->encoder->video_rxtx) { // detached, see recompress_done()
+                return;
+        }
+        if (port->mirror == nullptr) {
+                port->encoder->video_rxtx->set_primary_muted(!port->active);
+        } else if (port->active) {
+                port->encoder->video_rxtx->add_mirror(port->mirror);
+        } else {
+                port->encoder->video_rxtx->remove_mirror(port->mirror);
+        }
+}
+
+void *recompress_init(struct module *parent,
+                const char *host, const char *compress, unsigned short rx_port,
+                unsigned short tx_port, int mtu, char *fec, long long bitrate)
+{
+        auto port = new recompress_output_port{nullptr, parent, host, rx_port, tx_port, nullptr, true};
+        string fec_str = fec ? fec : "";
+
+        lock_guard<mutex> lk(recompress_lock);
+        // ports with RX port set need their own RTP session
+        if (rx_port == 0) {
+                for (auto e : recompress_encoders) {
+                        if (e->compress == compress && e->fec == fec_str && e->mtu == mtu
+                                        && e->bitrate == bitrate && e->ports[0]->rx_port == 0) {
+                                port->mirror = udp_init(host, 0, tx_port, 255, 0, false);
+                                if (port->mirror == nullptr) {
+                                        delete port;
+                                        return nullptr;
+                                }
+                                udp_set_send_buf(port->mirror, INITIAL_VIDEO_SEND_BUFFER_SIZE);
+                                port->encoder = e;
+                                e->ports.push_back(port);
+                                update_port_output(port);
+                                log_msg(LOG_LEVEL_NOTICE, "Output port %s:%d shares encoder with %s:%d.\n",
+                                                host, tx_port, e->ports[0]->host.c_str(), e->ports[0]->tx_port);
+                                return port;
+                        }
+                }
+        }
+
+        auto rxtx = create_video_rxtx(port, compress, mtu, fec, bitrate);
+        if (rxtx == nullptr) {
+                delete port;
+                return nullptr;
+        }
+        auto e = new state_recompress{unique_ptr<ultragrid_rtp_video_rxtx>(rxtx), compress, fec_str, mtu, bitrate,
+                {port}, chrono::system_clock::now(), 0};
+        port->encoder = e;
+        recompress_encoders.push_back(e);
+        return port;
+}
+
+void *recompress_get_encoder(void *state)
+{
+        return static_cast<recompress_output_port *>(state)->encoder;
+}
+
+void recompress_set_active(void *state, bool active)
+{
+        auto port = static_cast<recompress_output_port *>(state);
+
+        lock_guard<mutex> lk(recompress_lock);
+        if (port->active != active) {
+                port->active = active;
+                update_port_output(port);
+        }
+}
+
 void recompress_process_async(void *state, shared_ptr<video_frame> frame)
 {
-        auto s = static_cast<state_recompress *>(state);
+        auto s = static_cast<recompress_output_port *>(state)->encoder;
+
+        if (!s->video_rxtx) {
+                return;
+        }
 
         s->frames += 1;
 
@@ -92,9 +188,10 @@ void recompress_process_async(void *state, shared_ptr<video_frame> frame)
         double seconds = chrono::duration_cast<chrono::microseconds>(now - s->t0).count() / 1000000.0;
         if(seconds > 5) {
                 double fps = s->frames / seconds;
+                lock_guard<mutex> lk(recompress_lock);
                 log_msg(LOG_LEVEL_INFO, "[0x%08lx->%s:%d:0x%08lx] %d frames in %g seconds = %g FPS\n",
                                 frame->ssrc,
-                                s->host.c_str(), s->tx_port,
+                                s->ports[0]->host.c_str(), s->ports[0]->tx_port,
                                 s->video_rxtx->get_ssrc(),
                                 s->frames, seconds, fps);
                 s->t0 = now;
@@ -113,17 +210,100 @@ void recompress_assign_ssrc(void *state, uint32_t ssrc)
 
 uint32_t recompress_get_ssrc(void *state)
 {
-        auto s = static_cast<state_recompress *>(state);
+        auto s = static_cast<recompress_output_port *>(state)->encoder;
 
-        return s->video_rxtx->get_ssrc();
+        return s->video_rxtx ? s->video_rxtx->get_ssrc() : 0;
 }
 
 void recompress_done(void *state)
 {
-        auto s = static_cast<state_recompress *>(state);
+        auto port = static_cast<recompress_output_port *>(state);
+        auto s = port->encoder;
+        unique_ptr<ultragrid_rtp_video_rxtx> old_rxtx;
 
-        s->video_rxtx->join();
+        unique_lock<mutex> lk(recompress_lock);
+        s->ports.erase(find(s->ports.begin(), s->ports.end(), port));
 
-        delete s;
+        if (port->mirror != nullptr) {
+                if (port->active && s->video_rxtx) {
+                        s->video_rxtx->remove_mirror(port->mirror);
+                }
+                udp_exit(port->mirror);
+        } else if (!s->ports.empty() && s->video_rxtx) {
+                // the encoder belongs to the removed port (and its module) -
+                // the next port takes over with a new one. Creating it opens
+                // sockets and initializes the compression so do not hold the
+                // lock meanwhile. Ports added or (de)activated in between are
+                // applied to the new encoder by update_port_output() below.
+                auto primary = s->ports[0];
+                lk.unlock();
+                auto rxtx = create_video_rxtx(primary, s->compress.c_str(), s->mtu,
+                                s->fec.empty() ? nullptr : s->fec.c_str(), s->bitrate);
+                lk.lock();
+                old_rxtx = move(s->video_rxtx);
+                if (rxtx == nullptr) {
+                        // leave the remaining ports without an encoder - they
+                        // drop frames until removed
+                        log_msg(LOG_LEVEL_ERROR, "Unable to recreate shared encoder for %s:%d, "
+                                        "detaching %zu remaining port(s)!\n",
+                                        primary->host.c_str(), primary->tx_port, s->ports.size());
+                        for (auto p : s->ports) {
+                                if (p->mirror != nullptr) {
+                                        udp_exit(p->mirror);
+                                        p->mirror = nullptr;
+                                }
+                        }
+                        recompress_encoders.erase(find(recompress_encoders.begin(), recompress_encoders.end(), s));
+                } else {
+                        s->video_rxtx.reset(rxtx);
+                        udp_exit(primary->mirror);
+                        primary->mirror = nullptr;
+                        for (auto p : s->ports) {
+                                update_port_output(p);
+                        }
+                        // the stream now originates from a new RTP session so
+                        // receivers see a new SSRC
+                        log_msg(LOG_LEVEL_NOTICE, "Shared encoder moved to output port %s:%d, "
+                                        "SSRC changed 0x%08x -> 0x%08x.\n",
+                                        primary->host.c_str(), primary->tx_port,
+                                        (unsigned) old_rxtx->get_ssrc(),
+                                        (unsigned) s->video_rxtx->get_ssrc());
+                }
+        }
+
+        bool last = s->ports.empty();
+        if (last) {
+                auto it = find(recompress_encoders.begin(), recompress_encoders.end(), s);
+                if (it != recompress_encoders.end()) {
+                        recompress_encoders.erase(it);
+                }
+                old_rxtx = move(s->video_rxtx);
+        }
+        lk.unlock();
+
+        if (old_rxtx) {
+                old_rxtx->join();
+        }
+        if (last) {
+                delete s;
+        }
+
+        delete port;
 }
 
+string recompress_list_encoders()
+{
+        lock_guard<mutex> lk(recompress_lock);
+        string ret;
+        for (auto s : recompress_encoders) {
+                char ssrc[11];
+                snprintf(ssrc, sizeof ssrc, "0x%08x", (unsigned) s->video_rxtx->get_ssrc());
+                ret += string(ret.empty() ? "" : "; ") + s->compress + " fec=" + (s->fec.empty() ? "none" : s->fec) +
+                        " mtu=" + to_string(s->mtu) + " ssrc=" + ssrc + " ports=";
+                for (auto p : s->ports) {
+                        ret += (p == s->ports[0] ? "" : ",") + p->host + ":" + to_string(p->tx_port) +
+                                (p->active ? "" : "(inactive)");
+                }
+        }
+        return ret;
+}
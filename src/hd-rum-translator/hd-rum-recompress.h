@@ -17,6 +17,9 @@ void *recompress_init(struct module *parent, const char *host, const char *compr
 void recompress_assign_ssrc(void *state, uint32_t ssrc);
 void recompress_done(void *state);
 uint32_t recompress_get_ssrc(void *state);
+/// ports sharing the encoder (compression settings) return the same value
+void *recompress_get_encoder(void *state);
+void recompress_set_active(void *state, bool active);
 
 #ifdef __cplusplus
 }
@@ -26,4 +29,5 @@ uint32_t recompress_get_ssrc(void *state);
 #include <memory>
 #include <string>
 void recompress_process_async(void *state, std::shared_ptr<video_frame> frame);
+std::string recompress_list_encoders();
 #endif
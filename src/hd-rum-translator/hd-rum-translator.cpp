@@ -22,12 +22,17 @@
 #include "module.h"
 #include "rang.hpp"
 #include "rtp/net_udp.h"
+#include "rtp/rtp.h"
 #include "utils/misc.h"
 #include "tv.h"
 
+#include <atomic>
 #include <cinttypes>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -35,6 +40,7 @@ using s = rang::style;
 using fg = rang::fg;
 
 struct item;
+struct sender_shard;
 
 #define REPLICA_MAGIC 0xd2ff3323
 
@@ -79,6 +85,12 @@ struct replica {
     enum type_t type;
     socket_udp *sock;
     void *recompress;
+
+    // forwarding statistics, updated by the sender thread
+    atomic<unsigned long long> sent_pkts{0};
+    atomic<unsigned long long> dropped_pkts{0};
+    atomic<int> max_queue_depth{0}; ///< since last report
+    unsigned long long reported_drops = 0; ///< accessed by main thread only
 };
 
 struct hd_rum_translator_state {
@@ -112,6 +124,11 @@ struct hd_rum_translator_state {
 
     vector<replica *> replicas;
     void *decompress;
+
+    int qsize = 0;
+    int sender_threads = 1;
+    vector<sender_shard *> shards;
+    vector<sender_shard *> active_shards; ///< shards having at least one replica
 };
 
 /*
@@ -173,10 +190,32 @@ struct wsa_aux_storage {
 #define SIZE MAX_PKT_SIZE
 #endif
 
+/*
+ * Packet buffers have RTP_PACKET_HEADER_SIZE bytes of headroom before the
+ * datagram (item::buf) so that they can be handed over to the transcoding
+ * receiver as they are (see hd_rum_decompress_write()).
+ */
+#define BUF_ALLOC_SIZE (RTP_PACKET_HEADER_SIZE + SIZE > RTP_MAX_PACKET_LEN ? \
+        RTP_PACKET_HEADER_SIZE + SIZE : RTP_MAX_PACKET_LEN)
+
+static char *qbuf_alloc()
+{
+    return (char *) malloc(BUF_ALLOC_SIZE) + RTP_PACKET_HEADER_SIZE;
+}
+
+static void qbuf_free(char *buf)
+{
+    free(buf - RTP_PACKET_HEADER_SIZE);
+}
+
 struct item {
     struct item *next;
     long size;
     char *buf;
+    int idx;
+    bool transcode;         ///< pass to transcoder when all senders are done
+    atomic<int> refs;       ///< writer and sender threads using the item
+    atomic<bool> busy;      ///< receiver must not overwrite the item yet
 };
 
 static struct item *qinit(int qsize)
@@ -186,15 +225,12 @@ static struct item *qinit(int qsize)
 
     printf("initializing packet queue for %d items\n", qsize);
 
-    queue = (struct item *) calloc(qsize, sizeof(struct item));
-    if (queue == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        exit(2);
-    }
+    queue = new struct item[qsize]();
 
     for (i = 0; i < qsize; i++) {
-        queue[i].buf = (char *) malloc(SIZE);
+        queue[i].buf = qbuf_alloc();
         queue[i].next = queue + i + 1;
+        queue[i].idx = i;
     }
     queue[qsize - 1].next = queue;
 
@@ -205,11 +241,178 @@ static void qdestroy(struct item *queue)
 {
     struct item *q = queue;
     do {
-        free(q->buf);
+        qbuf_free(q->buf);
         q = q->next;
     } while (q != queue);
-    free(queue);
+    delete [] queue;
+}
+
+#ifndef WIN32
+/**
+ * Drops a reference to the item. The last one passes the packet to the
+ * transcoder (if requested) and returns the item to the receiver.
+ */
+static void item_release(struct hd_rum_translator_state *s, struct item *it)
+{
+    if (it->refs.fetch_sub(1, memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    // pass it for transcoding if needed - the buffer is handed over
+    // to the receiver (no copy) and replaced with a new one
+    if (it->transcode) {
+        ssize_t ret = hd_rum_decompress_write(s->decompress, it->buf - RTP_PACKET_HEADER_SIZE, it->size);
+        if (ret < 0) {
+            perror("hd_rum_decompress_write");
+        }
+        it->buf = qbuf_alloc();
+    }
+    it->busy.store(false, memory_order_release);
+
+    pthread_mutex_lock(&s->qfull_mtx);
+    s->qfull = 0;
+    pthread_cond_signal(&s->qfull_cond);
+    pthread_mutex_unlock(&s->qfull_mtx);
+}
+
+#define SHARD_MAX_BATCH 64 ///< max packets sent with one call per replica
+#define SHARD_PUBLISH_INTERVAL 16 ///< items processed by writer before waking the senders
+
+/*
+ * Forwarding replicas are distributed among sender threads (shards). The
+ * writer publishes every received item to all active shards, each of them
+ * sends it to its replicas in non-blocking batches and releases it. A replica
+ * that cannot keep pace gets its packets dropped instead of stalling the
+ * other ones.
+ */
+struct sender_shard {
+    thread thr;
+    vector<replica *> replicas; ///< changed by writer only when the shard is idle
+    struct item *next = nullptr; ///< first item not yet sent
+    struct item *end = nullptr; ///< end of published items
+    bool should_exit = false;
+    mutex lock; ///< guards next, end and should_exit
+    condition_variable cv;
+    condition_variable idle_cv;
+};
+
+static void sender_shard_run(struct hd_rum_translator_state *s, struct sender_shard *sh)
+{
+    struct item *items[SHARD_MAX_BATCH];
+    char *bufs[SHARD_MAX_BATCH];
+    int sizes[SHARD_MAX_BATCH];
+
+    unique_lock<mutex> lk(sh->lock);
+    while (true) {
+        sh->cv.wait(lk, [sh]{ return sh->next != sh->end || sh->should_exit; });
+        if (sh->next == sh->end) {
+            break;
+        }
+        struct item *it = sh->next;
+        struct item *end = sh->end;
+        lk.unlock();
+
+        int depth = (end->idx - it->idx + s->qsize) % s->qsize;
+        int count = 0;
+        for ( ; it != end && count < SHARD_MAX_BATCH; it = it->next) {
+            items[count] = it;
+            bufs[count] = it->buf;
+            sizes[count] = it->size;
+            count++;
+        }
+        for (auto r : sh->replicas) {
+            int sent = udp_send_nonblock_batch(r->sock, bufs, sizes, count);
+            r->sent_pkts += sent;
+            if (sent < count) {
+                r->dropped_pkts += count - sent;
+            }
+            if (depth > r->max_queue_depth) {
+                r->max_queue_depth = depth;
+            }
+        }
+        for (int i = 0; i < count; ++i) {
+            item_release(s, items[i]);
+        }
+
+        lk.lock();
+        sh->next = it;
+        if (sh->next == sh->end) {
+            sh->idle_cv.notify_one();
+        }
+    }
+}
+
+static void shards_publish(struct hd_rum_translator_state *s)
+{
+    for (auto sh : s->active_shards) {
+        {
+            lock_guard<mutex> lk(sh->lock);
+            sh->end = s->qhead;
+        }
+        sh->cv.notify_one();
+    }
+}
+
+/// waits until shards send all published items
+static void shards_quiesce(struct hd_rum_translator_state *s)
+{
+    shards_publish(s);
+    for (auto sh : s->active_shards) {
+        unique_lock<mutex> lk(sh->lock);
+        sh->idle_cv.wait(lk, [sh]{ return sh->next == sh->end; });
+    }
+}
+
+/// (re)distributes forwarding replicas among shards round-robin
+static void shards_assign(struct hd_rum_translator_state *s)
+{
+    shards_quiesce(s);
+    for (auto sh : s->shards) {
+        lock_guard<mutex> lk(sh->lock);
+        sh->replicas.clear();
+        sh->next = sh->end = s->qhead;
+    }
+    int idx = 0;
+    for (auto r : s->replicas) {
+        if (r->type == replica::type_t::USE_SOCK) {
+            s->shards[idx++ % s->shards.size()]->replicas.push_back(r);
+        }
+    }
+    s->active_shards.clear();
+    for (auto sh : s->shards) {
+        if (!sh->replicas.empty()) {
+            s->active_shards.push_back(sh);
+        }
+    }
+}
+
+static void shards_start(struct hd_rum_translator_state *s)
+{
+    for (int i = 0; i < s->sender_threads; ++i) {
+        auto sh = new sender_shard();
+        sh->next = sh->end = s->qhead;
+        sh->thr = thread(sender_shard_run, s, sh);
+        s->shards.push_back(sh);
+    }
+    shards_assign(s);
+}
+
+static void shards_stop(struct hd_rum_translator_state *s)
+{
+    shards_publish(s);
+    for (auto sh : s->shards) {
+        {
+            lock_guard<mutex> lk(sh->lock);
+            sh->should_exit = true;
+        }
+        sh->cv.notify_one();
+        sh->thr.join();
+        delete sh;
+    }
+    s->shards.clear();
+    s->active_shards.clear();
 }
+#endif // ! defined WIN32
 
 static struct response *change_replica_type(struct hd_rum_translator_state *s,
         struct module *mod, struct message *msg, int index)
@@ -242,7 +445,7 @@ static VOID CALLBACK wsa_deleter(DWORD /* dwErrorCode */,
     struct wsa_aux_storage *aux = (struct wsa_aux_storage *) ((char *) lpOverlapped->Pointer + OFFSET);
     if (--aux->ref == 0) {
         free(aux->overlapped);
-        free(lpOverlapped->Pointer);
+        qbuf_free((char *) lpOverlapped->Pointer);
     }
 }
 #endif
@@ -252,13 +455,19 @@ static void *writer(void *arg)
     struct hd_rum_translator_state *s =
         (struct hd_rum_translator_state *) arg;
 
+#ifndef WIN32
+    shards_start(s);
+#endif
+
     while (1) {
+        bool replicas_changed = false;
         // first check messages
         for (unsigned int i = 0; i < s->replicas.size(); i++) {
             struct message *msg;
             while ((msg = check_message(&s->replicas[i]->mod))) {
                 struct response *r = change_replica_type(s, &s->replicas[i]->mod, msg, i);
                 free_message(msg, r);
+                replicas_changed = true;
             }
         }
 
@@ -266,6 +475,7 @@ static void *writer(void *arg)
         while ((msg = (struct msg_universal *) check_message(&s->mod))) {
             struct response *r = NULL;
             if (strncasecmp(msg->text, "delete-port ", strlen("delete-port ")) == 0) {
+                replicas_changed = true;
                 char *port_spec = msg->text + strlen("delete-port ");
                 int index = -1;
                 if (isdigit(port_spec[0])) {
@@ -289,12 +499,16 @@ static void *writer(void *arg)
                     }
                 }
                 if (index >= 0) {
+#ifndef WIN32
+                    shards_quiesce(s); // senders may still use the replica
+#endif
                     hd_rum_decompress_remove_port(s->decompress, index);
                     delete s->replicas[index];
                     s->replicas.erase(s->replicas.begin() + index);
                     log_msg(LOG_LEVEL_NOTICE, "Deleted output port %d.\n", index);
                 }
             } else if (strncasecmp(msg->text, "create-port", strlen("create-port")) == 0) {
+                replicas_changed = true;
                 // format of parameters is either:
                 // <host>:<port> [<compression>]
                 // or (for compat with older CoUniverse version)
@@ -364,6 +578,12 @@ static void *writer(void *arg)
                     hd_rum_decompress_set_active(s->decompress, rep->recompress, false);
                     log_msg(LOG_LEVEL_NOTICE, "Created new forwarding output port %s:%d.\n", host, tx_port);
                 }
+            } else if (strcasecmp(msg->text, "list-encoders") == 0) {
+                // groups of ports sharing one encoder - control socket messages
+                // are delivered asynchronously so the list is sent as an event
+                string list = recompress_list_encoders();
+                control_report_event(s->control_state, "encoders " + list);
+                r = new_response(RESPONSE_OK, list.c_str());
             } else {
                 r = new_response(RESPONSE_BAD_REQUEST, NULL);
             }
@@ -371,22 +591,41 @@ static void *writer(void *arg)
             free_message((struct message *) msg, r ? r : new_response(RESPONSE_OK, NULL));
         }
 
+#ifndef WIN32
+        if (replicas_changed) {
+            shards_assign(s);
+        }
+#else
+        UNUSED(replicas_changed);
+#endif
+
         // then process incoming packets
+#ifndef WIN32
+        int unpublished = 0;
+#endif
         while (s->qhead != s->qtail) {
             if(s->qhead->size == 0) { // poisoned pill
+#ifndef WIN32
+                shards_stop(s);
+#endif
                 return NULL;
             }
 
-            // pass it for transcoding if needed
-            if (hd_rum_decompress_get_num_active_ports(s->decompress) > 0) {
-                ssize_t ret = hd_rum_decompress_write(s->decompress, s->qhead->buf, s->qhead->size);
+            bool transcode = hd_rum_decompress_get_num_active_ports(s->decompress) > 0;
+
+            // distribute it to output ports that don't need transcoding
+#ifdef WIN32
+            // pass a copy for transcoding if needed, the buffer itself is
+            // owned by the asynchronous sends
+            if (transcode) {
+                char *copy = qbuf_alloc();
+                memcpy(copy, s->qhead->buf, s->qhead->size);
+                ssize_t ret = hd_rum_decompress_write(s->decompress, copy - RTP_PACKET_HEADER_SIZE, s->qhead->size);
                 if (ret < 0) {
                     perror("hd_rum_decompress_write");
                 }
             }
 
-            // distribute it to output ports that don't need transcoding
-#ifdef WIN32
             // send it asynchronously in MSW (performance optimalization)
             SleepEx(0, TRUE); // allow system to call our completion routines in APC
             int ref = 0;
@@ -411,24 +650,32 @@ static void *writer(void *arg)
                 }
             }
             // reallocate the buffer since the last one will be freeed automaticaly
-            s->qhead->buf = (char *) malloc(SIZE);
+            s->qhead->buf = qbuf_alloc();
+            s->qhead = s->qhead->next;
 #else
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ssize_t ret = udp_send(s->replicas[i]->sock, s->qhead->buf, s->qhead->size);
-                    if (ret < 0) {
-                        perror("Hd-rum-translator send");
-                    }
-                }
+            // the senders (and the transcoder) get the item, the writer holds
+            // one reference until the item is published
+            struct item *it = s->qhead;
+            it->transcode = transcode;
+            it->refs.store(s->active_shards.size() + 1, memory_order_relaxed);
+            it->busy.store(true, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            s->qhead = s->qhead->next;
+            item_release(s, it);
+            if (++unpublished == SHARD_PUBLISH_INTERVAL) {
+                shards_publish(s);
+                unpublished = 0;
             }
 #endif
-            s->qhead = s->qhead->next;
 
             pthread_mutex_lock(&s->qfull_mtx);
             s->qfull = 0;
             pthread_cond_signal(&s->qfull_cond);
             pthread_mutex_unlock(&s->qfull_mtx);
         }
+#ifndef WIN32
+        shards_publish(s);
+#endif
 
         pthread_mutex_lock(&s->qempty_mtx);
         if (s->qempty)
@@ -449,6 +696,7 @@ static void usage(const char *progname) {
                 s::bold << "\t\t--blend" << s::reset << " - enable blending from original to newly received stream, increases latency\n" <<
                 s::bold << "\t\t--conference <width>:<height>[:fps]" << s::reset << " - enable combining of multiple inputs, increases latency\n" <<
                 s::bold << "\t\t--capture-filter <cfg_string>" << s::reset << " - apply video capture filter to incoming video\n" <<
+                s::bold << "\t\t--sender-threads <n>" << s::reset << " - number of threads forwarding packets (default: half of CPU cores, max. 4)\n" <<
                 s::bold << "\t\t--help\n" << s::reset <<
                 s::bold << "\t\t--verbose\n" << s::reset <<
                 s::bold << "\t\t-v" << s::reset << " - print version\n";
@@ -487,6 +735,7 @@ struct cmdline_parameters {
     struct hd_rum_output_conf out_conf = {NORMAL, NULL};
     const char *capture_filter = NULL;
     bool verbose = false;
+    int sender_threads = max(1, min(4, (int) thread::hardware_concurrency() / 2));
 };
 
 /**
@@ -516,6 +765,12 @@ static bool parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
             parsed->out_conf.arg = item;
         } else if(strcmp(argv[start_index], "--capture-filter") == 0) {
             parsed->capture_filter = argv[++start_index];
+        } else if(strcmp(argv[start_index], "--sender-threads") == 0) {
+            parsed->sender_threads = atoi(argv[++start_index]);
+            if (parsed->sender_threads <= 0) {
+                fprintf(stderr, "Error: invalid number of sender threads\n");
+                exit(EXIT_FAIL_USAGE);
+            }
         } else if(strcmp(argv[start_index], "--help") == 0) {
             usage(argv[0]);
             return false;
@@ -633,6 +888,32 @@ static string format_port_list(struct hd_rum_translator_state *s)
     return oss.str();
 }
 
+#ifndef WIN32
+/**
+ * Formats per-port forwarding statistics (in the order of port list) - packets
+ * dropped since last report and maximal sender queue depth. New drops are
+ * also logged.
+ */
+static string format_port_stats(struct hd_rum_translator_state *s)
+{
+    string drops, depths;
+    for (auto it : s->replicas) {
+        unsigned long long dropped = it->dropped_pkts;
+        unsigned long long new_drops = dropped - it->reported_drops;
+        int depth = it->max_queue_depth.exchange(0);
+        it->reported_drops = dropped;
+        if (new_drops > 0) {
+            log_msg(LOG_LEVEL_WARNING, "Port %s: %llu packets dropped (sender queue up to %d packets).\n",
+                    it->mod.name, new_drops, depth);
+        }
+        drops += (drops.empty() ? "" : ",") + to_string(new_drops);
+        depths += (depths.empty() ? "" : ",") + to_string(depth);
+    }
+
+    return "portDrops " + drops + " portQueueDepth " + depths;
+}
+#endif
+
 int main(int argc, char **argv)
 {
     struct hd_rum_translator_state state;
@@ -709,6 +990,8 @@ int main(int argc, char **argv)
     }
 
     state.qhead = state.qtail = state.queue = qinit(qsize);
+    state.qsize = qsize;
+    state.sender_threads = params.sender_threads;
 
     /* input socket */
     if ((sock_in = udp_init_if("localhost", NULL, params.port, 0, 255, false, false)) == NULL) {
@@ -795,6 +1078,7 @@ int main(int argc, char **argv)
     while (!should_exit) {
         struct timeval timeout = { 1, 0 };
         while (state.qtail->next != state.qhead
+               && !state.qtail->busy.load(memory_order_acquire)
                && (state.qtail->size = udp_recv_timeout(sock_in, state.qtail->buf, SIZE, &timeout)) > 0
                && !should_exit) {
             received_data += state.qtail->size;
@@ -817,6 +1101,9 @@ int main(int argc, char **argv)
                 string statline = "FWD receivedBytes " + to_string(received_data) + " receivedPackets " + to_string(received_pkts) + " timestamp " + to_string(time_since_epoch_in_ms());
                 if (!port_list.empty()) {
                     statline += " portList " + format_port_list(&state);
+#ifndef WIN32
+                    statline += " " + format_port_stats(&state);
+#endif
                 }
                 control_report_stats(state.control_state, statline);
                 log_msg(LOG_LEVEL_INFO, "Received %llu bytes in %g seconds = %llu B/s.\n", cur_data, seconds, bps);
@@ -842,6 +1129,11 @@ int main(int argc, char **argv)
     }
 
     // pass poisoned pill to the worker
+    pthread_mutex_lock(&state.qfull_mtx);
+    while (state.qtail->next == state.qhead || state.qtail->busy.load(memory_order_acquire)) {
+        pthread_cond_wait(&state.qfull_cond, &state.qfull_mtx);
+    }
+    pthread_mutex_unlock(&state.qfull_mtx);
     state.qtail->size = 0;
     state.qtail = state.qtail->next;
 
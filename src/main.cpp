@@ -954,6 +954,10 @@ int main(int argc, char *argv[])
                 log_msg(LOG_LEVEL_WARNING, "Cannot set console output buffering!\n");
         }
 
+        if (!log_init_async()) {
+                return EXIT_FAIL_USAGE;
+        }
+
         // default values for different RXTX protocols
         if (strcmp(video_protocol, "rtsp") == 0 || strcmp(video_protocol, "sdp") == 0) {
                 if (audio_codec == nullptr) {
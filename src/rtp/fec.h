@@ -50,6 +50,12 @@ struct fec {
         virtual std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame>) = 0;
         virtual void decode(char *in, int in_len, char **out, int *len,
                         const std::map<int, int> &) = 0;
+        /**
+         * Extracts payload from a buffer that has been received completely,
+         * without running the actual decoding (codes are systematic).
+         * *len is set to 0 if the buffer is malformed.
+         */
+        virtual void decode_complete(char *in, int in_len, char **out, int *len) = 0;
         virtual ~fec() {}
 
         static fec *create_from_config(const char *str);
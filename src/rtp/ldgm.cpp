@@ -54,9 +54,14 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <dirent.h>
 #include <iomanip>
 #include <iostream>
+#include <list>
+#include <mutex>
 #include <sstream>
+#include <tuple>
+#include <vector>
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
@@ -72,6 +77,7 @@
 #include "host.h"
 #include "ldgm.h"
 #include "lib_common.h"
+#include "utils/worker.h"
 
 #include "ldgm/src/ldgm-session.h"
 #include "ldgm/src/ldgm-session-cpu.h"
@@ -166,20 +172,130 @@ static bool file_exists(char *filename)
         return true;
 }
 
-void ldgm::set_params(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
+#define DEFAULT_LDGM_CACHE_SIZE 16
+
+ADD_TO_PARAM(ldgm_cache_size, "ldgm-cache-size", "* ldgm-cache-size=<n>\n"
+                "  number of LDGM matrices and idle coding sessions kept in memory (default: 16),\n"
+                "  0 disables caching (matrices from ldgm-matrix-store are still used)\n");
+ADD_TO_PARAM(ldgm_matrix_store, "ldgm-matrix-store", "* ldgm-matrix-store=<dir>\n"
+                "  directory with precomputed LDGM matrices (ldgm_matrix-<k>-<m>-<c>-<seed>.bin), all\n"
+                "  of them are loaded at startup; newly generated matrices are stored there as well\n");
+
+namespace {
+typedef tuple<unsigned int, unsigned int, unsigned int, unsigned int> ldgm_key; // k, m, c, seed
+
+struct ldgm_matrix {
+        vector<int> pcm;
+        unsigned int columns;
+};
+
+/**
+ * Process-wide cache of parity matrices and of coding sessions of destroyed
+ * ldgm instances, both keyed by (k, m, c, seed). Changing FEC parameters
+ * (adaptive FEC on sender, new fec_desc on receiver) thus doesn't need to
+ * generate the matrix or read it from disk again if the configuration was
+ * used recently. Matrices from the ldgm-matrix-store directory are loaded
+ * when the cache is first used and never evicted.
+ */
+class ldgm_cache {
+public:
+        static ldgm_cache &instance() {
+                static ldgm_cache instance;
+                return instance;
+        }
+        shared_ptr<const ldgm_matrix> get_matrix(ldgm_key const &key);
+        shared_ptr<LDGM_session> take_session(ldgm_key const &key);
+        void put_session(ldgm_key const &key, shared_ptr<LDGM_session> session);
+
+private:
+        ldgm_cache();
+        static shared_ptr<const ldgm_matrix> load_matrix(const char *filename, ldgm_key const &key);
+        void load_store();
+        string matrix_dir();
+
+        mutex m_lock;
+        size_t m_capacity = DEFAULT_LDGM_CACHE_SIZE; ///< 0 - nothing is cached
+        string m_store_dir;
+        map<ldgm_key, shared_ptr<const ldgm_matrix>> m_store;
+        list<pair<ldgm_key, shared_ptr<const ldgm_matrix>>> m_matrices; ///< most recently used first
+        list<pair<ldgm_key, shared_ptr<LDGM_session>>> m_sessions; ///< most recently used first
+};
+
+ldgm_cache::ldgm_cache()
 {
-        m_k = k;
-        m_m = m;
-        m_c = c;
-        m_seed = seed;
+        if (const char *size = get_commandline_param("ldgm-cache-size")) {
+                char *end;
+                errno = 0;
+                long val = strtol(size, &end, 10);
+                if (end == size || *end != '\0' || errno != 0 || val < 0) {
+                        log_msg(LOG_LEVEL_ERROR, "[LDGM] Wrong ldgm-cache-size \"%s\", using default %d.\n",
+                                        size, DEFAULT_LDGM_CACHE_SIZE);
+                } else {
+                        m_capacity = val;
+                }
+        }
+        if (get_commandline_param("ldgm-matrix-store")) {
+                m_store_dir = get_commandline_param("ldgm-matrix-store");
+                load_store();
+        }
+}
 
-        m_coding_session->set_params(k, m, c);
+shared_ptr<const ldgm_matrix> ldgm_cache::load_matrix(const char *filename, ldgm_key const &key)
+{
+        unsigned int k, m, columns;
+        int *pcm;
+        try {
+                pcm = LDGM_session::read_pcMatrix(filename, &k, &m, &columns);
+        } catch (string const &err) {
+                log_msg(LOG_LEVEL_ERROR, "[LDGM] %s: %s\n", filename, err.c_str());
+                return {};
+        }
+        if (k != get<0>(key) || m != get<1>(key)) {
+                log_msg(LOG_LEVEL_ERROR, "[LDGM] %s: size mismatch (%ux%u).\n", filename, k, m);
+                free(pcm);
+                return {};
+        }
+        auto matrix = make_shared<ldgm_matrix>();
+        matrix->pcm.assign(pcm, pcm + m * columns);
+        matrix->columns = columns;
+        free(pcm);
+        return matrix;
+}
 
-        char filename[512];
-        char path[256];
+void ldgm_cache::load_store()
+{
+        DIR *dir = opendir(m_store_dir.c_str());
+        if (!dir) {
+                log_msg(LOG_LEVEL_WARNING, "[LDGM] Unable to open matrix store %s: %s\n",
+                                m_store_dir.c_str(), strerror(errno));
+                return;
+        }
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL) {
+                unsigned int k, m, c, seed;
+                char suffix[5] = "";
+                if (sscanf(ent->d_name, "ldgm_matrix-%u-%u-%u-%u%4s", &k, &m, &c, &seed, suffix) != 5 ||
+                                strcmp(suffix, ".bin") != 0) {
+                        continue;
+                }
+                ldgm_key key{k, m, c, seed};
+                auto matrix = load_matrix((m_store_dir + "/" + ent->d_name).c_str(), key);
+                if (matrix) {
+                        m_store[key] = matrix;
+                }
+        }
+        closedir(dir);
+        log_msg(LOG_LEVEL_INFO, "[LDGM] Loaded %zu precomputed matrices from %s.\n",
+                        m_store.size(), m_store_dir.c_str());
+}
 
-        int res;
+string ldgm_cache::matrix_dir()
+{
+        if (!m_store_dir.empty()) {
+                return m_store_dir + "/";
+        }
 
+        char path[256];
 #ifdef WIN32
         TCHAR tmpPath[MAX_PATH];
         UINT ret = GetTempPath(MAX_PATH, tmpPath);
@@ -191,8 +307,7 @@ void ldgm::set_params(unsigned int k, unsigned int m, unsigned int c, unsigned i
 #else
         snprintf(path, 256, "/var/tmp/ultragrid-%d/", (int) getuid());
 #endif
-
-        res = platform_mkdir(path);
+        int res = platform_mkdir(path);
         if(res != 0) {
                 if(errno != EEXIST) {
                         perror("mkdir");
@@ -200,25 +315,106 @@ void ldgm::set_params(unsigned int k, unsigned int m, unsigned int c, unsigned i
                         throw 1;
                 }
         }
-        snprintf(filename, 512, "%s/ldgm_matrix-%u-%u-%u-%u.bin", path, k, m, c, seed);
+        return path;
+}
+
+/**
+ * @throws 1 if the matrix cannot be generated or loaded
+ */
+shared_ptr<const ldgm_matrix> ldgm_cache::get_matrix(ldgm_key const &key)
+{
+        lock_guard<mutex> lk(m_lock);
+        auto stored = m_store.find(key);
+        if (stored != m_store.end()) {
+                return stored->second;
+        }
+        for (auto it = m_matrices.begin(); it != m_matrices.end(); ++it) {
+                if (it->first == key) {
+                        m_matrices.splice(m_matrices.begin(), m_matrices, it);
+                        return it->second;
+                }
+        }
+
+        char filename[512];
+        snprintf(filename, 512, "%s/ldgm_matrix-%u-%u-%u-%u.bin", matrix_dir().c_str(),
+                        get<0>(key), get<1>(key), get<2>(key), get<3>(key));
         if(!file_exists(filename)) {
-                int ret = generate_ldgm_matrix(filename, k, m, c, seed, 0);
+                int ret = generate_ldgm_matrix(filename, get<0>(key), get<1>(key), get<2>(key), get<3>(key), 0);
                 if(ret != 0) {
                         fprintf(stderr, "[LDGM] Unable to initialize LDGM matrix.\n");
                         throw 1;
                 }
         }
+        auto matrix = load_matrix(filename, key);
+        if (!matrix) {
+                throw 1;
+        }
+        if (m_capacity > 0) {
+                m_matrices.emplace_front(key, matrix);
+                if (m_matrices.size() > m_capacity) {
+                        m_matrices.pop_back();
+                }
+        }
+        return matrix;
+}
+
+shared_ptr<LDGM_session> ldgm_cache::take_session(ldgm_key const &key)
+{
+        lock_guard<mutex> lk(m_lock);
+        for (auto it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+                if (it->first == key) {
+                        auto session = move(it->second);
+                        m_sessions.erase(it);
+                        return session;
+                }
+        }
+        return {};
+}
+
+void ldgm_cache::put_session(ldgm_key const &key, shared_ptr<LDGM_session> session)
+{
+        if (m_capacity == 0) {
+                return;
+        }
+        lock_guard<mutex> lk(m_lock);
+        m_sessions.emplace_front(key, move(session));
+        if (m_sessions.size() > m_capacity) {
+                m_sessions.pop_back();
+        }
+}
+} // end of anonymous namespace
 
-        m_coding_session->set_pcMatrix(filename);
+void ldgm::set_params(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
+{
+        m_k = k;
+        m_m = m;
+        m_c = c;
+        m_seed = seed;
+
+        m_coding_session->set_params(k, m, c);
+
+        auto matrix = ldgm_cache::instance().get_matrix(ldgm_key{k, m, c, seed});
+        m_coding_session->set_pcm(matrix->pcm.data(), matrix->columns);
 }
 
 ADD_TO_PARAM(ldgm_device, "ldgm-device", "* ldgm-device={CPU|GPU}\n"
                 "  specify whether use CPU or GPU for LDGM\n");
+ADD_TO_PARAM(ldgm_cpu_simd, "ldgm-cpu-simd", "* ldgm-cpu-simd={sse2|avx2|avx512}\n"
+                "  force XOR kernel used by CPU LDGM (default: best supported)\n");
 
 void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
 {
         bool ldgm_device_gpu = false;
 
+        m_coding_session = ldgm_cache::instance().take_session(ldgm_key{k, m, c, seed});
+        if (m_coding_session) {
+                m_k = k;
+                m_m = m;
+                m_c = c;
+                m_seed = seed;
+                return;
+        }
+
         if (get_commandline_param("ldgm-device")) {
             ldgm_device_gpu = strcasecmp(get_commandline_param("ldgm-device"), "GPU") == 0;
         }
@@ -236,7 +432,20 @@ void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int see
 
                 }
         } else {
-                m_coding_session = unique_ptr<LDGM_session>(new LDGM_session_cpu());
+                // the kernel is process-wide, select it only once
+                static once_flag xor_impl_set;
+                call_once(xor_impl_set, []{
+                        const char *simd = get_commandline_param("ldgm-cpu-simd");
+                        if (simd && !LDGM_session_cpu::set_xor_impl(simd)) {
+                                log_msg(LOG_LEVEL_WARNING, "[LDGM] XOR kernel %s not supported, using %s.\n",
+                                                simd, LDGM_session_cpu::get_xor_impl());
+                        }
+                });
+                auto session = new LDGM_session_cpu();
+                session->set_parallel_for([](int count, const function<void(int, int)> &fn) {
+                                parallel_for(0, count, fn);
+                                });
+                m_coding_session = unique_ptr<LDGM_session>(session);
         }
 
         set_params(k, m, c, seed);
@@ -247,12 +456,37 @@ ldgm::ldgm(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
         init(k, m, c, seed);
 }
 
+ldgm::~ldgm()
+{
+        if (m_coding_session) {
+                ldgm_cache::instance().put_session(ldgm_key{m_k, m_m, m_c, m_seed}, move(m_coding_session));
+        }
+}
+
 void ldgm::decode(char *frame, int size, char **out, int *out_size, const map<int, int> &packets) {
         char *decoded;
         decoded = m_coding_session->decode_frame(frame, size, out_size, packets);
         *out = decoded;
 }
 
+void ldgm::decode_complete(char *frame, int size, char **out, int *out_size) {
+        // buffer starts with the header written by LDGM_session::encode_hdr_frame(),
+        // its first int32 is the frame size
+        static_assert(LDGM_session::HEADER_SIZE >= sizeof(int32_t), "LDGM header doesn't hold frame size");
+        if (size < LDGM_session::HEADER_SIZE) {
+                *out_size = 0;
+                return;
+        }
+        int32_t frame_size;
+        memcpy(&frame_size, frame, sizeof frame_size);
+        if (frame_size < 0 || frame_size > size - LDGM_session::HEADER_SIZE) {
+                *out_size = 0;
+                return;
+        }
+        *out_size = frame_size;
+        *out = frame + LDGM_session::HEADER_SIZE;
+}
+
 //////////////////////////////////
 // ENCODER
 //////////////////////////////////
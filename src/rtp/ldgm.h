@@ -55,10 +55,12 @@ struct ldgm : public fec{
         ldgm(unsigned int k, unsigned int m, unsigned int c, unsigned int seed);
         ldgm(int packet_size, int frame_size, double max_expected_loss);
         ldgm(const char *cfg);
+        ~ldgm();
         void set_params(unsigned int k, unsigned int m, unsigned int c, unsigned int seed);
         std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame>);
         void decode(char *in, int in_len, char **out, int *len,
                 const std::map<int, int> &);
+        void decode_complete(char *in, int in_len, char **out, int *len);
 
 private:
         void init(unsigned int k, unsigned int m, unsigned int c, unsigned int seed = DEFAULT_LDGM_SEED);
@@ -54,25 +54,40 @@
 #include "compat/vsnprintf.h"
 #include "net_udp.h"
 #include "rtp.h"
+#include "utils/metrics.h"
 #include "utils/net.h"
 
 #ifdef NEED_ADDRINFO_H
 #include "addrinfo.h"
 #endif
 
+#ifdef HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+
 #include <algorithm>
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 using std::condition_variable;
 using std::max;
+using std::min;
 using std::mutex;
 using std::queue;
 using std::unique_lock;
+using std::vector;
 
 #define DEFAULT_MAX_UDP_READER_QUEUE_LEN (1920/3*8*1080/1152) //< 10-bit FullHD frame divided by 1280 MTU packets (minus headers)
+#define DEFAULT_UDP_MMSG_BATCH 32 ///< datagrams read by one recvmmsg() call
+#define DEFAULT_UDP_MMSG_SLAB (4 * DEFAULT_UDP_MMSG_BATCH) ///< spare preallocated packet buffers
+#define UDP_READER_STATS_INTERVAL_SEC 5
+#define DEFAULT_UDP_MMSG_SEND_BATCH 64 ///< max datagrams passed to one sendmmsg() call
+#define UDP_MAX_SENDV_IOV 3 ///< max iovec count passed to udp_sendv() (RTP header, payload header, data)
+#define UDP_GSO_MAX_SEGMENTS 64
+#define UDP_GSO_MAX_LEN 65000 ///< max length of GSO super-datagram (must fit in IP datagram)
 
 static int resolve_address(socket_udp *s, const char *addr, uint16_t tx_port);
 static void *udp_reader(void *arg);
@@ -155,6 +170,20 @@ struct socket_udp_local {
 
         bool should_exit;
         fd_t should_exit_fd[2];
+
+        // batched receiving (recvmmsg), valid only if multithreaded
+        unsigned int mmsg_batch; ///< max datagrams per syscall, <= 1 disables batching
+        unsigned int slab_size;  ///< number of spare packet buffers kept preallocated
+        vector<uint8_t *> slab;  ///< spare packet buffers, accessed only by reader thread
+
+        // reader statistics, accessed only by reader thread
+        unsigned long long stat_packets;
+        unsigned long long stat_syscalls;
+        std::chrono::steady_clock::time_point stat_since;
+
+        bool gso; ///< kernel supports UDP_SEGMENT and it is enabled
+
+        unsigned long long injected_dropped; ///< udp_inject_data() packets dropped on full queue, guarded by lock
 };
 
 /*
@@ -174,6 +203,17 @@ struct _socket_udp {
         bool overlapping_active;
         int overlapped_max;
         int overlapped_count;
+#elif defined HAVE_SENDMMSG
+        // batched sending between udp_async_start() and udp_async_wait()
+        bool mmsg_active;
+        int mmsg_count;
+        vector<struct mmsghdr> mmsg_hdrs;
+        vector<struct iovec> mmsg_iovecs; ///< UDP_MAX_SENDV_IOV per message
+        vector<void *> mmsg_dispose;
+        // GSO aggregates built from mmsg_hdrs upon flush
+        vector<struct mmsghdr> gso_hdrs;
+        vector<struct iovec> gso_iovecs;
+        vector<char> gso_cmsgs;
 #endif
 };
 
@@ -658,6 +698,18 @@ socket_udp *udp_init(const char *addr, uint16_t rx_port, uint16_t tx_port,
 ADD_TO_PARAM(udp_queue_len, "udp-queue-len",
                 "* udp-queue-len=<l>\n"
                 "  Use different queue size than default DEFAULT_MAX_UDP_READER_QUEUE_LEN\n");
+ADD_TO_PARAM(udp_mmsg_batch, "udp-mmsg-batch",
+                "* udp-mmsg-batch=<n>\n"
+                "  Read up to <n> datagrams with one recvmmsg() call in receiver thread (default DEFAULT_UDP_MMSG_BATCH, 1 disables)\n");
+ADD_TO_PARAM(udp_mmsg_send_batch, "udp-mmsg-send-batch",
+                "* udp-mmsg-send-batch=<n>\n"
+                "  Send up to <n> datagrams with one sendmmsg() call when sending video (default DEFAULT_UDP_MMSG_SEND_BATCH, 1 disables)\n");
+ADD_TO_PARAM(udp_disable_gso, "udp-disable-gso",
+                "* udp-disable-gso\n"
+                "  Do not use UDP segmentation offload (UDP_SEGMENT) for batched sending\n");
+ADD_TO_PARAM(udp_mmsg_slab, "udp-mmsg-slab",
+                "* udp-mmsg-slab=<n>\n"
+                "  Number of spare packet buffers preallocated by receiver thread (default DEFAULT_UDP_MMSG_SLAB)\n");
 /**
  * udp_init_if:
  * Creates a session for sending and receiving UDP datagrams over IP
@@ -808,6 +860,14 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 abort();
         }
 
+#if defined HAVE_SENDMMSG && defined UDP_SEGMENT
+        if (!get_commandline_param("udp-disable-gso")) {
+                // probe only - the segment size is passed per message in cmsg
+                int gso_size = 0;
+                s->local->gso = SETSOCKOPT(s->local->fd, SOL_UDP, UDP_SEGMENT, (sockopt_t) &gso_size, sizeof gso_size) == 0;
+        }
+#endif
+
         s->local->multithreaded = multithreaded;
         if (multithreaded) {
                 if (!get_commandline_param("udp-queue-len")) {
@@ -815,6 +875,19 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 } else {
                         s->local->max_packets = atoi(get_commandline_param("udp-queue-len"));
                 }
+#ifdef HAVE_RECVMMSG
+                s->local->mmsg_batch = DEFAULT_UDP_MMSG_BATCH;
+                s->local->slab_size = DEFAULT_UDP_MMSG_SLAB;
+                if (get_commandline_param("udp-mmsg-batch")) {
+                        s->local->mmsg_batch = max(atoi(get_commandline_param("udp-mmsg-batch")), 1);
+                }
+                if (get_commandline_param("udp-mmsg-slab")) {
+                        s->local->slab_size = max(atoi(get_commandline_param("udp-mmsg-slab")), 0);
+                }
+#else
+                s->local->mmsg_batch = 1;
+                s->local->slab_size = 0;
+#endif
                 platform_pipe_init(s->local->should_exit_fd);
                 pthread_create(&s->local->thread_id, NULL, udp_reader, s);
         }
@@ -940,6 +1013,72 @@ int udp_sendto(socket_udp * s, char *buffer, int buflen, struct sockaddr *dst_ad
         return sendto(s->local->fd, buffer, buflen, 0, dst_addr, addrlen);
 }
 
+#define UDP_SEND_NONBLOCK_BATCH 64
+
+/**
+ * Sends count datagrams to the socket destination without blocking, using
+ * sendmmsg() if available.
+ *
+ * Datagrams that would block are not sent, a datagram that fails to be sent
+ * for other reason (eg. ICMP port unreachable reported) is skipped.
+ *
+ * @returns number of datagrams actually passed to the kernel
+ */
+int udp_send_nonblock_batch(socket_udp *s, char **buffers, const int *sizes, int count)
+{
+        assert(s != NULL);
+
+        int sent = 0;
+#ifdef WIN32
+        for (int i = 0; i < count; ++i) {
+                if (udp_send(s, buffers[i], sizes[i]) > 0) {
+                        sent += 1;
+                }
+        }
+#elif defined HAVE_SENDMMSG
+        struct mmsghdr msgs[UDP_SEND_NONBLOCK_BATCH];
+        struct iovec iov[UDP_SEND_NONBLOCK_BATCH];
+        int i = 0;
+        while (i < count) {
+                int n = std::min(count - i, UDP_SEND_NONBLOCK_BATCH);
+                memset(msgs, 0, n * sizeof msgs[0]);
+                for (int j = 0; j < n; ++j) {
+                        iov[j].iov_base = buffers[i + j];
+                        iov[j].iov_len = sizes[i + j];
+                        msgs[j].msg_hdr.msg_name = (void *) &s->sock;
+                        msgs[j].msg_hdr.msg_namelen = s->sock_len;
+                        msgs[j].msg_hdr.msg_iov = &iov[j];
+                        msgs[j].msg_hdr.msg_iovlen = 1;
+                }
+                int ret = sendmmsg(s->local->fd, msgs, n, MSG_DONTWAIT);
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                                break;
+                        }
+                        i += 1; // skip the failing datagram
+                        continue;
+                }
+                sent += ret;
+                i += ret;
+        }
+#else
+        for (int i = 0; i < count; ++i) {
+                ssize_t ret = sendto(s->local->fd, buffers[i], sizes[i], MSG_DONTWAIT,
+                                (struct sockaddr *) &s->sock, s->sock_len);
+                if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        break;
+                }
+                if (ret >= 0) {
+                        sent += 1;
+                }
+        }
+#endif
+        return sent;
+}
+
 #ifdef WIN32
 int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
 {
@@ -964,11 +1103,20 @@ int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
         }
 }
 #else
+#ifdef HAVE_SENDMMSG
+static int udp_sendv_batched(socket_udp * s, struct iovec *vector, int count, void *d);
+#endif
+
 int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 {
         struct msghdr msg;
 
         assert(s != NULL);
+#ifdef HAVE_SENDMMSG
+        if (s->mmsg_active) {
+                return udp_sendv_batched(s, vector, count, d);
+        }
+#endif
 
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
@@ -985,14 +1133,30 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 }
 #endif // WIN32
 
+static void udp_reader_stats(struct socket_udp_local *l, int packets, int syscalls)
+{
+        l->stat_packets += packets;
+        l->stat_syscalls += syscalls;
+
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(now - l->stat_since).count();
+        if (seconds < UDP_READER_STATS_INTERVAL_SEC) {
+                return;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, "[UDP reader] %.0f packets/s, %.0f syscalls/s (%.2f packets per syscall)\n",
+                        l->stat_packets / seconds, l->stat_syscalls / seconds,
+                        l->stat_syscalls ? (double) l->stat_packets / l->stat_syscalls : 0.0);
+        l->stat_packets = l->stat_syscalls = 0;
+        l->stat_since = now;
+}
+
 /**
- * When receiving data in separate thread, this function fetches data
- * from socket and puts it in queue.
+ * Waits until the socket is readable.
+ *
+ * @retval false if the reader should exit
  */
-static void *udp_reader(void *arg)
+static bool udp_reader_wait(socket_udp *s)
 {
-        socket_udp *s = (socket_udp *) arg;
-
         while (1) {
                 fd_set fds;
                 FD_ZERO(&fds);
@@ -1005,7 +1169,115 @@ static void *udp_reader(void *arg)
                         perror("select");
                         continue;
                 }
-                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
+                return !FD_ISSET(s->local->should_exit_fd[0], &fds);
+        }
+}
+
+#ifdef HAVE_RECVMMSG
+static uint8_t *udp_reader_get_buffer(struct socket_udp_local *l)
+{
+        if (l->slab.empty()) {
+                return (uint8_t *) malloc(RTP_MAX_PACKET_LEN);
+        }
+        uint8_t *ret = l->slab.back();
+        l->slab.pop_back();
+        return ret;
+}
+
+/**
+ * Batched variant of udp_reader() - reads up to mmsg_batch datagrams with one
+ * recvmmsg() call and enqueues them while holding the lock only once.
+ *
+ * Filled buffers are handed over to the consumer (which frees them as usual)
+ * and are replaced from the slab of spare buffers. The slab is refilled only
+ * when the socket has been drained, so that no allocation is performed while
+ * a burst of packets is being received.
+ */
+static void udp_reader_mmsg(socket_udp *s)
+{
+        struct socket_udp_local *l = s->local;
+        const unsigned int batch = l->mmsg_batch;
+        vector<struct mmsghdr> msgs(batch);
+        vector<struct iovec> iovecs(batch);
+        vector<uint8_t *> bufs(batch);
+
+        l->slab.reserve(l->slab_size);
+        for (unsigned int i = 0; i < batch; ++i) {
+                bufs[i] = udp_reader_get_buffer(l);
+        }
+
+        while (1) {
+                for (unsigned int i = 0; i < batch; ++i) {
+                        iovecs[i].iov_base = bufs[i] + RTP_PACKET_HEADER_SIZE;
+                        iovecs[i].iov_len = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+                        msgs[i].msg_hdr = msghdr{};
+                        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+
+                int count = recvmmsg(l->fd, msgs.data(), batch, MSG_DONTWAIT, NULL);
+                udp_reader_stats(l, max(count, 0), 1);
+                if (count <= 0) {
+                        if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                                socket_error("recvmmsg");
+                        }
+                        // socket drained - replenish spare buffers before blocking
+                        while (l->slab.size() < l->slab_size) {
+                                l->slab.push_back((uint8_t *) malloc(RTP_MAX_PACKET_LEN));
+                        }
+                        if (!udp_reader_wait(s)) {
+                                break;
+                        }
+                        udp_reader_stats(l, 0, 1);
+                        continue;
+                }
+
+                unique_lock<mutex> lk(l->lock);
+                l->reader_cv.wait(lk, [l]{return l->packets.size() < l->max_packets || l->should_exit;});
+                if (l->should_exit) {
+                        break;
+                }
+                for (int i = 0; i < count; ++i) {
+                        l->packets.emplace(bufs[i], (int) msgs[i].msg_len);
+                }
+                lk.unlock();
+                l->boss_cv.notify_one();
+
+                for (int i = 0; i < count; ++i) {
+                        bufs[i] = udp_reader_get_buffer(l);
+                }
+        }
+
+        for (auto buf : bufs) {
+                free(buf);
+        }
+        for (auto buf : l->slab) {
+                free(buf);
+        }
+        l->slab.clear();
+}
+#endif // defined HAVE_RECVMMSG
+
+/**
+ * When receiving data in separate thread, this function fetches data
+ * from socket and puts it in queue.
+ */
+static void *udp_reader(void *arg)
+{
+        socket_udp *s = (socket_udp *) arg;
+
+        s->local->stat_since = std::chrono::steady_clock::now();
+
+#ifdef HAVE_RECVMMSG
+        if (s->local->mmsg_batch > 1) {
+                udp_reader_mmsg(s);
+                platform_pipe_close(s->local->should_exit_fd[0]);
+                return NULL;
+        }
+#endif
+
+        while (1) {
+                if (!udp_reader_wait(s)) {
                         break;
                 }
                 uint8_t *packet = (uint8_t *) malloc(RTP_MAX_PACKET_LEN);
@@ -1023,6 +1295,7 @@ static void *udp_reader(void *arg)
                         socket_error("recvfrom");
                         continue;
                 }
+                udp_reader_stats(s->local, 1, 2);
 
                 unique_lock<mutex> lk(s->local->lock);
                 s->local->reader_cv.wait(lk, [s]{return s->local->packets.size() < s->local->max_packets || s->local->should_exit;});
@@ -1149,6 +1422,93 @@ int udp_recv_data(socket_udp * s, char **buffer)
         return ret;
 }
 
+/**
+ * Receives multiple datagrams from multithreaded socket at once.
+ *
+ * Unlike udp_recv_data(), the function doesn't block and the queue lock is
+ * taken only once for the whole batch.
+ *
+ * @param[in] s        UDP socket state
+ * @param[out] buffers received datagrams. Each must be freed by caller!
+ * @param[out] sizes   lengths of the received datagrams
+ * @param[in] max_count capacity of buffers and sizes
+ * @returns            number of received datagrams
+ */
+int udp_recv_data_batch(socket_udp * s, char **buffers, int *sizes, int max_count)
+{
+        assert(s->local->multithreaded);
+        int count = 0;
+        unique_lock<mutex> lk(s->local->lock);
+
+        while (count < max_count && !s->local->packets.empty()) {
+                auto it = s->local->packets.front();
+                buffers[count] = (char *) it.buf;
+                sizes[count] = it.size;
+                s->local->packets.pop();
+                count += 1;
+        }
+
+        lk.unlock();
+        if (count > 0) {
+                s->local->reader_cv.notify_one();
+        }
+
+        return count;
+}
+
+bool udp_is_multithreaded(socket_udp *s)
+{
+        return s->local->multithreaded;
+}
+
+/**
+ * Enqueues a datagram obtained by other means than reading the socket (eg.
+ * from a reflector running in the same process) as if it was received by
+ * the reader thread.
+ *
+ * Never blocks - the caller may be forwarding to other receivers as well. If
+ * the queue is full, the packet is dropped as the kernel would do with a
+ * datagram sent to the socket.
+ *
+ * @param s      multithreaded UDP socket (see udp_is_multithreaded())
+ * @param packet malloc'ed buffer of at least RTP_MAX_PACKET_LEN bytes with
+ *               the datagram starting at offset RTP_PACKET_HEADER_SIZE, the
+ *               socket takes ownership of it in any case
+ * @param size   length of the datagram
+ * @retval false packet was dropped (queue full or socket not multithreaded)
+ */
+bool udp_inject_data(socket_udp * s, char *packet, int size)
+{
+        if (!s->local->multithreaded) {
+                free(packet);
+                return false;
+        }
+        // the same as recvfrom() would do
+        size = min(size, RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE);
+
+        unique_lock<mutex> lk(s->local->lock);
+        if (s->local->should_exit) {
+                free(packet);
+                return true;
+        }
+        if (s->local->packets.size() >= s->local->max_packets) {
+                static struct metric *dropped = metric_counter("udp.injected_dropped");
+                metric_add(dropped, 1);
+                unsigned long long count = ++s->local->injected_dropped;
+                lk.unlock();
+                free(packet);
+                if (count % 1000 == 1) {
+                        log_msg(LOG_LEVEL_WARNING, "[NET UDP] Receive queue full, %llu injected packets dropped so far.\n", count);
+                }
+                return false;
+        }
+        s->local->packets.emplace((uint8_t *) packet, size);
+        lk.unlock();
+        s->local->boss_cv.notify_one();
+
+        return true;
+}
+
 #ifndef WIN32
 int udp_recvv(socket_udp * s, struct msghdr *m)
 {
@@ -1352,6 +1712,30 @@ int udp_set_send_buf(socket_udp *s, int size)
         return TRUE;
 }
 
+/**
+ * Sets maximal rate the kernel sends packets from the socket with. Works only
+ * if the kernel supports SO_MAX_PACING_RATE for UDP (requires fq qdisc).
+ *
+ * @param rate  rate in bytes per second, 0 means unlimited
+ */
+bool udp_set_pacing_rate(socket_udp *s, uint64_t rate)
+{
+#ifdef SO_MAX_PACING_RATE
+        // all ones is unlimited for the kernel - UINT32_MAX would be a real cap of ~34 Gbps
+        unsigned long val = rate == 0 ? ~0UL : rate;
+        if (SETSOCKOPT(s->local->fd, SOL_SOCKET, SO_MAX_PACING_RATE, (sockopt_t) &val, sizeof val) != 0) {
+                socket_error("setsockopt SO_MAX_PACING_RATE");
+                return false;
+        }
+        return true;
+#else
+        UNUSED(s);
+        UNUSED(rate);
+        log_msg(LOG_LEVEL_ERROR, "[NET UDP] SO_MAX_PACING_RATE is not supported!\n");
+        return false;
+#endif
+}
+
 /*
  * TODO: This should be definitely removed. We need to solve audio burst avoidance first.
  */
@@ -1380,10 +1764,143 @@ void udp_flush_recv_buf(socket_udp *s)
         free(buf);
 }
 
+#ifdef HAVE_SENDMMSG
+static size_t udp_msg_len(const struct msghdr *msg)
+{
+        size_t len = 0;
+        for (size_t i = 0; i < msg->msg_iovlen; ++i) {
+                len += msg->msg_iov[i].iov_len;
+        }
+        return len;
+}
+
+/**
+ * Merges runs of equally sized queued datagrams into UDP GSO super-datagrams
+ * (the last datagram of a run may be shorter).
+ *
+ * @returns number of messages in s->gso_hdrs
+ */
+static int udp_build_gso_batch(socket_udp *s)
+{
+        int out = 0;
+        int iov_used = 0;
+        for (int i = 0; i < s->mmsg_count; ) {
+                size_t seg_len = udp_msg_len(&s->mmsg_hdrs[i].msg_hdr);
+                size_t total = 0;
+                int j = i;
+                while (j < s->mmsg_count && j - i < UDP_GSO_MAX_SEGMENTS) {
+                        size_t len = udp_msg_len(&s->mmsg_hdrs[j].msg_hdr);
+                        if (len > seg_len || total + len > UDP_GSO_MAX_LEN) {
+                                break;
+                        }
+                        total += len;
+                        j += 1;
+                        if (len < seg_len) { // shorter segment terminates the run
+                                break;
+                        }
+                }
+
+                struct msghdr *msg = &s->gso_hdrs[out].msg_hdr;
+                *msg = msghdr{};
+                msg->msg_name = (void *) &s->sock;
+                msg->msg_namelen = s->sock_len;
+                msg->msg_iov = &s->gso_iovecs[iov_used];
+                for (int k = i; k < j; ++k) {
+                        const struct msghdr *src = &s->mmsg_hdrs[k].msg_hdr;
+                        memcpy(&s->gso_iovecs[iov_used], src->msg_iov, src->msg_iovlen * sizeof(struct iovec));
+                        iov_used += src->msg_iovlen;
+                        msg->msg_iovlen += src->msg_iovlen;
+                }
+                if (j - i > 1) {
+                        msg->msg_control = &s->gso_cmsgs[out * CMSG_SPACE(sizeof(uint16_t))];
+                        msg->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+                        struct cmsghdr *cm = CMSG_FIRSTHDR(msg);
+                        cm->cmsg_level = SOL_UDP;
+                        cm->cmsg_type = UDP_SEGMENT;
+                        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                        uint16_t gso_size = seg_len;
+                        memcpy(CMSG_DATA(cm), &gso_size, sizeof gso_size);
+                }
+                out += 1;
+                i = j;
+        }
+        return out;
+}
+
+static void udp_flush_batch(socket_udp *s)
+{
+        struct mmsghdr *msgs = s->mmsg_hdrs.data();
+        int count = s->mmsg_count;
+#ifdef UDP_SEGMENT
+        if (s->local->gso) {
+                count = udp_build_gso_batch(s);
+                msgs = s->gso_hdrs.data();
+        }
+#endif
+
+        int sent = 0;
+        while (sent < count) {
+                int ret = sendmmsg(s->local->fd, msgs + sent, count - sent, 0);
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+#ifdef UDP_SEGMENT
+                        if (s->local->gso && sent == 0 && (errno == EIO || errno == EINVAL)) {
+                                // segmentation not supported by the device/path - resend without it
+                                log_msg(LOG_LEVEL_WARNING, "[NET UDP] UDP GSO failed, disabling.\n");
+                                s->local->gso = false;
+                                udp_flush_batch(s);
+                                return;
+                        }
+#endif
+                        socket_error("sendmmsg");
+                        break;
+                }
+                sent += ret;
+        }
+
+        for (int i = 0; i < s->mmsg_count; ++i) {
+                free(s->mmsg_dispose[i]);
+        }
+        s->mmsg_count = 0;
+}
+
+/**
+ * Enqueues datagram to be sent by sendmmsg(). Neither the data pointed to by
+ * vector nor d may be altered or freed until udp_async_wait() is called.
+ */
+static int udp_sendv_batched(socket_udp * s, struct iovec *vector, int count, void *d)
+{
+        assert(count <= UDP_MAX_SENDV_IOV);
+
+        struct iovec *iov = &s->mmsg_iovecs[s->mmsg_count * UDP_MAX_SENDV_IOV];
+        memcpy(iov, vector, count * sizeof(struct iovec));
+        struct msghdr *msg = &s->mmsg_hdrs[s->mmsg_count].msg_hdr;
+        *msg = msghdr{};
+        msg->msg_name = (void *) &s->sock;
+        msg->msg_namelen = s->sock_len;
+        msg->msg_iov = iov;
+        msg->msg_iovlen = count;
+        s->mmsg_dispose[s->mmsg_count] = d;
+        s->mmsg_count += 1;
+
+        if (s->mmsg_count == (int) s->mmsg_hdrs.size()) {
+                udp_flush_batch(s);
+        }
+
+        return udp_msg_len(msg);
+}
+#endif // defined HAVE_SENDMMSG
+
 /**
  * By calling this function under MSW, caller indicates that following packets
  * can be send in asynchronous manner. Caller should then call udp_async_wait()
  * to ensure that all packets were actually sent.
+ *
+ * In Linux, following packets are collected and sent in batches with
+ * sendmmsg() (optionally merged with UDP GSO), the rest is flushed by
+ * udp_async_wait().
  */
 void udp_async_start(socket_udp *s, int nr_packets)
 {
@@ -1406,6 +1923,25 @@ void udp_async_start(socket_udp *s, int nr_packets)
 
         s->overlapped_count = 0;
         s->overlapping_active = true;
+#elif defined HAVE_SENDMMSG
+        int batch = DEFAULT_UDP_MMSG_SEND_BATCH;
+        if (get_commandline_param("udp-mmsg-send-batch")) {
+                batch = atoi(get_commandline_param("udp-mmsg-send-batch"));
+        }
+        batch = std::min(batch, nr_packets);
+        if (batch <= 1) {
+                return;
+        }
+        if ((int) s->mmsg_hdrs.size() != batch) {
+                s->mmsg_hdrs.resize(batch);
+                s->mmsg_iovecs.resize(batch * UDP_MAX_SENDV_IOV);
+                s->mmsg_dispose.resize(batch);
+                s->gso_hdrs.resize(batch);
+                s->gso_iovecs.resize(batch * UDP_MAX_SENDV_IOV);
+                s->gso_cmsgs.resize(batch * CMSG_SPACE(sizeof(uint16_t)));
+        }
+        s->mmsg_count = 0;
+        s->mmsg_active = true;
 #else
         UNUSED(nr_packets);
         UNUSED(s);
@@ -1434,6 +1970,27 @@ void udp_async_wait(socket_udp *s)
                 free(s->dispose_udata[i]);
         }
         s->overlapping_active = false;
+#elif defined HAVE_SENDMMSG
+        if (!s->mmsg_active) {
+                return;
+        }
+        udp_flush_batch(s);
+        s->mmsg_active = false;
+#else
+        UNUSED(s);
+#endif
+}
+
+/**
+ * Sends packets queued after udp_async_start() without ending the async
+ * section (Linux only, no-op otherwise).
+ */
+void udp_async_flush(socket_udp *s)
+{
+#if !defined WIN32 && defined HAVE_SENDMMSG
+        if (s->mmsg_active && s->mmsg_count > 0) {
+                udp_flush_batch(s);
+        }
 #else
         UNUSED(s);
 #endif
@@ -63,10 +63,13 @@ int         udp_recv_timeout(socket_udp *s, char *buffer, int buflen, struct tim
 int         udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_addr, socklen_t *addrlen);
 int         udp_send(socket_udp *s, char *buffer, int buflen);
 int         udp_sendto(socket_udp *s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen);
+int         udp_send_nonblock_batch(socket_udp *s, char **buffers, const int *sizes, int count);
 
 int         udp_recvv(socket_udp *s, struct msghdr *m);
 void        udp_async_start(socket_udp *s, int nr_packets);
 void        udp_async_wait(socket_udp *s);
+void        udp_async_flush(socket_udp *s);
+bool        udp_set_pacing_rate(socket_udp *s, uint64_t rate);
 #ifdef WIN32
 int         udp_sendv(socket_udp *s, LPWSABUF vector, int count, void *d);
 #else
@@ -96,7 +99,10 @@ void        udp_fd_set_r(socket_udp *s, struct udp_fd_r *);
 int         udp_fd_isset_r(socket_udp *s, struct udp_fd_r *);
 
 int         udp_recv_data(socket_udp * s, char **buffer);
+int         udp_recv_data_batch(socket_udp * s, char **buffers, int *sizes, int max_count);
 bool        udp_not_empty(socket_udp *s, struct timeval *timeout);
+bool        udp_inject_data(socket_udp *s, char *packet, int size);
+bool        udp_is_multithreaded(socket_udp *s);
 int         udp_port_pair_is_free(const char *addr, int force_ip_version, int even_port);
 bool        udp_is_ipv6(socket_udp *s);
 
@@ -10,7 +10,11 @@
  *           Dalibor Matura   <255899@mail.muni.cz>
  *           Ian Wesley-Smith <iwsmith@cct.lsu.edu>
  * 
- * This file implements a linked list for the playout buffer.
+ * This file implements the playout buffer. Frames are kept in RTP timestamp
+ * order, packets of a frame are stored in an array indexed by the sequence
+ * number delta, together with a bitmap of the occupied slots that is used to
+ * tell whether the frame was received completely. Frame nodes are recycled
+ * to avoid per-packet allocations.
  *
  * Copyright (c) 2003-2004 University of Southern California
  * Copyright (c) 2003-2004 University of Glasgow
@@ -63,26 +67,39 @@
 #include "rtp/ptime.h"
 #include "rtp/pbuf.h"
 
+#include <algorithm>
+#include <deque>
+#include <vector>
+
 #define PBUF_MAGIC	0xcafebabe
 
 #define STATS_INTERVAL 100
 
+/// number of empty slots kept in front of the first received packet of a
+/// frame so that slightly reordered frame beginnings do not shift the array
+#define PBUF_SEQ_HEADROOM 64
+/// maximal number of recycled frame nodes kept for reuse
+#define PBUF_POOL_MAX 16
+
 struct pbuf_node {
-        struct pbuf_node *nxt;
-        struct pbuf_node *prv;
         uint32_t rtp_timestamp; /* RTP timestamp for the frame           */
         std::chrono::high_resolution_clock::time_point arrival_time;    /* Arrival time of first packet in frame */
         std::chrono::high_resolution_clock::time_point playout_time;    /* Playout time for the frame            */
-        struct coded_data *cdata;       /*                                       */
+        uint16_t base_seq;      /* sequence number of pkts[0]            */
+        std::vector<struct coded_data> pkts; /* indexed by seqno - base_seq,
+                                                data == NULL if missing   */
+        std::vector<uint64_t> present; /* bitmap of occupied slots in pkts */
+        int pkt_count;          /* number of occupied slots in pkts      */
         int decoded;            /* Non-zero if we've decoded this frame  */
         int mbit;               /* determines if mbit of frame had been seen */
+        uint16_t mbit_seq;      /* seqno of the packet with mbit (if seen) */
         uint32_t magic;         /* For debugging                         */
         bool completed;
 };
 
 struct pbuf {
-        struct pbuf_node *frst;
-        struct pbuf_node *last;
+        std::deque<struct pbuf_node *> frames; ///< ordered by RTP timestamp
+        std::vector<struct pbuf_node *> pool;  ///< recycled frame nodes
         long long int playout_delay_us;
         volatile int *offset_ms;
 
@@ -97,60 +114,40 @@ struct pbuf {
         int last_rtp_seq;
         uint32_t last_display_ts;
         int longest_gap; // longest loss
+
+        // per-frame accounting (see frame_expected_pkts())
+        int last_removed_mbit_seq; ///< mbit seqno of the last removed frame, -1 if unknown
+        long long int lost_pkts_cum;
+        long long int incomplete_frames_cum;
 };
 
-static void free_cdata(struct coded_data *head);
 static int frame_complete(struct pbuf_node *frame);
 
 /*********************************************************************************/
 
 static void pbuf_validate(struct pbuf *playout_buf)
 {
-        /* Run through the entire playout buffer, checking pointers, etc.  */
+        /* Run through the entire playout buffer, checking ordering, etc.  */
         /* Only used in debugging mode, since it's a lot of overhead [csp] */
 #ifdef NDEF
-        struct pbuf_node *cpb, *ppb;
-        struct coded_data *ccd, *pcd;
+        struct pbuf_node *ppb = NULL;
 
-        cpb = playout_buf->frst;
-        ppb = NULL;
-        while (cpb != NULL) {
+        for (auto cpb : playout_buf->frames) {
                 assert(cpb->magic == PBUF_MAGIC);
-                assert(cpb->prv == ppb);
-                if (cpb->prv != NULL) {
-                        assert(cpb->prv->nxt == cpb);
+                if (ppb != NULL) {
                         /* stored in RTP timestamp order */
                         assert(cpb->rtp_timestamp > ppb->rtp_timestamp);
-                        /* stored in playout time order  */
-                        /* TODO: eventually check why is this assert always failng */
-                        // assert(tv_gt(cpb->ptime, ppb->ptime));  
                 }
-                if (cpb->nxt != NULL) {
-                        assert(cpb->nxt->prv == cpb);
-                } else {
-                        assert(cpb = playout_buf->last);
-                }
-                if (cpb->cdata != NULL) {
-                        /* We have coded data... check all the pointers on that list too */
-                        ccd = cpb->cdata;
-                        pcd = NULL;
-                        while (ccd != NULL) {
-                                assert(ccd->prv == pcd);
-                                if (ccd->prv != NULL) {
-                                        assert(ccd->prv->nxt == ccd);
-                                        /* list is descending - cant really check this now */
-                                        //assert(ccd->seqno < pcd->seqno); 
-                                        assert(ccd->data != NULL);
-                                }
-                                if (ccd->nxt != NULL) {
-                                        assert(ccd->nxt->prv == ccd);
-                                }
-                                pcd = ccd;
-                                ccd = ccd->nxt;
+                int occupied = 0;
+                for (unsigned int i = 0; i < cpb->pkts.size(); ++i) {
+                        assert(((cpb->present[i / 64] >> (i % 64)) & 1) == (cpb->pkts[i].data != NULL));
+                        if (cpb->pkts[i].data != NULL) {
+                                assert(cpb->pkts[i].seqno == (uint16_t) (cpb->base_seq + i));
+                                occupied += 1;
                         }
                 }
+                assert(occupied == cpb->pkt_count);
                 ppb = cpb;
-                cpb = cpb->nxt;
         }
 #else
         UNUSED(playout_buf);
@@ -159,23 +156,46 @@ static void pbuf_validate(struct pbuf *playout_buf)
 
 struct pbuf *pbuf_init(volatile int *delay_ms)
 {
-        struct pbuf *playout_buf = NULL;
-
-        playout_buf = (struct pbuf *) calloc(1, sizeof(struct pbuf));
-        if (playout_buf != NULL) {
-                playout_buf->frst = NULL;
-                playout_buf->last = NULL;
-                /* Playout delay... should really be adaptive, based on the */
-                /* jitter, but we use a (conservative) fixed 32ms delay for */
-                /* now (2 video frames at 60fps).                           */
-                playout_buf->offset_ms = delay_ms;
-                playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
-                playout_buf->last_rtp_seq = -1;
-                playout_buf->last_report_seq = -1;
+        struct pbuf *playout_buf = new struct pbuf();
+
+        /* Playout delay... should really be adaptive, based on the */
+        /* jitter, but we use a (conservative) fixed 32ms delay for */
+        /* now (2 video frames at 60fps).                           */
+        playout_buf->offset_ms = delay_ms;
+        playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
+        playout_buf->last_rtp_seq = -1;
+        playout_buf->last_report_seq = -1;
+        playout_buf->last_removed_mbit_seq = -1;
+
+        return playout_buf;
+}
+
+/**
+ * Frees packets held by the node and returns it to the pool (or deletes it
+ * if the pool is already full).
+ */
+static void release_pnode(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        for (unsigned int w = 0; w < node->present.size(); ++w) {
+                if (node->present[w] == 0) {
+                        continue;
+                }
+                for (unsigned int b = 0; b < 64; ++b) {
+                        if ((node->present[w] >> b) & 1) {
+                                free(node->pkts[w * 64 + b].data);
+                        }
+                }
+        }
+        node->pkts.clear(); // keeps capacity for the next frame
+        node->present.clear();
+        node->pkt_count = 0;
+        node->magic = 0;
+
+        if (playout_buf->pool.size() < PBUF_POOL_MAX) {
+                playout_buf->pool.push_back(node);
         } else {
-                debug_msg("Failed to allocate memory for playout buffer\n");
+                delete node;
         }
-        return playout_buf;
 }
 
 void pbuf_destroy(struct pbuf *playout_buf) {
@@ -191,123 +211,127 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                                         playout_buf->expected_pkts_cum * 100.0);
                 }
 
-                struct pbuf_node *curr = playout_buf->frst;
-                while (curr != NULL) {
-                        struct pbuf_node *temp = curr->nxt;
-                        if (curr == playout_buf->frst) {
-                                playout_buf->frst = curr->nxt;
-                        }
-                        if (curr == playout_buf->last) {
-                                playout_buf->last = curr->prv;
-                        }
-                        if (curr->nxt != NULL) {
-                                curr->nxt->prv = curr->prv;
-                        }
-                        if (curr->prv != NULL) {
-                                curr->prv->nxt = curr->nxt;
-                        }
-                        free_cdata(curr->cdata);
-                        delete curr;
-                        curr = temp;
+                for (auto node : playout_buf->frames) {
+                        release_pnode(playout_buf, node);
+                }
+                for (auto node : playout_buf->pool) {
+                        delete node;
                 }
-                free(playout_buf);
+                delete playout_buf;
         }
 }
 
 static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
 {
-        /* Add "pkt" to the frame represented by "node". The "node" has    */
-        /* previously been created, and has some coded data already...     */
-
-        /* New arrivals are added at the head of the list, which is stored */
-        /* in descending order of packets as they arrive (NOT necessarily  */
-        /* descending sequence number order, as the network might reorder) */
-
-        struct coded_data *tmp, *curr, *prv;
+        /* Add "pkt" to the frame represented by "node". The packet is     */
+        /* stored in the slot given by its sequence number distance from   */
+        /* node->base_seq, so reordered packets are placed in O(1). Only a */
+        /* packet preceding base_seq (more than PBUF_SEQ_HEADROOM packets  */
+        /* of reordering at the frame start) needs to shift the array.     */
 
         assert(node->rtp_timestamp == pkt->ts);
-        assert(node->cdata != NULL);
 
-        tmp = (struct coded_data *) malloc(sizeof(struct coded_data));
-        if (tmp == NULL) {
-                /* this is bad, out of memory, drop the packet... */
-                free(pkt);
-                return;
-        }
-
-        tmp->seqno = pkt->seq;
-        tmp->data = pkt;
-        node->mbit |= pkt->m;
-        if((int16_t)(tmp->seqno - node->cdata->seqno) > 0){
-                tmp->prv = NULL;
-                tmp->nxt = node->cdata;
-                node->cdata->prv = tmp;
-                node->cdata = tmp;
-        } else {
-                curr = node->cdata;
-                if (curr == NULL){
-                        /* this is bad, out of memory, drop the packet... */
+        int idx = (int16_t) (pkt->seq - node->base_seq);
+        if (idx < 0) {
+                int shift = -idx;
+                if (node->pkts.size() + shift > 1<<15) {
+                        debug_msg("Packet too far from the rest of the frame - discarded\n");
                         free(pkt);
-                        free(tmp);
-                } else {
-                        while (curr != NULL &&  ((int16_t)(tmp->seqno - curr->seqno) < 0)){
-                                prv = curr;
-                                curr = curr->nxt;
-                        }
-                        if (curr == NULL) {
-                                tmp->nxt = NULL;
-                                tmp->prv = prv;
-                                prv->nxt = tmp;
-                        }else if ((int16_t)(tmp->seqno - curr->seqno) > 0){
-                                tmp->nxt = curr;
-                                tmp->prv = curr->prv;
-                                tmp->prv->nxt = tmp;
-                                curr->prv = tmp;
-                        } else {
-                                /* this is bad, something went terribly wrong... */
-                                free(pkt);
-                                free(tmp);
+                        return;
+                }
+                node->pkts.insert(node->pkts.begin(), shift, coded_data());
+                node->base_seq = pkt->seq;
+                idx = 0;
+                node->present.assign((node->pkts.size() + 63) / 64, 0);
+                for (unsigned int i = 0; i < node->pkts.size(); ++i) {
+                        if (node->pkts[i].data != NULL) {
+                                node->present[i / 64] |= 1ull << (i % 64);
                         }
                 }
+        } else if ((unsigned int) idx >= node->pkts.size()) {
+                node->pkts.resize(idx + 1);
+                node->present.resize((idx + 64) / 64);
+        }
+
+        struct coded_data *cd = &node->pkts[idx];
+        if (cd->data != NULL) {
+                /* duplicate packet */
+                free(pkt);
+                return;
+        }
+        cd->seqno = pkt->seq;
+        cd->data = pkt;
+        node->present[idx / 64] |= 1ull << (idx % 64);
+        node->pkt_count += 1;
+        if (pkt->m) {
+                node->mbit = 1;
+                node->mbit_seq = pkt->seq;
         }
 }
 
-static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
+static struct pbuf_node *create_new_pnode(struct pbuf *playout_buf, rtp_packet * pkt, long long playout_delay_us)
 {
         struct pbuf_node *tmp;
 
         perf_record(UVP_CREATEPBUF, pkt->ts);
 
-        tmp = new struct pbuf_node();
-        if (tmp != NULL) {
-                tmp->magic = PBUF_MAGIC;
-                tmp->rtp_timestamp = pkt->ts;
-                tmp->mbit = pkt->m;
-                tmp->playout_time =
-                        tmp->arrival_time = std::chrono::high_resolution_clock::now();
-                tmp->playout_time += std::chrono::microseconds(playout_delay_us);
-
-                tmp->cdata = (struct coded_data *) malloc(sizeof(struct coded_data));
-                if (tmp->cdata != NULL) {
-                        tmp->cdata->nxt = NULL;
-                        tmp->cdata->prv = NULL;
-                        tmp->cdata->seqno = pkt->seq;
-                        tmp->cdata->data = pkt;
-                } else {
-                        free(pkt);
-                        delete tmp;
-                        return NULL;
-                }
+        if (!playout_buf->pool.empty()) {
+                tmp = playout_buf->pool.back();
+                playout_buf->pool.pop_back();
         } else {
-                free(pkt);
+                tmp = new struct pbuf_node();
         }
+
+        tmp->magic = PBUF_MAGIC;
+        tmp->rtp_timestamp = pkt->ts;
+        tmp->mbit = 0;
+        tmp->decoded = 0;
+        tmp->completed = false;
+        tmp->playout_time =
+                tmp->arrival_time = std::chrono::high_resolution_clock::now();
+        tmp->playout_time += std::chrono::microseconds(playout_delay_us);
+        tmp->base_seq = pkt->seq - PBUF_SEQ_HEADROOM;
+        tmp->pkt_count = 0;
+
+        add_coded_unit(tmp, pkt);
+
         return tmp;
 }
 
-void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
+/**
+ * Links the occupied slots of the node into the coded_data list passed to
+ * decode_frame_t. The list is in descending sequence number order, as it
+ * always was.
+ */
+static struct coded_data *link_cdata(struct pbuf_node *node)
 {
-        struct pbuf_node *tmp;
+        struct coded_data *head = NULL;
+        struct coded_data *prv = NULL;
+
+        for (int i = (int) node->pkts.size() - 1; i >= 0; --i) {
+                if (node->present[i / 64] == 0) {
+                        i -= i % 64; // skip the rest of an empty word
+                        continue;
+                }
+                if (((node->present[i / 64] >> (i % 64)) & 1) == 0) {
+                        continue;
+                }
+                struct coded_data *cd = &node->pkts[i];
+                cd->prv = prv;
+                cd->nxt = NULL;
+                if (prv != NULL) {
+                        prv->nxt = cd;
+                } else {
+                        head = cd;
+                }
+                prv = cd;
+        }
 
+        return head;
+}
+
+void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
+{
         pbuf_validate(playout_buf);
 
         // collect statistics
@@ -372,41 +396,41 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                 playout_buf->longest_gap = 0;
         }
 
-        if (playout_buf->frst == NULL && playout_buf->last == NULL) {
+        long long playout_delay_us = playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0);
+
+        if (playout_buf->frames.empty()) {
                 /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
-                playout_buf->last = playout_buf->frst;
+                playout_buf->frames.push_back(create_new_pnode(playout_buf, pkt, playout_delay_us));
                 return;
         }
 
-        if (playout_buf->last->rtp_timestamp == pkt->ts) {
+        struct pbuf_node *last = playout_buf->frames.back();
+        if (last->rtp_timestamp == pkt->ts) {
                 /* Packet belongs to last frame in playout_buf this is the */
                 /* most likely scenario - although...                      */
-                add_coded_unit(playout_buf->last, pkt);
+                add_coded_unit(last, pkt);
         } else {
-                if (playout_buf->last->rtp_timestamp < pkt->ts) {
+                if (last->rtp_timestamp < pkt->ts) {
                         /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
-                        playout_buf->last->nxt = tmp;
-                        playout_buf->last->completed = true;
-                        tmp->prv = playout_buf->last;
-                        playout_buf->last = tmp;
+                        last->completed = true;
+                        playout_buf->frames.push_back(create_new_pnode(playout_buf, pkt, playout_delay_us));
                 } else {
                         bool discard_pkt = false;
                         /* Packet belongs to a previous frame... */
-                        if (playout_buf->frst->rtp_timestamp > pkt->ts) {
+                        if (playout_buf->frames.front()->rtp_timestamp > pkt->ts) {
                                 debug_msg("A very old packet - discarded\n");
                                 discard_pkt = true;
                         } else {
                                 debug_msg
                                     ("A packet for a previous frame, but might still be useful\n");
-                                struct pbuf_node *curr = playout_buf->last;
-                                while(curr != playout_buf->frst && curr->rtp_timestamp > pkt->ts){
-                                        curr = curr->prv;
-                                }
-                                if (curr->rtp_timestamp == pkt->ts) {
+                                auto it = std::lower_bound(playout_buf->frames.begin(),
+                                                playout_buf->frames.end(), pkt->ts,
+                                                [](struct pbuf_node *n, uint32_t ts) {
+                                                        return n->rtp_timestamp < ts;
+                                                });
+                                if (it != playout_buf->frames.end() && (*it)->rtp_timestamp == pkt->ts) {
                                         /* Packet belongs to a previous existing frame... */
-                                        add_coded_unit(curr, pkt);
+                                        add_coded_unit(*it, pkt);
                                 } else {
                                         /* Packet belongs to a frame that is not present */
                                         discard_pkt = true;
@@ -424,46 +448,20 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
         pbuf_validate(playout_buf);
 }
 
-static void free_cdata(struct coded_data *head)
-{
-        struct coded_data *tmp;
-
-        while (head != NULL) {
-                free(head->data);
-                tmp = head;
-                head = head->nxt;
-                free(tmp);
-        }
-}
-
 void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_point const & curr_time)
 {
         /* Remove previously decoded frames that have passed their playout  */
         /* time from the playout buffer. Incomplete frames that have passed */
         /* their playout time are also discarded.                           */
 
-        struct pbuf_node *curr, *temp;
-
         pbuf_validate(playout_buf);
 
-        curr = playout_buf->frst;
-        while (curr != NULL) {
-                temp = curr->nxt;
+        while (!playout_buf->frames.empty()) {
+                struct pbuf_node *curr = playout_buf->frames.front();
                 if (curr_time > curr->playout_time && frame_complete(curr)) {
-                        if (curr == playout_buf->frst) {
-                                playout_buf->frst = curr->nxt;
-                        }
-                        if (curr == playout_buf->last) {
-                                playout_buf->last = curr->prv;
-                        }
-                        if (curr->nxt != NULL) {
-                                curr->nxt->prv = curr->prv;
-                        }
-                        if (curr->prv != NULL) {
-                                curr->prv->nxt = curr->nxt;
-                        }
-                        free_cdata(curr->cdata);
-                        delete curr;
+                        playout_buf->frames.pop_front();
+                        playout_buf->last_removed_mbit_seq = curr->mbit ? curr->mbit_seq : -1;
+                        release_pnode(playout_buf, curr);
                 } else {
                         /* The playout buffer is stored in order, so once  */
                         /* we see one packet that has not yet reached it's */
@@ -471,7 +469,6 @@ void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::t
                         /* will have done so...                            */
                         break;
                 }
-                curr = temp;
         }
 
         pbuf_validate(playout_buf);
@@ -480,20 +477,42 @@ void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::t
 
 static int frame_complete(struct pbuf_node *frame)
 {
-        /* Return non-zero if the list of coded_data represents a    */
-        /* complete frame of video. This might have to be passed the */
-        /* seqnum of the last packet in the previous frame, too?     */
-        /* i dont think that would reflect correctly of weather this */
-        /* frame is complete or not - however we should check for all */
-        /* the packtes of a frame being present - perhaps we should  */
-        /* keep a bit vector in pbuf_node? LG.  */
+        /* Return non-zero if the frame is ready to be passed to the  */
+        /* decoder, ie. its last packet has been seen or a subsequent */
+        /* frame started. This doesn't mean that all packets of the   */
+        /* frame are present - use frame_expected_pkts() for that.    */
 
         return (frame->mbit == 1 || frame->completed == true);
 }
 
+/**
+ * Returns number of packets the frame consists of or -1 if it cannot be
+ * determined. The frame spans from the packet following the previous
+ * frame's M-bit packet to its own M-bit packet, so both must have been
+ * received. If a whole frame is lost in between, the packets of the lost
+ * frame are counted as well (the frame is then reported as incomplete).
+ *
+ * @param pos  index of the frame in playout_buf->frames
+ */
+static int frame_expected_pkts(struct pbuf *playout_buf, unsigned int pos)
+{
+        struct pbuf_node *frame = playout_buf->frames[pos];
+        int prev_mbit_seq;
+        if (pos == 0) {
+                prev_mbit_seq = playout_buf->last_removed_mbit_seq;
+        } else {
+                struct pbuf_node *prev = playout_buf->frames[pos - 1];
+                prev_mbit_seq = prev->mbit ? prev->mbit_seq : -1;
+        }
+        if (!frame->mbit || prev_mbit_seq == -1) {
+                return -1;
+        }
+        return (uint16_t) (frame->mbit_seq - prev_mbit_seq);
+}
+
 int pbuf_is_empty(struct pbuf *playout_buf)
 {
-        if (playout_buf->frst == NULL)
+        if (playout_buf->frames.empty())
                 return TRUE;
         else
                 return FALSE;
@@ -506,19 +525,26 @@ pbuf_decode(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_p
         /* Find the first complete frame that has reached it's playout */
         /* time, and decode it into the framebuffer. Mark the frame as */
         /* decoded, but otherwise leave it in the playout buffer.      */
-        struct pbuf_node *curr;
-
         pbuf_validate(playout_buf);
 
-        curr = playout_buf->frst;
-        while (curr != NULL) {
+        for (unsigned int i = 0; i < playout_buf->frames.size(); ++i) {
+                struct pbuf_node *curr = playout_buf->frames[i];
                 if (!curr->decoded 
                                 && curr_time > curr->playout_time
                    ) {
                         if (frame_complete(curr)) {
-                                struct pbuf_stats stats = { playout_buf->received_pkts_cum,
-                                        playout_buf->expected_pkts_cum };
-                                int ret = decode_func(curr->cdata, data, &stats);
+                                int expected = frame_expected_pkts(playout_buf, i);
+                                if (!curr->mbit || curr->pkt_count < expected) {
+                                        playout_buf->incomplete_frames_cum += 1;
+                                }
+                                if (expected > curr->pkt_count) {
+                                        playout_buf->lost_pkts_cum += expected - curr->pkt_count;
+                                }
+                                struct pbuf_stats stats;
+                                pbuf_get_stats(playout_buf, &stats);
+                                stats.frame_received_pkts = curr->pkt_count;
+                                stats.frame_expected_pkts = expected;
+                                int ret = decode_func(link_cdata(curr), data, &stats);
                                 curr->decoded = 1;
                                 return ret;
                         } else {
@@ -527,11 +553,20 @@ pbuf_decode(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_p
                                      curr->rtp_timestamp);
                         }
                 }
-                curr = curr->nxt;
         }
         return 0;
 }
 
+void pbuf_get_stats(struct pbuf *playout_buf, struct pbuf_stats *stats)
+{
+        stats->received_pkts_cum = playout_buf->received_pkts_cum;
+        stats->expected_pkts_cum = playout_buf->expected_pkts_cum;
+        stats->lost_pkts_cum = playout_buf->lost_pkts_cum;
+        stats->incomplete_frames_cum = playout_buf->incomplete_frames_cum;
+        stats->frame_received_pkts = 0;
+        stats->frame_expected_pkts = -1;
+}
+
 void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
 {
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
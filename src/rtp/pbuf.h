@@ -72,7 +72,9 @@
 extern "C" {
 #endif
 
-/* The coded representation of a single frame */
+/* The coded representation of a single frame. The list is passed to */
+/* decode_frame_t in descending sequence number order; nxt/prv links */
+/* are valid only during the callback.                               */
 struct coded_data {
         struct coded_data       *nxt;
         struct coded_data       *prv;
@@ -83,8 +85,17 @@ struct coded_data {
 struct pbuf_stats {
         long long int received_pkts_cum;
         long long int expected_pkts_cum;
+        long long int lost_pkts_cum;         ///< packets missing in frames passed to decoder
+        long long int incomplete_frames_cum; ///< frames passed to decoder with missing packets
+
+        int frame_received_pkts; ///< packets of the decoded frame that were received
+        int frame_expected_pkts; ///< packets the decoded frame consists of, -1 if unknown
 };
 
+/// true if all packets of the decoded frame are known to be present
+#define PBUF_STATS_FRAME_COMPLETE(stats) ((stats)->frame_expected_pkts != -1 && \
+                (stats)->frame_received_pkts == (stats)->frame_expected_pkts)
+
 /* The playout buffer */
 struct pbuf;
 struct state_decoder;
@@ -119,6 +130,7 @@ typedef int decode_frame_t(struct coded_data *cdata, void *decode_data, struct p
 struct pbuf	*pbuf_init(volatile int *delay_ms);
 void             pbuf_destroy(struct pbuf *);
 void		 pbuf_insert(struct pbuf *playout_buf, rtp_packet *r);
+void             pbuf_get_stats(struct pbuf *playout_buf, struct pbuf_stats *stats);
 
 #ifdef __cplusplus
 }
@@ -41,16 +41,23 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <bitset>
 #include <stdlib.h>
 #include "rtp/rs.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
+#include "utils/worker.h"
 #include "video.h"
 
 #define DEFAULT_K 200
 #define DEFAULT_N 240
 
+/// encoding/decoding is split among threads in stripes of symbols that
+/// are multiple of RS_STRIPE_ALIGN and at least RS_MIN_STRIPE bytes long
+#define RS_STRIPE_ALIGN 64
+#define RS_MIN_STRIPE 4096
+
 #define MAX_K 255
 #define MAX_N 255
 
@@ -62,6 +69,19 @@ static void usage();
 
 using namespace std;
 
+/**
+ * Runs fn(offset, len) in parallel for stripes covering [0, ss).
+ */
+static void for_each_stripe(unsigned int ss, function<void(size_t, size_t)> const &fn)
+{
+        int units = (ss + RS_STRIPE_ALIGN - 1) / RS_STRIPE_ALIGN;
+        parallel_for(0, units, [&](int begin, int end) {
+                        size_t offset = (size_t) begin * RS_STRIPE_ALIGN;
+                        size_t len = min<size_t>((size_t) end * RS_STRIPE_ALIGN, ss) - offset;
+                        fn(offset, len);
+                }, RS_MIN_STRIPE / RS_STRIPE_ALIGN);
+}
+
 rs::rs(unsigned int k, unsigned int n)
         : m_k(k), m_n(n)
 {
@@ -136,19 +156,24 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
                 fec_encode(state, src, *out + ss * (m_k + m), m, ss);
         }
 #else
-        void *src[m_k];
-        for (unsigned int k = 0; k < m_k; ++k) {
-                src[k] = out_data + ss * k;
-        }
-        void *dst[m_n-m_k];
         unsigned int dst_idx[m_n-m_k];
         for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                dst[m] = out_data + ss * (m_k + m);
                 dst_idx[m] = m_k + m;
         }
 
-        fec_encode((const fec_t *)state, (gf **) src,
-                        (gf **) dst, dst_idx, m_n-m_k, ss);
+        for_each_stripe(ss, [&](size_t offset, size_t len) {
+                void *src[m_k];
+                for (unsigned int k = 0; k < m_k; ++k) {
+                        src[k] = out_data + ss * k + offset;
+                }
+                void *dst[m_n-m_k];
+                for (unsigned int m = 0; m < m_n-m_k; ++m) {
+                        dst[m] = out_data + ss * (m_k + m) + offset;
+                }
+
+                fec_encode((const fec_t *)state, (gf **) src,
+                                (gf **) dst, dst_idx, m_n-m_k, len);
+        });
 #endif
 
         out->tiles[0].data_len = buffer_len;
@@ -275,8 +300,12 @@ void rs::decode(char *in, int in_len, char **out, int *len,
                 output[i] = (char *) malloc(ss);
         }
 
-        fec_decode((const fec_t *) state, (const gf *const *) pkt,
-                        (gf *const *) output, index, ss);
+        gf *m_dec = (gf *) alloca(m_k * m_k);
+        fec_build_decode_matrix((const fec_t *) state, index, m_dec);
+        for_each_stripe(ss, [&](size_t offset, size_t len) {
+                fec_decode_with_matrix((const fec_t *) state, m_dec, (const gf *const *) pkt,
+                                (gf *const *) output, index, offset, len);
+        });
 
         i = 0;
         for (unsigned int j = 0; j < m_k; ++j) {
@@ -299,6 +328,22 @@ void rs::decode(char *in, int in_len, char **out, int *len,
 #endif 
 }
 
+void rs::decode_complete(char *in, int in_len, char **out, int *len)
+{
+        if (in_len < (int) sizeof(uint32_t)) {
+                *len = 0;
+                return;
+        }
+        uint32_t out_sz;
+        memcpy(&out_sz, in, sizeof(out_sz));
+        if (out_sz > (size_t) in_len - sizeof(uint32_t)) {
+                *len = 0;
+                return;
+        }
+        *len = out_sz;
+        *out = in + sizeof(uint32_t);
+}
+
 static void usage() {
         printf("RS usage:\n"
                         "\t-f rs[:<k>:<n>]\n"
@@ -52,6 +52,7 @@ struct rs : public fec {
         std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame> frame);
         void decode(char *in, int in_len, char **out, int *len,
                 const std::map<int, int> &);
+        void decode_complete(char *in, int in_len, char **out, int *len);
 
 private:
         int get_ss(int hdr_len, int len);
@@ -111,6 +111,10 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define MAX_MISORDER   100
 #define MIN_SEQUENTIAL 2
 
+#define RTP_RECV_BATCH 64 /* max packets processed per rtp_recv_r() call in multithreaded mode */
+/* size of one preallocated header slot (internal rtp_packet fields + max 20 B of header), 16 B aligned */
+#define RTP_SEND_HDR_SLOT_LEN ((20 + RTP_PACKET_HEADER_SIZE + 15) / 16 * 16)
+
 /*
  * Definitions for the RTP/RTCP packets on the wire...
  */
@@ -316,6 +320,15 @@ struct rtp {
         rtp_callback callback;
         struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        /* preallocated RTP headers for outgoing packets, see rtp_get_send_hdr() */
+        uint8_t *send_hdrs;
+        int send_hdrs_count;
+        int send_hdrs_idx;
+        bool send_async;        /* between rtp_async_start() and rtp_async_wait() */
+        /* additional destinations of RTP data packets, see rtp_add_mirror() */
+        socket_udp **mirrors;
+        int mirror_count;
+        bool primary_muted;     /* do not send RTP data to the session destination */
         uint32_t magic;         /* For debugging...  */
 };
 
@@ -1546,6 +1559,30 @@ int rtp_send_raw_rtp_data(struct rtp *session, char *data, int buflen)
         return udp_send(session->rtp_socket, data, buflen);
 }
 
+/**
+ * Passes an RTP packet obtained in the same process directly to the session
+ * as if it had been received from its RTP socket, without any syscall or
+ * copy. It is then processed by rtp_recv_r() in the receiving thread.
+ *
+ * Doesn't block, the packet is dropped if the receive queue is full.
+ *
+ * @param packet malloc'ed buffer of at least RTP_MAX_PACKET_LEN bytes with the
+ *               datagram at offset RTP_PACKET_HEADER_SIZE; the session takes
+ *               ownership of it in any case
+ * @retval false the packet was dropped, injection works only if
+ *               rtp_is_multithreaded()
+ */
+bool rtp_inject_data(struct rtp *session, char *packet, int buflen)
+{
+        return udp_inject_data(session->rtp_socket, packet, buflen);
+}
+
+/// @returns true if the session receives with a separate thread (see rtp_init_if())
+bool rtp_is_multithreaded(struct rtp *session)
+{
+        return udp_is_multithreaded(session->rtp_socket);
+}
+
 static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
 {
         int buflen;
@@ -1584,6 +1621,32 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
         return buflen;
 }
 
+/**
+ * Processes all packets already queued by the multithreaded receiver (up to
+ * RTP_RECV_BATCH), fetching them from the socket with a single queue lock.
+ */
+static int rtp_recv_data_batch(struct rtp *session, uint32_t curr_rtp_ts)
+{
+        char *packets[RTP_RECV_BATCH];
+        int sizes[RTP_RECV_BATCH];
+        int count;
+        int received_bytes = 0;
+
+        assert(session->mt_recv);
+        count = udp_recv_data_batch(session->rtp_socket, packets, sizes, RTP_RECV_BATCH);
+        for (int i = 0; i < count; ++i) {
+                if (sizes[i] > 0) {
+                        rtp_process_data(session, curr_rtp_ts, (uint8_t *) packets[i] + RTP_PACKET_HEADER_SIZE,
+                                        (rtp_packet *) packets[i], sizes[i]);
+                        received_bytes += sizes[i];
+                } else {
+                        free(packets[i]);
+                }
+        }
+
+        return received_bytes;
+}
+
 static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                uint8_t *buffer, rtp_packet *packet, int buflen)
 {
@@ -2369,7 +2432,7 @@ int rtp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp_t
         if (session->mt_recv) {
                 int ret = FALSE;
                 if (udp_not_empty(session->rtp_socket, timeout)) {
-                        rtp_recv_data(session, curr_rtp_ts);
+                        rtp_recv_data_batch(session, curr_rtp_ts);
                         ret = TRUE;
                 }
                 udp_fd_zero_r(&fd);
@@ -2773,6 +2836,27 @@ int rtp_send_data(struct rtp *session, uint32_t rtp_ts, char pt, int m,
                                  data, data_len, extn, extn_len, extn_type);
 }
 
+#ifndef WIN32
+/**
+ * Returns buffer for header of an outgoing packet. Headers are taken from
+ * a per-session preallocated array - if the async (batched) sending is
+ * active, each packet gets its own slot because it is not sent until
+ * rtp_async_wait(), otherwise the first slot is reused.
+ */
+static uint8_t *rtp_get_send_hdr(struct rtp *session)
+{
+        if (session->send_hdrs == NULL) {
+                session->send_hdrs = (uint8_t *) malloc(RTP_SEND_HDR_SLOT_LEN);
+                session->send_hdrs_count = 1;
+        }
+        if (!session->send_async) {
+                return session->send_hdrs;
+        }
+        assert(session->send_hdrs_idx < session->send_hdrs_count);
+        return session->send_hdrs + RTP_SEND_HDR_SLOT_LEN * session->send_hdrs_idx++;
+}
+#endif
+
 int
 rtp_send_data_hdr(struct rtp *session,
                   uint32_t rtp_ts, char pt, int m,
@@ -2843,7 +2927,8 @@ rtp_send_data_hdr(struct rtp *session,
                 send_vector = d;
                 buffer = (uint8_t *) d + 3 * sizeof(WSABUF);
 #else
-                d = buffer = (uint8_t *) malloc(20 + RTP_PACKET_HEADER_SIZE);
+                buffer = rtp_get_send_hdr(session);
+                d = NULL;
 #endif
                 packet = (rtp_packet *) buffer;
         }
@@ -2943,9 +3028,19 @@ rtp_send_data_hdr(struct rtp *session,
                                          buffer_len, initVec);
         }
 
-        rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
-        if (rc == -1) {
-                perror("sending RTP packet");
+        for (i = 0; i < session->mirror_count; i++) {
+                if (udp_sendv(session->mirrors[i], send_vector, send_vector_len, NULL) == -1) {
+                        perror("sending mirrored RTP packet");
+                }
+        }
+        if (session->primary_muted) {
+                free(d);
+                rc = buffer_len + data_len;
+        } else {
+                rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
+                if (rc == -1) {
+                        perror("sending RTP packet");
+                }
         }
 
         /* Update the RTCP statistics... */
@@ -3730,6 +3825,8 @@ void rtp_done(struct rtp *session)
 
         udp_exit(session->rtp_socket);
         udp_exit(session->rtcp_socket);
+        free(session->send_hdrs);
+        free(session->mirrors);
         free(session->opt);
         free(session);
 }
@@ -4053,12 +4150,83 @@ bool rtp_is_ipv6(struct rtp *session)
 
 void rtp_async_start(struct rtp *session, int nr_packets)
 {
-       udp_async_start(session->rtp_socket, nr_packets);
+#ifndef WIN32
+        if (nr_packets > session->send_hdrs_count) {
+                free(session->send_hdrs);
+                session->send_hdrs = (uint8_t *) malloc(RTP_SEND_HDR_SLOT_LEN * nr_packets);
+                session->send_hdrs_count = nr_packets;
+        }
+        session->send_hdrs_idx = 0;
+        session->send_async = true;
+        // mirrors are sent synchronously in MSW - the primary socket owns the buffers
+        for (int i = 0; i < session->mirror_count; i++) {
+                udp_async_start(session->mirrors[i], nr_packets);
+        }
+#endif
+        udp_async_start(session->rtp_socket, nr_packets);
 }
 
 void rtp_async_wait(struct rtp *session)
 {
-       udp_async_wait(session->rtp_socket);
+#ifndef WIN32
+        for (int i = 0; i < session->mirror_count; i++) {
+                udp_async_wait(session->mirrors[i]);
+        }
+#endif
+        udp_async_wait(session->rtp_socket);
+#ifndef WIN32
+        session->send_async = false;
+#endif
+}
+
+void rtp_async_flush(struct rtp *session)
+{
+        for (int i = 0; i < session->mirror_count; i++) {
+                udp_async_flush(session->mirrors[i]);
+        }
+        udp_async_flush(session->rtp_socket);
+}
+
+/**
+ * Adds another destination of RTP data packets. The packets are built once
+ * and sent both to the session destination and to all mirrors. RTCP is not
+ * mirrored.
+ *
+ * The socket is still owned by the caller. Mirrors must not be added or
+ * removed concurrently with sending (nor between rtp_async_start() and
+ * rtp_async_wait()).
+ */
+void rtp_add_mirror(struct rtp *session, socket_udp *s)
+{
+        session->mirrors = (socket_udp **) realloc(session->mirrors,
+                        (session->mirror_count + 1) * sizeof(socket_udp *));
+        session->mirrors[session->mirror_count++] = s;
+}
+
+void rtp_remove_mirror(struct rtp *session, socket_udp *s)
+{
+        for (int i = 0; i < session->mirror_count; i++) {
+                if (session->mirrors[i] == s) {
+                        memmove(&session->mirrors[i], &session->mirrors[i + 1],
+                                        (session->mirror_count - i - 1) * sizeof(socket_udp *));
+                        session->mirror_count -= 1;
+                        return;
+                }
+        }
+}
+
+/**
+ * Suppresses sending RTP data to the session destination (data are sent only
+ * to mirrors, if any). RTCP is not affected.
+ */
+void rtp_set_primary_muted(struct rtp *session, bool muted)
+{
+        session->primary_muted = muted;
+}
+
+bool rtp_set_pacing_rate(struct rtp *session, uint64_t bytes_per_sec)
+{
+        return udp_set_pacing_rate(session->rtp_socket, bytes_per_sec);
 }
 
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session)
@@ -250,6 +250,8 @@ int 		 rtcp_recv_r(struct rtp *session,
 int 		 rtp_recv_poll_r(struct rtp **sessions, 
 			  struct timeval *timeout, uint32_t curr_rtp_ts);
 int 		 rtp_send_raw_rtp_data(struct rtp *session, char *buffer, int buffer_len);
+bool		 rtp_inject_data(struct rtp *session, char *packet, int buflen);
+bool		 rtp_is_multithreaded(struct rtp *session);
 
 int 		 rtp_send_data(struct rtp *session, 
 			       uint32_t rtp_ts, char pt, int m, 
@@ -293,7 +295,7 @@ int              rtp_compute_fract_lost(struct rtp *session, uint32_t ssrc);
 bool             rtp_is_ipv6(struct rtp *session);
 
 /*
- * Async API - MSW specific
+ * Async API - overlapped I/O in MSW, batched sendmmsg()/UDP GSO in Linux
  *
  * Using async API hugely improves performance.
  * Usage is simple - prior to sending a bulk of packets (eg. video frame), rtp_async_start()
@@ -304,6 +306,14 @@ bool             rtp_is_ipv6(struct rtp *session);
  */
 void             rtp_async_start(struct rtp *session, int nr_packets);
 void             rtp_async_wait(struct rtp *session);
+void             rtp_async_flush(struct rtp *session);
+
+struct _socket_udp;
+void             rtp_add_mirror(struct rtp *session, struct _socket_udp *s);
+void             rtp_remove_mirror(struct rtp *session, struct _socket_udp *s);
+void             rtp_set_primary_muted(struct rtp *session, bool muted);
+
+bool             rtp_set_pacing_rate(struct rtp *session, uint64_t bytes_per_sec);
 
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session);
 
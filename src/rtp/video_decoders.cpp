@@ -89,6 +89,8 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/pbuf.h"
 #include "rtp/video_decoders.h"
+#include "utils/lock_free_queue.h"
+#include "utils/metrics.h"
 #include "utils/synchronized_queue.h"
 #include "utils/timed_message.h"
 #include "utils/worker.h"
@@ -96,6 +98,9 @@
 #include "video_decompress.h"
 #include "video_display.h"
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <condition_variable>
 #ifdef RECONFIGURE_IN_FUTURE_THREAD
 #include <future>
@@ -103,9 +108,11 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <sstream>
 #include <thread>
+#include <vector>
 
 #ifdef HAVE_LIBAVCODEC_AVCODEC_H
 #include <libavcodec/avcodec.h> // AV_INPUT_BUFFER_PADDING_SIZE
@@ -173,28 +180,58 @@ struct line_decoder {
         unsigned int         src_linesize; ///< source linesize
 };
 
+/**
+ * Packet payload of an uncompressed frame waiting to be decoded by
+ * decode_line_jobs(). Payload is owned by the playout buffer.
+ */
+struct line_decode_job {
+        uint32_t             data_pos;     ///< offset in the source tile
+        int                  len;          ///< payload length
+        const unsigned char *source;       ///< payload
+};
+
+/**
+ * Per-stage counters and latency histograms of the decoder, see utils/metrics.h.
+ */
+struct decoder_metrics {
+        struct metric *frames = metric_counter("receive.frames");
+        struct metric *received_bytes = metric_counter("receive.bytes");
+        struct metric *expected_bytes = metric_counter("receive.expected_bytes");
+        struct metric *corrupted = metric_counter("receive.corrupted_frames");
+        struct metric *displayed = metric_counter("display.decoded_frames");
+        struct metric *lost_pkts = metric_gauge("receive.lost_packets");
+        struct metric *fec_ok = metric_counter("fec.ok");
+        struct metric *fec_corrected = metric_counter("fec.corrected");
+        struct metric *fec_nok = metric_counter("fec.nok");
+        struct metric *fec_ns = metric_histogram("fec.frame_ns");
+        struct metric *decompress_ns = metric_histogram("decompress.frame_ns");
+};
+
 struct reported_statistics_cumul {
-        mutex             lock;
-        unsigned long long int     received_bytes_total = 0;
-        unsigned long long int     expected_bytes_total = 0;
-        unsigned long int displayed = 0, dropped = 0, corrupted = 0, missing = 0;
-        unsigned long int fec_ok = 0, fec_corrected = 0, fec_nok = 0;
-        unsigned long long int     nano_per_frame_decompress = 0;
-        unsigned long long int     nano_per_frame_error_correction = 0;
-        unsigned long long int     nano_per_frame_expected = 0;
-        unsigned long int     reported_frames = 0;
+        mutex             lock; ///< protects nano_per_tile_error_correction
+        atomic<unsigned long long>     received_bytes_total{0};
+        atomic<unsigned long long>     expected_bytes_total{0};
+        atomic<unsigned long> displayed{0}, dropped{0}, corrupted{0}, missing{0};
+        atomic<unsigned long> fec_ok{0}, fec_corrected{0}, fec_nok{0};
+        atomic<unsigned long long>     nano_per_frame_decompress{0};
+        atomic<unsigned long long>     nano_per_frame_error_correction{0};
+        vector<unsigned long long int> nano_per_tile_error_correction; ///< accumulated only while stats are reported
+        atomic<unsigned long long>     nano_per_frame_expected{0};
+        atomic<unsigned long>     reported_frames{0};
+        struct decoder_metrics metrics;
         void print() {
                 char buff[256];
+                unsigned long disp = displayed, drop = dropped, miss = missing;
                 int bytes = sprintf(buff, "Video dec stats (cumulative): %lu total / %lu disp / %lu "
                                 "drop / %lu corr / %lu missing.",
-                                displayed + dropped + missing,
-                                displayed, dropped, corrupted,
-                                missing);
+                                disp + drop + miss,
+                                disp, drop, corrupted.load(),
+                                miss);
                 if (fec_ok + fec_nok + fec_corrected > 0)
-                        sprintf(buff + bytes, " FEC noerr/OK/NOK: %ld/%ld/%ld\n", fec_ok, fec_corrected, fec_nok);
+                        sprintf(buff + bytes, " FEC noerr/OK/NOK: %ld/%ld/%ld\n", fec_ok.load(), fec_corrected.load(), fec_nok.load());
                 else
                         sprintf(buff + bytes, "\n");
-                log_msg(LOG_LEVEL_INFO, buff);
+                log_msg(LOG_LEVEL_INFO, "%s", buff);
         }
 };
 
@@ -203,11 +240,16 @@ struct frame_msg {
         inline frame_msg(struct control_state *c, struct reported_statistics_cumul &sr) : control(c), recv_frame(nullptr),
                                 nofec_frame(nullptr),
                              received_pkts_cum(0), expected_pkts_cum(0),
+                             lost_pkts_cum(0), incomplete_frames_cum(0),
                              stats(sr)
         {}
+        /**
+         * Updates statistics of the frame. Metrics and cumulative counters are
+         * lock-free, the RECV line is formatted only if stats reporting is on.
+         */
         inline ~frame_msg() {
                 if (recv_frame) {
-                        lock_guard<mutex> lk(stats.lock);
+                        struct decoder_metrics &m = stats.metrics;
                         int received_bytes = 0;
                         for (unsigned int i = 0; i < recv_frame->tile_count; ++i) {
                                 received_bytes += sum_map(pckt_list[i]);
@@ -216,33 +258,67 @@ struct frame_msg {
                         if (recv_frame->fec_params.type != FEC_NONE) {
                                 if (is_corrupted) {
                                         stats.fec_nok += 1;
+                                        metric_add(m.fec_nok, 1);
                                 } else {
                                         if (received_bytes == expected_bytes) {
                                                 stats.fec_ok += 1;
+                                                metric_add(m.fec_ok, 1);
                                         } else {
                                                 stats.fec_corrected += 1;
+                                                metric_add(m.fec_corrected, 1);
                                         }
                                 }
+                                metric_record(m.fec_ns, nanoPerFrameErrorCorrection);
                         }
-                        ostringstream oss;
-                        oss << "RECV " << "bufferId " << buffer_num[0] << " expectedPackets " <<
-                                expected_pkts_cum <<  " receivedPackets " << received_pkts_cum <<
-                                // droppedPackets
-                                " expectedBytes " << (stats.expected_bytes_total += expected_bytes) <<
-                                " receivedBytes " << (stats.received_bytes_total += received_bytes) <<
-                                " isCorrupted " << (stats.corrupted += (is_corrupted ? 1 : 0)) <<
-                                " isDisplayed " << (stats.displayed += (is_displayed ? 1 : 0)) <<
-                                " timestamp " << time_since_epoch_in_ms() <<
-                                " nanoPerFrameDecompress " << (stats.nano_per_frame_decompress += nanoPerFrameDecompress) <<
-                                " nanoPerFrameErrorCorrection " << (stats.nano_per_frame_error_correction += nanoPerFrameErrorCorrection) <<
-                                " nanoPerFrameExpected " << (stats.nano_per_frame_expected += nanoPerFrameExpected) <<
-                                " reportedFrames " << (stats.reported_frames += 1);
-                        if ((stats.displayed + stats.dropped + stats.missing) % 600 == 599) {
-                                stats.print();
+                        metric_add(m.frames, 1);
+                        metric_add(m.received_bytes, received_bytes);
+                        metric_add(m.expected_bytes, expected_bytes);
+                        metric_add(m.corrupted, is_corrupted ? 1 : 0);
+                        metric_add(m.displayed, is_displayed ? 1 : 0);
+                        metric_set(m.lost_pkts, lost_pkts_cum);
+                        if (nanoPerFrameDecompress > 0) {
+                                metric_record(m.decompress_ns, nanoPerFrameDecompress);
                         }
-                        if (control) {
+
+                        unsigned long long expected_bytes_total = stats.expected_bytes_total += expected_bytes;
+                        unsigned long long received_bytes_total = stats.received_bytes_total += received_bytes;
+                        unsigned long corrupted = stats.corrupted += (is_corrupted ? 1 : 0);
+                        unsigned long displayed = stats.displayed += (is_displayed ? 1 : 0);
+                        unsigned long long nano_decompress = stats.nano_per_frame_decompress += nanoPerFrameDecompress;
+                        unsigned long long nano_fec = stats.nano_per_frame_error_correction += nanoPerFrameErrorCorrection;
+                        unsigned long long nano_expected = stats.nano_per_frame_expected += nanoPerFrameExpected;
+                        unsigned long reported_frames = stats.reported_frames += 1;
+
+                        if (control_stats_enabled(control)) {
+                                ostringstream oss;
+                                oss << "RECV " << "bufferId " << buffer_num[0] << " expectedPackets " <<
+                                        expected_pkts_cum <<  " receivedPackets " << received_pkts_cum <<
+                                        " lostPackets " << lost_pkts_cum << " incompleteFrames " << incomplete_frames_cum <<
+                                        // droppedPackets
+                                        " expectedBytes " << expected_bytes_total <<
+                                        " receivedBytes " << received_bytes_total <<
+                                        " isCorrupted " << corrupted <<
+                                        " isDisplayed " << displayed <<
+                                        " timestamp " << time_since_epoch_in_ms() <<
+                                        " nanoPerFrameDecompress " << nano_decompress <<
+                                        " nanoPerFrameErrorCorrection " << nano_fec;
+                                if (!nanoPerTileErrorCorrection.empty()) {
+                                        lock_guard<mutex> lk(stats.lock);
+                                        stats.nano_per_tile_error_correction.resize(max(stats.nano_per_tile_error_correction.size(),
+                                                                nanoPerTileErrorCorrection.size()));
+                                        oss << " nanoPerTileErrorCorrection ";
+                                        for (unsigned int i = 0; i < nanoPerTileErrorCorrection.size(); ++i) {
+                                                oss << (i > 0 ? "," : "") << (stats.nano_per_tile_error_correction[i] += nanoPerTileErrorCorrection[i]);
+                                        }
+                                }
+                                oss <<
+                                        " nanoPerFrameExpected " << nano_expected <<
+                                        " reportedFrames " << reported_frames;
                                 control_report_stats(control, oss.str());
                         }
+                        if ((stats.displayed + stats.dropped + stats.missing) % 600 == 599) {
+                                stats.print();
+                        }
                 }
                 vf_free(recv_frame);
                 vf_free(nofec_frame);
@@ -253,9 +329,12 @@ struct frame_msg {
         struct video_frame *nofec_frame; ///< frame without FEC
         unique_ptr<map<int, int>[]> pckt_list;
         unsigned long long int received_pkts_cum, expected_pkts_cum;
+        unsigned long long int lost_pkts_cum, incomplete_frames_cum;
+        bool all_pkts_received = false; ///< no packet of the frame is missing, FEC can be skipped
         struct reported_statistics_cumul &stats;
         unsigned long long int nanoPerFrameDecompress = 0;
         unsigned long long int nanoPerFrameErrorCorrection = 0;
+        vector<unsigned long long int> nanoPerTileErrorCorrection; ///< FEC and line decoding time of individual tiles
         unsigned long long int nanoPerFrameExpected = 0;
         bool is_displayed = false;
         bool is_corrupted = false;
@@ -318,18 +397,20 @@ struct state_video_decoder
         enum decoder_type_t decoder_type = {};  ///< how will the video data be decoded
         struct line_decoder *line_decoder = NULL; ///< if the video is uncompressed and only pixelformat change
                                            ///< is neeeded, use this structure
+        int line_decode_threads = 1; ///< number of slices uncompressed frame is decoded in
+        vector<vector<line_decode_job>> line_jobs; ///< per-substream packets to be decoded in slices
         struct state_decompress **decompress_state = NULL; ///< state of the decompress (for every substream)
         bool accepts_corrupted_frame = false;     ///< whether we should pass corrupted frame to decompress
         bool buffer_swapped = true; /**< variable indicating that display buffer
                               * has been processed and we can write to a new one */
         condition_variable buffer_swapped_cv; ///< condition variable associated with @ref buffer_swapped
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> decompress_queue;
+        lock_free_queue<unique_ptr<frame_msg>, 1> decompress_queue;
 
         codec_t           out_codec = VIDEO_CODEC_NONE;
         int               pitch = 0;
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> fec_queue;
+        lock_free_queue<unique_ptr<frame_msg>, 1> fec_queue;
 
         enum video_mode   video_mode = {} ;  ///< video mode set for this decoder
         bool          merged_fb = false; ///< flag if the display device driver requires tiled video or not
@@ -359,16 +440,259 @@ static void wait_for_framebuffer_swap(struct state_video_decoder *decoder) {
         decoder->buffer_swapped_cv.wait(lk, [decoder]{return decoder->buffer_swapped;});
 }
 
+/**
+ * Decodes part of a packet payload that belongs to source lines
+ * [line_begin, line_end) of the tile.
+ *
+ * Packet may span several lines, it is clipped (v210) or centered (RGBA,
+ * R10k) line by line.
+ * @retval false if the frame buffer is too small for the data
+ */
+static bool decode_packet_lines(const struct line_decoder *line_decoder, struct tile *tile,
+                uint32_t data_pos, const unsigned char *source, int len,
+                unsigned int line_begin, unsigned int line_end)
+{
+        /* MAGIC, don't touch it, you definitely break it
+         *  *source* is data from network, *destination* is frame buffer
+         */
+        unsigned int line = data_pos / line_decoder->src_linesize;
+
+        /* compute X pos in source frame */
+        int s_x = data_pos % line_decoder->src_linesize;
+
+        if (line < line_begin) {
+                int skip = (line_begin - line) * line_decoder->src_linesize - s_x;
+                if (skip >= len) {
+                        return true;
+                }
+                source += skip;
+                len -= skip;
+                s_x = 0;
+                line = line_begin;
+        }
+
+        /* compute Y pos in source frame and convert it to
+         * byte offset in the destination frame
+         */
+        int y = line * line_decoder->dst_pitch;
+
+        /* convert X pos from source frame into the destination frame.
+         * it is byte offset from the beginning of a line.
+         */
+        int d_x = ((int)((s_x) / line_decoder->src_bpp)) *
+                line_decoder->dst_bpp;
+
+        /* copy whole packet that can span several lines.
+         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
+         */
+        while (len > 0 && line < line_end) {
+                /* len id payload length in source BPP
+                 * decoder needs len in destination BPP, so convert it
+                 */
+                int l = ((int)(len / line_decoder->src_bpp)) * line_decoder->dst_bpp;
+
+                /* do not copy multiple lines, we need to
+                 * copy (& clip, center) line by line
+                 */
+                if (l + d_x > (int) line_decoder->dst_linesize) {
+                        l = line_decoder->dst_linesize - d_x;
+                }
+
+                /* compute byte offset in destination frame */
+                uint32_t offset = y + d_x;
+
+                /* watch the SEGV */
+                if (l + line_decoder->base_offset + offset > tile->data_len) {
+                        return false;
+                }
+                /*decode frame:
+                 * we have offset for destination
+                 * we update source contiguously
+                 * we pass {r,g,b}shifts */
+                line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
+                                line_decoder->shifts[0], line_decoder->shifts[1],
+                                line_decoder->shifts[2]);
+                /* we decoded one line (or a part of one line) to the end of the line
+                 * so decrease *source* len by 1 line (or that part of the line */
+                len -= line_decoder->src_linesize - s_x;
+                /* jump in source by the same amount */
+                source += line_decoder->src_linesize - s_x;
+
+                /* each new line continues from the beginning */
+                d_x = 0;        /* next line from beginning */
+                s_x = 0;
+                y += line_decoder->dst_pitch;  /* next line */
+                line += 1;
+        }
+        return true;
+}
+
+/**
+ * Decodes packets collected in state_video_decoder::line_jobs. Every tile is
+ * split to line_decode_threads slices of whole lines that are decoded in
+ * parallel, so that no two threads write to the same line.
+ * @retval false if the frame buffer is too small for the data
+ */
+static bool decode_line_jobs(struct state_video_decoder *decoder)
+{
+        atomic<bool> ok{true};
+        for (unsigned int substream = 0; substream < decoder->line_jobs.size(); ++substream) {
+                vector<line_decode_job> &jobs = decoder->line_jobs[substream];
+                if (jobs.empty()) {
+                        continue;
+                }
+                const struct line_decoder *line_decoder = &decoder->line_decoder[substream];
+                struct tile *tile = vf_get_tile(decoder->frame, decoder->merged_fb ? 0 : substream);
+                // pbuf passes the packets in descending order
+                sort(jobs.begin(), jobs.end(), [](line_decode_job const &a, line_decode_job const &b) {
+                                return a.data_pos < b.data_pos; });
+                unsigned int src_linesize = line_decoder->src_linesize;
+                int lines = (jobs.back().data_pos + jobs.back().len + src_linesize - 1) / src_linesize;
+                int threads = decoder->line_decode_threads;
+
+                parallel_for(0, lines, [&](int line_begin, int line_end) {
+                        uint32_t begin = line_begin * src_linesize;
+                        uint32_t end = line_end * src_linesize;
+                        // last packet starting at or before the slice (may span into it)
+                        auto it = upper_bound(jobs.begin(), jobs.end(), begin, [](uint32_t pos, line_decode_job const &job) {
+                                        return pos < job.data_pos; });
+                        if (it != jobs.begin()) {
+                                --it;
+                        }
+                        for ( ; it != jobs.end() && it->data_pos < end; ++it) {
+                                if (!decode_packet_lines(line_decoder, tile, it->data_pos, it->source, it->len,
+                                                        line_begin, line_end)) {
+                                        ok = false;
+                                }
+                        }
+                }, (lines + threads - 1) / threads);
+        }
+        return ok;
+}
+
 #define ENCRYPTED_ERR "Receiving encrypted video data but " \
         "no decryption key entered!\n"
 #define NOT_ENCRYPTED_ERR "Receiving unencrypted video data " \
         "while expecting encrypted.\n"
 
+/**
+ * Result of FEC decoding of a single tile (see fec_decode_tile())
+ */
+struct tile_fec_result {
+        enum {
+                TILE_OK,
+                TILE_CORRUPTED,  ///< unable to reconstruct data
+                TILE_RECONFIGURE, ///< tile format differs from the current one (see @ref network_desc)
+                TILE_NO_FRAME,   ///< no framebuffer to decode to
+        } status = TILE_OK;
+        struct video_desc network_desc = {};
+        unsigned long long nanoPerTileErrorCorrection = 0;
+        char *data = nullptr; ///< recovered tile data (without video header)
+        int data_len = 0;
+};
+
+/**
+ * Recovers single tile of a frame with its own FEC instance. Tiles are
+ * processed in parallel so this must touch only data related to the tile pos.
+ */
+static struct tile_fec_result fec_recover_tile(struct state_video_decoder *decoder, frame_msg *data,
+                fec *fec_state, int pos, struct video_frame *frame)
+{
+        struct tile_fec_result ret;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        char *fec_out_buffer = NULL;
+        int fec_out_len = 0;
+
+        if (data->all_pkts_received) {
+                fec_state->decode_complete(data->recv_frame->tiles[pos].data,
+                                data->recv_frame->tiles[pos].data_len,
+                                &fec_out_buffer, &fec_out_len);
+        } else {
+                fec_state->decode(data->recv_frame->tiles[pos].data,
+                                data->recv_frame->tiles[pos].data_len,
+                                &fec_out_buffer, &fec_out_len, data->pckt_list[pos]);
+        }
+
+        if (data->recv_frame->tiles[pos].data_len != (unsigned int) sum_map(data->pckt_list[pos])) {
+                verbose_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.\n", pos,
+                                (unsigned int) data->buffer_num[pos],
+                                data->recv_frame->tiles[pos].data_len,
+                                (unsigned int) sum_map(data->pckt_list[pos]));
+        }
+
+        if(fec_out_len == 0) {
+                verbose_msg("[decoder] FEC: unable to reconstruct data.\n");
+                ret.status = tile_fec_result::TILE_CORRUPTED;
+                return ret;
+        }
+
+        video_payload_hdr_t video_hdr;
+        memcpy(&video_hdr, fec_out_buffer,
+                        sizeof(video_payload_hdr_t));
+        fec_out_buffer += sizeof(video_payload_hdr_t);
+        fec_out_len -= sizeof(video_payload_hdr_t);
+
+        parse_video_hdr(video_hdr, &ret.network_desc);
+        if (!video_desc_eq_excl_param(decoder->received_vid_desc,
+                                ret.network_desc, PARAM_TILE_COUNT)) {
+                ret.status = tile_fec_result::TILE_RECONFIGURE;
+                return ret;
+        }
+
+        if(!frame) {
+                ret.status = tile_fec_result::TILE_NO_FRAME;
+                return ret;
+        }
+
+        if(decoder->decoder_type == EXTERNAL_DECODER) {
+                data->nofec_frame->tiles[pos].data_len = fec_out_len;
+                data->nofec_frame->tiles[pos].data = fec_out_buffer;
+        }
+        ret.data = fec_out_buffer;
+        ret.data_len = fec_out_len;
+
+        ret.nanoPerTileErrorCorrection =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - t0).count();
+        return ret;
+}
+
+/**
+ * Decodes recovered tile pos with the line decoder to the framebuffer.
+ */
+static void line_decode_tile(struct state_video_decoder *decoder, int pos, struct video_frame *frame,
+                const char *src, int len)
+{
+        int divisor;
+
+        if (!decoder->merged_fb) {
+                divisor = decoder->max_substreams;
+        } else {
+                divisor = 1;
+        }
+
+        struct tile *tile = vf_get_tile(frame, pos % divisor);
+
+        struct line_decoder *line_decoder =
+                &decoder->line_decoder[pos];
+
+        int data_pos = 0;
+        char *dst = tile->data + line_decoder->base_offset;
+        while(data_pos < len) {
+                line_decoder->decode_line((unsigned char*)dst, (const unsigned char *) src, line_decoder->src_linesize,
+                                line_decoder->shifts[0],
+                                line_decoder->shifts[1],
+                                line_decoder->shifts[2]);
+                src += line_decoder->src_linesize;
+                dst += vc_get_linesize(tile->width ,frame->color_spec);
+                data_pos += line_decoder->src_linesize;
+        }
+}
+
 static void *fec_thread(void *args) {
         struct state_video_decoder *decoder =
                 (struct state_video_decoder *) args;
 
-        fec *fec_state = NULL;
+        vector<unique_ptr<fec>> fec_states; ///< one instance per tile - decoded in parallel
         struct fec_desc desc(FEC_NONE);
 
         while(1) {
@@ -380,23 +704,31 @@ static void *fec_thread(void *args) {
                 }
 
                 struct video_frame *frame = decoder->frame;
-                struct tile *tile = NULL;
+                int tile_count = get_video_mode_tiles_x(decoder->video_mode)
+                        * get_video_mode_tiles_y(decoder->video_mode);
                 auto t0 = std::chrono::high_resolution_clock::now();
 
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
-                        if(!fec_state || desc.k != data->recv_frame->fec_params.k ||
+                        if(desc.k != data->recv_frame->fec_params.k ||
                                         desc.m != data->recv_frame->fec_params.m ||
                                         desc.c != data->recv_frame->fec_params.c ||
-                                        desc.seed != data->recv_frame->fec_params.seed
+                                        desc.seed != data->recv_frame->fec_params.seed ||
+                                        desc.type != data->recv_frame->fec_params.type
                           ) {
-                                delete fec_state;
+                                fec_states.clear();
                                 desc = data->recv_frame->fec_params;
-                                fec_state = fec::create_from_desc(desc);
+                        }
+                        while ((int) fec_states.size() < tile_count) {
+                                fec *fec_state = fec::create_from_desc(desc);
                                 if(fec_state == NULL) {
                                         log_msg(LOG_LEVEL_FATAL, "[decoder] Unable to initialize FEC.\n");
                                         exit_uv(1);
-                                        goto cleanup;
+                                        break;
                                 }
+                                fec_states.emplace_back(fec_state);
+                        }
+                        if ((int) fec_states.size() < tile_count) {
+                                goto cleanup;
                         }
                 }
 
@@ -404,84 +736,53 @@ static void *fec_thread(void *args) {
                 data->nofec_frame->ssrc = data->recv_frame->ssrc;
 
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
-                        bool buffer_swapped = false;
-                        for (int pos = 0; pos < get_video_mode_tiles_x(decoder->video_mode)
-                                        * get_video_mode_tiles_y(decoder->video_mode); ++pos) {
-                                char *fec_out_buffer = NULL;
-                                int fec_out_len = 0;
-
-                                fec_state->decode(data->recv_frame->tiles[pos].data,
-                                                data->recv_frame->tiles[pos].data_len,
-                                                &fec_out_buffer, &fec_out_len, data->pckt_list[pos]);
-
-                                if (data->recv_frame->tiles[pos].data_len != (unsigned int) sum_map(data->pckt_list[pos])) {
-                                        verbose_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.\n", pos,
-                                                        (unsigned int) data->buffer_num[pos],
-                                                        data->recv_frame->tiles[pos].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[pos]));
-                                }
-
-                                if(fec_out_len == 0) {
-                                        verbose_msg("[decoder] FEC: unable to reconstruct data.\n");
-                                        data->is_corrupted = true;
-                                        goto cleanup;
-                                }
-
-                                video_payload_hdr_t video_hdr;
-                                memcpy(&video_hdr, fec_out_buffer,
-                                                sizeof(video_payload_hdr_t));
-                                fec_out_buffer += sizeof(video_payload_hdr_t);
-                                fec_out_len -= sizeof(video_payload_hdr_t);
-
-                                struct video_desc network_desc;
-                                parse_video_hdr(video_hdr, &network_desc);
-                                if (!video_desc_eq_excl_param(decoder->received_vid_desc,
-                                                        network_desc, PARAM_TILE_COUNT)) {
-                                        decoder->msg_queue.push(new main_msg_reconfigure(network_desc, move(data)));
-                                        goto cleanup;
-                                }
-
-                                if(!frame) {
-                                        goto cleanup;
-                                }
-
-                                if(decoder->decoder_type == EXTERNAL_DECODER) {
-                                        data->nofec_frame->tiles[pos].data_len = fec_out_len;
-                                        data->nofec_frame->tiles[pos].data = fec_out_buffer;
-                                } else { // linedecoder
-                                        if (!buffer_swapped) {
-                                                buffer_swapped = true;
-                                                wait_for_framebuffer_swap(decoder);
-                                                unique_lock<mutex> lk(decoder->lock);
-                                                decoder->buffer_swapped = false;
+                        vector<tile_fec_result> results(tile_count);
+                        // the frame is dropped if any tile fails, so don't waste time with the others
+                        atomic<bool> failed{false};
+                        parallel_for(0, tile_count, [&](int begin, int end) {
+                                        for (int pos = begin; pos < end && !failed; ++pos) {
+                                                results[pos] = fec_recover_tile(decoder, data.get(),
+                                                                fec_states[pos].get(), pos, frame);
+                                                if (results[pos].status != tile_fec_result::TILE_OK) {
+                                                        failed = true;
+                                                }
                                         }
+                                });
 
-                                        int divisor;
+                        data->nanoPerTileErrorCorrection.resize(tile_count);
+                        for (int pos = 0; pos < tile_count; ++pos) {
+                                data->nanoPerTileErrorCorrection[pos] = results[pos].nanoPerTileErrorCorrection;
+                        }
 
-                                        if (!decoder->merged_fb) {
-                                                divisor = decoder->max_substreams;
-                                        } else {
-                                                divisor = 1;
-                                        }
+                        for (int pos = 0; pos < tile_count && failed; ++pos) {
+                                switch (results[pos].status) {
+                                case tile_fec_result::TILE_OK:
+                                        continue;
+                                case tile_fec_result::TILE_CORRUPTED:
+                                        data->is_corrupted = true;
+                                        break;
+                                case tile_fec_result::TILE_RECONFIGURE:
+                                        decoder->msg_queue.push(new main_msg_reconfigure(results[pos].network_desc, move(data)));
+                                        break;
+                                case tile_fec_result::TILE_NO_FRAME:
+                                        break;
+                                }
+                                goto cleanup;
+                        }
 
-                                        tile = vf_get_tile(frame, pos % divisor);
-
-                                        struct line_decoder *line_decoder =
-                                                &decoder->line_decoder[pos];
-
-                                        int data_pos = 0;
-                                        char *src = fec_out_buffer;
-                                        char *dst = tile->data + line_decoder->base_offset;
-                                        while(data_pos < (int) fec_out_len) {
-                                                line_decoder->decode_line((unsigned char*)dst, (unsigned char *) src, line_decoder->src_linesize,
-                                                                line_decoder->shifts[0],
-                                                                line_decoder->shifts[1],
-                                                                line_decoder->shifts[2]);
-                                                src += line_decoder->src_linesize;
-                                                dst += vc_get_linesize(tile->width ,frame->color_spec);
-                                                data_pos += line_decoder->src_linesize;
-                                        }
+                        if (decoder->decoder_type != EXTERNAL_DECODER) {
+                                // wait here, not in the pool tasks, not to block them while the display swaps
+                                wait_for_framebuffer_swap(decoder);
+                                {
+                                        unique_lock<mutex> lk(decoder->lock);
+                                        decoder->buffer_swapped = false;
                                 }
+                                parallel_for(0, tile_count, [&](int begin, int end) {
+                                                for (int pos = begin; pos < end; ++pos) {
+                                                        line_decode_tile(decoder, pos, frame, results[pos].data,
+                                                                        results[pos].data_len);
+                                                }
+                                        });
                         }
                 } else { /* PT_VIDEO */
                         for(int i = 0; i < (int) decoder->max_substreams; ++i) {
@@ -510,8 +811,6 @@ cleanup:
                 ;
         }
 
-        delete fec_state;
-
         return NULL;
 }
 
@@ -617,7 +916,7 @@ static void *decompress_thread(void *args) {
                         }
                 }
 
-                msg->nanoPerFrameDecompress =
+                msg->nanoPerFrameDecompress +=
                         std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - t0).count();
 
                 if(decoder->change_il) {
@@ -689,6 +988,8 @@ static void decoder_set_video_mode(struct state_video_decoder *decoder, enum vid
  * @return Newly created decoder state. If an error occured, returns NULL.
  * @ingroup video_rtp_decoder
  */
+ADD_TO_PARAM(decoder_line_threads, "decoder-line-threads", "* decoder-line-threads=<n>\n"
+                "  Decode uncompressed video in <n> slices in parallel (limited by worker-threads)\n");
 struct state_video_decoder *video_decoder_init(struct module *parent,
                 enum video_mode video_mode,
                 struct display *display, const char *encryption)
@@ -697,6 +998,10 @@ struct state_video_decoder *video_decoder_init(struct module *parent,
 
         s = new state_video_decoder(parent);
 
+        if (get_commandline_param("decoder-line-threads")) {
+                s->line_decode_threads = max(atoi(get_commandline_param("decoder-line-threads")), 1);
+        }
+
         if (encryption) {
                 s->dec_funcs = static_cast<const struct openssl_decrypt_info *>(load_library("openssl_decrypt",
                                         LIBRARY_CLASS_UNDEFINED, OPENSSL_DECRYPT_ABI_VERSION));
@@ -1337,6 +1642,8 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
 
         int pt;
         bool buffer_swapped = false;
+        bool pkt_dropped = false;
+        std::chrono::high_resolution_clock::duration line_decode_duration{};
 
         perf_record(UVP_DECODEFRAME, cdata);
 
@@ -1382,12 +1689,15 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 delete msg_reconf;
         }
 
+        decoder->line_jobs.resize(max_substreams);
+        for (auto &jobs : decoder->line_jobs) {
+                jobs.clear();
+        }
+
         while (cdata != NULL) {
                 uint32_t tmp;
                 uint32_t *hdr;
                 int len;
-                uint32_t offset;
-                unsigned char *source;
                 char *data;
                 uint32_t data_pos;
                 uint32_t substream;
@@ -1487,6 +1797,7 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                                         sizeof(video_payload_hdr_t) : sizeof(fec_video_payload_hdr_t),
                                         plaintext, crypto_mode)) == 0) {
                                 log_msg(LOG_LEVEL_VERBOSE, "Warning: Packet dropped AES - wrong CRC!\n");
+                                pkt_dropped = true;
                                 goto next_packet;
                         }
                         data = (char *) plaintext;
@@ -1503,6 +1814,10 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                                 vf_free(frame);
                                 return FALSE;
 #endif
+                                // packets collected so far belong to the previous format
+                                for (auto &jobs : decoder->line_jobs) {
+                                        jobs.clear();
+                                }
                         }
 
                         // hereafter, display framebuffer can be used, so we
@@ -1532,82 +1847,28 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                                 tile = vf_get_tile(decoder->frame, 0);
                         }
 
-                        struct line_decoder *line_decoder =
-                                &decoder->line_decoder[substream];
-
                         /* End of critical section */
 
-                        /* MAGIC, don't touch it, you definitely break it
-                         *  *source* is data from network, *destination* is frame buffer
-                         */
-
-                        /* compute Y pos in source frame and convert it to
-                         * byte offset in the destination frame
-                         */
-                        int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
-
-                        /* compute X pos in source frame */
-                        int s_x = data_pos % line_decoder->src_linesize;
-
-                        /* convert X pos from source frame into the destination frame.
-                         * it is byte offset from the beginning of a line.
-                         */
-                        int d_x = ((int)((s_x) / line_decoder->src_bpp)) *
-                                line_decoder->dst_bpp;
-
-                        /* pointer to data payload in packet */
-                        source = (unsigned char*)(data);
-
-                        /* copy whole packet that can span several lines.
-                         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
-                         */
-                        while (len > 0) {
-                                /* len id payload length in source BPP
-                                 * decoder needs len in destination BPP, so convert it
-                                 */
-                                int l = ((int)(len / line_decoder->src_bpp)) * line_decoder->dst_bpp;
+                        if (pt == PT_VIDEO && decoder->line_decode_threads > 1) {
+                                // payload stays valid until we return, decode all at once
+                                decoder->line_jobs[substream].push_back({data_pos, len, (const unsigned char *) data});
+                                goto next_packet;
+                        }
 
-                                /* do not copy multiple lines, we need to
-                                 * copy (& clip, center) line by line
+                        auto t0 = std::chrono::high_resolution_clock::now();
+                        if (!decode_packet_lines(&decoder->line_decoder[substream], tile, data_pos,
+                                                (const unsigned char *) data, len, 0, UINT_MAX)) {
+                                /* this should not ever happen as we call reconfigure before each packet
+                                 * iff reconfigure is needed. But if it still happens, something is terribly wrong
+                                 * say it loudly
                                  */
-                                if (l + d_x > (int) line_decoder->dst_linesize) {
-                                        l = line_decoder->dst_linesize - d_x;
+                                if((prints % 100) == 0) {
+                                        log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
+                                                        "Well this should not happened. Expect troubles pretty soon.\n");
                                 }
-
-                                /* compute byte offset in destination frame */
-                                offset = y + d_x;
-
-                                /* watch the SEGV */
-                                if (l + line_decoder->base_offset + offset <= tile->data_len) {
-                                        /*decode frame:
-                                         * we have offset for destination
-                                         * we update source contiguously
-                                         * we pass {r,g,b}shifts */
-                                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
-                                                        line_decoder->shifts[0], line_decoder->shifts[1],
-                                                        line_decoder->shifts[2]);
-                                        /* we decoded one line (or a part of one line) to the end of the line
-                                         * so decrease *source* len by 1 line (or that part of the line */
-                                        len -= line_decoder->src_linesize - s_x;
-                                        /* jump in source by the same amount */
-                                        source += line_decoder->src_linesize - s_x;
-                                } else {
-                                        /* this should not ever happen as we call reconfigure before each packet
-                                         * iff reconfigure is needed. But if it still happens, something is terribly wrong
-                                         * say it loudly
-                                         */
-                                        if((prints % 100) == 0) {
-                                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
-                                                                "Well this should not happened. Expect troubles pretty soon.\n");
-                                        }
-                                        prints++;
-                                        len = 0;
-                                }
-                                /* each new line continues from the beginning */
-                                d_x = 0;        /* next line from beginning */
-                                s_x = 0;
-                                y += line_decoder->dst_pitch;  /* next line */
+                                prints++;
                         }
+                        line_decode_duration += std::chrono::high_resolution_clock::now() - t0;
                 } else { /* PT_VIDEO_LDGM or external decoder */
                         if(!frame->tiles[substream].data) {
                                 frame->tiles[substream].data = (char *) malloc(buffer_length + PADDING);
@@ -1631,6 +1892,14 @@ next_packet:
                 goto cleanup;
         }
 
+        if (buffer_swapped && decoder->line_decode_threads > 1) {
+                auto t0 = std::chrono::high_resolution_clock::now();
+                if (!decode_line_jobs(decoder)) {
+                        log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n");
+                }
+                line_decode_duration += std::chrono::high_resolution_clock::now() - t0;
+        }
+
         assert(ret == TRUE);
 
         for(int i = 0; i < max_substreams; ++i) {
@@ -1648,7 +1917,12 @@ next_packet:
                 fec_msg->pckt_list = std::move(pckt_list);
                 fec_msg->received_pkts_cum = stats->received_pkts_cum;
                 fec_msg->expected_pkts_cum = stats->expected_pkts_cum;
+                fec_msg->lost_pkts_cum = stats->lost_pkts_cum;
+                fec_msg->incomplete_frames_cum = stats->incomplete_frames_cum;
+                fec_msg->all_pkts_received = PBUF_STATS_FRAME_COMPLETE(stats) && !pkt_dropped;
                 fec_msg->nanoPerFrameExpected = decoder->frame ? 1000000000 / decoder->frame->fps : 0;
+                fec_msg->nanoPerFrameDecompress =
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(line_decode_duration).count();
 
                 auto t0 = std::chrono::high_resolution_clock::now();
                 decoder->fec_queue.push(move(fec_msg));
@@ -1672,7 +1946,6 @@ cleanup:
                 long int missing = buffer_number -
                         ((decoder->last_buffer_number + 1) & 0x3fffff);
                 missing = (missing + 0x3fffff) % 0x3fffff;
-                lock_guard<mutex> lk(decoder->stats.lock);
                 if (missing < 0x3fffff / 2) {
                         decoder->stats.missing += missing;
                 } else { // frames may have been reordered, add arbitrary 1
@@ -80,6 +80,7 @@
 #include "tv.h"
 #include "transmit.h"
 #include "utils/jpeg_reader.h"
+#include "utils/pacer.h"
 #include "video.h"
 #include "video_codec.h"
 
@@ -143,6 +144,8 @@ struct tx {
         const struct openssl_encrypt_info *enc_funcs;
         struct openssl_encrypt *encryption;
         long long int bitrate;
+        pacer *shaper;
+        uint64_t kernel_pacing_rate; ///< last rate set to socket if shaper is in PACER_KERNEL mode
 		
         struct rtpenc_h264_state *rtpenc_h264_state;
         char tmp_packet[RTP_MAX_MTU];
@@ -233,6 +236,7 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                 }
 
                 tx->bitrate = bitrate;
+                tx->shaper = new pacer();
                 tx->rtpenc_h264_state = rtpenc_h264_init_state();
         }
 		return tx;
@@ -335,6 +339,7 @@ static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
+        delete tx->shaper;
         free(tx);
 }
 
@@ -467,6 +472,32 @@ static inline int get_data_len(bool with_fec, int mtu, int hdrs_len,
         return data_len;
 }
 
+/**
+ * Sets socket pacing rate if it differs from the last one by more than 5 %.
+ * If the kernel pacing is not available, switches pacer to sleep mode.
+ *
+ * @param rate rate in B/s, 0 means unlimited
+ */
+static void tx_set_kernel_pacing_rate(struct tx *tx, struct rtp *rtp_session, uint64_t rate)
+{
+        if (rate == 0) {
+                rate = UINT64_MAX; // stored as unlimited, passed to the socket as 0
+        }
+        if (rate == tx->kernel_pacing_rate) {
+                return;
+        }
+        if (tx->kernel_pacing_rate != 0 && tx->kernel_pacing_rate != UINT64_MAX && rate != UINT64_MAX &&
+                        llabs((long long) rate - (long long) tx->kernel_pacing_rate) < (long long) (tx->kernel_pacing_rate / 20)) {
+                return;
+        }
+        if (!rtp_set_pacing_rate(rtp_session, rate == UINT64_MAX ? 0 : rate)) {
+                log_msg(LOG_LEVEL_WARNING, "[Transmit] Kernel pacing not available, using sleeping pacer.\n");
+                tx->shaper->set_mode(PACER_SLEEP);
+                return;
+        }
+        tx->kernel_pacing_rate = rate;
+}
+
 static void
 tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 uint32_t ts, int send_m,
@@ -486,14 +517,6 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         int pt;            /* A value specified in our packet format */
         char *data;
         unsigned int pos;
-#ifdef HAVE_LINUX
-        struct timespec start, stop;
-#elif defined HAVE_MACOSX
-        struct timeval start, stop;
-#else // Windows
-	LARGE_INTEGER start, stop, freq;
-#endif
-        long delta, overslept = 0;
         uint32_t tmp;
         int mult_pos[FEC_MAX_MULT];
         int mult_index = 0;
@@ -631,8 +654,14 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 rtp_async_start(rtp_session, packet_count);
         }
 
+        if (tx->shaper->get_mode() == PACER_KERNEL) {
+                tx_set_kernel_pacing_rate(tx, rtp_session, packet_rate > 0 ?
+                                (uint64_t) ((tile->data_len + (double) packet_count * hdrs_len) / packet_count * 1000000000.0 / packet_rate) :
+                                0);
+        }
+        tx->shaper->start(packet_rate, [rtp_session]() { rtp_async_flush(rtp_session); });
+
         do {
-                GET_STARTTIME;
                 if(tx->fec_scheme == FEC_MULT) {
                         pos = mult_pos[mult_index];
                 }
@@ -683,20 +712,14 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 }
                 rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
 
-                // TRAFFIS SHAPER
-                if (pos < (unsigned int) tile->data_len) { // wait for all but last packet
-                        do {
-                                GET_STOPTIME;
-                                GET_DELTA;
-                        } while (packet_rate - delta - overslept > 0);
-                        overslept = -(packet_rate - delta - overslept);
-                        //fprintf(stdout, "%ld ", overslept);
-                }
+                // TRAFFIS SHAPER - waits for all but last packet
+                tx->shaper->packet_sent(data_len + hdrs_len, pos >= (unsigned int) tile->data_len);
         } while (pos < (unsigned int) tile->data_len);
 
         if (!tx->encryption) {
                 rtp_async_wait(rtp_session);
         }
+        tx->shaper->end();
         free(rtp_headers);
 }
 
@@ -0,0 +1,470 @@
+/**
+ * @file   utils/dxt_cpu.cpp
+ * @brief  CPU DXT1, DXT1_YUV and DXT5 (YCoCg) encoder and decoder
+ *
+ * Source pixels of a band of 4 lines are converted to the color space of the
+ * output (with the same formulas as the GLSL shaders) to float planes
+ * ordered so that the same pixel of consecutive blocks is contiguous. The
+ * block encoders from dxt_cpu_kernel.h then process 4 (SSE4.1) or 8 (AVX2,
+ * dxt_cpu_avx2.cpp) blocks at once.
+ *
+ * DXT1_YUV has no GLSL encoder, its blocks store Y, Cb and Cr instead of
+ * R, G and B and are otherwise encoded as DXT1.
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <smmintrin.h>
+#include <vector>
+
+#include "host.h"
+#include "utils/dxt_cpu.h"
+#include "utils/dxt_cpu_kernel.h"
+#include "utils/worker.h"
+
+using namespace std;
+
+ADD_TO_PARAM(dxt_cpu_simd, "dxt-cpu-simd", "* dxt-cpu-simd=sse4.1|avx2\n"
+                "  Limits instruction set used by CPU DXT encoder (default: best supported by CPU)\n");
+
+namespace {
+
+/// SSE4.1 vector of 4 lanes for the templates in dxt_cpu_kernel.h
+struct dxt_vec_sse {
+        typedef __m128 f;
+        typedef __m128i i;
+        enum { N = 4 };
+        static inline f load(const float *p) { return _mm_loadu_ps(p); }
+        static inline f set1(float x) { return _mm_set1_ps(x); }
+        static inline f add(f a, f b) { return _mm_add_ps(a, b); }
+        static inline f sub(f a, f b) { return _mm_sub_ps(a, b); }
+        static inline f mul(f a, f b) { return _mm_mul_ps(a, b); }
+        static inline f div(f a, f b) { return _mm_div_ps(a, b); }
+        static inline f min(f a, f b) { return _mm_min_ps(a, b); }
+        static inline f max(f a, f b) { return _mm_max_ps(a, b); }
+        static inline f abs(f a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        static inline f cmpgt(f a, f b) { return _mm_cmpgt_ps(a, b); }
+        static inline f cmplt(f a, f b) { return _mm_cmplt_ps(a, b); }
+        static inline f cmple(f a, f b) { return _mm_cmple_ps(a, b); }
+        /// mask ? a : b
+        static inline f select(f mask, f a, f b) { return _mm_blendv_ps(b, a, mask); }
+        static inline i set1_i(int x) { return _mm_set1_epi32(x); }
+        static inline i or_i(i a, i b) { return _mm_or_si128(a, b); }
+        static inline i and_i(i a, i b) { return _mm_and_si128(a, b); }
+        static inline i xor_i(i a, i b) { return _mm_xor_si128(a, b); }
+        static inline i sub_i(i a, i b) { return _mm_sub_epi32(a, b); }
+        static inline i slli(i a, int n) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+        static inline i srli(i a, int n) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+        static inline i cmpgt_i(i a, i b) { return _mm_cmpgt_epi32(a, b); }
+        /// rounds to nearest (even) integer
+        static inline i cvt_i(f a) { return _mm_cvtps_epi32(a); }
+        static inline f cvt_f(i a) { return _mm_cvtepi32_ps(a); }
+        static inline i mask_i(f a) { return _mm_castps_si128(a); }
+        static inline f mask_f(i a) { return _mm_castsi128_ps(a); }
+        static inline i select_i(f mask, i a, i b) {
+                return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b), _mm_castsi128_ps(a), mask));
+        }
+        static inline void store_i(uint32_t *p, i a) { _mm_storeu_si128((__m128i *)(void *) p, a); }
+};
+
+static const float norm_table[256] = {
+#define N(x) (x) / 255.0f, (x + 1) / 255.0f, (x + 2) / 255.0f, (x + 3) / 255.0f
+#define N16(x) N(x), N(x + 4), N(x + 8), N(x + 12)
+        N16(0.0f), N16(16.0f), N16(32.0f), N16(48.0f), N16(64.0f), N16(80.0f), N16(96.0f), N16(112.0f),
+        N16(128.0f), N16(144.0f), N16(160.0f), N16(176.0f), N16(192.0f), N16(208.0f), N16(224.0f), N16(240.0f),
+#undef N16
+#undef N
+};
+
+/// ConvertYUVToRGB() of the compression shaders
+static inline void yuv_to_rgb(float y, float u, float v, float *rgb)
+{
+        float Y = 1.1643f * (y - 0.0625f);
+        float U = u - 0.5f;
+        float V = v - 0.5f;
+        rgb[0] = Y + 1.7926f * V;
+        rgb[1] = Y - 0.2132f * U - 0.5328f * V;
+        rgb[2] = Y + 2.1124f * U;
+}
+
+/// ConvertRGBToYCoCg() of compress_dxt5ycocg_fp.glsl
+static inline void rgb_to_ycocg(const float *rgb, float *ycocg)
+{
+        ycocg[0] = (rgb[0] + 2.0f * rgb[1] + rgb[2]) * 0.25f;
+        ycocg[1] = (2.0f * rgb[0] - 2.0f * rgb[2]) * 0.25f + DXT_YCOCG_OFFSET;
+        ycocg[2] = (-rgb[0] + 2.0f * rgb[1] - rgb[2]) * 0.25f + DXT_YCOCG_OFFSET;
+}
+
+/// inverse of the conversion in display_dxt1_yuv_fp.glsl used to display DXT1_YUV
+static inline void rgb_to_dxt1_yuv(const float *rgb, float *yuv)
+{
+        yuv[0] = 0.0625f + rgb[0] * 0.2568f + rgb[1] * 0.5042f + rgb[2] * 0.0979f;
+        yuv[1] = 0.5f - rgb[0] * 0.1302f - rgb[1] * 0.2556f + rgb[2] * 0.3859f;
+        yuv[2] = 0.5f + rgb[0] * 0.3859f - rgb[1] * 0.3231f - rgb[2] * 0.0628f;
+}
+
+/**
+ * Converts 4 lines starting at line y (clamped to image as GL_CLAMP_TO_EDGE
+ * does) to planes of the output color space.
+ */
+template<codec_t IN, codec_t OUT>
+static void convert_band(const unsigned char *src, int src_linesize, int width, int height, int y,
+                int blocks, float *const *planes, int stride)
+{
+        for (int i = 0; i < 4; ++i) {
+                const unsigned char *line = src + (size_t) min(y + i, height - 1) * src_linesize;
+                for (int x = 0; x < blocks * 4; ++x) {
+                        int xs = min(x, width - 1);
+                        float in[3], out[3];
+                        if (IN == UYVY) {
+                                const unsigned char *pair = line + 4 * (xs / 2);
+                                in[0] = norm_table[pair[1 + 2 * (xs & 1)]];
+                                in[1] = norm_table[pair[0]];
+                                in[2] = norm_table[pair[2]];
+                        } else {
+                                const unsigned char *pix = line + (IN == RGBA ? 4 : 3) * xs;
+                                in[0] = norm_table[pix[0]];
+                                in[1] = norm_table[pix[1]];
+                                in[2] = norm_table[pix[2]];
+                        }
+                        // UYVY (BT.709) goes through RGB also for DXT1_YUV,
+                        // which uses different coefficients
+                        float rgb[3];
+                        if (IN == UYVY) {
+                                yuv_to_rgb(in[0], in[1], in[2], rgb);
+                        } else {
+                                memcpy(rgb, in, sizeof rgb);
+                        }
+                        if (OUT == DXT1_YUV) {
+                                rgb_to_dxt1_yuv(rgb, out);
+                        } else if (OUT == DXT5) {
+                                rgb_to_ycocg(rgb, out);
+                        } else {
+                                memcpy(out, rgb, sizeof out);
+                        }
+                        int idx = (4 * i + (x & 3)) * stride + x / 4;
+                        planes[0][idx] = out[0];
+                        planes[1][idx] = out[1];
+                        planes[2][idx] = out[2];
+                }
+        }
+}
+
+typedef void (*convert_band_t)(const unsigned char *, int, int, int, int, int, float *const *, int);
+
+template<codec_t OUT>
+static convert_band_t get_convert_band(codec_t in_codec)
+{
+        switch (in_codec) {
+        case RGB: return convert_band<RGB, OUT>;
+        case RGBA: return convert_band<RGBA, OUT>;
+        case UYVY: return convert_band<UYVY, OUT>;
+        default: return nullptr;
+        }
+}
+
+static bool use_avx2()
+{
+#ifdef DXT_CPU_HAVE_AVX2
+        const char *req = get_commandline_param("dxt-cpu-simd");
+        if (req != NULL && strcmp(req, "avx2") != 0) {
+                return false;
+        }
+        static bool supported = [] { __builtin_cpu_init(); return __builtin_cpu_supports("avx2"); }();
+        return supported;
+#else
+        return false;
+#endif
+}
+
+/// expands 5:6:5 color to 8 bits per component
+static inline void rgb565_to_rgb(unsigned c, int *rgb)
+{
+        int r = c >> 11, g = (c >> 5) & 0x3f, b = c & 0x1f;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+}
+
+/// decodes color palette of a block, @returns color indices
+static inline uint32_t decode_color_palette(const unsigned char *block, bool dxt1, int (*pal)[3])
+{
+        unsigned c0 = block[0] | block[1] << 8;
+        unsigned c1 = block[2] | block[3] << 8;
+        rgb565_to_rgb(c0, pal[0]);
+        rgb565_to_rgb(c1, pal[1]);
+        for (int k = 0; k < 3; ++k) {
+                if (!dxt1 || c0 > c1) {
+                        pal[2][k] = (2 * pal[0][k] + pal[1][k] + 1) / 3;
+                        pal[3][k] = (pal[0][k] + 2 * pal[1][k] + 1) / 3;
+                } else {
+                        pal[2][k] = (pal[0][k] + pal[1][k]) / 2;
+                        pal[3][k] = 0;
+                }
+        }
+        return block[4] | block[5] << 8 | block[6] << 16 | (uint32_t) block[7] << 24;
+}
+
+/// decodes DXT5 alpha block to 16 values
+static inline void decode_alpha_block(const unsigned char *block, int *out)
+{
+        int a[8];
+        a[0] = block[0];
+        a[1] = block[1];
+        if (a[0] > a[1]) {
+                for (int k = 1; k < 7; ++k) {
+                        a[k + 1] = ((7 - k) * a[0] + k * a[1] + 3) / 7;
+                }
+        } else {
+                for (int k = 1; k < 5; ++k) {
+                        a[k + 1] = ((5 - k) * a[0] + k * a[1] + 2) / 5;
+                }
+                a[6] = 0;
+                a[7] = 255;
+        }
+        uint64_t indices = 0;
+        for (int k = 0; k < 6; ++k) {
+                indices |= (uint64_t) block[2 + k] << (8 * k);
+        }
+        for (int p = 0; p < 16; ++p) {
+                out[p] = a[(indices >> (3 * p)) & 0x7];
+        }
+}
+
+static inline int clamp_byte(int x)
+{
+        return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+static inline int clamp_byte(float x)
+{
+        return clamp_byte((int) lrintf(x * 255.0f));
+}
+
+/// BT.709 limited range as in rgba_to_yuv422.glsl, in 16-bit fixed point
+static inline void rgb_to_yuv_int(const int *rgb, int *yuv)
+{
+        yuv[0] = (16 << 16) + 11966 * rgb[0] + 40254 * rgb[1] + 4064 * rgb[2];
+        yuv[1] = (128 << 16) - 6592 * rgb[0] - 22187 * rgb[1] + 28784 * rgb[2];
+        yuv[2] = (128 << 16) + 28784 * rgb[0] - 26142 * rgb[1] - 2637 * rgb[2];
+}
+
+/**
+ * Decodes a block to 16 pixels in the color space of out_codec - RGB for
+ * RGBA and Y, Cb, Cr (in 16-bit fixed point, to be averaged) for UYVY.
+ * Conversions follow the display shaders (display_dxt5ycocg_fp.glsl,
+ * display_dxt1_yuv_fp.glsl) and rgba_to_yuv422.glsl, where possible they
+ * are applied to the palette rather than to individual pixels.
+ */
+static inline void decode_block(codec_t codec, const unsigned char *block, codec_t out_codec, int (*px)[3])
+{
+        int pal[4][3];
+        if (codec == DXT5) {
+                int y[16];
+                decode_alpha_block(block, y);
+                uint32_t indices = decode_color_palette(block + 8, false, pal);
+                // 4 * Co and 4 * Cg - scale 1, 2 or 4 is stored in blue as 0, 1 and 3
+                int cocg4[4][2];
+                for (int e = 0; e < 4; ++e) {
+                        int mul = 4 / ((pal[e][2] >> 3) + 1);
+                        cocg4[e][0] = (pal[e][0] - 128) * mul;
+                        cocg4[e][1] = (pal[e][1] - 128) * mul;
+                }
+                for (int p = 0; p < 16; ++p) {
+                        const int *c = cocg4[(indices >> (2 * p)) & 0x3];
+                        int rgb[3] = {
+                                clamp_byte((4 * y[p] + c[0] - c[1] + 2) >> 2),
+                                clamp_byte((4 * y[p] + c[1] + 2) >> 2),
+                                clamp_byte((4 * y[p] - c[0] - c[1] + 2) >> 2),
+                        };
+                        if (out_codec == UYVY) {
+                                rgb_to_yuv_int(rgb, px[p]);
+                        } else {
+                                memcpy(px[p], rgb, sizeof rgb);
+                        }
+                }
+                return;
+        }
+
+        uint32_t indices = decode_color_palette(block, true, pal);
+        // DXT1_YUV is converted to RGB first also for UYVY output (BT.709)
+        if (codec == DXT1_YUV) {
+                for (int e = 0; e < 4; ++e) {
+                        float Y = 1.1643f * (norm_table[pal[e][0]] - 0.0625f);
+                        float U = 1.1384f * (norm_table[pal[e][1]] - 0.5f);
+                        float V = 1.1384f * (norm_table[pal[e][2]] - 0.5f);
+                        pal[e][0] = clamp_byte(Y + 1.5958f * V);
+                        pal[e][1] = clamp_byte(Y - 0.39173f * U - 0.81290f * V);
+                        pal[e][2] = clamp_byte(Y + 2.017f * U);
+                }
+        }
+        if (out_codec == UYVY) {
+                for (int e = 0; e < 4; ++e) {
+                        int rgb[3];
+                        memcpy(rgb, pal[e], sizeof rgb);
+                        rgb_to_yuv_int(rgb, pal[e]);
+                }
+        }
+        for (int p = 0; p < 16; ++p) {
+                memcpy(px[p], pal[(indices >> (2 * p)) & 0x3], sizeof px[p]);
+        }
+}
+
+} // end of anonymous namespace
+
+bool dxt_cpu_encoder_supports(codec_t in_codec, codec_t out_codec)
+{
+        return (in_codec == RGB || in_codec == RGBA || in_codec == UYVY) &&
+                (out_codec == DXT1 || out_codec == DXT1_YUV || out_codec == DXT5);
+}
+
+bool dxt_cpu_decoder_supports(codec_t in_codec, codec_t out_codec)
+{
+        return (in_codec == DXT1 || in_codec == DXT1_YUV || in_codec == DXT5) &&
+                (out_codec == RGBA || out_codec == UYVY);
+}
+
+size_t dxt_cpu_get_size(int width, int height, codec_t codec)
+{
+        size_t size = (size_t) ((width + 3) / 4 * 4) * ((height + 3) / 4 * 4);
+        return codec == DXT5 ? size : size / 2;
+}
+
+const char *dxt_cpu_simd(void)
+{
+        return use_avx2() ? "avx2" : "sse4.1";
+}
+
+void dxt_cpu_compress_rows(codec_t out_codec, codec_t in_codec, const unsigned char *src, int src_linesize,
+                int width, int height, unsigned char *dst, int block_row_begin, int block_row_end)
+{
+        convert_band_t convert = out_codec == DXT1 ? get_convert_band<DXT1>(in_codec) :
+                out_codec == DXT1_YUV ? get_convert_band<DXT1_YUV>(in_codec) :
+                out_codec == DXT5 ? get_convert_band<DXT5>(in_codec) : nullptr;
+        if (convert == nullptr) {
+                return;
+        }
+        int blocks = (width + 3) / 4;
+        int stride = (blocks + DXT_MAX_LANES - 1) / DXT_MAX_LANES * DXT_MAX_LANES;
+        vector<float> buffer(3 * 16 * stride);
+        float *planes[3] = { buffer.data(), buffer.data() + 16 * stride, buffer.data() + 32 * stride };
+        int words_per_block = out_codec == DXT5 ? 4 : 2;
+        bool avx2 = use_avx2();
+
+        for (int br = block_row_begin; br < block_row_end; ++br) {
+                convert(src, src_linesize, width, height, 4 * br, blocks, planes, stride);
+                auto out = (uint32_t *)(void *) (dst + (size_t) br * blocks * words_per_block * sizeof(uint32_t));
+                if (out_codec == DXT5) {
+#ifdef DXT_CPU_HAVE_AVX2
+                        if (avx2) {
+                                dxt5_ycocg_encode_row_avx2(planes, stride, blocks, out);
+                                continue;
+                        }
+#endif
+                        dxt_encode_row<dxt_vec_sse, dxt5_ycocg_encode_blocks<dxt_vec_sse>, 4>(planes, stride, blocks, out);
+                } else {
+#ifdef DXT_CPU_HAVE_AVX2
+                        if (avx2) {
+                                dxt1_encode_row_avx2(planes, stride, blocks, out);
+                                continue;
+                        }
+#endif
+                        dxt_encode_row<dxt_vec_sse, dxt1_encode_blocks<dxt_vec_sse>, 2>(planes, stride, blocks, out);
+                }
+        }
+        (void) avx2;
+}
+
+void dxt_cpu_compress(codec_t out_codec, codec_t in_codec, const unsigned char *src, int src_linesize,
+                int width, int height, unsigned char *dst)
+{
+        parallel_for(0, (height + 3) / 4, [&](int begin, int end) {
+                        dxt_cpu_compress_rows(out_codec, in_codec, src, src_linesize, width, height, dst, begin, end);
+                        }, 4);
+}
+
+void dxt_cpu_decompress_rows(codec_t in_codec, const unsigned char *src, int width, int height,
+                codec_t out_codec, unsigned char *dst, int pitch, int rshift, int gshift, int bshift,
+                int block_row_begin, int block_row_end)
+{
+        int blocks = (width + 3) / 4;
+        int block_size = in_codec == DXT5 ? 16 : 8;
+        uint32_t alpha = 0xFFFFFFFFu ^ (0xFFu << rshift) ^ (0xFFu << gshift) ^ (0xFFu << bshift);
+
+        for (int br = block_row_begin; br < block_row_end; ++br) {
+                for (int b = 0; b < blocks; ++b) {
+                        int px[16][3];
+                        decode_block(in_codec, src + ((size_t) br * blocks + b) * block_size, out_codec, px);
+                        for (int i = 0; i < 4 && 4 * br + i < height; ++i) {
+                                unsigned char *line = dst + (size_t) (4 * br + i) * pitch;
+                                if (out_codec == RGBA) {
+                                        for (int j = 0; j < 4 && 4 * b + j < width; ++j) {
+                                                const int *c = px[4 * i + j];
+                                                uint32_t val = alpha | (uint32_t) c[0] << rshift |
+                                                        (uint32_t) c[1] << gshift | (uint32_t) c[2] << bshift;
+                                                memcpy(line + 4 * (4 * b + j), &val, sizeof val);
+                                        }
+                                        continue;
+                                }
+                                // UYVY, width is even
+                                for (int j = 0; j < 4 && 4 * b + j < width; j += 2) {
+                                        const int *c1 = px[4 * i + j];
+                                        const int *c2 = px[4 * i + j + 1];
+                                        unsigned char *out = line + 2 * (4 * b + j);
+                                        out[0] = clamp_byte((c1[1] + c2[1] + (1 << 16)) >> 17);
+                                        out[1] = clamp_byte((c1[0] + (1 << 15)) >> 16);
+                                        out[2] = clamp_byte((c1[2] + c2[2] + (1 << 16)) >> 17);
+                                        out[3] = clamp_byte((c2[0] + (1 << 15)) >> 16);
+                                }
+                        }
+                }
+        }
+}
+
+void dxt_cpu_decompress(codec_t in_codec, const unsigned char *src, int width, int height,
+                codec_t out_codec, unsigned char *dst, int pitch, int rshift, int gshift, int bshift)
+{
+        parallel_for(0, (height + 3) / 4, [&](int begin, int end) {
+                        dxt_cpu_decompress_rows(in_codec, src, width, height, out_codec, dst, pitch,
+                                        rshift, gshift, bshift, begin, end);
+                        }, 4);
+}
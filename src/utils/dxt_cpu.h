@@ -0,0 +1,100 @@
+/**
+ * @file   utils/dxt_cpu.h
+ * @brief  CPU DXT1, DXT1_YUV and DXT5 (YCoCg) encoder and decoder
+ *
+ * The encoder follows the RTDXT GLSL compression shaders (dxt_compress/)
+ * so that the produced streams are interchangeable with those of the GPU
+ * encoder. Blocks are encoded with SSE4.1 or AVX2 (if supported by the CPU),
+ * a vector lane per 4x4 block.
+ *
+ * Both directions work on bands of block rows so that a frame can be split
+ * among threads - dxt_cpu_compress() and dxt_cpu_decompress() do that with
+ * the worker pool.
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_DXT_CPU_H_
+#define UTILS_DXT_CPU_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#endif
+
+/// @returns true if the encoder can produce out_codec (DXT1, DXT1_YUV or DXT5) from in_codec (RGB, RGBA or UYVY)
+bool dxt_cpu_encoder_supports(codec_t in_codec, codec_t out_codec);
+/// @returns true if the decoder can decode in_codec to out_codec (RGBA or UYVY)
+bool dxt_cpu_decoder_supports(codec_t in_codec, codec_t out_codec);
+/// @returns size of the compressed frame, same as dxt_get_size() in dxt_compress/dxt_util.h
+size_t dxt_cpu_get_size(int width, int height, codec_t codec);
+/// @returns name of the instruction set used for encoding ("sse4.1" or "avx2")
+const char *dxt_cpu_simd(void);
+
+/**
+ * Compresses block rows [block_row_begin, block_row_end) of the image.
+ *
+ * @param src_linesize  length of a source line in bytes
+ * @param dst           beginning of the whole compressed frame
+ */
+void dxt_cpu_compress_rows(codec_t out_codec, codec_t in_codec, const unsigned char *src, int src_linesize,
+                int width, int height, unsigned char *dst, int block_row_begin, int block_row_end);
+/// compresses the whole image in parallel using the worker pool
+void dxt_cpu_compress(codec_t out_codec, codec_t in_codec, const unsigned char *src, int src_linesize,
+                int width, int height, unsigned char *dst);
+
+/**
+ * Decompresses block rows [block_row_begin, block_row_end) of the image.
+ *
+ * @param src       beginning of the whole compressed frame
+ * @param pitch     length of an output line in bytes
+ * @param rshift, gshift, bshift  positions of components in RGBA output,
+ *                  other bits are set to 1
+ */
+void dxt_cpu_decompress_rows(codec_t in_codec, const unsigned char *src, int width, int height,
+                codec_t out_codec, unsigned char *dst, int pitch, int rshift, int gshift, int bshift,
+                int block_row_begin, int block_row_end);
+/// decompresses the whole image in parallel using the worker pool
+void dxt_cpu_decompress(codec_t in_codec, const unsigned char *src, int width, int height,
+                codec_t out_codec, unsigned char *dst, int pitch, int rshift, int gshift, int bshift);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_DXT_CPU_H_
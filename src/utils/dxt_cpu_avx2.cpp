@@ -0,0 +1,109 @@
+/**
+ * @file   utils/dxt_cpu_avx2.cpp
+ * @brief  AVX2 build of the CPU DXT block encoders
+ *
+ * Compiled with AVX2 enabled as a whole, the functions are called only if
+ * the CPU supports it. FMA is intentionally not enabled so that the output
+ * is bit-identical to the SSE4.1 encoder. Do not include headers with inline
+ * functions shared with other translation units (eg. STL) here.
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+// before any include so that also the kernel templates are compiled for AVX2
+#if defined __GNUC__ && !defined __clang__ && (defined __x86_64__ || defined __i386__)
+#pragma GCC target("avx2")
+#include <immintrin.h>
+#endif
+
+#include "utils/dxt_cpu_kernel.h"
+
+#ifdef DXT_CPU_HAVE_AVX2
+
+namespace {
+
+/// AVX2 vector of 8 lanes, see dxt_vec_sse in dxt_cpu.cpp
+struct dxt_vec_avx2 {
+        typedef __m256 f;
+        typedef __m256i i;
+        enum { N = 8 };
+        static inline f load(const float *p) { return _mm256_loadu_ps(p); }
+        static inline f set1(float x) { return _mm256_set1_ps(x); }
+        static inline f add(f a, f b) { return _mm256_add_ps(a, b); }
+        static inline f sub(f a, f b) { return _mm256_sub_ps(a, b); }
+        static inline f mul(f a, f b) { return _mm256_mul_ps(a, b); }
+        static inline f div(f a, f b) { return _mm256_div_ps(a, b); }
+        static inline f min(f a, f b) { return _mm256_min_ps(a, b); }
+        static inline f max(f a, f b) { return _mm256_max_ps(a, b); }
+        static inline f abs(f a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        static inline f cmpgt(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_GT_OS); }
+        static inline f cmplt(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_LT_OS); }
+        static inline f cmple(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_LE_OS); }
+        static inline f select(f mask, f a, f b) { return _mm256_blendv_ps(b, a, mask); }
+        static inline i set1_i(int x) { return _mm256_set1_epi32(x); }
+        static inline i or_i(i a, i b) { return _mm256_or_si256(a, b); }
+        static inline i and_i(i a, i b) { return _mm256_and_si256(a, b); }
+        static inline i xor_i(i a, i b) { return _mm256_xor_si256(a, b); }
+        static inline i sub_i(i a, i b) { return _mm256_sub_epi32(a, b); }
+        static inline i slli(i a, int n) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+        static inline i srli(i a, int n) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+        static inline i cmpgt_i(i a, i b) { return _mm256_cmpgt_epi32(a, b); }
+        static inline i cvt_i(f a) { return _mm256_cvtps_epi32(a); }
+        static inline f cvt_f(i a) { return _mm256_cvtepi32_ps(a); }
+        static inline i mask_i(f a) { return _mm256_castps_si256(a); }
+        static inline f mask_f(i a) { return _mm256_castsi256_ps(a); }
+        static inline i select_i(f mask, i a, i b) {
+                return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), mask));
+        }
+        static inline void store_i(uint32_t *p, i a) { _mm256_storeu_si256((__m256i *)(void *) p, a); }
+};
+
+} // end of anonymous namespace
+
+void dxt1_encode_row_avx2(const float *const *planes, int stride, int blocks, uint32_t *out)
+{
+        dxt_encode_row<dxt_vec_avx2, dxt1_encode_blocks<dxt_vec_avx2>, 2>(planes, stride, blocks, out);
+}
+
+void dxt5_ycocg_encode_row_avx2(const float *const *planes, int stride, int blocks, uint32_t *out)
+{
+        dxt_encode_row<dxt_vec_avx2, dxt5_ycocg_encode_blocks<dxt_vec_avx2>, 4>(planes, stride, blocks, out);
+}
+
+#endif // defined DXT_CPU_HAVE_AVX2
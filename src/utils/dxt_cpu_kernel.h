@@ -0,0 +1,346 @@
+/**
+ * @file   utils/dxt_cpu_kernel.h
+ * @brief  DXT block encoders shared by the SSE4.1 and AVX2 builds
+ *
+ * Internal header of dxt_cpu.cpp and dxt_cpu_avx2.cpp. The encoders are
+ * templates over a vector abstraction V (see dxt_cpu.cpp), each vector lane
+ * encodes one 4x4 block. The computation mirrors compress_dxt1_fp.glsl and
+ * compress_dxt5ycocg_fp.glsl step by step, keep them in sync.
+ *
+ * Input are 3 planes of floats, pixel p = 4 * row + column of block b is at
+ * plane[p * stride + b]. Everything in this header must be a template or
+ * static - it is compiled with different target options in each includer.
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_DXT_CPU_KERNEL_H_
+#define UTILS_DXT_CPU_KERNEL_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define DXT_YCOCG_OFFSET (128.0f / 255.0f)
+/// lanes of the widest encoder, planes are padded to a multiple of it
+#define DXT_MAX_LANES 8
+
+#if defined __GNUC__ && !defined __clang__ && (defined __x86_64__ || defined __i386__)
+#define DXT_CPU_HAVE_AVX2 1
+/**
+ * @name AVX2 row encoders (dxt_cpu_avx2.cpp)
+ * Encode blocks [0, blocks) of a block row, output equals the one of the
+ * SSE4.1 encoder. Planes must be readable up to the multiple of 8 blocks.
+ * @{ */
+void dxt1_encode_row_avx2(const float *const *planes, int stride, int blocks, uint32_t *out);
+void dxt5_ycocg_encode_row_avx2(const float *const *planes, int stride, int blocks, uint32_t *out);
+/// @}
+#endif
+
+template<class V>
+static inline void dxt_swap_where(typename V::f mask, typename V::f &a, typename V::f &b)
+{
+        typename V::f tmp = V::select(mask, b, a);
+        b = V::select(mask, a, b);
+        a = tmp;
+}
+
+/// GLSL clamp(x, 0.0, 1.0)
+template<class V>
+static inline typename V::f dxt_saturate(typename V::f x)
+{
+        return V::min(V::max(x, V::set1(0.0f)), V::set1(1.0f));
+}
+
+/// GLSL mix(x, y, a)
+template<class V>
+static inline typename V::f dxt_mix(typename V::f x, typename V::f y, float a)
+{
+        return V::add(V::mul(x, V::set1(1.0f - a)), V::mul(y, V::set1(a)));
+}
+
+/// rounds to integer and expands 5 or 6 bit value back to [0, 1]
+template<class V>
+static inline typename V::f dxt_expand(typename V::i c, int bits)
+{
+        typename V::i e = bits == 5 ?
+                V::or_i(V::slli(c, 3), V::srli(c, 2)) :
+                V::or_i(V::slli(c, 2), V::srli(c, 4));
+        return V::mul(V::cvt_f(e), V::set1(1.0f / 255.0f));
+}
+
+/**
+ * Palette indices of color block with endpoints c0 (max) and c1 (min),
+ * EmitIndicesDXT1() and EmitIndicesYCoCgDXT5() in the shaders. For 2
+ * components pass nullptr as c[2].
+ */
+template<class V>
+static inline typename V::i dxt_color_indices(const float *const *planes, int stride, int b,
+                const typename V::f *c0, const typename V::f *c1, int components)
+{
+        typename V::f pal[4][3];
+        for (int k = 0; k < components; ++k) {
+                pal[0][k] = c0[k];
+                pal[1][k] = c1[k];
+                pal[2][k] = dxt_mix<V>(c0[k], c1[k], 1.0f / 3.0f);
+                pal[3][k] = dxt_mix<V>(c0[k], c1[k], 2.0f / 3.0f);
+        }
+        typename V::i indices = V::set1_i(0);
+        typename V::i one = V::set1_i(1);
+        for (int p = 0; p < 16; ++p) {
+                typename V::f col[3];
+                for (int k = 0; k < components; ++k) {
+                        col[k] = V::load(planes[k] + p * stride + b);
+                }
+                typename V::f dist[4];
+                for (int e = 0; e < 4; ++e) {
+                        typename V::f d = V::sub(col[0], pal[e][0]);
+                        dist[e] = V::mul(d, d);
+                        for (int k = 1; k < components; ++k) {
+                                d = V::sub(col[k], pal[e][k]);
+                                dist[e] = V::add(dist[e], V::mul(d, d));
+                        }
+                }
+                typename V::i bx = V::mask_i(V::cmpgt(dist[0], dist[3]));
+                typename V::i by = V::mask_i(V::cmpgt(dist[1], dist[2]));
+                typename V::i bz = V::mask_i(V::cmpgt(dist[0], dist[2]));
+                typename V::i bw = V::mask_i(V::cmpgt(dist[1], dist[3]));
+                typename V::i b4 = V::mask_i(V::cmpgt(dist[2], dist[3]));
+                typename V::i index = V::or_i(V::and_i(V::and_i(bx, b4), one),
+                                V::and_i(V::or_i(V::and_i(by, bz), V::and_i(bx, bw)), V::set1_i(2)));
+                indices = V::or_i(indices, V::slli(index, 2 * p));
+        }
+        return indices;
+}
+
+template<class V>
+static inline void dxt_min_max(const float *const *planes, int stride, int b,
+                typename V::f *mincol, typename V::f *maxcol)
+{
+        for (int k = 0; k < 3; ++k) {
+                mincol[k] = maxcol[k] = V::load(planes[k] + b);
+                for (int p = 1; p < 16; ++p) {
+                        typename V::f v = V::load(planes[k] + p * stride + b);
+                        mincol[k] = V::min(mincol[k], v);
+                        maxcol[k] = V::max(maxcol[k], v);
+                }
+        }
+}
+
+/**
+ * Encodes V::N DXT1 blocks starting with block b, output is 2 words per
+ * block (endpoints, indices).
+ */
+template<class V>
+static void dxt1_encode_blocks(const float *const *planes, int stride, int b, uint32_t *out)
+{
+        typename V::f mincol[3], maxcol[3];
+        dxt_min_max<V>(planes, stride, b, mincol, maxcol);
+
+        // SelectDiagonal
+        typename V::f center[3];
+        for (int k = 0; k < 3; ++k) {
+                center[k] = V::mul(V::add(mincol[k], maxcol[k]), V::set1(0.5f));
+        }
+        typename V::f cov_x = V::set1(0.0f), cov_y = V::set1(0.0f);
+        for (int p = 0; p < 16; ++p) {
+                typename V::f tz = V::sub(V::load(planes[2] + p * stride + b), center[2]);
+                cov_x = V::add(cov_x, V::mul(V::sub(V::load(planes[0] + p * stride + b), center[0]), tz));
+                cov_y = V::add(cov_y, V::mul(V::sub(V::load(planes[1] + p * stride + b), center[1]), tz));
+        }
+        dxt_swap_where<V>(V::cmplt(cov_x, V::set1(0.0f)), mincol[0], maxcol[0]);
+        dxt_swap_where<V>(V::cmplt(cov_y, V::set1(0.0f)), mincol[1], maxcol[1]);
+
+        // InsetBBox
+        for (int k = 0; k < 3; ++k) {
+                typename V::f inset = V::sub(V::div(V::sub(maxcol[k], mincol[k]), V::set1(16.0f)),
+                                V::set1((8.0f / 255.0f) / 16.0f));
+                mincol[k] = dxt_saturate<V>(V::add(mincol[k], inset));
+                maxcol[k] = dxt_saturate<V>(V::sub(maxcol[k], inset));
+        }
+
+        // EmitEndPointsDXT1
+        const float scale[3] = { 31.0f, 63.0f, 31.0f };
+        const int bits[3] = { 5, 6, 5 };
+        typename V::i wmax = V::set1_i(0), wmin = V::set1_i(0);
+        for (int k = 0; k < 3; ++k) {
+                typename V::i cmax = V::cvt_i(V::mul(maxcol[k], V::set1(scale[k])));
+                typename V::i cmin = V::cvt_i(V::mul(mincol[k], V::set1(scale[k])));
+                int shift = k == 0 ? 11 : k == 1 ? 5 : 0;
+                wmax = V::or_i(wmax, V::slli(cmax, shift));
+                wmin = V::or_i(wmin, V::slli(cmin, shift));
+                maxcol[k] = dxt_expand<V>(cmax, bits[k]);
+                mincol[k] = dxt_expand<V>(cmin, bits[k]);
+        }
+        typename V::f swap = V::mask_f(V::cmpgt_i(wmin, wmax));
+        for (int k = 0; k < 3; ++k) {
+                dxt_swap_where<V>(swap, mincol[k], maxcol[k]);
+        }
+        typename V::i lo = V::select_i(swap, wmin, wmax);
+        typename V::i hi = V::select_i(swap, wmax, wmin);
+        typename V::i endpoints = V::or_i(lo, V::slli(hi, 16));
+
+        typename V::i indices = dxt_color_indices<V>(planes, stride, b, maxcol, mincol, 3);
+
+        uint32_t ep[V::N], idx[V::N];
+        V::store_i(ep, endpoints);
+        V::store_i(idx, indices);
+        for (int l = 0; l < V::N; ++l) {
+                out[2 * l] = ep[l];
+                out[2 * l + 1] = idx[l];
+        }
+}
+
+/**
+ * Encodes V::N DXT5 YCoCg blocks starting with block b, planes are Y, Co
+ * and Cg, output is 4 words per block.
+ */
+template<class V>
+static void dxt5_ycocg_encode_blocks(const float *const *planes, int stride, int b, uint32_t *out)
+{
+        typename V::f mincol[3], maxcol[3];
+        dxt_min_max<V>(planes, stride, b, mincol, maxcol);
+        const typename V::f offset = V::set1(DXT_YCOCG_OFFSET);
+
+        // SelectYCoCgDiagonal
+        typename V::f mid_co = V::mul(V::add(maxcol[1], mincol[1]), V::set1(0.5f));
+        typename V::f mid_cg = V::mul(V::add(maxcol[2], mincol[2]), V::set1(0.5f));
+        typename V::f cov = V::set1(0.0f);
+        for (int p = 0; p < 16; ++p) {
+                cov = V::add(cov, V::mul(V::sub(V::load(planes[1] + p * stride + b), mid_co),
+                                        V::sub(V::load(planes[2] + p * stride + b), mid_cg)));
+        }
+        dxt_swap_where<V>(V::cmplt(cov, V::set1(0.0f)), mincol[2], maxcol[2]);
+
+        // ScaleYCoCg
+        typename V::f m = V::max(V::max(V::abs(V::sub(mincol[1], offset)), V::abs(V::sub(mincol[2], offset))),
+                        V::max(V::abs(V::sub(maxcol[1], offset)), V::abs(V::sub(maxcol[2], offset))));
+        typename V::f scale = V::set1(1.0f);
+        scale = V::select(V::cmplt(m, V::set1(64.0f / 255.0f)), V::set1(2.0f), scale);
+        scale = V::select(V::cmplt(m, V::set1(32.0f / 255.0f)), V::set1(4.0f), scale);
+
+        // EmitEndPointsYCoCgDXT5
+        typename V::i scale_bits = V::sub_i(V::cvt_i(scale), V::set1_i(1));
+        typename V::i wmax = scale_bits, wmin = scale_bits;
+        for (int k = 1; k < 3; ++k) {
+                maxcol[k] = V::add(V::mul(V::sub(maxcol[k], offset), scale), offset);
+                mincol[k] = V::add(V::mul(V::sub(mincol[k], offset), scale), offset);
+                typename V::f inset = V::sub(V::div(V::sub(maxcol[k], mincol[k]), V::set1(16.0f)),
+                                V::set1((8.0f / 255.0f) / 16.0f));
+                mincol[k] = dxt_saturate<V>(V::add(mincol[k], inset));
+                maxcol[k] = dxt_saturate<V>(V::sub(maxcol[k], inset));
+                float range = k == 1 ? 31.0f : 63.0f;
+                typename V::i imax = V::cvt_i(V::mul(maxcol[k], V::set1(range)));
+                typename V::i imin = V::cvt_i(V::mul(mincol[k], V::set1(range)));
+                wmax = V::or_i(wmax, V::slli(imax, k == 1 ? 11 : 5));
+                wmin = V::or_i(wmin, V::slli(imin, k == 1 ? 11 : 5));
+                maxcol[k] = dxt_expand<V>(imax, k == 1 ? 5 : 6);
+                mincol[k] = dxt_expand<V>(imin, k == 1 ? 5 : 6);
+                maxcol[k] = V::add(V::div(V::sub(maxcol[k], offset), scale), offset);
+                mincol[k] = V::add(V::div(V::sub(mincol[k], offset), scale), offset);
+        }
+        typename V::i color_endpoints = V::or_i(wmax, V::slli(wmin, 16));
+        const float *const cocg_planes[2] = { planes[1], planes[2] };
+        typename V::i color_indices = dxt_color_indices<V>(cocg_planes, stride, b, maxcol + 1, mincol + 1, 2);
+
+        // InsetYBBox
+        typename V::f inset = V::sub(V::div(V::sub(maxcol[0], mincol[0]), V::set1(32.0f)),
+                        V::set1((16.0f / 255.0f) / 32.0f));
+        typename V::f min_y = dxt_saturate<V>(V::add(mincol[0], inset));
+        typename V::f max_y = dxt_saturate<V>(V::sub(maxcol[0], inset));
+
+        // EmitAlphaEndPointsYCoCgDXT5
+        typename V::i alpha_x = V::or_i(V::slli(V::cvt_i(V::mul(min_y, V::set1(255.0f))), 8),
+                        V::cvt_i(V::mul(max_y, V::set1(255.0f))));
+
+        // EmitAlphaIndicesYCoCgDXT5
+        const float alpha_range = 7.0f;
+        typename V::f mid = V::div(V::sub(max_y, min_y), V::set1(2.0f * alpha_range));
+        typename V::f ab[7];
+        ab[0] = V::add(min_y, mid);
+        for (int k = 1; k < 7; ++k) {
+                // ((7 - k) * maxAlpha + k * minAlpha) * (1.0 / ALPHA_RANGE) + mid
+                ab[k] = V::add(V::mul(V::add(V::mul(max_y, V::set1((float) (7 - k))),
+                                                V::mul(min_y, V::set1((float) k))),
+                                        V::set1(1.0f / alpha_range)), mid);
+        }
+        typename V::i alpha_y = V::set1_i(0);
+        typename V::i index = V::set1_i(1);
+        for (int p = 0; p < 16; ++p) {
+                typename V::f a = V::load(planes[0] + p * stride + b);
+                index = V::set1_i(1);
+                for (int k = 0; k < 7; ++k) {
+                        index = V::sub_i(index, V::mask_i(V::cmple(a, ab[k])));
+                }
+                index = V::and_i(index, V::set1_i(7));
+                index = V::xor_i(index, V::and_i(V::cmpgt_i(V::set1_i(2), index), V::set1_i(1)));
+                if (p < 6) {
+                        alpha_x = V::or_i(alpha_x, V::slli(index, 3 * p + 16));
+                        if (p == 5) {
+                                alpha_y = V::srli(index, 1);
+                        }
+                } else {
+                        alpha_y = V::or_i(alpha_y, V::slli(index, 3 * p - 16));
+                }
+        }
+
+        uint32_t w[4][V::N];
+        V::store_i(w[0], alpha_x);
+        V::store_i(w[1], alpha_y);
+        V::store_i(w[2], color_endpoints);
+        V::store_i(w[3], color_indices);
+        for (int l = 0; l < V::N; ++l) {
+                for (int k = 0; k < 4; ++k) {
+                        out[4 * l + k] = w[k][l];
+                }
+        }
+}
+
+/**
+ * Encodes a row of blocks with the block encoder ENC, the last incomplete
+ * group of lanes is stored through a temporary buffer.
+ */
+template<class V, void (*ENC)(const float *const *, int, int, uint32_t *), int WORDS_PER_BLOCK>
+static void dxt_encode_row(const float *const *planes, int stride, int blocks, uint32_t *out)
+{
+        int b = 0;
+        for ( ; b + V::N <= blocks; b += V::N) {
+                ENC(planes, stride, b, out + b * WORDS_PER_BLOCK);
+        }
+        if (b < blocks) {
+                uint32_t tmp[DXT_MAX_LANES * WORDS_PER_BLOCK];
+                ENC(planes, stride, b, tmp);
+                memcpy(out + b * WORDS_PER_BLOCK, tmp, (blocks - b) * WORDS_PER_BLOCK * sizeof(uint32_t));
+        }
+}
+
+#endif // UTILS_DXT_CPU_KERNEL_H_
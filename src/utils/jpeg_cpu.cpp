@@ -0,0 +1,662 @@
+/**
+ * @file   utils/jpeg_cpu.cpp
+ * @brief  Multithreaded baseline JPEG encoder and decoder using libjpeg(-turbo)
+ *
+ * Band boundaries must start a restart interval whose number is divisible by
+ * 8 so that restart markers written by the per-band encoders (numbered from
+ * RST0) are in the right sequence after joining; see get_bands().
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <jpeglib.h>
+#include <jerror.h> // after jpeglib.h
+#include <memory>
+#include <vector>
+
+#include "debug.h"
+#include "utils/jpeg_cpu.h"
+#include "utils/jpeg_reader.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[CPU JPEG] "
+
+#define JPEG_MARKER_SOF0 0xC0
+#define JPEG_MARKER_RST0 0xD0
+#define JPEG_MARKER_EOI  0xD9
+#define JPEG_MARKER_SOS  0xDA
+
+using namespace std;
+
+namespace {
+
+struct error_mgr {
+        struct jpeg_error_mgr pub;
+        jmp_buf env;
+};
+
+static void error_exit(j_common_ptr cinfo)
+{
+        char msg[JMSG_LENGTH_MAX];
+        (*cinfo->err->format_message)(cinfo, msg);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s\n", msg);
+        longjmp(((struct error_mgr *) cinfo->err)->env, 1);
+}
+
+/// libjpeg warnings (eg. corrupt data) would otherwise go to stderr
+static void output_message(j_common_ptr cinfo)
+{
+        char msg[JMSG_LENGTH_MAX];
+        (*cinfo->err->format_message)(cinfo, msg);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%s\n", msg);
+}
+
+static void init_error_mgr(struct error_mgr *err)
+{
+        jpeg_std_error(&err->pub);
+        err->pub.error_exit = error_exit;
+        err->pub.output_message = output_message;
+}
+
+static long gcd(long a, long b)
+{
+        return b == 0 ? a : gcd(b, a % b);
+}
+
+struct band {
+        int first_row; ///< first MCU row
+        int rows;      ///< count of MCU rows
+};
+
+/**
+ * Splits mcu_rows to at most task_pool_size() bands. Every band except the
+ * first starts at a restart interval with index divisible by 8 (and thus
+ * is preceded by RST7).
+ */
+static vector<band> get_bands(int mcu_rows, int mcus_per_row, int restart_interval)
+{
+        if (restart_interval <= 0) {
+                return { band{0, mcu_rows} };
+        }
+        // segments at MCU row start are multiples of step, band must start at a multiple of 8 segments too
+        long step = mcus_per_row / gcd(restart_interval, mcus_per_row);
+        long unit_segments = step / gcd(step, 8) * 8;
+        int unit_rows = unit_segments * restart_interval / mcus_per_row;
+        int units = (mcu_rows + unit_rows - 1) / unit_rows;
+        int count = max(min(units, task_pool_size()), 1);
+        vector<band> bands;
+        for (int i = 0; i < count; ++i) {
+                int first = (long) units * i / count * unit_rows;
+                int last = min((long) units * (i + 1) / count * unit_rows, (long) mcu_rows);
+                bands.push_back(band{first, last - first});
+        }
+        return bands;
+}
+
+/**
+ * Walks JPEG markers up to SOS.
+ * @returns offset of entropy-coded data, 0 if not found
+ */
+static size_t find_scan(const unsigned char *data, size_t len, size_t *sof_offset)
+{
+        size_t pos = 2; // SOI
+        while (pos + 4 <= len) {
+                if (data[pos] != 0xFF) {
+                        return 0;
+                }
+                int marker = data[pos + 1];
+                size_t seg_len = data[pos + 2] << 8 | data[pos + 3];
+                if (marker == JPEG_MARKER_SOF0) {
+                        *sof_offset = pos;
+                } else if (marker == JPEG_MARKER_SOS) {
+                        return pos + 2 + seg_len;
+                }
+                pos += 2 + seg_len;
+        }
+        return 0;
+}
+
+static void set_sof_height(unsigned char *sof, int height)
+{
+        sof[5] = height >> 8;
+        sof[6] = height & 0xFF;
+}
+
+static inline int clamp_byte(int x)
+{
+        return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+/**
+ * Converts a line of UYVY (BT.709 limited) to JFIF (BT.601 full range)
+ * planes, padding with the last pixel up to padded_width (luma samples).
+ */
+static void uyvy_to_jfif_planes(const unsigned char *src, int width, int padded_width,
+                unsigned char *y, unsigned char *cb, unsigned char *cr)
+{
+        for (int x = 0; x < width / 2; ++x) {
+                int u = src[0] - 128;
+                int v = src[2] - 128;
+                int c = 7578 * u + 14628 * v + (1 << 15);
+                y[2 * x] = clamp_byte((76309 * (src[1] - 16) + c) >> 16);
+                y[2 * x + 1] = clamp_byte((76309 * (src[3] - 16) + c) >> 16);
+                cb[x] = clamp_byte(128 + ((73849 * u - 8255 * v + (1 << 15)) >> 16));
+                cr[x] = clamp_byte(128 + ((-5405 * u + 73367 * v + (1 << 15)) >> 16));
+                src += 4;
+        }
+        int w = width / 2 * 2;
+        memset(y + w, y[w - 1], padded_width - w);
+        memset(cb + w / 2, cb[w / 2 - 1], (padded_width - w) / 2);
+        memset(cr + w / 2, cr[w / 2 - 1], (padded_width - w) / 2);
+}
+
+/// converts interleaved JFIF YCbCr (4:4:4) line to UYVY (BT.709 limited)
+static void jfif_to_uyvy(const unsigned char *src, int width, unsigned char *dst)
+{
+        for (int x = 0; x < width / 2; ++x) {
+                int u = src[1] + src[4] - 256;
+                int v = src[2] + src[5] - 256;
+                int c = -6652 * u - 11971 * v + (1 << 16);
+                dst[0] = clamp_byte(128 + ((58642 * u + 6598 * v + (1 << 16)) >> 17));
+                dst[1] = clamp_byte(16 + ((2 * 56284 * src[0] + c) >> 17));
+                dst[2] = clamp_byte(128 + ((4321 * u + 59027 * v + (1 << 16)) >> 17));
+                dst[3] = clamp_byte(16 + ((2 * 56284 * src[3] + c) >> 17));
+                src += 6;
+                dst += 4;
+        }
+}
+
+} // end of anonymous namespace
+
+struct jpeg_cpu_enc_band {
+        jpeg_cpu_enc_band() {
+                init_error_mgr(&err);
+                cinfo.err = &err.pub;
+                jpeg_create_compress(&cinfo);
+                cinfo.client_data = this;
+                dest.init_destination = [](j_compress_ptr cinfo) {
+                        auto b = (struct jpeg_cpu_enc_band *) cinfo->client_data;
+                        b->out.resize(max<size_t>(b->out.size(), 1 << 16));
+                        cinfo->dest->next_output_byte = b->out.data();
+                        cinfo->dest->free_in_buffer = b->out.size();
+                };
+                dest.empty_output_buffer = [](j_compress_ptr cinfo) -> boolean {
+                        auto b = (struct jpeg_cpu_enc_band *) cinfo->client_data;
+                        size_t old_size = b->out.size();
+                        b->out.resize(2 * old_size);
+                        cinfo->dest->next_output_byte = b->out.data() + old_size;
+                        cinfo->dest->free_in_buffer = old_size;
+                        return TRUE;
+                };
+                dest.term_destination = [](j_compress_ptr cinfo) {
+                        auto b = (struct jpeg_cpu_enc_band *) cinfo->client_data;
+                        b->out_len = b->out.size() - cinfo->dest->free_in_buffer;
+                };
+                cinfo.dest = &dest;
+        }
+        ~jpeg_cpu_enc_band() {
+                jpeg_destroy_compress(&cinfo);
+        }
+        jpeg_cpu_enc_band(jpeg_cpu_enc_band const &) = delete;
+        jpeg_cpu_enc_band &operator=(jpeg_cpu_enc_band const &) = delete;
+
+        struct jpeg_compress_struct cinfo;
+        struct error_mgr err;
+        struct jpeg_destination_mgr dest;
+        vector<unsigned char> out;
+        size_t out_len = 0;
+        vector<unsigned char> planes; ///< one iMCU row of raw input for UYVY (or RGB lines, see below)
+};
+
+#ifdef JCS_EXTENSIONS
+#define RGBA_NEEDS_EXPAND 0
+#else
+/// plain libjpeg doesn't have JCS_EXT_RGBX - RGBA lines are expanded from/to RGB
+#define RGBA_NEEDS_EXPAND 1
+#endif
+
+struct jpeg_cpu_encoder {
+        int quality;
+        int restart_interval;
+        vector<unique_ptr<jpeg_cpu_enc_band>> bands;
+};
+
+/**
+ * Encodes pixel lines [first_line, first_line + lines) of the image as a
+ * standalone JPEG. No objects with destructors may live in this function
+ * because of longjmp() from error_exit().
+ */
+static bool encode_band(struct jpeg_cpu_enc_band *b, int quality, int restart_interval, codec_t codec,
+                const unsigned char *src, int width, int height, int first_line, int lines)
+{
+        struct jpeg_compress_struct *cinfo = &b->cinfo;
+        if (setjmp(b->err.env)) {
+                jpeg_abort_compress(cinfo);
+                return false;
+        }
+
+        cinfo->image_width = width;
+        cinfo->image_height = lines;
+#ifdef JCS_EXTENSIONS
+        cinfo->input_components = codec == RGBA ? 4 : 3;
+        cinfo->in_color_space = codec == RGBA ? JCS_EXT_RGBX : codec == RGB ? JCS_RGB : JCS_YCbCr;
+#else
+        cinfo->input_components = 3;
+        cinfo->in_color_space = codec == UYVY ? JCS_YCbCr : JCS_RGB;
+#endif
+        jpeg_set_defaults(cinfo);
+        jpeg_set_quality(cinfo, quality, TRUE);
+        cinfo->restart_interval = restart_interval;
+        cinfo->comp_info[0].h_samp_factor = codec == UYVY ? 2 : 1;
+        cinfo->comp_info[0].v_samp_factor = 1;
+        cinfo->raw_data_in = codec == UYVY;
+
+        jpeg_start_compress(cinfo, TRUE);
+        int src_linesize = vc_get_linesize(width, codec);
+        if (codec == UYVY) {
+                int padded_width = (width + 15) / 16 * 16;
+                unsigned char *y = b->planes.data();
+                unsigned char *cb = y + DCTSIZE * padded_width;
+                unsigned char *cr = cb + DCTSIZE * padded_width / 2;
+                JSAMPROW rows[3][DCTSIZE];
+                JSAMPARRAY planes[3] = { rows[0], rows[1], rows[2] };
+                for (int i = 0; i < DCTSIZE; ++i) {
+                        rows[0][i] = y + i * padded_width;
+                        rows[1][i] = cb + i * padded_width / 2;
+                        rows[2][i] = cr + i * padded_width / 2;
+                }
+                for (int line = 0; line < lines; line += DCTSIZE) {
+                        for (int i = 0; i < DCTSIZE; ++i) {
+                                int src_line = min(first_line + line + i, height - 1);
+                                uyvy_to_jfif_planes(src + (size_t) src_line * src_linesize, width, padded_width,
+                                                rows[0][i], rows[1][i], rows[2][i]);
+                        }
+                        jpeg_write_raw_data(cinfo, planes, DCTSIZE);
+                }
+        } else {
+                while (cinfo->next_scanline < cinfo->image_height) {
+                        JSAMPROW rows[DCTSIZE];
+                        int count = min<int>(DCTSIZE, cinfo->image_height - cinfo->next_scanline);
+                        for (int i = 0; i < count; ++i) {
+                                rows[i] = const_cast<unsigned char *>(src) +
+                                        (size_t) (first_line + cinfo->next_scanline + i) * src_linesize;
+                                if (RGBA_NEEDS_EXPAND && codec == RGBA) {
+                                        unsigned char *rgb = b->planes.data() + (size_t) i * 3 * width;
+                                        for (int x = 0; x < width; ++x) {
+                                                rgb[3 * x] = rows[i][4 * x];
+                                                rgb[3 * x + 1] = rows[i][4 * x + 1];
+                                                rgb[3 * x + 2] = rows[i][4 * x + 2];
+                                        }
+                                        rows[i] = rgb;
+                                }
+                        }
+                        jpeg_write_scanlines(cinfo, rows, count);
+                }
+        }
+        jpeg_finish_compress(cinfo);
+        return true;
+}
+
+bool jpeg_cpu_encoder_supports(codec_t in_codec)
+{
+        return in_codec == UYVY || in_codec == RGB || in_codec == RGBA;
+}
+
+struct jpeg_cpu_encoder *jpeg_cpu_encoder_create(int quality, int restart_interval)
+{
+        auto enc = new jpeg_cpu_encoder();
+        enc->quality = quality;
+        enc->restart_interval = restart_interval;
+        return enc;
+}
+
+size_t jpeg_cpu_encode(struct jpeg_cpu_encoder *enc, codec_t in_codec, const unsigned char *src,
+                int width, int height, unsigned char *dst, size_t dst_len)
+{
+        int mcu_width = in_codec == UYVY ? 16 : 8;
+        int mcus_per_row = (width + mcu_width - 1) / mcu_width;
+        int restart_interval = enc->restart_interval;
+        if (restart_interval < 0) { // GPUJPEG defaults
+                restart_interval = in_codec == UYVY ? 4 : 8;
+        }
+        vector<band> bands = get_bands((height + DCTSIZE - 1) / DCTSIZE, mcus_per_row, restart_interval);
+        while (enc->bands.size() < bands.size()) {
+                enc->bands.emplace_back(new jpeg_cpu_enc_band());
+        }
+
+        vector<char> ok(bands.size());
+        parallel_for(0, bands.size(), [&](int begin, int end) {
+                        for (int i = begin; i < end; ++i) {
+                                auto b = enc->bands[i].get();
+                                if (in_codec == UYVY) {
+                                        b->planes.resize(2 * DCTSIZE * (width + 15) / 16 * 16);
+                                } else if (RGBA_NEEDS_EXPAND && in_codec == RGBA) {
+                                        b->planes.resize(3 * DCTSIZE * width);
+                                }
+                                int first_line = bands[i].first_row * DCTSIZE;
+                                int lines = min(bands[i].rows * DCTSIZE, height - first_line);
+                                ok[i] = encode_band(b, enc->quality, restart_interval, in_codec, src,
+                                                width, height, first_line, lines);
+                        }
+                        });
+
+        // join the bands - header of the first one with the height of the whole image, then
+        // entropy-coded segments (without EOI) separated by RST7
+        size_t sof_offset = 0;
+        size_t header_len = 0;
+        size_t total_len = 2;
+        for (unsigned int i = 0; i < bands.size(); ++i) {
+                auto b = enc->bands[i].get();
+                if (!ok[i] || (header_len = find_scan(b->out.data(), b->out_len, &sof_offset)) == 0 ||
+                                b->out_len < header_len + 2) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Encoding failed!\n");
+                        return 0;
+                }
+                total_len += b->out_len - 2 - (i == 0 ? 0 : header_len - 2);
+        }
+        if (total_len > dst_len) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Compressed frame too large (%zu B)!\n", total_len);
+                return 0;
+        }
+
+        unsigned char *out = dst;
+        for (unsigned int i = 0; i < bands.size(); ++i) {
+                auto b = enc->bands[i].get();
+                if (i == 0) {
+                        memcpy(out, b->out.data(), b->out_len - 2);
+                        set_sof_height(out + sof_offset, height);
+                        out += b->out_len - 2;
+                } else {
+                        *out++ = 0xFF;
+                        *out++ = JPEG_MARKER_RST0 + 7;
+                        memcpy(out, b->out.data() + header_len, b->out_len - 2 - header_len);
+                        out += b->out_len - 2 - header_len;
+                }
+        }
+        *out++ = 0xFF;
+        *out++ = JPEG_MARKER_EOI;
+        return out - dst;
+}
+
+void jpeg_cpu_encoder_destroy(struct jpeg_cpu_encoder *enc)
+{
+        delete enc;
+}
+
+struct jpeg_cpu_dec_band {
+        jpeg_cpu_dec_band() {
+                init_error_mgr(&err);
+                cinfo.err = &err.pub;
+                jpeg_create_decompress(&cinfo);
+                cinfo.client_data = this;
+                src.init_source = [](j_decompress_ptr cinfo) {
+                        auto b = (struct jpeg_cpu_dec_band *) cinfo->client_data;
+                        b->chunk = -1;
+                        cinfo->src->bytes_in_buffer = 0;
+                };
+                src.fill_input_buffer = [](j_decompress_ptr cinfo) -> boolean {
+                        static const JOCTET eoi[] = { 0xFF, JPEG_MARKER_EOI };
+                        auto b = (struct jpeg_cpu_dec_band *) cinfo->client_data;
+                        do {
+                                b->chunk += 1;
+                        } while (b->chunk < 3 && b->chunk_len[b->chunk] == 0);
+                        if (b->chunk < 3) {
+                                cinfo->src->next_input_byte = b->chunk_data[b->chunk];
+                                cinfo->src->bytes_in_buffer = b->chunk_len[b->chunk];
+                        } else { // premature end, insert fake EOI like jdatasrc.c
+                                WARNMS(cinfo, JWRN_JPEG_EOF);
+                                cinfo->src->next_input_byte = eoi;
+                                cinfo->src->bytes_in_buffer = sizeof eoi;
+                        }
+                        return TRUE;
+                };
+                src.skip_input_data = [](j_decompress_ptr cinfo, long num_bytes) {
+                        while (num_bytes > (long) cinfo->src->bytes_in_buffer) {
+                                num_bytes -= cinfo->src->bytes_in_buffer;
+                                (*cinfo->src->fill_input_buffer)(cinfo);
+                        }
+                        if (num_bytes > 0) {
+                                cinfo->src->next_input_byte += num_bytes;
+                                cinfo->src->bytes_in_buffer -= num_bytes;
+                        }
+                };
+                src.resync_to_restart = jpeg_resync_to_restart;
+                src.term_source = [](j_decompress_ptr) {};
+                cinfo.src = &src;
+        }
+        ~jpeg_cpu_dec_band() {
+                jpeg_destroy_decompress(&cinfo);
+        }
+        jpeg_cpu_dec_band(jpeg_cpu_dec_band const &) = delete;
+        jpeg_cpu_dec_band &operator=(jpeg_cpu_dec_band const &) = delete;
+
+        struct jpeg_decompress_struct cinfo;
+        struct error_mgr err;
+        struct jpeg_source_mgr src;
+        /// input consists of header, entropy-coded data and EOI
+        const unsigned char *chunk_data[3];
+        size_t chunk_len[3];
+        int chunk;
+        vector<unsigned char> header;
+        vector<unsigned char> line; ///< for output requiring conversion
+};
+
+struct jpeg_cpu_decoder {
+        struct jpeg_info info;
+        vector<size_t> rst_pos; ///< positions of RSTn markers in the current frame
+        vector<unique_ptr<jpeg_cpu_dec_band>> bands;
+};
+
+/// see encode_band()
+static bool decode_band(struct jpeg_cpu_dec_band *b, int first_line, codec_t out_codec,
+                unsigned char *dst, int pitch, int rshift, int gshift, int bshift)
+{
+        struct jpeg_decompress_struct *cinfo = &b->cinfo;
+        if (setjmp(b->err.env)) {
+                jpeg_abort_decompress(cinfo);
+                return false;
+        }
+
+        jpeg_read_header(cinfo, TRUE);
+        bool direct = true;
+        if (out_codec == UYVY) {
+                cinfo->out_color_space = JCS_YCbCr;
+                direct = false;
+        } else if (out_codec == RGB) {
+                cinfo->out_color_space = JCS_RGB;
+                direct = rshift == 0 && gshift == 8 && bshift == 16;
+#ifdef JCS_EXTENSIONS
+        } else if (rshift == 0 && gshift == 8 && bshift == 16) {
+                cinfo->out_color_space = JCS_EXT_RGBX;
+        } else if (rshift == 16 && gshift == 8 && bshift == 0) {
+                cinfo->out_color_space = JCS_EXT_BGRX;
+#endif
+        } else {
+                cinfo->out_color_space = JCS_RGB;
+                direct = false;
+        }
+        cinfo->do_fancy_upsampling = FALSE;
+        jpeg_start_decompress(cinfo);
+        int width = cinfo->output_width;
+        b->line.resize(3 * width);
+        uint32_t alpha = 0xFFFFFFFFu ^ (0xFFu << rshift) ^ (0xFFu << gshift) ^ (0xFFu << bshift);
+
+        while (cinfo->output_scanline < cinfo->output_height) {
+                unsigned char *line = dst + (size_t) (first_line + cinfo->output_scanline) * pitch;
+                JSAMPROW row = direct ? line : b->line.data();
+                jpeg_read_scanlines(cinfo, &row, 1);
+                if (direct) {
+                        continue;
+                }
+                if (out_codec == UYVY) {
+                        jfif_to_uyvy(row, width, line);
+                } else if (out_codec == RGB) {
+                        vc_copylineRGB(line, row, 3 * width, rshift, gshift, bshift);
+                } else {
+                        for (int x = 0; x < width; ++x) {
+                                uint32_t val = alpha | row[3 * x] << rshift | row[3 * x + 1] << gshift |
+                                        row[3 * x + 2] << bshift;
+                                memcpy(line + 4 * x, &val, sizeof val);
+                        }
+                }
+        }
+        jpeg_finish_decompress(cinfo);
+        return true;
+}
+
+bool jpeg_cpu_decoder_supports(codec_t out_codec)
+{
+        return out_codec == UYVY || out_codec == RGB || out_codec == RGBA;
+}
+
+struct jpeg_cpu_decoder *jpeg_cpu_decoder_create(void)
+{
+        return new jpeg_cpu_decoder();
+}
+
+/**
+ * Finds RSTn markers in entropy-coded data.
+ * @returns end of the data (EOI position or len)
+ */
+static size_t find_restart_markers(const unsigned char *data, size_t pos, size_t len, vector<size_t> &rst_pos)
+{
+        rst_pos.clear();
+        while (pos + 1 < len) {
+                auto ff = (const unsigned char *) memchr(data + pos, 0xFF, len - pos - 1);
+                if (ff == nullptr) {
+                        break;
+                }
+                pos = ff - data;
+                int marker = data[pos + 1];
+                if (marker == 0xFF) { // fill byte
+                        pos += 1;
+                        continue;
+                }
+                if (marker >= JPEG_MARKER_RST0 && marker <= JPEG_MARKER_RST0 + 7) {
+                        rst_pos.push_back(pos);
+                } else if (marker == JPEG_MARKER_EOI) {
+                        return pos;
+                }
+                pos += 2;
+        }
+        return len;
+}
+
+bool jpeg_cpu_decode(struct jpeg_cpu_decoder *dec, const unsigned char *src, size_t src_len,
+                int width, int height, codec_t out_codec, unsigned char *dst, int pitch,
+                int rshift, int gshift, int bshift)
+{
+        struct jpeg_info *info = &dec->info;
+        if (jpeg_read_info(const_cast<unsigned char *>(src), src_len, info) != 0) {
+                return false;
+        }
+        if (info->width != width || info->height != height) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Image size %dx%d doesn't match expected %dx%d!\n",
+                                info->width, info->height, width, height);
+                return false;
+        }
+
+        vector<band> bands{ band{0, 0} };
+        size_t header_len = info->data - src;
+        size_t sof_offset = 0;
+        size_t data_end = src_len;
+        int max_h = 1, max_v = 1;
+        for (int i = 0; i < info->comp_count; ++i) {
+                max_h = max(max_h, info->sampling_factor_h[i]);
+                max_v = max(max_v, info->sampling_factor_v[i]);
+        }
+        int mcu_height = DCTSIZE * max_v;
+        int mcus_per_row = (width + DCTSIZE * max_h - 1) / (DCTSIZE * max_h);
+        int mcu_rows = (height + mcu_height - 1) / mcu_height;
+        if (info->interleaved && info->restart_interval > 0 && find_scan(src, src_len, &sof_offset) == header_len) {
+                data_end = find_restart_markers(src, header_len, src_len, dec->rst_pos);
+                long segments = ((long) mcus_per_row * mcu_rows + info->restart_interval - 1) / info->restart_interval;
+                if ((long) dec->rst_pos.size() == segments - 1) {
+                        bands = get_bands(mcu_rows, mcus_per_row, info->restart_interval);
+                } else {
+                        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Unexpected restart marker count, decoding in a single thread.\n");
+                }
+        }
+        while (dec->bands.size() < bands.size()) {
+                dec->bands.emplace_back(new jpeg_cpu_dec_band());
+        }
+
+        for (unsigned int i = 0; i < bands.size(); ++i) {
+                auto b = dec->bands[i].get();
+                if (bands.size() == 1) { // whole image as is
+                        b->chunk_data[0] = src;
+                        b->chunk_len[0] = src_len;
+                        b->chunk_len[1] = b->chunk_len[2] = 0;
+                        continue;
+                }
+                static const unsigned char eoi[] = { 0xFF, JPEG_MARKER_EOI };
+                long first_segment = (long) bands[i].first_row * mcus_per_row / info->restart_interval;
+                long next_segment = (long) (bands[i].first_row + bands[i].rows) * mcus_per_row / info->restart_interval;
+                size_t begin = first_segment == 0 ? header_len : dec->rst_pos[first_segment - 1] + 2;
+                size_t end = i == bands.size() - 1 ? data_end : dec->rst_pos[next_segment - 1];
+                b->header.assign(src, src + header_len);
+                set_sof_height(b->header.data() + sof_offset, min(bands[i].rows * mcu_height, height - bands[i].first_row * mcu_height));
+                b->chunk_data[0] = b->header.data();
+                b->chunk_len[0] = header_len;
+                b->chunk_data[1] = src + begin;
+                b->chunk_len[1] = end - begin;
+                b->chunk_data[2] = eoi;
+                b->chunk_len[2] = sizeof eoi;
+        }
+
+        vector<char> ok(bands.size());
+        parallel_for(0, bands.size(), [&](int begin, int end) {
+                        for (int i = begin; i < end; ++i) {
+                                ok[i] = decode_band(dec->bands[i].get(), bands[i].first_row * mcu_height, out_codec,
+                                                dst, pitch, rshift, gshift, bshift);
+                        }
+                        });
+        return all_of(ok.begin(), ok.end(), [](char c) { return c != 0; });
+}
+
+void jpeg_cpu_decoder_destroy(struct jpeg_cpu_decoder *dec)
+{
+        delete dec;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file   utils/jpeg_cpu.h
+ * @brief  Multithreaded baseline JPEG encoder and decoder using libjpeg(-turbo)
+ *
+ * A frame is split to horizontal bands whose boundaries coincide with
+ * restart markers. Each band is encoded as a standalone image by its own
+ * libjpeg instance in the worker pool and the entropy-coded data of bands
+ * are then joined with restart markers to a single interleaved JFIF image,
+ * decodable by GPUJPEG and parsable by utils/jpeg_reader.h. The decoder
+ * does the opposite - it splits the stream at restart markers and decodes
+ * the bands in parallel. Streams without usable restart markers are decoded
+ * by a single thread.
+ *
+ * YCbCr input and output (UYVY) is BT.709 limited range as used elsewhere
+ * in UltraGrid, the JPEG color space is JFIF (BT.601 full range).
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_JPEG_CPU_H_
+#define UTILS_JPEG_CPU_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#endif
+
+struct jpeg_cpu_encoder;
+struct jpeg_cpu_decoder;
+
+/// @returns true if in_codec (UYVY, RGB or RGBA) can be compressed
+bool jpeg_cpu_encoder_supports(codec_t in_codec);
+/**
+ * @param quality           1-100
+ * @param restart_interval  restart interval in MCUs, 0 to disable restart
+ *                          markers (and parallelism), -1 for default
+ */
+struct jpeg_cpu_encoder *jpeg_cpu_encoder_create(int quality, int restart_interval);
+/**
+ * Compresses the frame, UYVY is compressed as 4:2:2, RGB(A) as 4:4:4.
+ * @returns length of the compressed image, 0 on error (eg. if it doesn't fit to dst_len)
+ */
+size_t jpeg_cpu_encode(struct jpeg_cpu_encoder *enc, codec_t in_codec, const unsigned char *src,
+                int width, int height, unsigned char *dst, size_t dst_len);
+void jpeg_cpu_encoder_destroy(struct jpeg_cpu_encoder *enc);
+
+/// @returns true if the decoder can produce out_codec (UYVY, RGB or RGBA)
+bool jpeg_cpu_decoder_supports(codec_t out_codec);
+struct jpeg_cpu_decoder *jpeg_cpu_decoder_create(void);
+/**
+ * Decompresses the image, which must have dimensions width x height.
+ *
+ * @param pitch                   length of an output line in bytes
+ * @param rshift, gshift, bshift  positions of components in RGB(A) output,
+ *                                unoccupied bits of RGBA are set to 1
+ */
+bool jpeg_cpu_decode(struct jpeg_cpu_decoder *dec, const unsigned char *src, size_t src_len,
+                int width, int height, codec_t out_codec, unsigned char *dst, int pitch,
+                int rshift, int gshift, int bshift);
+void jpeg_cpu_decoder_destroy(struct jpeg_cpu_decoder *dec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_JPEG_CPU_H_
@@ -0,0 +1,227 @@
+/**
+ * @file   utils/lock_free_queue.h
+ * @brief  Bounded lock-free queue for frame handoff between threads
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LOCK_FREE_QUEUE_H_
+#define UTILS_LOCK_FREE_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+
+/**
+ * Returns number of iterations a blocked push/pop spins before it parks
+ * on a condition variable. Can be set by "--param lf-queue-spin=<n>".
+ */
+int lock_free_queue_spin_count();
+
+/**
+ * @brief bounded lock-free MPMC ring buffer queue
+ *
+ * Drop-in replacement of @ref synchronized_queue for a bounded queue -
+ * push blocks if there is max_len elements in the queue, pop blocks if the
+ * queue is empty (unless nonblocking is requested in which case T() is
+ * returned).
+ *
+ * Each slot carries a turn counter that tells whether it is free or full
+ * for current lap so that producers and consumers only contend on their
+ * respective position counters. A blocked caller first spins for
+ * lock_free_queue_spin_count() iterations, then parks on a condition
+ * variable; the other side takes the mutex only if someone is parked.
+ *
+ * @tparam T type to be stored, must be default constructible and movable
+ * @tparam max_len capacity of the queue (any positive number)
+ */
+template<typename T, int max_len = 1>
+class lock_free_queue {
+        static_assert(max_len > 0, "lock_free_queue must be bounded");
+public:
+        lock_free_queue() : m_spin(lock_free_queue_spin_count()) {}
+        lock_free_queue(lock_free_queue const &) = delete;
+        lock_free_queue &operator=(lock_free_queue const &) = delete;
+
+        int size()
+        {
+                size_t head = m_head.load(std::memory_order_acquire);
+                size_t tail = m_tail.load(std::memory_order_acquire);
+                return head > tail ? head - tail : 0;
+        }
+
+        bool try_push(T && message)
+        {
+                if (do_push(std::move(message))) {
+                        wake_parked();
+                        return true;
+                }
+                return false;
+        }
+
+        bool try_pop(T & message)
+        {
+                if (do_pop(message)) {
+                        wake_parked();
+                        return true;
+                }
+                return false;
+        }
+
+        void push(T const & message)
+        {
+                T copy(message);
+                push(std::move(copy));
+        }
+
+        void push(T && message)
+        {
+                wait([&]{ return do_push(std::move(message)); });
+        }
+
+        T pop(bool nonblocking = false)
+        {
+                T ret;
+                if (nonblocking) {
+                        try_pop(ret);
+                } else {
+                        wait([&]{ return do_pop(ret); });
+                }
+                return ret;
+        }
+
+private:
+        bool do_push(T && message)
+        {
+                size_t head = m_head.load(std::memory_order_acquire);
+                while (true) {
+                        struct slot &s = m_slots[head % max_len];
+                        if (s.turn.load(std::memory_order_acquire) == 2 * (head / max_len)) {
+                                if (m_head.compare_exchange_strong(head, head + 1)) {
+                                        s.value = std::move(message);
+                                        s.turn.store(2 * (head / max_len) + 1, std::memory_order_release);
+                                        return true;
+                                }
+                        } else {
+                                size_t prev = head;
+                                head = m_head.load(std::memory_order_acquire);
+                                if (head == prev) {
+                                        return false; // full
+                                }
+                        }
+                }
+        }
+
+        bool do_pop(T & message)
+        {
+                size_t tail = m_tail.load(std::memory_order_acquire);
+                while (true) {
+                        struct slot &s = m_slots[tail % max_len];
+                        if (s.turn.load(std::memory_order_acquire) == 2 * (tail / max_len) + 1) {
+                                if (m_tail.compare_exchange_strong(tail, tail + 1)) {
+                                        message = std::move(s.value);
+                                        s.value = T(); // do not hold the resource in the queue
+                                        s.turn.store(2 * (tail / max_len) + 2, std::memory_order_release);
+                                        return true;
+                                }
+                        } else {
+                                size_t prev = tail;
+                                tail = m_tail.load(std::memory_order_acquire);
+                                if (tail == prev) {
+                                        return false; // empty
+                                }
+                        }
+                }
+        }
+
+        /// spins and then parks until attempt() succeeds, then wakes the other side
+        template<typename F>
+        void wait(F const & attempt)
+        {
+                for (int i = 0; i <= m_spin; ++i) {
+                        if (attempt()) {
+                                wake_parked();
+                                return;
+                        }
+                        cpu_relax();
+                }
+                std::unique_lock<std::mutex> l(m_park_lock);
+                m_parked.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                m_park_cv.wait(l, attempt);
+                if (m_parked.fetch_sub(1) > 1) {
+                        m_park_cv.notify_all(); // lock is already held
+                }
+        }
+
+        void wake_parked()
+        {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (m_parked.load(std::memory_order_relaxed) > 0) {
+                        // taking the lock ensures that the waiter is either
+                        // before its check or already waiting
+                        std::unique_lock<std::mutex> l(m_park_lock);
+                        l.unlock();
+                        m_park_cv.notify_all();
+                }
+        }
+
+        static inline void cpu_relax()
+        {
+#if defined __x86_64__ || defined __i386__
+                __asm__ __volatile__("pause");
+#endif
+        }
+
+        enum { CACHE_LINE = 64 };
+        struct slot {
+                std::atomic<size_t> turn{0};
+                T value{};
+                char pad[CACHE_LINE];
+        };
+
+        std::atomic<size_t> m_head{0}; ///< next position to push to
+        char m_pad0[CACHE_LINE];
+        std::atomic<size_t> m_tail{0}; ///< next position to pop from
+        char m_pad1[CACHE_LINE];
+        struct slot m_slots[max_len];
+
+        const int m_spin;
+        std::atomic<int> m_parked{0};
+        std::mutex m_park_lock;
+        std::condition_variable m_park_cv;
+};
+
+#endif // UTILS_LOCK_FREE_QUEUE_H_
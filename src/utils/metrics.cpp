@@ -0,0 +1,364 @@
+/**
+ * @file   utils/metrics.cpp
+ * @brief  Registry of lock-free counters, gauges and latency histograms
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "compat/platform_time.h"
+#include "utils/metrics.h"
+
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+
+using namespace std;
+
+enum metric_type {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM,
+};
+
+/**
+ * Values of a counter or histogram written by a single thread. Members are
+ * atomic only to make concurrent snapshots well-defined - the owning thread
+ * updates them with relaxed load+store, not read-modify-write.
+ */
+struct metric_thread_block {
+        explicit metric_thread_block(enum metric_type type) {
+                if (type == METRIC_HISTOGRAM) {
+                        buckets = unique_ptr<atomic<uint64_t>[]>(new atomic<uint64_t>[HISTOGRAM_BUCKETS]());
+                }
+        }
+        atomic<uint64_t> value{0};      ///< counter value or histogram count
+        atomic<uint64_t> sum{0};        ///< histograms only
+        atomic<uint64_t> max{0};        ///< histograms only
+        unique_ptr<atomic<uint64_t>[]> buckets; ///< histograms only
+        metric_thread_block *next = nullptr;
+};
+
+struct metric {
+        metric(string n, enum metric_type t, int i) : name(move(n)), type(t), id(i), retired(t) {}
+        const string name;
+        const enum metric_type type;
+        const int id;                   ///< index to thread-local block lists
+        atomic<int64_t> gauge{0};
+        mutex blocks_lock;              ///< protects blocks and retired, not taken by updates
+        metric_thread_block *blocks = nullptr; ///< blocks of running threads that updated the metric
+        metric_thread_block retired;    ///< values of exited threads
+};
+
+namespace {
+struct metric_registry {
+        mutex lock;
+        vector<unique_ptr<metric>> metrics;
+        unordered_map<string, metric *> by_name;
+};
+
+/// never destroyed - metrics may be updated by threads running at exit
+metric_registry &get_registry()
+{
+        static auto registry = new metric_registry();
+        return *registry;
+}
+} // end of anonymous namespace
+
+static void retire_block(struct metric *m, metric_thread_block *b);
+
+/**
+ * Blocks of the calling thread indexed by metric id. When the thread exits,
+ * its values are merged to the retired block of the metric and the blocks
+ * are freed so that short-lived threads do not accumulate memory.
+ */
+namespace {
+struct thread_block_list {
+        ~thread_block_list() {
+                for (size_t i = 0; i < blocks.size(); ++i) {
+                        if (blocks[i] == nullptr) {
+                                continue;
+                        }
+                        struct metric *m;
+                        {
+                                auto &reg = get_registry();
+                                lock_guard<mutex> lk(reg.lock);
+                                m = reg.metrics[i].get();
+                        }
+                        retire_block(m, blocks[i]);
+                }
+        }
+        vector<metric_thread_block *> blocks;
+};
+} // end of anonymous namespace
+
+static thread_local thread_block_list thread_blocks;
+
+static struct metric *metric_get(const char *name, enum metric_type type)
+{
+        auto &reg = get_registry();
+        lock_guard<mutex> lk(reg.lock);
+        auto it = reg.by_name.find(name);
+        if (it != reg.by_name.end()) {
+                assert(it->second->type == type);
+                return it->second;
+        }
+        reg.metrics.emplace_back(new metric(name, type, reg.metrics.size()));
+        metric *m = reg.metrics.back().get();
+        reg.by_name[name] = m;
+        return m;
+}
+
+struct metric *metric_counter(const char *name)
+{
+        return metric_get(name, METRIC_COUNTER);
+}
+
+struct metric *metric_gauge(const char *name)
+{
+        return metric_get(name, METRIC_GAUGE);
+}
+
+struct metric *metric_histogram(const char *name)
+{
+        return metric_get(name, METRIC_HISTOGRAM);
+}
+
+static inline void add_relaxed(atomic<uint64_t> &val, uint64_t inc)
+{
+        val.store(val.load(memory_order_relaxed) + inc, memory_order_relaxed);
+}
+
+/// returns block of the calling thread, creating it on first use
+static metric_thread_block *get_block(struct metric *m)
+{
+        vector<metric_thread_block *> &blocks = thread_blocks.blocks;
+        if ((size_t) m->id < blocks.size() && blocks[m->id] != nullptr) {
+                return blocks[m->id];
+        }
+        if ((size_t) m->id >= blocks.size()) {
+                blocks.resize(m->id + 1);
+        }
+        auto b = new metric_thread_block(m->type);
+        {
+                lock_guard<mutex> lk(m->blocks_lock);
+                b->next = m->blocks;
+                m->blocks = b;
+        }
+        blocks[m->id] = b;
+        return b;
+}
+
+/// merges values of an exiting thread to the retired block and frees the block
+static void retire_block(struct metric *m, metric_thread_block *b)
+{
+        lock_guard<mutex> lk(m->blocks_lock);
+        metric_thread_block **it = &m->blocks;
+        while (*it != b) {
+                it = &(*it)->next;
+        }
+        *it = b->next;
+
+        metric_thread_block &r = m->retired;
+        add_relaxed(r.value, b->value.load(memory_order_relaxed));
+        add_relaxed(r.sum, b->sum.load(memory_order_relaxed));
+        r.max.store(max(r.max.load(memory_order_relaxed), b->max.load(memory_order_relaxed)),
+                        memory_order_relaxed);
+        if (m->type == METRIC_HISTOGRAM) {
+                for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+                        add_relaxed(r.buckets[i], b->buckets[i].load(memory_order_relaxed));
+                }
+        }
+        delete b;
+}
+
+/// calls fn for the retired block and blocks of all running threads
+template<typename F>
+static void for_each_block(struct metric *m, F const &fn)
+{
+        lock_guard<mutex> lk(m->blocks_lock);
+        fn(m->retired);
+        for (auto b = m->blocks; b != nullptr; b = b->next) {
+                fn(*b);
+        }
+}
+
+void metric_add(struct metric *m, uint64_t value)
+{
+        assert(m->type == METRIC_COUNTER);
+        add_relaxed(get_block(m)->value, value);
+}
+
+void metric_set(struct metric *m, int64_t value)
+{
+        assert(m->type == METRIC_GAUGE);
+        m->gauge.store(value, memory_order_relaxed);
+}
+
+static int bucket_index(uint64_t value)
+{
+        if (value < HISTOGRAM_SUB) {
+                return value;
+        }
+        int exp = 63 - __builtin_clzll(value);
+        return (exp - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB +
+                ((value >> (exp - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB - 1));
+}
+
+/// @returns the highest value that falls to the bucket
+static uint64_t bucket_upper_bound(int idx)
+{
+        if (idx < HISTOGRAM_SUB) {
+                return idx;
+        }
+        int exp = idx / HISTOGRAM_SUB + HISTOGRAM_SUB_BITS - 1;
+        uint64_t lower = (uint64_t) (HISTOGRAM_SUB + idx % HISTOGRAM_SUB) << (exp - HISTOGRAM_SUB_BITS);
+        return lower + ((uint64_t) 1 << (exp - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void metric_record(struct metric *m, uint64_t value)
+{
+        assert(m->type == METRIC_HISTOGRAM);
+        metric_thread_block *b = get_block(m);
+        add_relaxed(b->buckets[bucket_index(value)], 1);
+        add_relaxed(b->value, 1);
+        add_relaxed(b->sum, value);
+        if (value > b->max.load(memory_order_relaxed)) {
+                b->max.store(value, memory_order_relaxed);
+        }
+}
+
+/// sum of per-thread values (counter value or histogram sample count)
+static uint64_t blocks_value(struct metric *m)
+{
+        uint64_t val = 0;
+        for_each_block(m, [&](metric_thread_block const &b) {
+                val += b.value.load(memory_order_relaxed);
+        });
+        return val;
+}
+
+int64_t metric_value(struct metric *m)
+{
+        if (m->type == METRIC_GAUGE) {
+                return m->gauge.load(memory_order_relaxed);
+        }
+        return blocks_value(m);
+}
+
+uint64_t metric_time_ns(void)
+{
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void histogram_snapshot(ostream &out, struct metric *m)
+{
+        vector<uint64_t> buckets(HISTOGRAM_BUCKETS);
+        uint64_t count = 0, sum = 0, max_val = 0;
+        for_each_block(m, [&](metric_thread_block const &b) {
+                for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+                        buckets[i] += b.buckets[i].load(memory_order_relaxed);
+                }
+                count += b.value.load(memory_order_relaxed);
+                sum += b.sum.load(memory_order_relaxed);
+                max_val = max(max_val, b.max.load(memory_order_relaxed));
+        });
+        // count is read separately from buckets - use the bucket total for consistency
+        uint64_t total = 0;
+        for (auto c : buckets) {
+                total += c;
+        }
+        out << "{\"count\":" << count << ",\"sum\":" << sum << ",\"max\":" << max_val;
+        const struct { const char *name; double q; } percentiles[] = {
+                { "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "p999", 0.999 } };
+        for (auto const &p : percentiles) {
+                uint64_t rank = (uint64_t) (p.q * total + 0.5);
+                rank = max<uint64_t>(rank, 1);
+                uint64_t seen = 0;
+                uint64_t val = 0;
+                for (int i = 0; i < HISTOGRAM_BUCKETS && total > 0; ++i) {
+                        seen += buckets[i];
+                        if (seen >= rank) {
+                                val = min(bucket_upper_bound(i), max_val);
+                                break;
+                        }
+                }
+                out << ",\"" << p.name << "\":" << val;
+        }
+        out << "}";
+}
+
+std::string metrics_snapshot_json()
+{
+        auto &reg = get_registry();
+        ostringstream counters, gauges, histograms;
+        const char *sep[3] = { "", "", "" };
+        lock_guard<mutex> lk(reg.lock);
+        for (auto const &m : reg.metrics) {
+                switch (m->type) {
+                case METRIC_COUNTER:
+                        counters << sep[0] << "\"" << m->name << "\":" << blocks_value(m.get());
+                        sep[0] = ",";
+                        break;
+                case METRIC_GAUGE:
+                        gauges << sep[1] << "\"" << m->name << "\":" << m->gauge.load(memory_order_relaxed);
+                        sep[1] = ",";
+                        break;
+                case METRIC_HISTOGRAM:
+                        histograms << sep[2] << "\"" << m->name << "\":";
+                        histogram_snapshot(histograms, m.get());
+                        sep[2] = ",";
+                        break;
+                }
+        }
+        return string("{\"timestamp\":") + to_string(time_since_epoch_in_ms()) +
+                ",\"counters\":{" + counters.str() +
+                "},\"gauges\":{" + gauges.str() +
+                "},\"histograms\":{" + histograms.str() + "}}";
+}
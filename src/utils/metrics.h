@@ -0,0 +1,96 @@
+/**
+ * @file   utils/metrics.h
+ * @brief  Registry of lock-free counters, gauges and latency histograms
+ *
+ * Metrics are registered by name once (eg. at module init) and the returned
+ * handle is then updated from hot paths. Counters and histograms are kept per
+ * thread, so updates are plain relaxed stores to thread-owned memory without
+ * any lock or contended atomic operation. metrics_snapshot_json() sums the
+ * per-thread values on demand.
+ *
+ * Histograms are log-linear (HDR-style) with 16 sub-buckets per power of two,
+ * ie. a recorded value is known with relative precision better than 6.25 %.
+ *
+ * Naming convention: "<stage>.<quantity>[_<unit>]", eg. "decompress.frame_ns".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_METRICS_H_
+#define UTILS_METRICS_H_
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <string>
+#else
+#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct metric;
+
+/**
+ * Returns the metric of the given name, creating it when needed. The same
+ * handle is returned for the same name (and type), handles remain valid for
+ * the lifetime of the program.
+ */
+struct metric *metric_counter(const char *name);
+struct metric *metric_gauge(const char *name);
+struct metric *metric_histogram(const char *name);
+
+void metric_add(struct metric *m, uint64_t value);      ///< counters only
+void metric_set(struct metric *m, int64_t value);       ///< gauges only
+void metric_record(struct metric *m, uint64_t value);   ///< histograms only
+
+/// @returns counter value, gauge value or number of samples of a histogram
+int64_t metric_value(struct metric *m);
+
+/// monotonic time suitable for measuring durations recorded to histograms
+uint64_t metric_time_ns(void);
+
+#ifdef __cplusplus
+}
+
+/**
+ * @returns JSON object with all registered metrics, eg.:
+ * {"timestamp":1571234567890,"counters":{"receive.frames":1200},
+ *  "gauges":{...},"histograms":{"decompress.frame_ns":{"count":1200,
+ *  "sum":...,"max":...,"p50":...,"p90":...,"p99":...,"p999":...}}}
+ */
+std::string metrics_snapshot_json();
+#endif
+
+#endif // UTILS_METRICS_H_
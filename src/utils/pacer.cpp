@@ -0,0 +1,185 @@
+/**
+ * @file   utils/pacer.cpp
+ * @brief  Packet pacing engine for the video sender
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "debug.h"
+#include "host.h"
+#include "utils/pacer.h"
+
+#define DEFAULT_SLEEP_THRESHOLD_US 100
+#define PACER_REPORT_INTERVAL_SEC 5
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+ADD_TO_PARAM(tx_pacing, "tx-pacing", "* tx-pacing={sleep|spin|kernel}\n"
+                "  Video sender packet pacing - sleep between bursts (default), busy-wait or leave it to kernel (SO_MAX_PACING_RATE, needs fq qdisc)\n");
+ADD_TO_PARAM(tx_pacing_burst, "tx-pacing-burst", "* tx-pacing-burst=<packets>\n"
+                "  Number of packets sent in one burst by pacer (default is computed from sleep threshold)\n");
+ADD_TO_PARAM(tx_pacing_sleep_threshold, "tx-pacing-sleep-threshold", "* tx-pacing-sleep-threshold=<us>\n"
+                "  Gaps between bursts shorter than threshold are busy-waited (default 100 us)\n");
+
+pacer::pacer() : m_mode(PACER_SLEEP), m_burst_cfg(0),
+        m_sleep_threshold_ns(DEFAULT_SLEEP_THRESHOLD_US * 1000ll),
+        m_interval_ns(0), m_burst(1), m_packets(0),
+        m_report_since(steady_clock::now()), m_stat_bytes(0),
+        m_stat_requested_ns(0), m_stat_actual_ns(0), m_stat_jitter_sq_sum(0.0),
+        m_stat_jitter_max(0), m_stat_waits(0)
+{
+        if (const char *mode = get_commandline_param("tx-pacing")) {
+                if (strcmp(mode, "spin") == 0) {
+                        m_mode = PACER_SPIN;
+                } else if (strcmp(mode, "kernel") == 0) {
+                        m_mode = PACER_KERNEL;
+                } else if (strcmp(mode, "sleep") != 0) {
+                        log_msg(LOG_LEVEL_WARNING, "[Pacer] Unknown mode %s, using sleep.\n", mode);
+                }
+        }
+        if (const char *burst = get_commandline_param("tx-pacing-burst")) {
+                m_burst_cfg = std::max(atoi(burst), 0);
+        }
+        if (const char *threshold = get_commandline_param("tx-pacing-sleep-threshold")) {
+                m_sleep_threshold_ns = atoll(threshold) * 1000;
+        }
+}
+
+void pacer::start(long long interval_ns, std::function<void()> const &flush)
+{
+        m_interval_ns = interval_ns;
+        m_flush = flush;
+        m_packets = 0;
+        m_start = steady_clock::now();
+
+        if (m_burst_cfg > 0) {
+                m_burst = m_burst_cfg;
+        } else if (m_mode == PACER_SLEEP && interval_ns > 0) {
+                // make the gaps between bursts twice the sleep threshold so that they
+                // are slept even if sending of the burst itself takes some time
+                m_burst = std::max<long long>(1, (2 * m_sleep_threshold_ns + interval_ns - 1) / interval_ns);
+        } else {
+                m_burst = 1;
+        }
+}
+
+void pacer::packet_sent(size_t len, bool last)
+{
+        if (m_interval_ns > 0) {
+                m_stat_bytes += len;
+        }
+        m_packets += 1;
+
+        if (last || m_interval_ns <= 0 || m_mode == PACER_KERNEL || m_packets % m_burst != 0) {
+                return;
+        }
+
+        if (m_flush) {
+                m_flush();
+        }
+        wait_until(m_start + nanoseconds(m_packets * m_interval_ns));
+}
+
+void pacer::wait_until(steady_clock::time_point deadline)
+{
+        auto now = steady_clock::now();
+        if (now >= deadline) {
+                return;
+        }
+
+        if (m_mode == PACER_SLEEP && duration_cast<nanoseconds>(deadline - now).count() >= m_sleep_threshold_ns) {
+#ifdef HAVE_LINUX
+                // steady_clock is CLOCK_MONOTONIC in both libstdc++ and libc++
+                long long deadline_ns = duration_cast<nanoseconds>(deadline.time_since_epoch()).count();
+                struct timespec ts = { (time_t) (deadline_ns / 1000000000ll), (long) (deadline_ns % 1000000000ll) };
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+                }
+#else
+                std::this_thread::sleep_until(deadline);
+#endif
+        }
+        while ((now = steady_clock::now()) < deadline) {
+        }
+
+        long long error_ns = duration_cast<nanoseconds>(now - deadline).count();
+        m_stat_jitter_sq_sum += (double) error_ns * error_ns;
+        m_stat_jitter_max = std::max(m_stat_jitter_max, error_ns);
+        m_stat_waits += 1;
+}
+
+void pacer::end()
+{
+        if (m_interval_ns > 0 && m_packets > 1) {
+                m_stat_requested_ns += (m_packets - 1) * m_interval_ns;
+                m_stat_actual_ns += duration_cast<nanoseconds>(steady_clock::now() - m_start).count();
+        }
+        report();
+}
+
+void pacer::report()
+{
+        auto now = steady_clock::now();
+        if (duration_cast<std::chrono::seconds>(now - m_report_since).count() < PACER_REPORT_INTERVAL_SEC) {
+                return;
+        }
+
+        if (m_stat_requested_ns > 0 && m_stat_actual_ns > 0) {
+                log_msg(LOG_LEVEL_VERBOSE, "[Pacer] requested %.2f Mbps, achieved %.2f Mbps, "
+                                "wakeup jitter %.2f us (max %.2f us), burst %d packets\n",
+                                m_stat_bytes * 8.0 / m_stat_requested_ns * 1000.0,
+                                m_stat_bytes * 8.0 / m_stat_actual_ns * 1000.0,
+                                m_stat_waits > 0 ? sqrt(m_stat_jitter_sq_sum / m_stat_waits) / 1000.0 : 0.0,
+                                m_stat_jitter_max / 1000.0, m_burst);
+        }
+
+        m_report_since = now;
+        m_stat_bytes = 0;
+        m_stat_requested_ns = m_stat_actual_ns = 0;
+        m_stat_jitter_sq_sum = 0.0;
+        m_stat_jitter_max = 0;
+        m_stat_waits = 0;
+}
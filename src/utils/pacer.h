@@ -0,0 +1,103 @@
+/**
+ * @file   utils/pacer.h
+ * @brief  Packet pacing engine for the video sender
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_PACER_H_
+#define UTILS_PACER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
+enum pacer_mode {
+        PACER_SLEEP,  ///< sleep between bursts, spin only for short gaps
+        PACER_SPIN,   ///< busy-wait between packets (legacy behavior)
+        PACER_KERNEL, ///< pacing is done by kernel (SO_MAX_PACING_RATE), pacer only collects stats
+};
+
+/**
+ * Paces packets of a tile so that they are sent with given average
+ * inter-packet interval.
+ *
+ * Packets are grouped in bursts - the pacer waits only after a whole burst
+ * has been sent. If the time to the next burst deadline is longer than
+ * sleep threshold, the thread sleeps, otherwise it spins. Deadlines are
+ * absolute (counted from the tile start) so that oversleeping is compensated
+ * by subsequent bursts.
+ *
+ * Usage: start() at the beginning of the tile, packet_sent() after each packet,
+ * end() after the last one.
+ */
+class pacer {
+public:
+        pacer();
+        enum pacer_mode get_mode() const { return m_mode; }
+        void set_mode(enum pacer_mode mode) { m_mode = mode; }
+        /**
+         * @param interval_ns  requested average interval between packets, 0 disables pacing
+         * @param flush        called prior waiting to let the caller submit
+         *                     queued packets (eg. batched sendmmsg()), may be empty
+         */
+        void start(long long interval_ns, std::function<void()> const &flush = {});
+        void packet_sent(size_t len, bool last);
+        void end();
+
+private:
+        void wait_until(std::chrono::steady_clock::time_point deadline);
+        void report();
+
+        enum pacer_mode m_mode;
+        int m_burst_cfg;                ///< configured burst size, 0 - auto
+        long long m_sleep_threshold_ns; ///< shorter gaps are spun
+
+        // current tile
+        long long m_interval_ns;
+        int m_burst;
+        std::function<void()> m_flush;
+        std::chrono::steady_clock::time_point m_start;
+        int m_packets;
+
+        // statistics
+        std::chrono::steady_clock::time_point m_report_since;
+        unsigned long long m_stat_bytes;
+        long long m_stat_requested_ns; ///< sum of requested tile send durations
+        long long m_stat_actual_ns;    ///< sum of actual tile send durations
+        double m_stat_jitter_sq_sum;   ///< sum of squared wakeup errors (ns^2)
+        long long m_stat_jitter_max;
+        unsigned long long m_stat_waits;
+};
+
+#endif // UTILS_PACER_H_
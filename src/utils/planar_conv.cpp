@@ -0,0 +1,661 @@
+/**
+ * @file   utils/planar_conv.cpp
+ * @brief  Scalar and SSE4.1 conversions to planar YCbCr and their dispatch
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "utils/planar_conv.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+
+using namespace std;
+
+namespace {
+
+enum simd_level {
+        SIMD_NONE,
+        SIMD_SSE41,
+        SIMD_AVX2,
+};
+
+static inline bool is_rgb_input(codec_t codec)
+{
+        return codec == RGB || codec == BGR || codec == RGBA || codec == R10k;
+}
+
+static inline bool is_out16(enum planar_fmt out)
+{
+        return out == PLANAR_YUV420P10LE || out == PLANAR_YUV422P10LE || out == PLANAR_YUV444P10LE;
+}
+
+static inline bool is_420(enum planar_fmt out)
+{
+        return out == PLANAR_YUV420P || out == PLANAR_NV12 || out == PLANAR_YUV420P10LE;
+}
+
+static inline bool is_444(enum planar_fmt out)
+{
+        return out == PLANAR_YUV444P || out == PLANAR_YUV444P10LE;
+}
+
+/// stores sample val to 8-bit or 16-bit array
+static inline void put(unsigned char *dst, int idx, int val, bool out16)
+{
+        if (out16) {
+                ((uint16_t *)(void *) dst)[idx] = val;
+        } else {
+                dst[idx] = val;
+        }
+}
+
+static inline int get(const unsigned char *src, int idx, bool out16)
+{
+        return out16 ? ((const uint16_t *)(const void *) src)[idx] : src[idx];
+}
+
+/**
+ * Converts UYVY or YUYV line starting from pixel x to 8-bit 4:2:2 planes.
+ */
+static void yuv422_line(codec_t in_codec, const unsigned char *src, unsigned char *y,
+                unsigned char *u, unsigned char *v, int x, int width)
+{
+        int y0 = in_codec == UYVY ? 1 : 0;
+        int cb = in_codec == UYVY ? 0 : 1;
+        src += 2 * x;
+        // the last pixel of an odd-width line is written to the plane padding
+        for ( ; x < width; x += 2) {
+                y[x] = src[y0];
+                y[x + 1] = src[y0 + 2];
+                u[x / 2] = src[cb];
+                v[x / 2] = src[cb + 2];
+                src += 4;
+        }
+}
+
+/**
+ * Converts v210 line starting from pixel x (must be divisible by 6) to 4:2:2
+ * planes, either 10-bit (out16) or 8-bit.
+ */
+static void v210_line(const unsigned char *src, unsigned char *y, unsigned char *u,
+                unsigned char *v, int x, int width, bool out16)
+{
+        int shift = out16 ? 0 : 2;
+        const uint32_t *s = (const uint32_t *)(const void *) (src + x / 6 * 16);
+        for ( ; x < width; x += 6) {
+                // samples of 6 pixels in the order U0 Y0 V0 Y1 U1 Y2 V1 Y3 U2 Y4 V2 Y5
+                int smp[12];
+                for (int i = 0; i < 4; ++i) {
+                        uint32_t w = *s++;
+                        smp[3 * i] = (w & 0x3ff) >> shift;
+                        smp[3 * i + 1] = ((w >> 10) & 0x3ff) >> shift;
+                        smp[3 * i + 2] = ((w >> 20) & 0x3ff) >> shift;
+                }
+                for (int i = 0; i < 6 && x + i < width; ++i) {
+                        put(y, x + i, smp[2 * i + 1], out16);
+                }
+                for (int i = 0; i < 3 && x + 2 * i < width; ++i) {
+                        put(u, x / 2 + i, smp[4 * i], out16);
+                        put(v, x / 2 + i, smp[4 * i + 2], out16);
+                }
+        }
+}
+
+/**
+ * Reads a pixel of RGB, BGR, RGBA or R10k. R10k gives either 8 most
+ * significant bits (same as vc_copyliner10k()) or all 10 bits (ten_bit).
+ */
+static inline void get_rgb(codec_t in_codec, const unsigned char *src, int x, bool ten_bit, int *r, int *g, int *b)
+{
+        switch (in_codec) {
+        case RGB:
+                *r = src[3 * x];
+                *g = src[3 * x + 1];
+                *b = src[3 * x + 2];
+                break;
+        case BGR:
+                *r = src[3 * x + 2];
+                *g = src[3 * x + 1];
+                *b = src[3 * x];
+                break;
+        case RGBA:
+                *r = src[4 * x];
+                *g = src[4 * x + 1];
+                *b = src[4 * x + 2];
+                break;
+        default: { // R10k, big-endian 10-bit R, G, B, 2-bit padding
+                const unsigned char *p = src + 4 * x;
+                if (ten_bit) {
+                        *r = p[0] << 2 | p[1] >> 6;
+                        *g = (p[1] & 0x3f) << 4 | p[2] >> 4;
+                        *b = (p[2] & 0xf) << 6 | p[3] >> 2;
+                } else {
+                        *r = p[0];
+                        *g = (p[1] & 0x3f) << 2 | p[2] >> 6;
+                        *b = (p[2] & 0xf) << 4 | p[3] >> 4;
+                }
+        }
+        }
+}
+
+static inline int dot(int r, int g, int b, int cr, int cg, int cb)
+{
+        return cr * r + cg * g + cb * b;
+}
+
+/**
+ * Converts RGB-like line starting from pixel x (even if subsample) to YCbCr
+ * planes. Chroma is either 4:2:2 (subsample, average of a pixel pair) or
+ * 4:4:4, 10-bit output (out16) is supported only for R10k.
+ */
+static void rgb_line(codec_t in_codec, const unsigned char *src, unsigned char *y, unsigned char *u,
+                unsigned char *v, int x, int width, bool subsample, bool out16)
+{
+        int y_off = (out16 ? 64 : 16) << 16;
+        int c_off = (out16 ? 512 : 128) << 16;
+        for ( ; x < width; x += subsample ? 2 : 1) {
+                int r, g, b;
+                get_rgb(in_codec, src, x, out16, &r, &g, &b);
+                put(y, x, (dot(r, g, b, PLANAR_CONV_COEFS(Y, out16)) + y_off) >> 16, out16);
+                int cb = dot(r, g, b, PLANAR_CONV_COEFS(CB, out16));
+                int cr = dot(r, g, b, PLANAR_CONV_COEFS(CR, out16));
+                if (!subsample) {
+                        put(u, x, (cb + c_off) >> 16, out16);
+                        put(v, x, (cr + c_off) >> 16, out16);
+                        continue;
+                }
+                if (x + 1 < width) {
+                        get_rgb(in_codec, src, x + 1, out16, &r, &g, &b);
+                        put(y, x + 1, (dot(r, g, b, PLANAR_CONV_COEFS(Y, out16)) + y_off) >> 16, out16);
+                }
+                cb += dot(r, g, b, PLANAR_CONV_COEFS(CB, out16));
+                cr += dot(r, g, b, PLANAR_CONV_COEFS(CR, out16));
+                put(u, x / 2, (cb / 2 + c_off) >> 16, out16);
+                put(v, x / 2, (cr / 2 + c_off) >> 16, out16);
+        }
+}
+
+/// vertical average of chroma lines (rounded down)
+static void avg_line(const unsigned char *a, const unsigned char *b, unsigned char *dst, int i, int count, bool out16)
+{
+        for ( ; i < count; ++i) {
+                put(dst, i, (get(a, i, out16) + get(b, i, out16)) / 2, out16);
+        }
+}
+
+/// vertical average of 8-bit chroma lines interleaved to NV12 CbCr plane
+static void avg_interleave_line(const unsigned char *u0, const unsigned char *u1, const unsigned char *v0,
+                const unsigned char *v1, unsigned char *dst, int i, int count)
+{
+        for ( ; i < count; ++i) {
+                dst[2 * i] = (u0[i] + u1[i]) / 2;
+                dst[2 * i + 1] = (v0[i] + v1[i]) / 2;
+        }
+}
+
+/// horizontal duplication of chroma samples (4:2:2 to 4:4:4)
+static void dup_line(const unsigned char *src, unsigned char *dst, int i, int count, bool out16)
+{
+        for ( ; i < count; ++i) {
+                put(dst, 2 * i, get(src, i, out16), out16);
+                put(dst, 2 * i + 1, get(src, i, out16), out16);
+        }
+}
+
+#ifdef __SSE4_1__
+static int yuv422_line_sse(codec_t in_codec, const unsigned char *src, unsigned char *y,
+                unsigned char *u, unsigned char *v, int width)
+{
+        // Y to the lower half, then 4 Cb and 4 Cr
+        const __m128i shuf = in_codec == UYVY ?
+                _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 4, 8, 12, 2, 6, 10, 14) :
+                _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 5, 9, 13, 3, 7, 11, 15);
+        int x = 0;
+        for ( ; x + 16 <= width; x += 16) {
+                __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *) (src + 2 * x)), shuf);
+                __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(const void *) (src + 2 * x + 16)), shuf);
+                __m128i uv = _mm_shuffle_epi32(_mm_unpackhi_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_si128((__m128i *)(void *) (y + x), _mm_unpacklo_epi64(a, b));
+                _mm_storel_epi64((__m128i *)(void *) (u + x / 2), uv);
+                _mm_storel_epi64((__m128i *)(void *) (v + x / 2), _mm_unpackhi_epi64(uv, uv));
+        }
+        return x;
+}
+
+/**
+ * Unpacks a v210 block (6 pixels) to 16-bit Y (6 lower words), Cb and Cr
+ * (3 lower words of each).
+ */
+static inline void v210_block_sse(const unsigned char *src, __m128i *y, __m128i *u, __m128i *v)
+{
+        const __m128i mask = _mm_set1_epi32(0x3ff);
+        // 16-bit word indices to byte shuffles, Z leaves zero
+#define W(i) (char) (2 * (i)), (char) (2 * (i) + 1)
+#define Z -1, -1
+        const __m128i y_ab = _mm_setr_epi8(W(4), W(1), Z, W(6), W(3), Z, Z, Z);
+        const __m128i y_c = _mm_setr_epi8(Z, Z, W(1), Z, Z, W(3), Z, Z);
+        const __m128i u_ab = _mm_setr_epi8(W(0), W(5), Z, Z, Z, Z, Z, Z);
+        const __m128i u_c = _mm_setr_epi8(Z, Z, W(2), Z, Z, Z, Z, Z);
+        const __m128i v_ab = _mm_setr_epi8(Z, W(2), W(7), Z, Z, Z, Z, Z);
+        const __m128i v_c = _mm_setr_epi8(W(0), Z, Z, Z, Z, Z, Z, Z);
+#undef W
+#undef Z
+        __m128i w = _mm_loadu_si128((const __m128i *)(const void *) src);
+        __m128i ab = _mm_packus_epi32(_mm_and_si128(w, mask), _mm_and_si128(_mm_srli_epi32(w, 10), mask));
+        __m128i c = _mm_and_si128(_mm_srli_epi32(w, 20), mask);
+        c = _mm_packus_epi32(c, c);
+        *y = _mm_or_si128(_mm_shuffle_epi8(ab, y_ab), _mm_shuffle_epi8(c, y_c));
+        *u = _mm_or_si128(_mm_shuffle_epi8(ab, u_ab), _mm_shuffle_epi8(c, u_c));
+        *v = _mm_or_si128(_mm_shuffle_epi8(ab, v_ab), _mm_shuffle_epi8(c, v_c));
+}
+
+static int v210_line_sse(const unsigned char *src, unsigned char *y, unsigned char *u,
+                unsigned char *v, int width, bool out16)
+{
+        int x = 0;
+        // stores are 8 luma and 4 chroma samples wide
+        for ( ; x + 8 <= width; x += 6) {
+                __m128i yy, uu, vv;
+                v210_block_sse(src, &yy, &uu, &vv);
+                src += 16;
+                if (out16) {
+                        _mm_storeu_si128((__m128i *)(void *) (y + 2 * x), yy);
+                        _mm_storel_epi64((__m128i *)(void *) (u + x), uu);
+                        _mm_storel_epi64((__m128i *)(void *) (v + x), vv);
+                } else {
+                        _mm_storel_epi64((__m128i *)(void *) (y + x), _mm_packus_epi16(_mm_srli_epi16(yy, 2), yy));
+                        int32_t cb = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_srli_epi16(uu, 2), uu));
+                        int32_t cr = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_srli_epi16(vv, 2), vv));
+                        memcpy(u + x / 2, &cb, sizeof cb);
+                        memcpy(v + x / 2, &cr, sizeof cr);
+                }
+        }
+        return x;
+}
+
+/// loads 4 pixels of IN_CODEC to 32-bit lanes of r, g and b
+template<codec_t IN_CODEC, bool TEN_BIT>
+static inline void load_rgb_sse(const unsigned char *src, __m128i *r, __m128i *g, __m128i *b)
+{
+        const __m128i mask8 = _mm_set1_epi32(0xff);
+        __m128i x = _mm_loadu_si128((const __m128i *)(const void *) src);
+        if (IN_CODEC == R10k && TEN_BIT) {
+                *r = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(x, mask8), 2),
+                                _mm_and_si128(_mm_srli_epi32(x, 14), _mm_set1_epi32(0x3)));
+                *g = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 4), _mm_set1_epi32(0x3f0)),
+                                _mm_and_si128(_mm_srli_epi32(x, 20), _mm_set1_epi32(0xf)));
+                *b = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 10), _mm_set1_epi32(0x3c0)),
+                                _mm_srli_epi32(x, 26));
+                return;
+        }
+        if (IN_CODEC == R10k) {
+                *r = _mm_and_si128(x, mask8);
+                *g = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 6), _mm_set1_epi32(0xfc)),
+                                _mm_and_si128(_mm_srli_epi32(x, 22), _mm_set1_epi32(0x3)));
+                *b = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 12), _mm_set1_epi32(0xf0)),
+                                _mm_srli_epi32(x, 28));
+                return;
+        }
+        if (IN_CODEC == RGB) {
+                x = _mm_shuffle_epi8(x, _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+        } else if (IN_CODEC == BGR) {
+                x = _mm_shuffle_epi8(x, _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1));
+        }
+        *r = _mm_and_si128(x, mask8);
+        *g = _mm_and_si128(_mm_srli_epi32(x, 8), mask8);
+        *b = _mm_and_si128(_mm_srli_epi32(x, 16), mask8);
+}
+
+static inline __m128i dot_sse(__m128i r, __m128i g, __m128i b, int cr, int cg, int cb)
+{
+        return _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(r, _mm_set1_epi32(cr)),
+                                _mm_mullo_epi32(g, _mm_set1_epi32(cg))),
+                        _mm_mullo_epi32(b, _mm_set1_epi32(cb)));
+}
+
+/// sums of adjacent lanes of a and b divided by 2 rounding towards zero (as C division)
+static inline __m128i pair_avg_sse(__m128i a, __m128i b)
+{
+        __m128i sum = _mm_hadd_epi32(a, b);
+        return _mm_srai_epi32(_mm_add_epi32(sum, _mm_srli_epi32(sum, 31)), 1);
+}
+
+/// packs two 32-bit vectors to 8 16-bit or 8-bit samples and stores them
+static inline void store8_sse(unsigned char *dst, __m128i a, __m128i b, bool out16)
+{
+        __m128i p = _mm_packus_epi32(a, b);
+        if (out16) {
+                _mm_storeu_si128((__m128i *)(void *) dst, p);
+        } else {
+                _mm_storel_epi64((__m128i *)(void *) dst, _mm_packus_epi16(p, p));
+        }
+}
+
+/// packs 32-bit vector to 4 16-bit or 8-bit samples and stores them
+static inline void store4_sse(unsigned char *dst, __m128i a, bool out16)
+{
+        __m128i p = _mm_packus_epi32(a, a);
+        if (out16) {
+                _mm_storel_epi64((__m128i *)(void *) dst, p);
+        } else {
+                int32_t val = _mm_cvtsi128_si32(_mm_packus_epi16(p, p));
+                memcpy(dst, &val, sizeof val);
+        }
+}
+
+template<codec_t IN_CODEC, bool SUBSAMPLE, bool OUT16>
+static int rgb_line_sse(const unsigned char *src, unsigned char *y, unsigned char *u, unsigned char *v, int width)
+{
+        const int bpp = IN_CODEC == RGB || IN_CODEC == BGR ? 3 : 4;
+        const int bps = OUT16 ? 2 : 1;
+        const __m128i y_off = _mm_set1_epi32((OUT16 ? 64 : 16) << 16);
+        const __m128i c_off = _mm_set1_epi32((OUT16 ? 512 : 128) << 16);
+        // 3-byte pixels are loaded 16 bytes at a time - don't read past the line
+        const int tail = bpp == 3 ? 2 : 0;
+        int x = 0;
+        for ( ; x + 8 + tail <= width; x += 8) {
+                __m128i r0, g0, b0, r1, g1, b1;
+                load_rgb_sse<IN_CODEC, OUT16>(src + bpp * x, &r0, &g0, &b0);
+                load_rgb_sse<IN_CODEC, OUT16>(src + bpp * (x + 4), &r1, &g1, &b1);
+                store8_sse(y + bps * x,
+                                _mm_srli_epi32(_mm_add_epi32(dot_sse(r0, g0, b0, PLANAR_CONV_COEFS(Y, OUT16)), y_off), 16),
+                                _mm_srli_epi32(_mm_add_epi32(dot_sse(r1, g1, b1, PLANAR_CONV_COEFS(Y, OUT16)), y_off), 16), OUT16);
+                __m128i cb0 = dot_sse(r0, g0, b0, PLANAR_CONV_COEFS(CB, OUT16));
+                __m128i cb1 = dot_sse(r1, g1, b1, PLANAR_CONV_COEFS(CB, OUT16));
+                __m128i cr0 = dot_sse(r0, g0, b0, PLANAR_CONV_COEFS(CR, OUT16));
+                __m128i cr1 = dot_sse(r1, g1, b1, PLANAR_CONV_COEFS(CR, OUT16));
+                if (SUBSAMPLE) {
+                        store4_sse(u + bps * x / 2, _mm_srli_epi32(_mm_add_epi32(pair_avg_sse(cb0, cb1), c_off), 16), OUT16);
+                        store4_sse(v + bps * x / 2, _mm_srli_epi32(_mm_add_epi32(pair_avg_sse(cr0, cr1), c_off), 16), OUT16);
+                } else {
+                        store8_sse(u + bps * x, _mm_srli_epi32(_mm_add_epi32(cb0, c_off), 16),
+                                        _mm_srli_epi32(_mm_add_epi32(cb1, c_off), 16), OUT16);
+                        store8_sse(v + bps * x, _mm_srli_epi32(_mm_add_epi32(cr0, c_off), 16),
+                                        _mm_srli_epi32(_mm_add_epi32(cr1, c_off), 16), OUT16);
+                }
+        }
+        return x;
+}
+
+template<codec_t IN_CODEC>
+static int rgb_line_sse(const unsigned char *src, unsigned char *y, unsigned char *u, unsigned char *v,
+                int width, bool subsample, bool out16)
+{
+        if (out16) {
+                return subsample ? rgb_line_sse<IN_CODEC, true, true>(src, y, u, v, width) :
+                        rgb_line_sse<IN_CODEC, false, true>(src, y, u, v, width);
+        }
+        return subsample ? rgb_line_sse<IN_CODEC, true, false>(src, y, u, v, width) :
+                rgb_line_sse<IN_CODEC, false, false>(src, y, u, v, width);
+}
+
+static int rgb_line_sse(codec_t in_codec, const unsigned char *src, unsigned char *y, unsigned char *u,
+                unsigned char *v, int width, bool subsample, bool out16)
+{
+        switch (in_codec) {
+        case RGB: return rgb_line_sse<RGB>(src, y, u, v, width, subsample, false);
+        case BGR: return rgb_line_sse<BGR>(src, y, u, v, width, subsample, false);
+        case RGBA: return rgb_line_sse<RGBA>(src, y, u, v, width, subsample, false);
+        default: return rgb_line_sse<R10k>(src, y, u, v, width, subsample, out16);
+        }
+}
+
+/// (a + b) / 2 of unsigned 8-bit or 16-bit samples, pavg rounds up so subtract the lost bit
+static inline __m128i avg_down_sse(__m128i a, __m128i b, bool out16)
+{
+        __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), out16 ? _mm_set1_epi16(1) : _mm_set1_epi8(1));
+        return out16 ? _mm_sub_epi16(_mm_avg_epu16(a, b), odd) : _mm_sub_epi8(_mm_avg_epu8(a, b), odd);
+}
+
+static int avg_line_sse(const unsigned char *a, const unsigned char *b, unsigned char *dst, int count, bool out16)
+{
+        int bytes = out16 ? 2 * count : count;
+        int i = 0;
+        for ( ; i + 16 <= bytes; i += 16) {
+                __m128i va = _mm_loadu_si128((const __m128i *)(const void *) (a + i));
+                __m128i vb = _mm_loadu_si128((const __m128i *)(const void *) (b + i));
+                _mm_storeu_si128((__m128i *)(void *) (dst + i), avg_down_sse(va, vb, out16));
+        }
+        return out16 ? i / 2 : i;
+}
+
+static int avg_interleave_line_sse(const unsigned char *u0, const unsigned char *u1, const unsigned char *v0,
+                const unsigned char *v1, unsigned char *dst, int count)
+{
+        int i = 0;
+        for ( ; i + 16 <= count; i += 16) {
+                __m128i u = avg_down_sse(_mm_loadu_si128((const __m128i *)(const void *) (u0 + i)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (u1 + i)), false);
+                __m128i v = avg_down_sse(_mm_loadu_si128((const __m128i *)(const void *) (v0 + i)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (v1 + i)), false);
+                _mm_storeu_si128((__m128i *)(void *) (dst + 2 * i), _mm_unpacklo_epi8(u, v));
+                _mm_storeu_si128((__m128i *)(void *) (dst + 2 * i + 16), _mm_unpackhi_epi8(u, v));
+        }
+        return i;
+}
+
+static int dup_line_sse(const unsigned char *src, unsigned char *dst, int count, bool out16)
+{
+        int bytes = out16 ? 2 * count : count;
+        int i = 0;
+        for ( ; i + 16 <= bytes; i += 16) {
+                __m128i s = _mm_loadu_si128((const __m128i *)(const void *) (src + i));
+                __m128i lo = out16 ? _mm_unpacklo_epi16(s, s) : _mm_unpacklo_epi8(s, s);
+                __m128i hi = out16 ? _mm_unpackhi_epi16(s, s) : _mm_unpackhi_epi8(s, s);
+                _mm_storeu_si128((__m128i *)(void *) (dst + 2 * i), lo);
+                _mm_storeu_si128((__m128i *)(void *) (dst + 2 * i + 16), hi);
+        }
+        return out16 ? i / 2 : i;
+}
+#endif // defined __SSE4_1__
+
+/// vectorized line kernels, each returns count of converted pixels (samples)
+struct kernels {
+        int (*yuv422)(codec_t, const unsigned char *, unsigned char *, unsigned char *, unsigned char *, int);
+        int (*v210)(const unsigned char *, unsigned char *, unsigned char *, unsigned char *, int, bool);
+        int (*rgb)(codec_t, const unsigned char *, unsigned char *, unsigned char *, unsigned char *, int, bool, bool);
+        int (*avg)(const unsigned char *, const unsigned char *, unsigned char *, int, bool);
+        int (*avg_interleave)(const unsigned char *, const unsigned char *, const unsigned char *,
+                        const unsigned char *, unsigned char *, int);
+        int (*dup)(const unsigned char *, unsigned char *, int, bool);
+};
+
+static enum simd_level get_simd_level()
+{
+        enum simd_level best = SIMD_NONE;
+#ifdef __SSE4_1__
+        best = SIMD_SSE41;
+#endif
+#ifdef PLANAR_CONV_HAVE_AVX2
+        static bool avx2 = [] { __builtin_cpu_init(); return __builtin_cpu_supports("avx2"); }();
+        if (avx2) {
+                best = SIMD_AVX2;
+        }
+#endif
+        const char *req = get_commandline_param("line-decoder-simd");
+        if (req != NULL && strcmp(req, "none") == 0) {
+                return SIMD_NONE;
+        }
+        if (req != NULL && strcmp(req, "sse4.1") == 0) {
+                return min(best, SIMD_SSE41);
+        }
+        return best;
+}
+
+static const struct kernels *get_kernels(enum simd_level level)
+{
+#ifdef PLANAR_CONV_HAVE_AVX2
+        static const struct kernels avx2 = { planar_conv_yuv422_avx2, planar_conv_v210_avx2, planar_conv_rgb_avx2,
+                planar_conv_avg_avx2, planar_conv_avg_interleave_avx2, planar_conv_dup_avx2 };
+        if (level == SIMD_AVX2) {
+                return &avx2;
+        }
+#endif
+#ifdef __SSE4_1__
+        static const struct kernels sse = { yuv422_line_sse, v210_line_sse, rgb_line_sse,
+                avg_line_sse, avg_interleave_line_sse, dup_line_sse };
+        if (level == SIMD_SSE41) {
+                return &sse;
+        }
+#endif
+        UNUSED(level);
+        return nullptr;
+}
+
+/// converts a line to Y and Cb/Cr of either 4:2:2 (subsample) or 4:4:4 (RGB input only)
+static void convert_line(const struct kernels *k, codec_t in_codec, const unsigned char *src, unsigned char *y,
+                unsigned char *u, unsigned char *v, int width, bool subsample, bool out16)
+{
+        switch (in_codec) {
+        case UYVY:
+        case YUYV:
+                yuv422_line(in_codec, src, y, u, v, k ? k->yuv422(in_codec, src, y, u, v, width) : 0, width);
+                break;
+        case v210:
+                v210_line(src, y, u, v, k ? k->v210(src, y, u, v, width, out16) : 0, width, out16);
+                break;
+        default:
+                rgb_line(in_codec, src, y, u, v, k ? k->rgb(in_codec, src, y, u, v, width, subsample, out16) : 0,
+                                width, subsample, out16);
+        }
+}
+
+} // end of anonymous namespace
+
+bool planar_conv_supports(codec_t in_codec, enum planar_fmt out)
+{
+        if (is_out16(out)) {
+                return in_codec == v210 || in_codec == R10k;
+        }
+        return in_codec == UYVY || in_codec == YUYV || in_codec == v210 || is_rgb_input(in_codec);
+}
+
+const char *planar_conv_simd(void)
+{
+        switch (get_simd_level()) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE41: return "sse4.1";
+        default: return "none";
+        }
+}
+
+static void planar_conv_lines_impl(const struct kernels *k, codec_t in_codec, enum planar_fmt out,
+                const unsigned char *src, int src_linesize, int width, int height,
+                unsigned char * const *dst, const int *dst_linesize, int begin, int end)
+{
+        const bool out16 = is_out16(out);
+        const bool v_sub = is_420(out);
+        // RGB is converted directly to 4:4:4, subsampled YCbCr needs to be duplicated
+        const bool full_chroma = is_444(out) && is_rgb_input(in_codec);
+        const bool dup = is_444(out) && !full_chroma;
+        const int chroma_width = full_chroma ? width : (width + 1) / 2;
+        const int bps = out16 ? 2 : 1;
+        // two lines of Cb and Cr, the size is rounded up to whole v210 blocks
+        const int tmp_linesize = bps * ((width + 5) / 6 * 6 + 16);
+        vector<unsigned char> tmp(v_sub || dup ? 4 * tmp_linesize : 0);
+        unsigned char *tmp_u[2] = { tmp.data(), tmp.data() + tmp_linesize };
+        unsigned char *tmp_v[2] = { tmp.data() + 2 * tmp_linesize, tmp.data() + 3 * tmp_linesize };
+
+        for (int line = begin; line < end; line += v_sub ? 2 : 1) {
+                const unsigned char *in = src + (size_t) line * src_linesize;
+                unsigned char *y = dst[0] + (size_t) line * dst_linesize[0];
+                if (!v_sub && !dup) {
+                        convert_line(k, in_codec, in, y, dst[1] + (size_t) line * dst_linesize[1],
+                                        dst[2] + (size_t) line * dst_linesize[2], width, !full_chroma, out16);
+                        continue;
+                }
+                convert_line(k, in_codec, in, y, tmp_u[0], tmp_v[0], width, !full_chroma, out16);
+                if (dup) {
+                        unsigned char *u = dst[1] + (size_t) line * dst_linesize[1];
+                        unsigned char *v = dst[2] + (size_t) line * dst_linesize[2];
+                        dup_line(tmp_u[0], u, k ? k->dup(tmp_u[0], u, chroma_width, out16) : 0, chroma_width, out16);
+                        dup_line(tmp_v[0], v, k ? k->dup(tmp_v[0], v, chroma_width, out16) : 0, chroma_width, out16);
+                        continue;
+                }
+                // 4:2:0 - the last line of an odd-height image is used as both
+                if (line + 1 < height) {
+                        convert_line(k, in_codec, in + src_linesize, y + dst_linesize[0], tmp_u[1], tmp_v[1],
+                                        width, true, out16);
+                } else {
+                        memcpy(tmp_u[1], tmp_u[0], bps * chroma_width);
+                        memcpy(tmp_v[1], tmp_v[0], bps * chroma_width);
+                }
+                if (out == PLANAR_NV12) {
+                        unsigned char *uv = dst[1] + (size_t) line / 2 * dst_linesize[1];
+                        avg_interleave_line(tmp_u[0], tmp_u[1], tmp_v[0], tmp_v[1], uv,
+                                        k ? k->avg_interleave(tmp_u[0], tmp_u[1], tmp_v[0], tmp_v[1], uv, chroma_width) : 0,
+                                        chroma_width);
+                        continue;
+                }
+                unsigned char *u = dst[1] + (size_t) line / 2 * dst_linesize[1];
+                unsigned char *v = dst[2] + (size_t) line / 2 * dst_linesize[2];
+                avg_line(tmp_u[0], tmp_u[1], u, k ? k->avg(tmp_u[0], tmp_u[1], u, chroma_width, out16) : 0,
+                                chroma_width, out16);
+                avg_line(tmp_v[0], tmp_v[1], v, k ? k->avg(tmp_v[0], tmp_v[1], v, chroma_width, out16) : 0,
+                                chroma_width, out16);
+        }
+}
+
+void planar_conv_lines(codec_t in_codec, enum planar_fmt out, const unsigned char *src, int src_linesize,
+                int width, int height, unsigned char * const *dst, const int *dst_linesize, int begin, int end)
+{
+        planar_conv_lines_impl(get_kernels(get_simd_level()), in_codec, out, src, src_linesize, width, height,
+                        dst, dst_linesize, begin, end);
+}
+
+void planar_conv(codec_t in_codec, enum planar_fmt out, const unsigned char *src, int src_linesize,
+                int width, int height, unsigned char * const *dst, const int *dst_linesize)
+{
+        const struct kernels *k = get_kernels(get_simd_level());
+        // split by pairs of lines because of 4:2:0
+        parallel_for(0, (height + 1) / 2, [&](int begin, int end) {
+                        planar_conv_lines_impl(k, in_codec, out, src, src_linesize, width, height, dst, dst_linesize,
+                                        2 * begin, min(2 * end, height));
+                        }, 16);
+}
@@ -0,0 +1,148 @@
+/**
+ * @file   utils/planar_conv.h
+ * @brief  Conversion of packed pixel formats to planar YCbCr for encoders
+ *
+ * Every line is converted from the source codec to the output planes in a
+ * single pass without an intermediate frame. Chroma of 4:2:0 formats is
+ * averaged from two lines converted to a small line buffer, so the frame
+ * can be split to slices of lines converted independently. Lines are
+ * converted with SSE4.1 or AVX2 (if supported by the CPU), remaining
+ * pixels by scalar code with identical results.
+ *
+ * YCbCr output is BT.709 limited range, RGB is converted with the same
+ * coefficients as vc_copylineRGBtoUYVY().
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_PLANAR_CONV_H_
+#define UTILS_PLANAR_CONV_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+enum planar_fmt {
+        PLANAR_YUV420P,
+        PLANAR_YUV422P,
+        PLANAR_YUV444P,
+        PLANAR_NV12,
+        PLANAR_YUV420P10LE,
+        PLANAR_YUV422P10LE,
+        PLANAR_YUV444P10LE,
+};
+
+/**
+ * @returns true if in_codec can be converted to out, ie. in_codec is one of
+ * UYVY, YUYV, v210, RGB, BGR, RGBA, R10k; 10-bit output formats only from
+ * v210 and R10k
+ */
+bool planar_conv_supports(codec_t in_codec, enum planar_fmt out);
+/// @returns name of the instruction set that will be used ("none", "sse4.1" or "avx2")
+const char *planar_conv_simd(void);
+
+/**
+ * Converts lines [begin, end) of the source image.
+ *
+ * @param dst, dst_linesize  output planes (2 for NV12, 3 otherwise) of the whole image
+ * @param begin  first line, must be even for 4:2:0 formats
+ */
+void planar_conv_lines(codec_t in_codec, enum planar_fmt out, const unsigned char *src, int src_linesize,
+                int width, int height, unsigned char * const *dst, const int *dst_linesize, int begin, int end);
+/// converts the whole image in parallel using the worker pool
+void planar_conv(codec_t in_codec, enum planar_fmt out, const unsigned char *src, int src_linesize,
+                int width, int height, unsigned char * const *dst, const int *dst_linesize);
+
+/**
+ * @name RGB to YCbCr coefficients
+ * BT.709 limited range in 16.16 fixed point, same as vc_copylineRGBtoUYVY().
+ * The *10 variants are for 10-bit input and output (scaled by 1020/1023 so
+ * that full-scale 1023 maps to 940 and 64..960 like 255 to 235 and 16..240).
+ * The sums cannot overflow the output range so no clamping is needed.
+ * @{ */
+#define PLANAR_CONV_Y_R 11993
+#define PLANAR_CONV_Y_G 40239
+#define PLANAR_CONV_Y_B 4063
+#define PLANAR_CONV_CB_R -6619
+#define PLANAR_CONV_CB_G -22151
+#define PLANAR_CONV_CB_B 28770
+#define PLANAR_CONV_CR_R 28770
+#define PLANAR_CONV_CR_G -26149
+#define PLANAR_CONV_CR_B -2621
+#define PLANAR_CONV_Y_R10 11958
+#define PLANAR_CONV_Y_G10 40121
+#define PLANAR_CONV_Y_B10 4051
+#define PLANAR_CONV_CB_R10 -6600
+#define PLANAR_CONV_CB_G10 -22086
+#define PLANAR_CONV_CB_B10 28686
+#define PLANAR_CONV_CR_R10 28686
+#define PLANAR_CONV_CR_G10 -26073
+#define PLANAR_CONV_CR_B10 -2613
+/// R, G and B coefficients of component c (Y, CB or CR) as 3 arguments
+#define PLANAR_CONV_COEFS(c, ten_bit) \
+        ((ten_bit) ? PLANAR_CONV_##c##_R10 : PLANAR_CONV_##c##_R), \
+        ((ten_bit) ? PLANAR_CONV_##c##_G10 : PLANAR_CONV_##c##_G), \
+        ((ten_bit) ? PLANAR_CONV_##c##_B10 : PLANAR_CONV_##c##_B)
+/// @}
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define PLANAR_CONV_HAVE_AVX2 1
+/**
+ * @name AVX2 line kernels
+ * Do not call directly. The functions convert as many pixels from the line
+ * beginning as they can with whole vectors and return their count. See the
+ * scalar counterparts in planar_conv.cpp for the parameters.
+ * @{ */
+int planar_conv_yuv422_avx2(codec_t in_codec, const unsigned char *src, unsigned char *y,
+                unsigned char *u, unsigned char *v, int width);
+int planar_conv_v210_avx2(const unsigned char *src, unsigned char *y, unsigned char *u,
+                unsigned char *v, int width, bool out16);
+int planar_conv_rgb_avx2(codec_t in_codec, const unsigned char *src, unsigned char *y,
+                unsigned char *u, unsigned char *v, int width, bool subsample, bool out16);
+int planar_conv_avg_avx2(const unsigned char *a, const unsigned char *b, unsigned char *dst,
+                int count, bool out16);
+int planar_conv_avg_interleave_avx2(const unsigned char *u0, const unsigned char *u1,
+                const unsigned char *v0, const unsigned char *v1, unsigned char *dst, int count);
+int planar_conv_dup_avx2(const unsigned char *src, unsigned char *dst, int count, bool out16);
+/// @}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_PLANAR_CONV_H_
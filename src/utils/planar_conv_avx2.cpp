@@ -0,0 +1,332 @@
+/**
+ * @file   utils/planar_conv_avx2.cpp
+ * @brief  AVX2 line kernels for utils/planar_conv.h
+ *
+ * Compiled for AVX2 via the target attribute (as video_codec_avx2.c), the
+ * dispatch in planar_conv.cpp calls them only if the CPU supports AVX2.
+ * 256-bit shuffles and packs work within 128-bit lanes, so the results are
+ * reordered with cross-lane permutes before storing.
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include "utils/planar_conv.h"
+
+#ifdef PLANAR_CONV_HAVE_AVX2
+
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i loadu(const unsigned char *src)
+{
+        return _mm256_loadu_si256((const __m256i *)(const void *) src);
+}
+
+static inline AVX2 void storeu(unsigned char *dst, __m256i val)
+{
+        _mm256_storeu_si256((__m256i *)(void *) dst, val);
+}
+
+AVX2 int planar_conv_yuv422_avx2(codec_t in_codec, const unsigned char *src, unsigned char *y,
+                unsigned char *u, unsigned char *v, int width)
+{
+        // in each lane Y to the lower half, then 4 Cb and 4 Cr
+        const __m256i shuf = in_codec == UYVY ?
+                _mm256_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 4, 8, 12, 2, 6, 10, 14,
+                                1, 3, 5, 7, 9, 11, 13, 15, 0, 4, 8, 12, 2, 6, 10, 14) :
+                _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 5, 9, 13, 3, 7, 11, 15,
+                                0, 2, 4, 6, 8, 10, 12, 14, 1, 5, 9, 13, 3, 7, 11, 15);
+        const __m256i uv_order = _mm256_setr_epi32(0, 4, 2, 6, 1, 5, 3, 7);
+        int x = 0;
+        for ( ; x + 32 <= width; x += 32) {
+                __m256i a = _mm256_shuffle_epi8(loadu(src + 2 * x), shuf);
+                __m256i b = _mm256_shuffle_epi8(loadu(src + 2 * x + 32), shuf);
+                storeu(y + x, _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+                __m256i uv = _mm256_permutevar8x32_epi32(_mm256_unpackhi_epi64(a, b), uv_order);
+                _mm_storeu_si128((__m128i *)(void *) (u + x / 2), _mm256_castsi256_si128(uv));
+                _mm_storeu_si128((__m128i *)(void *) (v + x / 2), _mm256_extracti128_si256(uv, 1));
+        }
+        return x;
+}
+
+/**
+ * Unpacks two v210 blocks (6 pixels each, one per lane) to 16-bit Y (6 lower
+ * words of each lane), Cb and Cr (3 lower words of each lane).
+ */
+static inline AVX2 void v210_blocks(const unsigned char *src, __m256i *y, __m256i *u, __m256i *v)
+{
+        const __m256i mask = _mm256_set1_epi32(0x3ff);
+        // 16-bit word indices to byte shuffles, Z leaves zero
+#define W(i) (char) (2 * (i)), (char) (2 * (i) + 1)
+#define Z -1, -1
+#define LANES(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+        const __m256i y_ab = LANES(W(4), W(1), Z, W(6), W(3), Z, Z, Z);
+        const __m256i y_c = LANES(Z, Z, W(1), Z, Z, W(3), Z, Z);
+        const __m256i u_ab = LANES(W(0), W(5), Z, Z, Z, Z, Z, Z);
+        const __m256i u_c = LANES(Z, Z, W(2), Z, Z, Z, Z, Z);
+        const __m256i v_ab = LANES(Z, W(2), W(7), Z, Z, Z, Z, Z);
+        const __m256i v_c = LANES(W(0), Z, Z, Z, Z, Z, Z, Z);
+#undef W
+#undef Z
+#undef LANES
+        __m256i w = loadu(src);
+        __m256i ab = _mm256_packus_epi32(_mm256_and_si256(w, mask), _mm256_and_si256(_mm256_srli_epi32(w, 10), mask));
+        __m256i c = _mm256_and_si256(_mm256_srli_epi32(w, 20), mask);
+        c = _mm256_packus_epi32(c, c);
+        *y = _mm256_or_si256(_mm256_shuffle_epi8(ab, y_ab), _mm256_shuffle_epi8(c, y_c));
+        *u = _mm256_or_si256(_mm256_shuffle_epi8(ab, u_ab), _mm256_shuffle_epi8(c, u_c));
+        *v = _mm256_or_si256(_mm256_shuffle_epi8(ab, v_ab), _mm256_shuffle_epi8(c, v_c));
+}
+
+AVX2 int planar_conv_v210_avx2(const unsigned char *src, unsigned char *y, unsigned char *u,
+                unsigned char *v, int width, bool out16)
+{
+        int x = 0;
+        // the second block is stored 8 luma and 4 chroma samples wide
+        for ( ; x + 6 + 8 <= width; x += 12) {
+                __m256i yy, uu, vv;
+                v210_blocks(src, &yy, &uu, &vv);
+                src += 32;
+                if (out16) {
+                        // the first lane is overwritten from the 7th sample by the second one
+                        _mm_storeu_si128((__m128i *)(void *) (y + 2 * x), _mm256_castsi256_si128(yy));
+                        _mm_storeu_si128((__m128i *)(void *) (y + 2 * x + 12), _mm256_extracti128_si256(yy, 1));
+                        _mm_storel_epi64((__m128i *)(void *) (u + x), _mm256_castsi256_si128(uu));
+                        _mm_storel_epi64((__m128i *)(void *) (u + x + 6), _mm256_extracti128_si256(uu, 1));
+                        _mm_storel_epi64((__m128i *)(void *) (v + x), _mm256_castsi256_si128(vv));
+                        _mm_storel_epi64((__m128i *)(void *) (v + x + 6), _mm256_extracti128_si256(vv, 1));
+                } else {
+                        yy = _mm256_packus_epi16(_mm256_srli_epi16(yy, 2), yy);
+                        uu = _mm256_packus_epi16(_mm256_srli_epi16(uu, 2), uu);
+                        vv = _mm256_packus_epi16(_mm256_srli_epi16(vv, 2), vv);
+                        _mm_storel_epi64((__m128i *)(void *) (y + x), _mm256_castsi256_si128(yy));
+                        _mm_storel_epi64((__m128i *)(void *) (y + x + 6), _mm256_extracti128_si256(yy, 1));
+                        int32_t c[4] = { _mm256_extract_epi32(uu, 0), _mm256_extract_epi32(uu, 4),
+                                _mm256_extract_epi32(vv, 0), _mm256_extract_epi32(vv, 4) };
+                        memcpy(u + x / 2, &c[0], sizeof c[0]);
+                        memcpy(u + x / 2 + 3, &c[1], sizeof c[1]);
+                        memcpy(v + x / 2, &c[2], sizeof c[2]);
+                        memcpy(v + x / 2 + 3, &c[3], sizeof c[3]);
+                }
+        }
+        return x;
+}
+
+/// loads 8 pixels of IN_CODEC to 32-bit lanes of r, g and b, see load_rgb_sse()
+template<codec_t IN_CODEC, bool TEN_BIT>
+static inline AVX2 void load_rgb(const unsigned char *src, __m256i *r, __m256i *g, __m256i *b)
+{
+        const __m256i mask8 = _mm256_set1_epi32(0xff);
+        __m256i x;
+        if (IN_CODEC == RGB || IN_CODEC == BGR) { // 4 pixels (12 bytes) per lane
+                x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) src)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (src + 12)), 1);
+                x = _mm256_shuffle_epi8(x, IN_CODEC == RGB ?
+                                _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1) :
+                                _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                                        2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1));
+        } else {
+                x = loadu(src);
+        }
+        if (IN_CODEC == R10k && TEN_BIT) {
+                *r = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(x, mask8), 2),
+                                _mm256_and_si256(_mm256_srli_epi32(x, 14), _mm256_set1_epi32(0x3)));
+                *g = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(x, 4), _mm256_set1_epi32(0x3f0)),
+                                _mm256_and_si256(_mm256_srli_epi32(x, 20), _mm256_set1_epi32(0xf)));
+                *b = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(x, 10), _mm256_set1_epi32(0x3c0)),
+                                _mm256_srli_epi32(x, 26));
+        } else if (IN_CODEC == R10k) {
+                *r = _mm256_and_si256(x, mask8);
+                *g = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(x, 6), _mm256_set1_epi32(0xfc)),
+                                _mm256_and_si256(_mm256_srli_epi32(x, 22), _mm256_set1_epi32(0x3)));
+                *b = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(x, 12), _mm256_set1_epi32(0xf0)),
+                                _mm256_srli_epi32(x, 28));
+        } else {
+                *r = _mm256_and_si256(x, mask8);
+                *g = _mm256_and_si256(_mm256_srli_epi32(x, 8), mask8);
+                *b = _mm256_and_si256(_mm256_srli_epi32(x, 16), mask8);
+        }
+}
+
+static inline AVX2 __m256i dot(__m256i r, __m256i g, __m256i b, int cr, int cg, int cb)
+{
+        return _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(cr)),
+                                _mm256_mullo_epi32(g, _mm256_set1_epi32(cg))),
+                        _mm256_mullo_epi32(b, _mm256_set1_epi32(cb)));
+}
+
+/// sums of adjacent lanes of a and b divided by 2 rounding towards zero, in pixel order
+static inline AVX2 __m256i pair_avg(__m256i a, __m256i b)
+{
+        __m256i sum = _mm256_permutevar8x32_epi32(_mm256_hadd_epi32(a, b), _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+        return _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_srli_epi32(sum, 31)), 1);
+}
+
+/// packs two 32-bit vectors to 16 16-bit or 8-bit samples and stores them
+static inline AVX2 void store16(unsigned char *dst, __m256i a, __m256i b, bool out16)
+{
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        if (out16) {
+                storeu(dst, p);
+        } else {
+                _mm_storeu_si128((__m128i *)(void *) dst,
+                                _mm_packus_epi16(_mm256_castsi256_si128(p), _mm256_extracti128_si256(p, 1)));
+        }
+}
+
+/// packs 32-bit vector to 8 16-bit or 8-bit samples and stores them
+static inline AVX2 void store8(unsigned char *dst, __m256i a, bool out16)
+{
+        __m128i p = _mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+        if (out16) {
+                _mm_storeu_si128((__m128i *)(void *) dst, p);
+        } else {
+                _mm_storel_epi64((__m128i *)(void *) dst, _mm_packus_epi16(p, p));
+        }
+}
+
+template<codec_t IN_CODEC, bool SUBSAMPLE, bool OUT16>
+static AVX2 int rgb_line(const unsigned char *src, unsigned char *y, unsigned char *u, unsigned char *v, int width)
+{
+        const int bpp = IN_CODEC == RGB || IN_CODEC == BGR ? 3 : 4;
+        const int bps = OUT16 ? 2 : 1;
+        const __m256i y_off = _mm256_set1_epi32((OUT16 ? 64 : 16) << 16);
+        const __m256i c_off = _mm256_set1_epi32((OUT16 ? 512 : 128) << 16);
+        // 3-byte pixels are loaded 16 bytes at a time - don't read past the line
+        const int tail = bpp == 3 ? 2 : 0;
+        int x = 0;
+        for ( ; x + 16 + tail <= width; x += 16) {
+                __m256i r0, g0, b0, r1, g1, b1;
+                load_rgb<IN_CODEC, OUT16>(src + bpp * x, &r0, &g0, &b0);
+                load_rgb<IN_CODEC, OUT16>(src + bpp * (x + 8), &r1, &g1, &b1);
+                store16(y + bps * x,
+                                _mm256_srli_epi32(_mm256_add_epi32(dot(r0, g0, b0, PLANAR_CONV_COEFS(Y, OUT16)), y_off), 16),
+                                _mm256_srli_epi32(_mm256_add_epi32(dot(r1, g1, b1, PLANAR_CONV_COEFS(Y, OUT16)), y_off), 16), OUT16);
+                __m256i cb0 = dot(r0, g0, b0, PLANAR_CONV_COEFS(CB, OUT16));
+                __m256i cb1 = dot(r1, g1, b1, PLANAR_CONV_COEFS(CB, OUT16));
+                __m256i cr0 = dot(r0, g0, b0, PLANAR_CONV_COEFS(CR, OUT16));
+                __m256i cr1 = dot(r1, g1, b1, PLANAR_CONV_COEFS(CR, OUT16));
+                if (SUBSAMPLE) {
+                        store8(u + bps * x / 2, _mm256_srli_epi32(_mm256_add_epi32(pair_avg(cb0, cb1), c_off), 16), OUT16);
+                        store8(v + bps * x / 2, _mm256_srli_epi32(_mm256_add_epi32(pair_avg(cr0, cr1), c_off), 16), OUT16);
+                } else {
+                        store16(u + bps * x, _mm256_srli_epi32(_mm256_add_epi32(cb0, c_off), 16),
+                                        _mm256_srli_epi32(_mm256_add_epi32(cb1, c_off), 16), OUT16);
+                        store16(v + bps * x, _mm256_srli_epi32(_mm256_add_epi32(cr0, c_off), 16),
+                                        _mm256_srli_epi32(_mm256_add_epi32(cr1, c_off), 16), OUT16);
+                }
+        }
+        return x;
+}
+
+template<codec_t IN_CODEC>
+static AVX2 int rgb_line(const unsigned char *src, unsigned char *y, unsigned char *u, unsigned char *v,
+                int width, bool subsample, bool out16)
+{
+        if (out16) {
+                return subsample ? rgb_line<IN_CODEC, true, true>(src, y, u, v, width) :
+                        rgb_line<IN_CODEC, false, true>(src, y, u, v, width);
+        }
+        return subsample ? rgb_line<IN_CODEC, true, false>(src, y, u, v, width) :
+                rgb_line<IN_CODEC, false, false>(src, y, u, v, width);
+}
+
+AVX2 int planar_conv_rgb_avx2(codec_t in_codec, const unsigned char *src, unsigned char *y,
+                unsigned char *u, unsigned char *v, int width, bool subsample, bool out16)
+{
+        switch (in_codec) {
+        case RGB: return rgb_line<RGB>(src, y, u, v, width, subsample, false);
+        case BGR: return rgb_line<BGR>(src, y, u, v, width, subsample, false);
+        case RGBA: return rgb_line<RGBA>(src, y, u, v, width, subsample, false);
+        default: return rgb_line<R10k>(src, y, u, v, width, subsample, out16);
+        }
+}
+
+/// (a + b) / 2 of unsigned 8-bit or 16-bit samples, pavg rounds up so subtract the lost bit
+static inline AVX2 __m256i avg_down(__m256i a, __m256i b, bool out16)
+{
+        __m256i odd = _mm256_and_si256(_mm256_xor_si256(a, b), out16 ? _mm256_set1_epi16(1) : _mm256_set1_epi8(1));
+        return out16 ? _mm256_sub_epi16(_mm256_avg_epu16(a, b), odd) : _mm256_sub_epi8(_mm256_avg_epu8(a, b), odd);
+}
+
+AVX2 int planar_conv_avg_avx2(const unsigned char *a, const unsigned char *b, unsigned char *dst,
+                int count, bool out16)
+{
+        int bytes = out16 ? 2 * count : count;
+        int i = 0;
+        for ( ; i + 32 <= bytes; i += 32) {
+                storeu(dst + i, avg_down(loadu(a + i), loadu(b + i), out16));
+        }
+        return out16 ? i / 2 : i;
+}
+
+AVX2 int planar_conv_avg_interleave_avx2(const unsigned char *u0, const unsigned char *u1,
+                const unsigned char *v0, const unsigned char *v1, unsigned char *dst, int count)
+{
+        int i = 0;
+        for ( ; i + 32 <= count; i += 32) {
+                __m256i u = avg_down(loadu(u0 + i), loadu(u1 + i), false);
+                __m256i v = avg_down(loadu(v0 + i), loadu(v1 + i), false);
+                __m256i lo = _mm256_unpacklo_epi8(u, v);
+                __m256i hi = _mm256_unpackhi_epi8(u, v);
+                storeu(dst + 2 * i, _mm256_permute2x128_si256(lo, hi, 0x20));
+                storeu(dst + 2 * i + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        return i;
+}
+
+AVX2 int planar_conv_dup_avx2(const unsigned char *src, unsigned char *dst, int count, bool out16)
+{
+        int bytes = out16 ? 2 * count : count;
+        int i = 0;
+        for ( ; i + 32 <= bytes; i += 32) {
+                __m256i s = loadu(src + i);
+                __m256i lo = out16 ? _mm256_unpacklo_epi16(s, s) : _mm256_unpacklo_epi8(s, s);
+                __m256i hi = out16 ? _mm256_unpackhi_epi16(s, s) : _mm256_unpackhi_epi8(s, s);
+                storeu(dst + 2 * i, _mm256_permute2x128_si256(lo, hi, 0x20));
+                storeu(dst + 2 * i + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        return out16 ? i / 2 : i;
+}
+
+#endif // defined PLANAR_CONV_HAVE_AVX2
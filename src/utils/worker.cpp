@@ -51,209 +51,420 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include "debug.h"
+#include "host.h"
 #include "utils/worker.h"
 
 #include <algorithm>
-#include <queue>
-#include <set>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define MOD_NAME "[worker] "
 
 using namespace std;
 
-struct wp_worker;
-
-struct worker_state_observer {
-        virtual ~worker_state_observer() {}
-        virtual void notify(wp_worker *) = 0;
-};
+ADD_TO_PARAM(worker_threads, "worker-threads", "* worker-threads=<n>\n"
+                "  Number of threads of the worker pool used for tile/slice parallelism\n"
+                "  (default is the number of CPUs available to the process)\n");
+ADD_TO_PARAM(worker_pin, "worker-pin", "* worker-pin=<cpu_list>\n"
+                "  Pin worker pool threads to listed CPUs (eg. 0-3,8), one thread per CPU (Linux only)\n");
 
 /**
  * @brief Holds data to be passed to worker.
  */
 struct wp_task_data {
-        wp_task_data(runnable_t task, void *data, wp_worker *w, bool detached) : m_task(task), m_data(data),
-                m_result(0), m_returned(false), m_w(w), m_detached(detached) {}
+        wp_task_data(runnable_t task, void *data, bool detached) : m_task(task), m_data(data),
+                m_result(0), m_returned(false), m_detached(detached) {}
+        wp_task_data(function<void()> const &fn, task_group *group) : m_task(nullptr), m_data(nullptr),
+                m_result(0), m_returned(false), m_detached(true), m_fn(fn), m_group(group) {}
         runnable_t m_task;
         void *m_data;
         void *m_result;
-        bool m_returned;
-        struct wp_worker *m_w;
+        atomic<bool> m_returned;
         bool m_detached;
+        function<void()> m_fn;       ///< used instead of m_task if set
+        task_group *m_group = nullptr; ///< group to be notified on completion
 };
 
 /**
- * @brief This class represents a worker that is called from within the pool
+ * @brief Per-worker task deque
+ *
+ * Owner pushes and pops at the back (LIFO, cache-friendly for nested
+ * parallelism), other threads steal from the front.
  */
-struct wp_worker {
-        wp_worker(worker_state_observer &observer) :
-                m_state_observer(observer)
-        {
-                int ret;
-                ret = pthread_mutex_init(&m_lock, NULL);
-                assert(ret == 0);
-                ret = pthread_cond_init(&m_task_ready_cv, NULL);
-                assert(ret == 0);
-                ret = pthread_cond_init(&m_task_completed_cv, NULL);
-                assert(ret == 0);
-
-                ret = pthread_create(&m_thread_id, NULL, wp_worker::enter_loop, this);
-                assert(ret == 0);
-        }
-        ~wp_worker() {
-                wp_task_data *poisoned = new wp_task_data(NULL, NULL, this, false);
-                this->push(poisoned);
-
-                pthread_join(m_thread_id, NULL);
-                pthread_mutex_destroy(&m_lock);
-                pthread_cond_destroy(&m_task_ready_cv);
-                pthread_cond_destroy(&m_task_completed_cv);
-        }
-        static void      *enter_loop(void *args);
-        void              run();
+struct wp_queue {
+        mutex m_lock;
+        deque<wp_task_data *> m_tasks;
+};
 
-        void              push(wp_task_data *);
-        void             *pop(wp_task_data *);
+/**
+ * @brief Fixed-size work-stealing thread pool
+ *
+ * Tasks submitted from a pool thread go to its own queue, tasks submitted
+ * from other threads are distributed round-robin. Idle workers steal from
+ * other queues before they go to sleep. A thread waiting for a task helps
+ * by running queued tasks, so nested waits cannot deadlock even if all
+ * workers are busy.
+ */
+class worker_pool
+{
+        public:
+                worker_pool();
+                ~worker_pool();
 
-        queue<wp_task_data*> m_data;
-        pthread_mutex_t   m_lock;
-        pthread_cond_t    m_task_ready_cv;
-        pthread_cond_t    m_task_completed_cv;
-        pthread_t         m_thread_id;
+                task_result_handle_t run_async(runnable_t task, void *data);
+                void run_async(function<void()> const &fn, task_group *group);
+                void *wait_task(task_result_handle_t handle);
+                void wait_until(function<bool()> const &done);
+                int size() const { return m_queues.size(); }
+                void task_finished();
 
-        worker_state_observer &m_state_observer;
+        private:
+                void push(wp_task_data *d);
+                wp_task_data *pop();
+                void dequeued(wp_task_data *d);
+                void run(wp_task_data *d);
+                void worker_loop(int idx, int cpu);
+
+                vector<unique_ptr<wp_queue>> m_queues;
+                vector<thread> m_threads;
+                atomic<unsigned int> m_next_queue{0};
+                atomic<int> m_queued{0};
+
+                mutex m_lock;                     ///< protects m_should_exit and the cvs
+                condition_variable m_work_cv;     ///< signalled when a task is pushed
+                condition_variable m_done_cv;     ///< signalled when a task completes
+                atomic<int> m_sleeping_waiters{0};
+                bool m_should_exit = false;
 };
 
-void *wp_worker::enter_loop(void *args) {
-        wp_worker *instance = (wp_worker *) args;
-        instance->run();
+/**
+ * @brief Threads for tasks that block or run for long
+ *
+ * Such tasks (eg. sending a whole frame with pacing, file I/O) would
+ * occupy the fixed-size pool and starve short compute tasks, so each gets
+ * its own thread. Threads are reused and a new one is created only if
+ * all are busy.
+ */
+class blocking_runner
+{
+        public:
+                ~blocking_runner();
+                void run_async(wp_task_data *d);
 
-        return NULL;
-}
+        private:
+                void thread_loop();
+
+                mutex m_lock;
+                condition_variable m_cv;
+                deque<wp_task_data *> m_tasks;
+                vector<thread> m_threads;
+                int m_idle = 0;
+                bool m_should_exit = false;
+};
 
-void wp_worker::run() {
-        while(1) {
-                struct wp_task_data *data;
-                pthread_mutex_lock(&m_lock);
-                while(m_data.empty()) {
-                        pthread_cond_wait(&m_task_ready_cv, &m_lock);
-                }
-                data = m_data.front();
-                m_data.pop();
-                pthread_mutex_unlock(&m_lock);
+static thread_local int current_worker = -1; ///< index of the pool thread, -1 for other threads
 
-                // poisoned pill
-                if(data->m_task == NULL) {
-                        delete data;
-                        return;
+static vector<int> parse_cpu_list(const char *str)
+{
+        vector<int> cpus;
+        char *copy = strdup(str);
+        char *save_ptr = NULL;
+        char *item, *tmp = copy;
+        while ((item = strtok_r(tmp, ",", &save_ptr))) {
+                tmp = NULL;
+                int first, last;
+                if (strchr(item, '-')) {
+                        first = atoi(item);
+                        last = atoi(strchr(item, '-') + 1);
+                } else {
+                        first = last = atoi(item);
                 }
-
-                void *res = data->m_task(data->m_data);
-
-                pthread_mutex_lock(&m_lock);
-                data->m_result = res;
-                data->m_returned = true;
-                pthread_cond_signal(&m_task_completed_cv);
-                m_state_observer.notify(this);
-                if (data->m_detached) {
-                        delete data;
+                for (int i = first; i <= last; ++i) {
+                        cpus.push_back(i);
                 }
-                pthread_mutex_unlock(&m_lock);
         }
+        free(copy);
+        return cpus;
 }
 
-void wp_worker::push(wp_task_data *data) {
-        pthread_mutex_lock(&m_lock);
-        assert(m_data.size() == 0);
-        m_data.push(data);
-        pthread_cond_signal(&m_task_ready_cv);
-        pthread_mutex_unlock(&m_lock);
+/// @returns number of CPUs the process may run on
+static int available_cpus()
+{
+#ifdef HAVE_LINUX
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof set, &set) == 0) {
+                return CPU_COUNT(&set);
+        }
+#endif
+        return max<int>(thread::hardware_concurrency(), 1);
 }
 
-void *wp_worker::pop(wp_task_data *d) {
-        void *res = NULL;
+worker_pool::worker_pool()
+{
+        vector<int> cpus;
+        if (get_commandline_param("worker-pin")) {
+                cpus = parse_cpu_list(get_commandline_param("worker-pin"));
+#ifndef HAVE_LINUX
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "CPU pinning is not supported on this platform.\n");
+                cpus.clear();
+#endif
+        }
+        int count = cpus.empty() ? available_cpus() : cpus.size();
+        if (get_commandline_param("worker-threads")) {
+                count = max(atoi(get_commandline_param("worker-threads")), 1);
+        }
 
-        pthread_mutex_lock(&m_lock);
-        while(!d->m_returned) {
-                pthread_cond_wait(&m_task_completed_cv, &m_lock);
+        for (int i = 0; i < count; ++i) {
+                m_queues.emplace_back(new wp_queue);
         }
-        res = d->m_result;
-        delete d;
-        pthread_mutex_unlock(&m_lock);
+        for (int i = 0; i < count; ++i) {
+                m_threads.emplace_back(&worker_pool::worker_loop, this, i,
+                                cpus.empty() ? -1 : cpus[i % cpus.size()]);
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Started %d worker threads%s.\n", count,
+                        cpus.empty() ? "" : " (pinned)");
+}
 
-        return res;
+worker_pool::~worker_pool()
+{
+        {
+                unique_lock<mutex> lk(m_lock);
+                m_should_exit = true;
+        }
+        m_work_cv.notify_all();
+        for (auto & t : m_threads) {
+                t.join();
+        }
 }
 
-static void func_delete(wp_worker *arg) {
-        delete arg;
+void worker_pool::push(wp_task_data *d)
+{
+        unsigned int idx = current_worker != -1 ? current_worker :
+                m_next_queue++ % m_queues.size();
+        {
+                lock_guard<mutex> lk(m_queues[idx]->m_lock);
+                m_queues[idx]->m_tasks.push_back(d);
+        }
+        m_queued++;
+        {
+                // lock to avoid lost wakeup of a worker that is just going to sleep
+                lock_guard<mutex> lk(m_lock);
+        }
+        m_work_cv.notify_one();
+        if (m_sleeping_waiters > 0) {
+                m_done_cv.notify_all();
+        }
 }
 
-class worker_pool : public worker_state_observer
+void worker_pool::dequeued(wp_task_data *)
 {
-        public:
-                worker_pool() {
-                        pthread_mutex_init(&m_lock, NULL);
-                        pthread_cond_init(&m_worker_finished, NULL);
-                }
+        m_queued--;
+}
 
-                ~worker_pool() {
-                        pthread_mutex_lock(&m_lock);
-                        while (m_occupied_workers.size() > 0) {
-                                pthread_cond_wait(&m_worker_finished, &m_lock);
-                        }
-                        pthread_mutex_unlock(&m_lock);
-
-                        for_each(m_empty_workers.begin(),
-                                        m_empty_workers.end(), func_delete);
-                        pthread_cond_destroy(&m_worker_finished);
-                        pthread_mutex_destroy(&m_lock);
+wp_task_data *worker_pool::pop()
+{
+        if (m_queued == 0) {
+                return nullptr;
+        }
+        int n = m_queues.size();
+        if (current_worker != -1) {
+                wp_queue &own = *m_queues[current_worker];
+                lock_guard<mutex> lk(own.m_lock);
+                if (!own.m_tasks.empty()) {
+                        wp_task_data *d = own.m_tasks.back();
+                        own.m_tasks.pop_back();
+                        dequeued(d);
+                        return d;
                 }
-
-                void notify(wp_worker *w) {
-                        pthread_mutex_lock(&m_lock);
-                        m_occupied_workers.erase(w);
-                        m_empty_workers.insert(w);
-                        pthread_mutex_unlock(&m_lock);
-                        pthread_cond_signal(&m_worker_finished);
+        }
+        int start = current_worker != -1 ? current_worker + 1 : 0;
+        for (int i = 0; i < n; ++i) {
+                wp_queue &victim = *m_queues[(start + i) % n];
+                lock_guard<mutex> lk(victim.m_lock);
+                if (!victim.m_tasks.empty()) {
+                        wp_task_data *d = victim.m_tasks.front();
+                        victim.m_tasks.pop_front();
+                        dequeued(d);
+                        return d;
                 }
+        }
+        return nullptr;
+}
 
-                task_result_handle_t run_async(runnable_t task, void *data, bool detached);
-                void *wait_task(task_result_handle_t handle);
-
-        private:
-                set<wp_worker*>    m_empty_workers;
-                set<wp_worker*>    m_occupied_workers;
-                pthread_mutex_t m_lock;
-                pthread_cond_t     m_worker_finished;
-};
+void worker_pool::run(wp_task_data *d)
+{
+        task_group *group = d->m_group;
+        if (d->m_fn) {
+                d->m_fn();
+        } else {
+                d->m_result = d->m_task(d->m_data);
+        }
+        if (d->m_detached) {
+                delete d;
+        } else {
+                d->m_returned = true;
+        }
+        if (group) {
+                group->task_finished();
+        }
+        task_finished();
+}
 
-task_result_handle_t worker_pool::run_async(runnable_t task, void *data, bool detached)
+void worker_pool::task_finished()
 {
-        wp_worker *w;
-        pthread_mutex_lock(&m_lock);
-        if(m_empty_workers.empty()) {
-                m_empty_workers.insert(new wp_worker(*this));
+        if (m_sleeping_waiters > 0) {
+                {
+                        lock_guard<mutex> lk(m_lock);
+                }
+                m_done_cv.notify_all();
         }
-        set<wp_worker*>::iterator it = m_empty_workers.begin();
-        assert(it != m_empty_workers.end());
-        w = *it;
-        /// @todo: really weird - it seems like that 'it' instead of 'w' caused some problems
-        m_empty_workers.erase(w);
-        m_occupied_workers.insert(w);
+}
 
-        wp_task_data *d = new wp_task_data(task, data, w, detached);
-        w->push(d);
-        pthread_mutex_unlock(&m_lock);
+void worker_pool::worker_loop(int idx, int cpu)
+{
+        current_worker = idx;
+#ifdef HAVE_LINUX
+        if (cpu != -1) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                if (pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unable to pin worker %d to CPU %d.\n", idx, cpu);
+                }
+        }
+#else
+        (void) cpu;
+#endif
+
+        while (true) {
+                wp_task_data *d = pop();
+                if (d) {
+                        run(d);
+                        continue;
+                }
+                unique_lock<mutex> lk(m_lock);
+                if (m_queued > 0) {
+                        continue;
+                }
+                if (m_should_exit) {
+                        return;
+                }
+                m_work_cv.wait(lk);
+        }
+}
 
+task_result_handle_t worker_pool::run_async(runnable_t task, void *data)
+{
+        wp_task_data *d = new wp_task_data(task, data, false);
+        push(d);
         return d;
 }
 
+void worker_pool::run_async(function<void()> const &fn, task_group *group)
+{
+        push(new wp_task_data(fn, group));
+}
+
+void worker_pool::wait_until(function<bool()> const &done)
+{
+        while (!done()) {
+                wp_task_data *d = pop();
+                if (d) {
+                        run(d);
+                        continue;
+                }
+                unique_lock<mutex> lk(m_lock);
+                m_sleeping_waiters++;
+                m_done_cv.wait(lk, [&]{ return done() || m_queued > 0; });
+                m_sleeping_waiters--;
+        }
+}
+
 void *worker_pool::wait_task(task_result_handle_t handle)
 {
         wp_task_data *d = (wp_task_data *) handle;
-        wp_worker *w = d->m_w;
-        return w->pop(d);
+        wait_until([d]{ return d->m_returned.load(); });
+        void *res = d->m_result;
+        delete d;
+        return res;
 }
 
-static class worker_pool instance;
+static worker_pool &get_instance()
+{
+        static worker_pool instance;
+        return instance;
+}
+
+static blocking_runner &get_blocking_runner()
+{
+        // the pool (notified on task completion) must be destroyed after the runner
+        get_instance();
+        static blocking_runner instance;
+        return instance;
+}
+
+blocking_runner::~blocking_runner()
+{
+        {
+                lock_guard<mutex> lk(m_lock);
+                m_should_exit = true;
+        }
+        m_cv.notify_all();
+        for (auto & t : m_threads) {
+                t.join();
+        }
+}
+
+void blocking_runner::run_async(wp_task_data *d)
+{
+        lock_guard<mutex> lk(m_lock);
+        m_tasks.push_back(d);
+        if (m_idle < (int) m_tasks.size()) {
+                m_threads.emplace_back(&blocking_runner::thread_loop, this);
+        } else {
+                m_cv.notify_one();
+        }
+}
+
+void blocking_runner::thread_loop()
+{
+        unique_lock<mutex> lk(m_lock);
+        while (true) {
+                m_idle++;
+                m_cv.wait(lk, [this]{ return !m_tasks.empty() || m_should_exit; });
+                m_idle--;
+                if (m_tasks.empty()) {
+                        return;
+                }
+                wp_task_data *d = m_tasks.front();
+                m_tasks.pop_front();
+                lk.unlock();
+
+                d->m_result = d->m_task(d->m_data);
+                if (d->m_detached) {
+                        delete d;
+                } else {
+                        d->m_returned = true;
+                        get_instance().task_finished(); // wakes wait_task()
+                }
+
+                lk.lock();
+        }
+}
 
 /**
  * @brief Runs task asynchronously.
@@ -267,22 +478,88 @@ static class worker_pool instance;
  */
 task_result_handle_t task_run_async(runnable_t task, void *data)
 {
-        return instance.run_async(task, data, false);
+        return get_instance().run_async(task, data);
+}
+
+/**
+ * @brief Runs task that may block (eg. on I/O) asynchronously
+ *
+ * The task runs on a dedicated thread, not in the worker pool. The
+ * result is obtained with wait_task() as for task_run_async().
+ */
+task_result_handle_t task_run_async_blocking(runnable_t task, void *data)
+{
+        wp_task_data *d = new wp_task_data(task, data, false);
+        get_blocking_runner().run_async(d);
+        return d;
 }
 
 /**
  * @brief Runs task asynchronously in a detached state
  *
+ * Detached tasks (eg. sending a frame) may block or run for long so they
+ * run on a dedicated thread, not in the worker pool.
+ *
  * @param   task callback to be run
  * @param   data additional data to be passed to the callback
  */
 void task_run_async_detached(runnable_t task, void *data)
 {
-        instance.run_async(task, data, true);
+        get_blocking_runner().run_async(new wp_task_data(task, data, true));
 }
 
+/**
+ * Waits for a task started with task_run_async(). The calling thread runs
+ * other queued tasks in the meanwhile.
+ */
 void *wait_task(task_result_handle_t handle)
 {
-        return instance.wait_task(handle);
+        return get_instance().wait_task(handle);
+}
+
+int task_pool_size(void)
+{
+        return get_instance().size();
 }
 
+task_group::~task_group()
+{
+        wait();
+}
+
+void task_group::run(function<void()> const &fn)
+{
+        m_pending++;
+        get_instance().run_async(fn, this);
+}
+
+void task_group::wait()
+{
+        get_instance().wait_until([this]{ return m_pending.load() == 0; });
+}
+
+void task_group::task_finished()
+{
+        m_pending--;
+}
+
+void parallel_for(int begin, int end, function<void(int, int)> const &fn, int min_chunk)
+{
+        int len = end - begin;
+        if (len <= 0) {
+                return;
+        }
+        int chunks = min(task_pool_size(), max(len / max(min_chunk, 1), 1));
+        if (chunks == 1) {
+                fn(begin, end);
+                return;
+        }
+        task_group group;
+        for (int i = 1; i < chunks; ++i) {
+                int b = begin + (long long) len * i / chunks;
+                int e = begin + (long long) len * (i + 1) / chunks;
+                group.run([&fn, b, e]{ fn(b, e); });
+        }
+        fn(begin, begin + len / chunks); // first chunk is processed by the caller
+        group.wait();
+}
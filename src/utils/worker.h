@@ -52,7 +52,7 @@
 #endif // HAVE_CONFIG_H
  
 #ifndef WORKER_H_
-#define WORKER_H
+#define WORKER_H_
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,17 +61,58 @@ extern "C" {
 typedef void *task_result_handle_t;
 typedef void *(*runnable_t)(void *);
 
+/**
+ * Runs a short compute task in the worker pool, tasks that block or run for
+ * long should use task_run_async_blocking() instead not to starve the pool.
+ */
 task_result_handle_t task_run_async(runnable_t task, void *data);
+/// runs a task that may block on a dedicated thread, wait for it with wait_task()
+task_result_handle_t task_run_async_blocking(runnable_t task, void *data);
 /**
  * Detached task should own its resources. Moreover, it must not use any static variables/objects.
+ * It runs on a dedicated thread, not in the worker pool.
  */
 void task_run_async_detached(runnable_t task, void *data);
 void *wait_task(task_result_handle_t handle);
+/**
+ * @returns number of threads of the worker pool
+ */
+int task_pool_size(void);
 
 
 #ifdef __cplusplus
 }
 #endif
 
+#ifdef __cplusplus
+#include <atomic>
+#include <functional>
+
+/**
+ * @brief Set of tasks that can be waited for together
+ *
+ * Destructor waits for all tasks that have been run.
+ */
+class task_group {
+public:
+        task_group() = default;
+        task_group(task_group const &) = delete;
+        task_group &operator=(task_group const &) = delete;
+        ~task_group();
+        void run(std::function<void()> const &fn);
+        void wait();
+        void task_finished(); ///< called by the pool
+private:
+        std::atomic<int> m_pending{0};
+};
+
+/**
+ * Splits range [begin, end) to at most task_pool_size() contiguous chunks
+ * (each at least min_chunk long, eg. lines) and runs fn(chunk_begin,
+ * chunk_end) on them in parallel. Returns when all chunks are processed.
+ */
+void parallel_for(int begin, int end, std::function<void(int, int)> const &fn, int min_chunk = 1);
+#endif
+
 #endif /* WORKER_H_ */
 
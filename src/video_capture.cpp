@@ -62,6 +62,7 @@
 #include "lib_common.h"
 #include "module.h"
 #include "utils/config_file.h"
+#include "utils/metrics.h"
 #include "video_capture.h"
 
 #include <string>
@@ -100,6 +101,9 @@ struct vidcap {
         uint32_t magic; ///< For debugging. Conatins @ref VIDCAP_MAGIC
 
         struct capture_filter *capture_filter; ///< capture_filter_state
+
+        struct metric *metric_frames;
+        struct metric *metric_grab_ns;
 };
 
 /* API for probing capture devices ****************************************************************/
@@ -189,6 +193,8 @@ int initialize_video_capture(struct module *parent,
                 (struct vidcap *)malloc(sizeof(struct vidcap));
         d->magic = VIDCAP_MAGIC;
         d->funcs = vci;
+        d->metric_frames = metric_counter("capture.frames");
+        d->metric_grab_ns = metric_histogram("capture.grab_ns");
 
         module_init_default(&d->mod);
         d->mod.cls = MODULE_CLASS_CAPTURE;
@@ -262,9 +268,14 @@ struct video_frame *vidcap_grab(struct vidcap *state, struct audio_frame **audio
 {
         assert(state->magic == VIDCAP_MAGIC);
         struct video_frame *frame;
+        uint64_t t0 = metric_time_ns();
         frame = state->funcs->grab(state->state, audio);
         if (frame != NULL)
                 frame = capture_filter(state->capture_filter, frame);
+        if (frame != NULL) {
+                metric_add(state->metric_frames, 1);
+                metric_record(state->metric_grab_ns, metric_time_ns() - t0);
+        }
         return frame;
 }
 
@@ -185,6 +185,9 @@ struct vidcap_import_state {
         double force_fps;
 
         volatile bool exit_control = false;
+
+        int container_fd = -1; ///< single-file export (VIDEO_EXPORT_CONTAINER_FILE)
+        struct video_export_index_entry *container_index = nullptr;
 };
 
 #ifdef WIN32
@@ -271,6 +274,45 @@ error_format:
         return false;
 }
 
+/**
+ * Opens the single-file export and loads its frame index.
+ */
+static void open_container(struct vidcap_import_state *s, string const &container, unsigned int tile_count)
+{
+        string name = string(s->directory) + "/" + container;
+        int flags = O_RDONLY;
+#ifdef WIN32
+        flags |= O_BINARY;
+#endif
+#ifdef HAVE_LINUX
+        if (s->o_direct) {
+                flags |= O_DIRECT;
+        }
+#endif
+        s->container_fd = open(name.c_str(), flags);
+        if (s->container_fd == -1) {
+                throw string("Unable to open ") + name + ": " + strerror(errno) + "\n";
+        }
+
+        name = string(s->directory) + "/" VIDEO_EXPORT_INDEX_FILE;
+        FILE *index = fopen(name.c_str(), "rb");
+        if (index == NULL) {
+                throw string("Unable to open ") + name + ": " + strerror(errno) + "\n";
+        }
+        size_t records = (size_t) s->count * tile_count;
+        s->container_index = (struct video_export_index_entry *) malloc(records * sizeof(struct video_export_index_entry));
+        size_t ret = fread(s->container_index, sizeof(struct video_export_index_entry), records, index);
+        fclose(index);
+        if (ret != records) {
+                // recording was probably interrupted - play what is indexed
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME "Index contains only " << ret / tile_count << " of " << s->count << " frames.\n";
+                s->count = ret / tile_count;
+                if (s->count == 0) {
+                        throw string("Empty container index.\n");
+                }
+        }
+}
+
 static int
 vidcap_import_init(const struct vidcap_params *params, void **state)
 {
@@ -366,6 +408,7 @@ try {
 
         struct video_desc desc;
         memset(&desc, 0, sizeof desc);
+        string container;
 
         char line[512];
         uint32_t items_found = 0;
@@ -429,6 +472,13 @@ try {
                         char *ptr = line + strlen("count ");
                         s->count = atoi(ptr);
                         items_found |= 1<<6;
+                } else if(strncmp(line, "tiles ", strlen("tiles ")) == 0) {
+                        desc.tile_count = atoi(line + strlen("tiles "));
+                } else if(strncmp(line, "container ", strlen("container ")) == 0) {
+                        container = line + strlen("container ");
+                        if (!container.empty() && container.back() == '\n') {
+                                container.pop_back();
+                        }
                 }
         }
 
@@ -445,7 +495,12 @@ try {
                         get_codec_file_extension(desc.color_spec));
 
         struct stat sb;
-        if (stat(name, &sb) == 0) {
+        if (!container.empty()) {
+                if (desc.tile_count == 0) {
+                        throw string("[import] Tile count of the container missing.\n");
+                }
+                open_container(s, container, desc.tile_count);
+        } else if (stat(name, &sb) == 0) {
                 desc.tile_count = 1;
         } else {
                 desc.tile_count = 0;
@@ -590,6 +645,11 @@ static void cleanup_common(struct vidcap_import_state *s) {
 
         free(s->directory);
 
+        if (s->container_fd != -1) {
+                close(s->container_fd);
+        }
+        free(s->container_index);
+
         // audio
         if(s->audio_state.has_audio) {
                 ring_buffer_destroy(s->audio_state.data);
@@ -958,10 +1018,41 @@ struct video_reader_data {
         unsigned int tile_count;
         struct processed_entry *entry;
         bool o_direct;
+        int container_fd;                               ///< -1 if exported to file per frame
+        const struct video_export_index_entry *index;   ///< container index of the frame
 };
 
 #define ALLOC_ALIGN 512
 
+static void *read_from_container(struct video_reader_data *data)
+{
+        for (unsigned int i = 0; i < data->tile_count; i++) {
+                const struct video_export_index_entry *idx = &data->index[i];
+                // tiles are aligned in the container so that O_DIRECT can be used
+                const size_t aligned_data_len = (idx->length + ALLOC_ALIGN - 1)
+                        / ALLOC_ALIGN * ALLOC_ALIGN;
+                data->entry->tiles[i].data_len = idx->length;
+                data->entry->tiles[i].data = (char *)
+                        aligned_malloc(aligned_data_len, ALLOC_ALIGN);
+                assert(data->entry->tiles[i].data != NULL);
+
+                size_t bytes = 0;
+                while (bytes < idx->length) {
+                        ssize_t res = pread(data->container_fd, data->entry->tiles[i].data + bytes,
+                                        aligned_data_len - bytes, idx->offset + bytes);
+                        if (res <= 0) {
+                                perror("pread");
+                                free_entry(data->entry);
+                                data->entry = NULL;
+                                return NULL;
+                        }
+                        bytes += res;
+                }
+        }
+
+        return data;
+}
+
 static void *video_reader_callback(void *arg)
 {
         struct video_reader_data *data =
@@ -972,6 +1063,10 @@ static void *video_reader_callback(void *arg)
         data->entry->next = NULL;
         data->entry->count = data->tile_count;
 
+        if (data->container_fd != -1) {
+                return read_from_container(data);
+        }
+
         for (unsigned int i = 0; i < data->tile_count; i++) {
                 char name[1048];
                 char tile_idx[3] = "";
@@ -1116,7 +1211,11 @@ static void * reading_thread(void *args)
                                         get_codec_file_extension(s->video_desc.color_spec),
                                         sizeof(data->file_name_suffix));
                         data->entry = NULL;
-                        task_handle[i] = task_run_async(video_reader_callback, data);
+                        data->container_fd = s->container_fd;
+                        data->index = s->container_index == nullptr ? nullptr :
+                                &s->container_index[(size_t) (index + i) * s->video_desc.tile_count];
+                        // reading blocks on I/O so it does not run in the worker pool
+                        task_handle[i] = task_run_async_blocking(video_reader_callback, data);
                 }
 
                 // wait for workers to finish
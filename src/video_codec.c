@@ -57,6 +57,7 @@
 #endif // HAVE_CONFIG_H
 
 #include "debug.h"
+#include "host.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -2103,13 +2104,54 @@ static const struct decoder_item decoders[] = {
         { (decoder_t) vc_copylineDPX10toRGBA, DPX10, RGBA, false },
         { (decoder_t) vc_copylineDPX10toRGB,  DPX10, RGB, false },
         { vc_copylineRGB,         RGB,   RGB, false },
+        { vc_copylineRGBtoR12L,   RGB,   R12L, false },
 };
 
+#ifdef VC_HAVE_AVX2_DECODERS
+/// decoders preferred to the ones in @ref decoders if the CPU supports AVX2
+static const struct decoder_item decoders_avx2[] = {
+        { (decoder_t) vc_copylinev210_avx2,        v210,  UYVY, false },
+        { vc_copyliner10k_avx2,                    R10k,  RGBA, false },
+        { vc_copylineRGBA_avx2,                    RGBA,  RGBA, false },
+        { vc_copylineRGBAtoRGB_avx2,               RGBA,  RGB, false },
+        { vc_copylineRGBtoRGBA_avx2,               RGB,   RGBA, false },
+        { vc_copylineDPX10toRGBA_avx2,             DPX10, RGBA, false },
+        { vc_copylineR12L_avx2,                    R12L,  RGBA, false },
+        { vc_copylineRGBtoR12L_avx2,               RGB,   R12L, false },
+};
+
+ADD_TO_PARAM(line_decoder_simd, "line-decoder-simd", "* line-decoder-simd=none|sse4.1|avx2\n"
+                "  Limits instruction set used by line decoders and by pixel format conversion\n"
+                "  for libavcodec (default: best supported by CPU)\n");
+
+static bool use_avx2_decoders(void)
+{
+        const char *req = get_commandline_param("line-decoder-simd");
+        if (req != NULL && strcmp(req, "avx2") != 0) {
+                return false;
+        }
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+}
+#endif
+
 /**
  * Returns line decoder for specifiedn input and output codec.
+ *
+ * If the CPU supports it, vectorized version of the decoder is returned.
  */
 decoder_t get_decoder_from_to(codec_t in, codec_t out, bool slow)
 {
+#ifdef VC_HAVE_AVX2_DECODERS
+        if (use_avx2_decoders()) {
+                for (unsigned int i = 0; i < sizeof decoders_avx2 / sizeof decoders_avx2[0]; ++i) {
+                        if (decoders_avx2[i].in == in && decoders_avx2[i].out == out) {
+                                return decoders_avx2[i].decoder;
+                        }
+                }
+        }
+#endif
+
         for (unsigned int i = 0; i < sizeof(decoders)/sizeof(struct decoder_item); ++i) {
                 if (decoders[i].in == in && decoders[i].out == out &&
                                 (decoders[i].slow == false || slow == true)) {
@@ -129,6 +129,31 @@ void vc_copylineDPX10toRGB(unsigned char *dst, const unsigned char *src, int dst
 void vc_copylineRGB(unsigned char *dst, const unsigned char *src, int dst_len,
                 int rshift, int gshift, int bshift);
 
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define VC_HAVE_AVX2_DECODERS 1
+/**
+ * @name AVX2 line decoders
+ * Bit-exact AVX2 counterparts of the respective scalar functions. Do not call
+ * directly, get_decoder_from_to() returns them if the CPU supports AVX2.
+ * @{ */
+void vc_copylinev210_avx2(unsigned char *dst, const unsigned char *src, int dst_len);
+void vc_copyliner10k_avx2(unsigned char *dst, const unsigned char *src, int len,
+                int rshift, int gshift, int bshift);
+void vc_copylineRGBA_avx2(unsigned char *dst, const unsigned char *src, int len,
+                int rshift, int gshift, int bshift);
+void vc_copylineRGBtoRGBA_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift);
+void vc_copylineRGBAtoRGB_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift);
+void vc_copylineDPX10toRGBA_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift);
+void vc_copylineR12L_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift);
+void vc_copylineRGBtoR12L_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift);
+/// @}
+#endif
+
 bool clear_video_buffer(unsigned char *data, size_t linesize, size_t pitch, size_t height, codec_t color_spec);
 
 #ifdef __cplusplus
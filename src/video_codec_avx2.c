@@ -0,0 +1,319 @@
+/**
+ * @file   video_codec_avx2.c
+ * @brief  AVX2 versions of the most frequently used line decoders
+ *
+ * The functions are compiled for AVX2 via the target attribute so that the
+ * rest of the build does not need to enable it. They must only be called
+ * when the CPU supports AVX2 - get_decoder_from_to() takes care of that.
+ * Each function handles as much of the line as possible with 256-bit
+ * vectors and passes the rest to the scalar version so that the output is
+ * bit-exact with it.
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include "video_codec.h"
+
+#ifdef VC_HAVE_AVX2_DECODERS
+
+#include <immintrin.h>
+#include <string.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+/// packs 8-bit components in 32-bit lanes to positions given by shifts
+static inline AVX2 __m256i rgb_to_shifted(__m256i r, __m256i g, __m256i b,
+                __m128i rshift, __m128i gshift, __m128i bshift)
+{
+        return _mm256_or_si256(_mm256_or_si256(_mm256_sll_epi32(r, rshift),
+                                _mm256_sll_epi32(g, gshift)),
+                        _mm256_sll_epi32(b, bshift));
+}
+
+/**
+ * Compacts 3 valid low bytes of every 32-bit word of a vector to 24
+ * consecutive bytes and stores them to dst.
+ */
+static inline AVX2 void store_24_of_32(unsigned char *dst, __m256i val)
+{
+        const __m256i compact = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+        val = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(val, compact), lanes);
+        _mm_storeu_si128((__m128i *)(void *) dst, _mm256_castsi256_si128(val));
+        _mm_storel_epi64((__m128i *)(void *) (dst + 16), _mm256_extracti128_si256(val, 1));
+}
+
+/**
+ * @brief AVX2 version of vc_copylinev210()
+ *
+ * Every 32-bit v210 word holds three 10-bit samples that are truncated to
+ * 8 bits, so that 32 input bytes make 24 output bytes.
+ */
+AVX2 void vc_copylinev210_avx2(unsigned char *dst, const unsigned char *src, int dst_len)
+{
+        const __m256i mask0 = _mm256_set1_epi32(0xff);
+        const __m256i mask1 = _mm256_set1_epi32(0xff00);
+        const __m256i mask2 = _mm256_set1_epi32(0xff0000);
+
+        while (dst_len >= 24) {
+                __m256i in = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i out = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in, 2), mask0),
+                                _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in, 4), mask1),
+                                        _mm256_and_si256(_mm256_srli_epi32(in, 6), mask2)));
+                store_24_of_32(dst, out);
+                src += 32;
+                dst += 24;
+                dst_len -= 24;
+        }
+        vc_copylinev210(dst, src, dst_len);
+}
+
+/// @brief AVX2 version of vc_copyliner10k()
+AVX2 void vc_copyliner10k_avx2(unsigned char *dst, const unsigned char *src, int len,
+                int rshift, int gshift, int bshift)
+{
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        const __m256i mask_r = _mm256_set1_epi32(0xff);
+        const __m256i mask_gh = _mm256_set1_epi32(0xfc);
+        const __m256i mask_gl = _mm256_set1_epi32(0x3);
+        const __m256i mask_bh = _mm256_set1_epi32(0xf0);
+
+        while (len >= 32) {
+                __m256i in = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i r = _mm256_and_si256(in, mask_r);
+                __m256i g = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in, 6), mask_gh),
+                                _mm256_and_si256(_mm256_srli_epi32(in, 22), mask_gl));
+                __m256i b = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(in, 12), mask_bh),
+                                _mm256_srli_epi32(in, 28));
+                _mm256_storeu_si256((__m256i *)(void *) dst, rgb_to_shifted(r, g, b, rs, gs, bs));
+                src += 32;
+                dst += 32;
+                len -= 32;
+        }
+        vc_copyliner10k(dst, src, len, rshift, gshift, bshift);
+}
+
+/// @brief AVX2 version of vc_copylineRGBA()
+AVX2 void vc_copylineRGBA_avx2(unsigned char *dst, const unsigned char *src, int len,
+                int rshift, int gshift, int bshift)
+{
+        if (rshift == 0 && gshift == 8 && bshift == 16) {
+                memcpy(dst, src, len);
+                return;
+        }
+
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        const __m256i mask = _mm256_set1_epi32(0xff);
+
+        while (len >= 32) {
+                __m256i in = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i r = _mm256_and_si256(in, mask);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(in, 8), mask);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(in, 16), mask);
+                _mm256_storeu_si256((__m256i *)(void *) dst, rgb_to_shifted(r, g, b, rs, gs, bs));
+                src += 32;
+                dst += 32;
+                len -= 32;
+        }
+        vc_copylineRGBA(dst, src, len, rshift, gshift, bshift);
+}
+
+/**
+ * @brief AVX2 version of vc_copylineRGBtoRGBA()
+ *
+ * Loads 2x12 bytes to both 128-bit lanes, so 4 bytes past the converted
+ * 24 are read - the loop ensures they are still part of the line.
+ */
+AVX2 void vc_copylineRGBtoRGBA_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift)
+{
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        const __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m256i mask = _mm256_set1_epi32(0xff);
+
+        while (dst_len >= 40) {
+                __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                                        _mm_loadu_si128((const __m128i *)(const void *) src)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (src + 12)), 1);
+                in = _mm256_shuffle_epi8(in, expand);
+                __m256i r = _mm256_and_si256(in, mask);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(in, 8), mask);
+                __m256i b = _mm256_srli_epi32(in, 16);
+                _mm256_storeu_si256((__m256i *)(void *) dst, rgb_to_shifted(r, g, b, rs, gs, bs));
+                src += 24;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineRGBtoRGBA(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @brief AVX2 version of vc_copylineRGBAtoRGB()
+AVX2 void vc_copylineRGBAtoRGB_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift)
+{
+        while (dst_len >= 24) {
+                store_24_of_32(dst, _mm256_loadu_si256((const __m256i *)(const void *) src));
+                src += 32;
+                dst += 24;
+                dst_len -= 24;
+        }
+        vc_copylineRGBAtoRGB(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/// @brief AVX2 version of vc_copylineDPX10toRGBA()
+AVX2 void vc_copylineDPX10toRGBA_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift)
+{
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        const __m256i mask = _mm256_set1_epi32(0xff);
+
+        while (dst_len >= 32) {
+                __m256i in = _mm256_loadu_si256((const __m256i *)(const void *) src);
+                __m256i r = _mm256_srli_epi32(in, 24);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(in, 14), mask);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask);
+                _mm256_storeu_si256((__m256i *)(void *) dst, rgb_to_shifted(r, g, b, rs, gs, bs));
+                src += 32;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineDPX10toRGBA(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * @brief AVX2 version of vc_copylineR12L()
+ *
+ * 8 pixels (36 bytes) are processed at once, 4 in each 128-bit lane. Every
+ * 8-bit component is made from 2 consecutive input bytes (placed to the low
+ * 16 bits of a 32-bit lane) shifted by 4 or 8 bits. The 18 input bytes of
+ * a lane do not fit in a register so the last 2 are taken from a second
+ * load offset by 2 bytes.
+ */
+AVX2 void vc_copylineR12L_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift)
+{
+        const __m128i rs = _mm_cvtsi32_si128(rshift);
+        const __m128i gs = _mm_cvtsi32_si128(gshift);
+        const __m128i bs = _mm_cvtsi32_si128(bshift);
+        const __m256i mask = _mm256_set1_epi32(0xff);
+#define LANES(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+        const __m256i r_lo = LANES(0, 1, -1, -1, 4, 5, -1, -1, 9, 10, -1, -1, 13, 14, -1, -1);
+        const __m256i g_lo = LANES(1, 2, -1, -1, 6, 7, -1, -1, 10, 11, -1, -1, 15, -1, -1, -1);
+        const __m256i g_hi = LANES(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 14, -1, -1);
+        const __m256i b_lo = LANES(3, 4, -1, -1, 7, 8, -1, -1, 12, 13, -1, -1, -1, -1, -1, -1);
+        const __m256i b_hi = LANES(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 14, 15, -1, -1);
+#undef LANES
+        const __m256i r_sh = _mm256_setr_epi32(4, 8, 4, 8, 4, 8, 4, 8);
+        const __m256i g_sh = _mm256_setr_epi32(8, 4, 8, 4, 8, 4, 8, 4);
+
+        while (dst_len >= 32) {
+                // bytes 0-15 and 2-17 of both halves of the 36-byte block
+                __m256i lo = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                                        _mm_loadu_si128((const __m128i *)(const void *) src)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (src + 18)), 1);
+                __m256i hi = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                                        _mm_loadu_si128((const __m128i *)(const void *) (src + 2))),
+                                _mm_loadu_si128((const __m128i *)(const void *) (src + 20)), 1);
+                __m256i r = _mm256_shuffle_epi8(lo, r_lo);
+                __m256i g = _mm256_or_si256(_mm256_shuffle_epi8(lo, g_lo), _mm256_shuffle_epi8(hi, g_hi));
+                __m256i b = _mm256_or_si256(_mm256_shuffle_epi8(lo, b_lo), _mm256_shuffle_epi8(hi, b_hi));
+                r = _mm256_and_si256(_mm256_srlv_epi32(r, r_sh), mask);
+                g = _mm256_and_si256(_mm256_srlv_epi32(g, g_sh), mask);
+                b = _mm256_and_si256(_mm256_srlv_epi32(b, r_sh), mask);
+                _mm256_storeu_si256((__m256i *)(void *) dst, rgb_to_shifted(r, g, b, rs, gs, bs));
+                src += 36;
+                dst += 32;
+                dst_len -= 32;
+        }
+        vc_copylineR12L(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+/**
+ * @brief AVX2 version of vc_copylineRGBtoR12L()
+ *
+ * Every output byte is a single input byte either unchanged or shifted by 4
+ * bits left or right. The first 32 bytes of a 36-byte block (8 pixels) are
+ * shuffled from input bytes 0-15 (low lane) and 8-23 (high lane), the last 4
+ * bytes belong to the last pixel and are written separately.
+ */
+AVX2 void vc_copylineRGBtoR12L_avx2(unsigned char *dst, const unsigned char *src, int dst_len,
+                int rshift, int gshift, int bshift)
+{
+        const __m256i shl = _mm256_setr_epi8(0, -1, -1, 2, -1, -1, 4, -1, -1, 6, -1, -1, 8, -1, -1, 10,
+                        -1, -1, 4, -1, -1, 6, -1, -1, 8, -1, -1, 10, -1, -1, 12, -1);
+        const __m256i shr = _mm256_setr_epi8(-1, 0, -1, -1, 2, -1, -1, 4, -1, -1, 6, -1, -1, 8, -1, -1,
+                        2, -1, -1, 4, -1, -1, 6, -1, -1, 8, -1, -1, 10, -1, -1, 12);
+        const __m256i copy = _mm256_setr_epi8(-1, -1, 1, -1, -1, 3, -1, -1, 5, -1, -1, 7, -1, -1, 9, -1,
+                        -1, 3, -1, -1, 5, -1, -1, 7, -1, -1, 9, -1, -1, 11, -1, -1);
+        const __m256i mask_hi = _mm256_set1_epi8((char) 0xf0);
+        const __m256i mask_lo = _mm256_set1_epi8(0x0f);
+
+        while (dst_len >= 36) {
+                __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                                        _mm_loadu_si128((const __m128i *)(const void *) src)),
+                                _mm_loadu_si128((const __m128i *)(const void *) (src + 8)), 1);
+                __m256i out = _mm256_or_si256(_mm256_shuffle_epi8(in, copy),
+                                _mm256_or_si256(
+                                        _mm256_and_si256(_mm256_slli_epi16(_mm256_shuffle_epi8(in, shl), 4), mask_hi),
+                                        _mm256_and_si256(_mm256_srli_epi16(_mm256_shuffle_epi8(in, shr), 4), mask_lo)));
+                _mm256_storeu_si256((__m256i *)(void *) dst, out);
+                dst[32] = src[21];
+                dst[33] = src[22] << 4;
+                dst[34] = src[22] >> 4;
+                dst[35] = src[23];
+                src += 24;
+                dst += 36;
+                dst_len -= 36;
+        }
+        vc_copylineRGBtoR12L(dst, src, dst_len, rshift, gshift, bshift);
+}
+
+#endif // defined VC_HAVE_AVX2_DECODERS
+
+/* vim: set expandtab sw=8: */
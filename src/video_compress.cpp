@@ -53,7 +53,8 @@
 #include "compat/platform_time.h"
 #include "messaging.h"
 #include "module.h"
-#include "utils/synchronized_queue.h"
+#include "utils/lock_free_queue.h"
+#include "utils/metrics.h"
 #include "utils/vf_split.h"
 #include "utils/worker.h"
 #include "video.h"
@@ -100,7 +101,7 @@ public:
 struct compress_state {
         struct module mod;               ///< compress module data
         struct compress_state_real *ptr; ///< pointer to real compress state
-        synchronized_queue<shared_ptr<video_frame>, 1> queue;
+        lock_free_queue<shared_ptr<video_frame>, 1> queue;
 };
 
 /**
@@ -374,6 +375,8 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                         return;
                 }
 
+                static struct metric *compress_ns = metric_histogram("compress.frame_ns");
+                uint64_t start_ns = metric_time_ns();
                 shared_ptr<video_frame> sync_api_frame;
                 if (s->funcs->compress_frame_func) {
                         sync_api_frame = s->funcs->compress_frame_func(s->state[0], frame);
@@ -382,6 +385,7 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                 } else {
                         assert(!"No egliable compress API found");
                 }
+                metric_record(compress_ns, metric_time_ns() - start_ns);
 
                 // empty return value here represents error, but we don't want to pass it to queue, since it would
                 // be interpreted as poisoned pill
@@ -582,6 +586,11 @@ shared_ptr<video_frame> compress_pop(struct compress_state *proxy)
         if(!proxy)
                 return NULL;
 
-        return proxy->queue.pop();
+        static struct metric *compress_frames = metric_counter("compress.frames");
+        auto frame = proxy->queue.pop();
+        if (frame) {
+                metric_add(compress_frames, 1);
+        }
+        return frame;
 }
 
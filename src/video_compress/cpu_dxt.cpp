@@ -0,0 +1,254 @@
+/**
+ * @file   video_compress/cpu_dxt.cpp
+ * @brief  DXT1, DXT1_YUV and DXT5 (YCoCg) compression on CPU
+ *
+ * Counterpart of RTDXT (dxt_glsl.cpp) for machines without a GPU, the
+ * produced streams are decodable by any DXT decompressor.
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <memory>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "module.h"
+#include "utils/dxt_cpu.h"
+#include "utils/video_frame_pool.h"
+#include "video.h"
+#include "video_compress.h"
+
+#define MOD_NAME "[CPU DXT] "
+
+using namespace std;
+
+namespace {
+
+struct state_video_compress_cpu_dxt {
+        struct module module_data;
+
+        codec_t out_codec;
+
+        struct video_desc saved_desc;
+        codec_t encoder_in_codec;       ///< input codec of dxt_cpu_compress()
+        decoder_t decoder;              ///< conversion to encoder_in_codec, NULL if not needed
+        bool interlaced_input;
+        int encoder_input_linesize;
+        unique_ptr<unsigned char []> decoded;
+
+        video_frame_pool<default_data_allocator> pool;
+};
+
+static void cpu_dxt_compress_done(struct module *mod);
+
+static bool configure_with(struct state_video_compress_cpu_dxt *s, struct video_desc desc)
+{
+        s->decoder = NULL;
+        if (dxt_cpu_encoder_supports(desc.color_spec, s->out_codec)) {
+                s->encoder_in_codec = desc.color_spec;
+        } else {
+                // prefer intermediate format of the same kind as the input
+                codec_t candidates[] = { UYVY, RGBA, RGB };
+                if (codec_is_a_rgb(desc.color_spec)) {
+                        swap(candidates[0], candidates[1]);
+                }
+                for (auto c : candidates) {
+                        if ((s->decoder = get_decoder_from_to(desc.color_spec, c, true)) != NULL) {
+                                s->encoder_in_codec = c;
+                                break;
+                        }
+                }
+                if (s->decoder == NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n",
+                                        get_codec_name(desc.color_spec));
+                        return false;
+                }
+        }
+        if (desc.color_spec == UYVY && desc.width % 2 != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Odd width of UYVY frame!\n");
+                return false;
+        }
+
+        s->encoder_input_linesize = vc_get_linesize(desc.width, s->encoder_in_codec);
+        s->interlaced_input = desc.interlacing == INTERLACED_MERGED;
+        if (s->decoder != NULL || s->interlaced_input) {
+                s->decoded = unique_ptr<unsigned char []>(new unsigned char[(size_t) s->encoder_input_linesize * desc.height]);
+        } else {
+                s->decoded = nullptr;
+        }
+
+        struct video_desc compressed_desc = desc;
+        compressed_desc.color_spec = s->out_codec;
+        /* We will deinterlace the output frame */
+        if (s->interlaced_input) {
+                compressed_desc.interlacing = PROGRESSIVE;
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Enabling automatic deinterlacing.\n");
+        }
+        s->pool.reconfigure(compressed_desc, dxt_cpu_get_size(desc.width, desc.height, s->out_codec));
+        s->saved_desc = desc;
+
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Compressing %s to %s using %s.\n",
+                        get_codec_name(s->encoder_in_codec), get_codec_name(s->out_codec), dxt_cpu_simd());
+        return true;
+}
+
+static void usage()
+{
+        printf("DXT CPU compression usage:\n");
+        printf("\t-c cpu_dxt[:DXT1|:DXT1_YUV|:DXT5]\n");
+        printf("\t\tDXT1 - compress with DXT1 (default)\n");
+        printf("\t\tDXT1_YUV - compress with DXT1 storing YCbCr\n");
+        printf("\t\tDXT5 - compress with DXT5 YCoCg\n");
+}
+
+struct module *cpu_dxt_compress_init(struct module *parent, const char *opts)
+{
+        if (strcmp(opts, "help") == 0) {
+                usage();
+                return &compress_init_noerr;
+        }
+
+        auto s = new state_video_compress_cpu_dxt();
+
+        if (strcasecmp(opts, "DXT5") == 0) {
+                s->out_codec = DXT5;
+        } else if (strcasecmp(opts, "DXT1_YUV") == 0) {
+                s->out_codec = DXT1_YUV;
+        } else if (strcasecmp(opts, "DXT1") == 0 || opts[0] == '\0') {
+                s->out_codec = DXT1;
+        } else {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown compression: %s\n", opts);
+                delete s;
+                return NULL;
+        }
+
+        module_init_default(&s->module_data);
+        s->module_data.cls = MODULE_CLASS_DATA;
+        s->module_data.priv_data = s;
+        s->module_data.deleter = cpu_dxt_compress_done;
+        module_register(&s->module_data, parent);
+
+        return &s->module_data;
+}
+
+shared_ptr<video_frame> cpu_dxt_compress(struct module *mod, shared_ptr<video_frame> tx)
+{
+        auto s = (struct state_video_compress_cpu_dxt *) mod->priv_data;
+
+        if (!tx) {
+                return {};
+        }
+
+        struct video_desc desc = video_desc_from_frame(tx.get());
+        if (!video_desc_eq(desc, s->saved_desc)) {
+                for (unsigned int x = 1; x < tx->tile_count; ++x) {
+                        if (vf_get_tile(tx.get(), x)->width != vf_get_tile(tx.get(), 0)->width ||
+                                        vf_get_tile(tx.get(), x)->height != vf_get_tile(tx.get(), 0)->height) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Requested to compress tiles of different size!\n");
+                                return {};
+                        }
+                }
+                if (!configure_with(s, desc)) {
+                        s->saved_desc = video_desc();
+                        return {};
+                }
+        }
+
+        shared_ptr<video_frame> out_frame = s->pool.get_frame();
+
+        for (unsigned int x = 0; x < tx->tile_count; ++x) {
+                struct tile *in_tile = vf_get_tile(tx.get(), x);
+                struct tile *out_tile = vf_get_tile(out_frame.get(), x);
+                auto src = (const unsigned char *) in_tile->data;
+                int src_linesize = vc_get_linesize(in_tile->width, tx->color_spec);
+
+                if (s->decoder != NULL) {
+                        for (unsigned int i = 0; i < in_tile->height; ++i) {
+                                s->decoder(s->decoded.get() + (size_t) i * s->encoder_input_linesize,
+                                                src + (size_t) i * src_linesize,
+                                                s->encoder_input_linesize, 0, 8, 16);
+                        }
+                        if (s->interlaced_input) {
+                                vc_deinterlace(s->decoded.get(), s->encoder_input_linesize, in_tile->height);
+                        }
+                        src = s->decoded.get();
+                        src_linesize = s->encoder_input_linesize;
+                } else if (s->interlaced_input) {
+                        vc_deinterlace_ex(const_cast<unsigned char *>(src), src_linesize,
+                                        s->decoded.get(), s->encoder_input_linesize, in_tile->height);
+                        src = s->decoded.get();
+                        src_linesize = s->encoder_input_linesize;
+                }
+
+                dxt_cpu_compress(s->out_codec, s->encoder_in_codec, src, src_linesize,
+                                in_tile->width, in_tile->height, (unsigned char *) out_tile->data);
+        }
+
+        return out_frame;
+}
+
+static void cpu_dxt_compress_done(struct module *mod)
+{
+        delete (struct state_video_compress_cpu_dxt *) mod->priv_data;
+}
+
+const struct video_compress_info cpu_dxt_info = {
+        "cpu_dxt",
+        cpu_dxt_compress_init,
+        cpu_dxt_compress,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        [] {
+                return list<compress_preset>{
+                        { "DXT1", 35, [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 4.0);},
+                                {20, 4, 0}, {10, 1, 0} },
+                        { "DXT5", 50, [](const struct video_desc *d){return (long)(d->width * d->height * d->fps * 8.0);},
+                                {25, 6, 0}, {10, 1, 0} },
+                };
+        }
+};
+
+REGISTER_MODULE(cpu_dxt, &cpu_dxt_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
+
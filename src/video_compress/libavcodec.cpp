@@ -60,8 +60,8 @@
 #include "module.h"
 #include "rang.hpp"
 #include "utils/misc.h"
+#include "utils/planar_conv.h"
 #include "utils/resource_manager.h"
-#include "utils/worker.h"
 #include "video.h"
 #include "video_compress.h"
 
@@ -74,17 +74,6 @@ extern "C"
 }
 #endif
 
-#ifdef __SSE3__
-#include "pmmintrin.h"
-// compat with older Clang compiler
-#ifndef _mm_bslli_si128
-#define _mm_bslli_si128 _mm_slli_si128
-#endif
-#ifndef _mm_bsrli_si128
-#define _mm_bsrli_si128 _mm_srli_si128
-#endif
-#endif
-
 using namespace std;
 using namespace rang;
 
@@ -209,15 +198,8 @@ struct state_video_compress_libav {
         struct video_desc   saved_desc;
 
         AVFrame            *in_frame;
-        // for every core - parts of the above
-        AVFrame           **in_frame_part;
         AVCodecContext     *codec_ctx;
 
-        unsigned char      *decoded; ///< intermediate representation for codecs
-                                     ///< that are not directly supported
-        codec_t             decoded_codec;
-        decoder_t           decoder;
-
         codec_t             requested_codec_id;
         long long int       requested_bitrate;
         double              requested_bpp;
@@ -227,6 +209,7 @@ struct state_video_compress_libav {
         int                 requested_subsampling;
         // actual value used
         AVPixelFormat       selected_pixfmt;
+        enum planar_fmt     planar_fmt; ///< selected_pixfmt for planar_conv()
 
         codec_t             out_codec;
 
@@ -242,17 +225,6 @@ struct state_video_compress_libav {
         AVFrame *hwframe;
 };
 
-static void to_yuv420p(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-static void to_yuv422p(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-static void to_yuv444p(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-static void to_nv12(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-static void v210_to_yuv420p10le(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-static void v210_to_yuv422p10le(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-static void v210_to_yuv444p10le(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-typedef void (*pixfmt_callback_t)(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-static pixfmt_callback_t select_pixfmt_callback(AVPixelFormat fmt, codec_t src);
-
-
 static void usage(void);
 static int parse_fmt(struct state_video_compress_libav *s, char *fmt);
 static void cleanup(struct state_video_compress_libav *s);
@@ -513,13 +485,6 @@ struct module * libavcodec_compress_init(struct module *parent, const char *opts
                 log_msg(LOG_LEVEL_WARNING, "Warning: Cannot get number of CPU cores!\n");
                 s->params.cpu_count = 1;
         }
-        s->in_frame_part = (AVFrame **) calloc(s->params.cpu_count, sizeof(AVFrame *));
-        for(int i = 0; i < s->params.cpu_count; i++) {
-                s->in_frame_part[i] = av_frame_alloc();
-        }
-
-        s->decoded = NULL;
-
         module_init_default(&s->module_data);
         s->module_data.cls = MODULE_CLASS_DATA;
         s->module_data.priv_data = s;
@@ -749,7 +714,32 @@ ADD_TO_PARAM(lavc_use_codec, "lavc-use-codec",
                 "  AV_PIX_FMT_NV12 (nv12) since some time ago, other codecs were broken\n"
                 "  for NVENC encoder.\n"
                 "  Another possibility is to use yuv420p10le, yuv422p10le or yuv444p10le\n"
-                "  to force 10-bit encoding.\n");
+                "  to force 10-bit encoding (input must be v210 or R10k).\n");
+
+/**
+ * Maps pix_fmt to the output format of planar_conv().
+ * @retval false if there is no corresponding format
+ */
+static bool get_planar_fmt(AVPixelFormat pix_fmt, enum planar_fmt *out)
+{
+        switch (pix_fmt) {
+        case AV_PIX_FMT_NV12: *out = PLANAR_NV12; return true;
+        case AV_PIX_FMT_YUV420P10LE: *out = PLANAR_YUV420P10LE; return true;
+        case AV_PIX_FMT_YUV422P10LE: *out = PLANAR_YUV422P10LE; return true;
+        case AV_PIX_FMT_YUV444P10LE: *out = PLANAR_YUV444P10LE; return true;
+        default: break;
+        }
+        if (is420_8(pix_fmt)) {
+                *out = PLANAR_YUV420P;
+        } else if (is422_8(pix_fmt)) {
+                *out = PLANAR_YUV422P;
+        } else if (is444_8(pix_fmt)) {
+                *out = PLANAR_YUV444P;
+        } else {
+                return false;
+        }
+        return true;
+}
 
 static bool configure_with(struct state_video_compress_libav *s, struct video_desc desc)
 {
@@ -944,40 +934,13 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         log_msg(LOG_LEVEL_INFO, "[lavc] Selected pixfmt: %s\n", av_get_pix_fmt_name(pix_fmt));
         s->selected_pixfmt = pix_fmt;
 
-        s->decoded_codec = UYVY; // most compressions use 8-bit YUV formats internally
-        switch(desc.color_spec) {
-                case UYVY:
-                        s->decoder = (decoder_t) memcpy;
-                        break;
-                case YUYV:
-                        s->decoder = (decoder_t) vc_copylineYUYV;
-                        break;
-                case v210:
-                        if (s->selected_pixfmt == AV_PIX_FMT_YUV420P10LE ||
-                                        s->selected_pixfmt == AV_PIX_FMT_YUV422P10LE ||
-                                        s->selected_pixfmt == AV_PIX_FMT_YUV444P10LE) {
-                                s->decoder = (decoder_t) memcpy;
-                                s->decoded_codec = v210;
-                        } else {
-                                s->decoder = (decoder_t) vc_copylinev210;
-                        }
-                        break;
-                case RGB:
-                        s->decoder = (decoder_t) vc_copylineRGBtoUYVY;
-                        break;
-                case BGR:
-                        s->decoder = (decoder_t) vc_copylineBGRtoUYVY;
-                        break;
-                case RGBA:
-                        s->decoder = (decoder_t) vc_copylineRGBAtoUYVY;
-                        break;
-                default:
-                        log_msg(LOG_LEVEL_ERROR, "[Libavcodec] Unable to find "
-                                        "appropriate pixel format.\n");
-                        return false;
+        if (!get_planar_fmt(s->selected_pixfmt, &s->planar_fmt) ||
+                        !planar_conv_supports(desc.color_spec, s->planar_fmt)) {
+                log_msg(LOG_LEVEL_ERROR, "[lavc] Unable to convert %s to %s.\n",
+                                get_codec_name(desc.color_spec), av_get_pix_fmt_name(s->selected_pixfmt));
+                return false;
         }
-
-        s->decoded = (unsigned char *) malloc(vc_get_linesize(desc.width, s->decoded_codec) * desc.height);
+        log_msg(LOG_LEVEL_VERBOSE, "[lavc] Pixel format conversion uses %s.\n", planar_conv_simd());
 
         s->in_frame = av_frame_alloc();
         if (!s->in_frame) {
@@ -1001,23 +964,6 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
                 log_msg(LOG_LEVEL_ERROR, "Could not allocate raw picture buffer\n");
                 return false;
         }
-        for(int i = 0; i < s->params.cpu_count; ++i) {
-                int chunk_size = s->codec_ctx->height / s->params.cpu_count;
-                chunk_size = chunk_size / 2 * 2;
-                s->in_frame_part[i]->data[0] = s->in_frame->data[0] + s->in_frame->linesize[0] * i *
-                        chunk_size;
-
-                if (av_pix_fmt_desc_get(s->selected_pixfmt)->log2_chroma_h == 1) { // eg. 4:2:0
-                        chunk_size /= 2;
-                }
-                s->in_frame_part[i]->data[1] = s->in_frame->data[1] + s->in_frame->linesize[1] * i *
-                        chunk_size;
-                s->in_frame_part[i]->data[2] = s->in_frame->data[2] + s->in_frame->linesize[2] * i *
-                        chunk_size;
-                s->in_frame_part[i]->linesize[0] = s->in_frame->linesize[0];
-                s->in_frame_part[i]->linesize[1] = s->in_frame->linesize[1];
-                s->in_frame_part[i]->linesize[2] = s->in_frame->linesize[2];
-        }
 
         s->saved_desc = desc;
         s->compressed_desc = desc;
@@ -1029,325 +975,11 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         return true;
 }
 
-static void to_yuv420p(AVFrame *out_frame, unsigned char *in_data, int width, int height)
-{
-        for(int y = 0; y < height; y += 2) {
-                /*  every even row */
-                unsigned char *src = in_data + y * (width * 2);
-                /*  every odd row */
-                unsigned char *src2 = in_data + (y + 1) * (width * 2);
-                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
-                unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
-                unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * y / 2;
-                unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * y / 2;
-                for(int x = 0; x < width / 2; ++x) {
-                        *dst_cb++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                        *dst_cr++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                }
-        }
-}
-
-static void to_yuv422p(AVFrame *out_frame, unsigned char *src, int width, int height)
-{
-        for(int y = 0; y < (int) height; ++y) {
-                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
-                unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * y;
-                unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * y;
-                for(int x = 0; x < width; x += 2) {
-                        *dst_cb++ = *src++;
-                        *dst_y++ = *src++;
-                        *dst_cr++ = *src++;
-                        *dst_y++ = *src++;
-                }
-        }
-}
-
-static void to_yuv444p(AVFrame *out_frame, unsigned char *src, int width, int height)
-{
-        for(int y = 0; y < height; ++y) {
-                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
-                unsigned char *dst_cb = out_frame->data[1] + out_frame->linesize[1] * y;
-                unsigned char *dst_cr = out_frame->data[2] + out_frame->linesize[2] * y;
-                for(int x = 0; x < width; x += 2) {
-                        *dst_cb++ = *src;
-                        *dst_cb++ = *src++;
-                        *dst_y++ = *src++;
-                        *dst_cr++ = *src;
-                        *dst_cr++ = *src++;
-                        *dst_y++ = *src++;
-                }
-        }
-}
-
-static void to_nv12(AVFrame *out_frame, unsigned char *in_data, int width, int height)
-{
-        for(int y = 0; y < height; y += 2) {
-                /*  every even row */
-                unsigned char *src = in_data + y * (width * 2);
-                /*  every odd row */
-                unsigned char *src2 = in_data + (y + 1) * (width * 2);
-                unsigned char *dst_y = out_frame->data[0] + out_frame->linesize[0] * y;
-                unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
-                unsigned char *dst_cbcr = out_frame->data[1] + out_frame->linesize[1] * y / 2;
-
-                int x = 0;
-#ifdef __SSE3__
-                __m128i yuv;
-                __m128i yuv2;
-                __m128i y1;
-                __m128i y2;
-                __m128i y3;
-                __m128i y4;
-                __m128i uv;
-                __m128i uv2;
-                __m128i uv3;
-                __m128i uv4;
-                __m128i ymask = _mm_set1_epi32(0xFF00FF00);
-                __m128i dsty;
-                __m128i dsty2;
-                __m128i dstuv;
-
-                for (; x < (width - 15); x += 16){
-                        yuv = _mm_lddqu_si128((__m128i const*) src);
-                        yuv2 = _mm_lddqu_si128((__m128i const*) src2);
-                        src += 16;
-                        src2 += 16;
-
-                        y1 = _mm_and_si128(ymask, yuv);
-                        y1 = _mm_bsrli_si128(y1, 1);
-                        y2 = _mm_and_si128(ymask, yuv2);
-                        y2 = _mm_bsrli_si128(y2, 1);
-
-                        uv = _mm_andnot_si128(ymask, yuv);
-                        uv2 = _mm_andnot_si128(ymask, yuv2);
-
-                        uv = _mm_avg_epu8(uv, uv2);
-
-                        yuv = _mm_lddqu_si128((__m128i const*) src);
-                        yuv2 = _mm_lddqu_si128((__m128i const*) src2);
-                        src += 16;
-                        src2 += 16;
-
-                        y3 = _mm_and_si128(ymask, yuv);
-                        y3 = _mm_bsrli_si128(y3, 1);
-                        y4 = _mm_and_si128(ymask, yuv2);
-                        y4 = _mm_bsrli_si128(y4, 1);
-
-                        uv3 = _mm_andnot_si128(ymask, yuv);
-                        uv4 = _mm_andnot_si128(ymask, yuv2);
-
-                        uv3 = _mm_avg_epu8(uv3, uv4);
-
-                        dsty = _mm_packus_epi16(y1, y3);
-                        dsty2 = _mm_packus_epi16(y2, y4);
-                        dstuv = _mm_packus_epi16(uv, uv3);
-                        _mm_storeu_si128((__m128i *) dst_y, dsty);
-                        _mm_storeu_si128((__m128i *) dst_y2, dsty2);
-                        _mm_storeu_si128((__m128i *) dst_cbcr, dstuv);
-                        dst_y += 16;
-                        dst_y2 += 16;
-                        dst_cbcr += 16;
-                }
-#endif
-                for(; x < width - 1; x += 2) {
-                        *dst_cbcr++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                        *dst_cbcr++ = (*src++ + *src2++) / 2;
-                        *dst_y++ = *src++;
-                        *dst_y2++ = *src2++;
-                }
-        }
-}
-
-static void v210_to_yuv420p10le(AVFrame *out_frame, unsigned char *in_data, int width, int height)
-{
-        for(int y = 0; y < height; y += 2) {
-                /*  every even row */
-                uint32_t *src = (uint32_t *) (in_data + y * vc_get_linesize(width, v210));
-                /*  every odd row */
-                uint32_t *src2 = (uint32_t *) (in_data + (y + 1) * vc_get_linesize(width, v210));
-                uint16_t *dst_y = (uint16_t *) (out_frame->data[0] + out_frame->linesize[0] * y);
-                uint16_t *dst_y2 = (uint16_t *) (out_frame->data[0] + out_frame->linesize[0] * (y + 1));
-                uint16_t *dst_cb = (uint16_t *) (out_frame->data[1] + out_frame->linesize[1] * y / 2);
-                uint16_t *dst_cr = (uint16_t *) (out_frame->data[2] + out_frame->linesize[2] * y / 2);
-                for(int x = 0; x < width / 6; ++x) {
-			//block 1, bits  0 -  9: U0+0
-			//block 1, bits 10 - 19: Y0
-			//block 1, bits 20 - 29: V0+1
-			//block 2, bits  0 -  9: Y1
-			//block 2, bits 10 - 19: U2+3
-			//block 2, bits 20 - 29: Y2
-			//block 3, bits  0 -  9: V2+3
-			//block 3, bits 10 - 19: Y3
-			//block 3, bits 20 - 29: U4+5
-			//block 4, bits  0 -  9: Y4
-			//block 4, bits 10 - 19: V4+5
-			//block 4, bits 20 - 29: Y5
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-                        uint32_t w1_0, w1_1, w1_2, w1_3;
-
-                        w0_0 = *src++;
-                        w0_1 = *src++;
-                        w0_2 = *src++;
-                        w0_3 = *src++;
-                        w1_0 = *src2++;
-                        w1_1 = *src2++;
-                        w1_2 = *src2++;
-                        w1_3 = *src2++;
-
-                        *dst_y++ = (w0_0 >> 10) & 0x3ff;
-                        *dst_y++ = w0_1 & 0x3ff;
-                        *dst_y++ = (w0_1 >> 20) & 0x3ff;
-                        *dst_y++ = (w0_2 >> 10) & 0x3ff;
-                        *dst_y++ = w0_3 & 0x3ff;
-                        *dst_y++ = (w0_3 >> 20) & 0x3ff;
-
-                        *dst_y2++ = (w1_0 >> 10) & 0x3ff;
-                        *dst_y2++ = w1_1 & 0x3ff;
-                        *dst_y2++ = (w1_1 >> 20) & 0x3ff;
-                        *dst_y2++ = (w1_2 >> 10) & 0x3ff;
-                        *dst_y2++ = w1_3 & 0x3ff;
-                        *dst_y2++ = (w1_3 >> 20) & 0x3ff;
-
-                        *dst_cb++ = ((w0_0 & 0x3ff) + (w1_0 & 0x3ff)) / 2;
-                        *dst_cb++ = (((w0_1 >> 10) & 0x3ff) + ((w1_1 >> 10) & 0x3ff)) / 2;
-                        *dst_cb++ = (((w0_2 >> 20) & 0x3ff) + ((w1_2 >> 20) & 0x3ff)) / 2;
-
-                        *dst_cr++ = (((w0_0 >> 20) & 0x3ff) + ((w1_0 >> 20) & 0x3ff)) / 2;
-                        *dst_cr++ = ((w0_2 & 0x3ff) + (w1_2 & 0x3ff)) / 2;
-                        *dst_cr++ = (((w0_3 >> 10) & 0x3ff) + ((w1_3 >> 10) & 0x3ff)) / 2;
-                }
-        }
-}
-
-static void v210_to_yuv422p10le(AVFrame *out_frame, unsigned char *in_data, int width, int height)
-{
-        for(int y = 0; y < height; y += 1) {
-                uint32_t *src = (uint32_t *) (in_data + y * vc_get_linesize(width, v210));
-                uint16_t *dst_y = (uint16_t *) (out_frame->data[0] + out_frame->linesize[0] * y);
-                uint16_t *dst_cb = (uint16_t *) (out_frame->data[1] + out_frame->linesize[1] * y);
-                uint16_t *dst_cr = (uint16_t *) (out_frame->data[2] + out_frame->linesize[2] * y);
-                for(int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-
-                        w0_0 = *src++;
-                        w0_1 = *src++;
-                        w0_2 = *src++;
-                        w0_3 = *src++;
-
-                        *dst_y++ = (w0_0 >> 10) & 0x3ff;
-                        *dst_y++ = w0_1 & 0x3ff;
-                        *dst_y++ = (w0_1 >> 20) & 0x3ff;
-                        *dst_y++ = (w0_2 >> 10) & 0x3ff;
-                        *dst_y++ = w0_3 & 0x3ff;
-                        *dst_y++ = (w0_3 >> 20) & 0x3ff;
-
-                        *dst_cb++ = w0_0 & 0x3ff;
-                        *dst_cb++ = (w0_1 >> 10) & 0x3ff;
-                        *dst_cb++ = (w0_2 >> 20) & 0x3ff;
-
-                        *dst_cr++ = (w0_0 >> 20) & 0x3ff;
-                        *dst_cr++ = w0_2 & 0x3ff;
-                        *dst_cr++ = (w0_3 >> 10) & 0x3ff;
-                }
-        }
-}
-
-static void v210_to_yuv444p10le(AVFrame *out_frame, unsigned char *in_data, int width, int height)
-{
-        for(int y = 0; y < height; y += 1) {
-                uint32_t *src = (uint32_t *) (in_data + y * vc_get_linesize(width, v210));
-                uint16_t *dst_y = (uint16_t *) (out_frame->data[0] + out_frame->linesize[0] * y);
-                uint16_t *dst_cb = (uint16_t *) (out_frame->data[1] + out_frame->linesize[1] * y);
-                uint16_t *dst_cr = (uint16_t *) (out_frame->data[2] + out_frame->linesize[2] * y);
-                for(int x = 0; x < width / 6; ++x) {
-                        uint32_t w0_0, w0_1, w0_2, w0_3;
-
-                        w0_0 = *src++;
-                        w0_1 = *src++;
-                        w0_2 = *src++;
-                        w0_3 = *src++;
-
-                        *dst_y++ = (w0_0 >> 10) & 0x3ff;
-                        *dst_y++ = w0_1 & 0x3ff;
-                        *dst_y++ = (w0_1 >> 20) & 0x3ff;
-                        *dst_y++ = (w0_2 >> 10) & 0x3ff;
-                        *dst_y++ = w0_3 & 0x3ff;
-                        *dst_y++ = (w0_3 >> 20) & 0x3ff;
-
-                        *dst_cb++ = w0_0 & 0x3ff;
-                        *dst_cb++ = w0_0 & 0x3ff;
-                        *dst_cb++ = (w0_1 >> 10) & 0x3ff;
-                        *dst_cb++ = (w0_1 >> 10) & 0x3ff;
-                        *dst_cb++ = (w0_2 >> 20) & 0x3ff;
-                        *dst_cb++ = (w0_2 >> 20) & 0x3ff;
-
-                        *dst_cr++ = (w0_0 >> 20) & 0x3ff;
-                        *dst_cr++ = (w0_0 >> 20) & 0x3ff;
-                        *dst_cr++ = w0_2 & 0x3ff;
-                        *dst_cr++ = w0_2 & 0x3ff;
-                        *dst_cr++ = (w0_3 >> 10) & 0x3ff;
-                        *dst_cr++ = (w0_3 >> 10) & 0x3ff;
-                }
-        }
-}
-
-static pixfmt_callback_t select_pixfmt_callback(AVPixelFormat fmt, codec_t src) {
-
-        if (src == v210) {
-                if (fmt == AV_PIX_FMT_YUV420P10LE) {
-                        return v210_to_yuv420p10le;
-                } else if (fmt == AV_PIX_FMT_YUV422P10LE) {
-                        return v210_to_yuv422p10le;
-                } else if (fmt == AV_PIX_FMT_YUV444P10LE) {
-                        return v210_to_yuv444p10le;
-                } else {
-                        abort();
-                }
-        }
-
-        if (is422_8(fmt)) {
-                return to_yuv422p;
-        } else if (is420_8(fmt)) {
-                if (fmt == AV_PIX_FMT_NV12)
-                        return to_nv12;
-                else
-                        return to_yuv420p;
-        } else if (is444_8(fmt)) {
-                return to_yuv444p;
-        } else {
-                log_msg(LOG_LEVEL_FATAL, "[lavc] Unknown subsampling.\n");
-                abort();
-        }
-}
-
-struct my_task_data {
-        void (*callback)(AVFrame *out_frame, unsigned char *in_data, int width, int height);
-        AVFrame *out_frame;
-        unsigned char *in_data;
-        int width;
-        int height;
-};
-
-void *my_task(void *arg);
-
-void *my_task(void *arg) {
-        struct my_task_data *data = (struct my_task_data *) arg;
-        data->callback(data->out_frame, data->in_data, data->width, data->height);
-        return NULL;
-}
-
 static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
 {
         struct state_video_compress_libav *s = (struct state_video_compress_libav *) mod->priv_data;
         static int frame_seq = 0;
         int ret;
-        unsigned char *decoded;
         shared_ptr<video_frame> out{};
 
         libavcodec_check_messages(s);
@@ -1387,50 +1019,10 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
 
         s->in_frame->pts = frame_seq++;
 
-        if((void *) s->decoder != (void *) memcpy) {
-                unsigned char *line1 = (unsigned char *) tx->tiles[0].data;
-                unsigned char *line2 = (unsigned char *) s->decoded;
-                int src_linesize = vc_get_linesize(tx->tiles[0].width, tx->color_spec);
-                int dst_linesize = tx->tiles[0].width * 2; /* UYVY */
-                for (int i = 0; i < (int) tx->tiles[0].height; ++i) {
-                        s->decoder(line2, line1, dst_linesize,
-                                        0, 8, 16);
-                        line1 += src_linesize;
-                        line2 += dst_linesize;
-                }
-                decoded = s->decoded;
-        } else {
-                decoded = (unsigned char *) tx->tiles[0].data;
-        }
-
-        {
-                task_result_handle_t handle[s->params.cpu_count];
-                struct my_task_data data[s->params.cpu_count];
-                for(int i = 0; i < s->params.cpu_count; ++i) {
-                        data[i].callback = select_pixfmt_callback(s->selected_pixfmt, s->decoded_codec);
-                        data[i].out_frame = s->in_frame_part[i];
-
-                        size_t height = tx->tiles[0].height / s->params.cpu_count;
-                        // height needs to be even
-                        height = height / 2 * 2;
-                        if (i < s->params.cpu_count - 1) {
-                                data[i].height = height;
-                        } else { // we are last so we need to do the rest
-                                data[i].height = tx->tiles[0].height -
-                                        height * (s->params.cpu_count - 1);
-                        }
-                        data[i].width = tx->tiles[0].width;
-                        data[i].in_data = decoded + i * height *
-                                vc_get_linesize(tx->tiles[0].width, s->decoded_codec);
-
-                        // run !
-                        handle[i] = task_run_async(my_task, (void *) &data[i]);
-                }
-
-                for(int i = 0; i < s->params.cpu_count; ++i) {
-                        wait_task(handle[i]);
-                }
-        }
+        // converts directly from the input frame, slices are processed in parallel
+        planar_conv(tx->color_spec, s->planar_fmt, (const unsigned char *) tx->tiles[0].data,
+                        vc_get_linesize(tx->tiles[0].width, tx->color_spec), tx->tiles[0].width,
+                        tx->tiles[0].height, s->in_frame->data, s->in_frame->linesize);
 
         AVFrame *frame = s->in_frame;
 #ifdef HWACC_VAAPI
@@ -1543,9 +1135,6 @@ static void cleanup(struct state_video_compress_libav *s)
                 av_free(s->in_frame);
                 s->in_frame = NULL;
         }
-        free(s->decoded);
-        s->decoded = NULL;
-
         if(s->hwframe){
                 av_frame_free(&s->hwframe);
         }
@@ -1558,10 +1147,6 @@ static void libavcodec_compress_done(struct module *mod)
         cleanup(s);
 
         rm_release_shared_lock(LAVCD_LOCK_NAME);
-        for(int i = 0; i < s->params.cpu_count; i++) {
-                av_free(s->in_frame_part[i]);
-        }
-        free(s->in_frame_part);
         delete s;
 }
 
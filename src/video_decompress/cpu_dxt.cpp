@@ -0,0 +1,154 @@
+/**
+ * @file   video_decompress/cpu_dxt.cpp
+ * @brief  DXT1, DXT1_YUV and DXT5 (YCoCg) decompression on CPU
+ *
+ * Used when dxt_glsl (which has a lower, ie. better, priority) is not
+ * available or cannot create a GL context.
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "utils/dxt_cpu.h"
+#include "video.h"
+#include "video_decompress.h"
+
+#define MOD_NAME "[CPU DXT] "
+
+struct state_decompress_cpu_dxt {
+        struct video_desc desc;
+        int rshift, gshift, bshift;
+        int pitch;
+        codec_t out_codec;
+};
+
+static void *cpu_dxt_decompress_init(void)
+{
+        return new state_decompress_cpu_dxt();
+}
+
+static int cpu_dxt_decompress_reconfigure(void *state, struct video_desc desc,
+                int rshift, int gshift, int bshift, int pitch, codec_t out_codec)
+{
+        auto s = (struct state_decompress_cpu_dxt *) state;
+
+        if (!dxt_cpu_decoder_supports(desc.color_spec, out_codec)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported conversion %s to %s!\n",
+                                get_codec_name(desc.color_spec), get_codec_name(out_codec));
+                return FALSE;
+        }
+        s->desc = desc;
+        s->pitch = pitch;
+        s->rshift = rshift;
+        s->gshift = gshift;
+        s->bshift = bshift;
+        s->out_codec = out_codec;
+
+        return TRUE;
+}
+
+static decompress_status cpu_dxt_decompress(void *state, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks)
+{
+        auto s = (struct state_decompress_cpu_dxt *) state;
+        UNUSED(frame_seq);
+        UNUSED(callbacks);
+
+        if (src_len < dxt_cpu_get_size(s->desc.width, s->desc.height, s->desc.color_spec)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame too short (%u B)!\n", src_len);
+                return DECODER_NO_FRAME;
+        }
+
+        dxt_cpu_decompress(s->desc.color_spec, buffer, s->desc.width, s->desc.height,
+                        s->out_codec, dst, s->pitch, s->rshift, s->gshift, s->bshift);
+
+        return DECODER_GOT_FRAME;
+}
+
+static int cpu_dxt_decompress_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        int ret = FALSE;
+
+        switch(property) {
+                case DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME:
+                        if(*len >= sizeof(int)) {
+                                *(int *) val = TRUE;
+                                *len = sizeof(int);
+                                ret = TRUE;
+                        }
+                        break;
+                default:
+                        ret = FALSE;
+        }
+
+        return ret;
+}
+
+static void cpu_dxt_decompress_done(void *state)
+{
+        delete (struct state_decompress_cpu_dxt *) state;
+}
+
+static const struct decode_from_to *cpu_dxt_decompress_get_decoders() {
+        static const struct decode_from_to ret[] = {
+                { DXT1, RGBA, 550 },
+                { DXT1_YUV, RGBA, 550 },
+                { DXT5, RGBA, 550 },
+                { DXT1, UYVY, 550 },
+                { DXT1_YUV, UYVY, 550 },
+                { DXT5, UYVY, 550 },
+                { VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, 0 },
+        };
+        return ret;
+}
+
+static const struct video_decompress_info cpu_dxt_info = {
+        cpu_dxt_decompress_init,
+        cpu_dxt_decompress_reconfigure,
+        cpu_dxt_decompress,
+        cpu_dxt_decompress_get_property,
+        cpu_dxt_decompress_done,
+        cpu_dxt_decompress_get_decoders,
+};
+
+REGISTER_MODULE(cpu_dxt, &cpu_dxt_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
+
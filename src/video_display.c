@@ -66,6 +66,7 @@
 #include "lib_common.h"
 #include "module.h"
 #include "perf.h"
+#include "utils/metrics.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
@@ -83,6 +84,9 @@ struct display {
         int pp_output_frames_count, display_pitch;
         struct video_desc saved_desc;
         enum video_mode saved_mode;
+
+        struct metric *metric_frames;
+        struct metric *metric_put_ns;
 };
 
 /**This variable represents a pseudostate and may be returned when initialization
@@ -124,6 +128,8 @@ int initialize_video_display(struct module *parent, const char *requested_displa
                 struct display *d = calloc(1, sizeof(struct display));
                 d->magic = DISPLAY_MAGIC;
                 d->funcs = vdi;
+                d->metric_frames = metric_counter("display.frames");
+                d->metric_put_ns = metric_histogram("display.put_ns");
 
                 module_init_default(&d->mod);
                 d->mod.cls = MODULE_CLASS_DISPLAY;
@@ -248,10 +254,19 @@ struct video_frame *display_get_frame(struct display *d)
         }
 }
 
+static int display_put_frame_real(struct display *d, struct video_frame *frame, int flags);
+
 /**
  * @brief Puts filled video frame.
  * After calling this function, video frame cannot be used.
  *
+ * If the display has @ref DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES set, the frame
+ * may also be a foreign one (eg. data shared by multiple displays). Such a frame
+ * has video_frame_callbacks::dispose set and the display calls it instead of
+ * recycling the frame when it is no longer needed (also if the frame is
+ * discarded or dropped), possibly from another thread. Data of a foreign frame
+ * must not be modified.
+ *
  * @param d        display to be putted frame to
  * @param frame    frame that has been obtained from display_get_frame() and has not yet been put.
  *                 Should not be NULL unless we want to quit display mainloop.
@@ -268,6 +283,15 @@ int display_put_frame(struct display *d, struct video_frame *frame, int flags)
                 return d->funcs->putf(d->state, frame, flags);
         }
 
+        metric_add(d->metric_frames, 1);
+        uint64_t t0 = metric_time_ns();
+        int ret = display_put_frame_real(d, frame, flags);
+        metric_record(d->metric_put_ns, metric_time_ns() - t0);
+        return ret;
+}
+
+static int display_put_frame_real(struct display *d, struct video_frame *frame, int flags)
+{
         if (d->postprocess) {
                 int display_ret = 0;
 		for (int i = 0; i < d->pp_output_frames_count; ++i) {
@@ -426,6 +450,9 @@ int display_get_property(struct display *d, int property, void *val, size_t *len
                                 }
                         }
 			break;
+                case DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES:
+                        // display input is owned by the postprocessor
+                        return FALSE;
                 default:
                         return d->funcs->get_property(d->state, property, val, len);
                 }
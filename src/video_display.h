@@ -125,6 +125,8 @@ enum display_property {
         DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES = 5, ///< whether display supports receiving data from - returns (struct multi_sources_supp_info *)
                                                      ///< multiple network sources concurrently
         DISPLAY_PROPERTY_AUDIO_FORMAT = 6, ///< @see audio_display_info::query_format - in/out parameter is struct audio_desc
+        DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES = 7, ///< whether putf() accepts also frames not obtained from getf() - bool
+                                                    ///< @see display_put_frame() for details
 };
 
 #define PITCH_DEFAULT -1 ///< default pitch, i. e. respective linesize
@@ -662,6 +662,8 @@ static int display_conference_get_property(void *state, int property, void *val,
                 *len = sizeof(struct multi_sources_supp_info);
                 return TRUE;
 
+        } else if (property == DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES) {
+                return FALSE;
         } else {
                 return display_get_property(s->real_display, property, val, len);
         }
@@ -77,12 +77,15 @@ static struct video_frame *display_dummy_getf(void *state)
         return ((dummy_display_state *) state)->f;
 }
 
-static int display_dummy_putf(void *state, struct video_frame * /* frame */, int flags)
+static int display_dummy_putf(void *state, struct video_frame *frame, int flags)
 {
+        auto s = (dummy_display_state *) state;
+        if (frame != nullptr && frame != s->f) { // shared frame
+                frame->callbacks.dispose(frame);
+        }
         if (flags == PUTF_DISCARD) {
                 return 0;
         }
-        auto s = (dummy_display_state *) state;
         auto curr_time = steady_clock::now();
         s->frames += 1;
         double seconds = duration_cast<duration<double>>(curr_time - s->t0).count();
@@ -111,6 +114,10 @@ static int display_dummy_get_property(void *, int property, void *val, size_t *l
                         
                         *len = sizeof(codecs);
                         break;
+                case DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES:
+                        *(bool *) val = true;
+                        *len = sizeof(bool);
+                        break;
                 default:
                         return FALSE;
         }
@@ -73,6 +73,7 @@
 #include <iostream>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include "debug.h"
 #include "gl_context.h"
@@ -255,6 +256,7 @@ struct state_gl {
         bool            deinterlace;
 
         struct video_frame *current_frame;
+        vector<char>    deinterlace_buf; ///< for shared frames that cannot be deinterlaced in place
 
         queue<struct video_frame *> frame_queue;
         queue<struct video_frame *> free_frame_queue;
@@ -795,10 +797,14 @@ static void gl_render(struct state_gl *s, char *data)
 {
         /* for DXT, deinterlacing doesn't make sense since it is
          * always deinterlaced before comrpression */
-        if(s->deinterlace && (s->current_display_desc.color_spec == RGBA || s->current_display_desc.color_spec == UYVY))
-                vc_deinterlace((unsigned char *) data,
-                                vc_get_linesize(s->current_display_desc.width, s->current_display_desc.color_spec),
-                                s->current_display_desc.height);
+        if(s->deinterlace && (s->current_display_desc.color_spec == RGBA || s->current_display_desc.color_spec == UYVY)) {
+                int linesize = vc_get_linesize(s->current_display_desc.width, s->current_display_desc.color_spec);
+                if (s->current_frame && s->current_frame->callbacks.dispose) { // shared frame - do not modify
+                        s->deinterlace_buf.assign(data, data + linesize * s->current_display_desc.height);
+                        data = s->deinterlace_buf.data();
+                }
+                vc_deinterlace((unsigned char *) data, linesize, s->current_display_desc.height);
+        }
 
         gl_check_error();
 
@@ -846,6 +852,20 @@ static void gl_render(struct state_gl *s, char *data)
         gl_check_error();
 }
 
+/**
+ * Returns the frame to the pool or disposes a shared one (see
+ * DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES), s->lock must be held.
+ */
+static void release_frame(struct state_gl *s, struct video_frame *frame)
+{
+        if (frame->callbacks.dispose) {
+                frame->callbacks.dispose(frame);
+                return;
+        }
+        vf_recycle(frame);
+        s->free_frame_queue.push(frame);
+}
+
 static void pop_frame(struct state_gl *s)
 {
         unique_lock<mutex> lk(s->lock);
@@ -908,15 +928,13 @@ static void glut_idle_callback(void)
         if (s->paused) {
                 pop_frame(s);
                 unique_lock<mutex> lk(s->lock);
-                vf_recycle(frame);
-                s->free_frame_queue.push(frame);
+                release_frame(s, frame);
                 return;
         }
 
         if (s->current_frame) {
                 s->lock.lock();
-                vf_recycle(s->current_frame);
-                s->free_frame_queue.push(s->current_frame);
+                release_frame(s, s->current_frame);
                 s->lock.unlock();
         }
         s->current_frame = frame;
@@ -1675,6 +1693,10 @@ static int display_gl_get_property(void *state, int property, void *val, size_t
                         }
                         *len = sizeof(supported_il_modes);
                         break;
+                case DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES:
+                        *(bool *) val = true;
+                        *len = sizeof(bool);
+                        break;
                 default:
                         return FALSE;
         }
@@ -1715,10 +1737,18 @@ static void display_gl_done(void *state)
         while (s->frame_queue.size() > 0) {
                 struct video_frame *buffer = s->frame_queue.front();
                 s->frame_queue.pop();
-                vf_free(buffer);
+                if (buffer && buffer->callbacks.dispose) {
+                        buffer->callbacks.dispose(buffer);
+                } else {
+                        vf_free(buffer);
+                }
         }
 
-        vf_free(s->current_frame);
+        if (s->current_frame && s->current_frame->callbacks.dispose) {
+                s->current_frame->callbacks.dispose(s->current_frame);
+        } else {
+                vf_free(s->current_frame);
+        }
 
         if (s->syphon_spout) {
 #ifdef HAVE_SYPHON
@@ -1776,13 +1806,11 @@ static int display_gl_putf(void *state, struct video_frame *frame, int nonblock)
         }
 
         if (nonblock == PUTF_DISCARD) {
-                vf_recycle(frame);
-                s->free_frame_queue.push(frame);
+                release_frame(s, frame);
                 return 0;
         }
         if (s->frame_queue.size() >= MAX_BUFFER_SIZE && nonblock == PUTF_NONBLOCK) {
-                vf_recycle(frame);
-                s->free_frame_queue.push(frame);
+                release_frame(s, frame);
                 return 1;
         }
         s->frame_consumed_cv.wait(lk, [s]{return s->frame_queue.size() < MAX_BUFFER_SIZE;});
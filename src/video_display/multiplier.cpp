@@ -64,6 +64,7 @@ static constexpr int SKIP_FIRST_N_FRAMES_IN_STREAM = 5;
 struct sub_display {
         struct display *real_display;
         thread disp_thread;
+        bool accepts_shared_frames; ///< frames are passed by reference, not copied
 };
 
 struct state_multiplier_common {
@@ -145,6 +146,10 @@ static void *display_multiplier_init(struct module *parent, const char *fmt, uns
                         LOG(LOG_LEVEL_FATAL) << "[multiplier] Unable to initialize a display " << requested_display << "!\n";
                         abort();
                 }
+                bool accepts_shared = false;
+                size_t len = sizeof accepts_shared;
+                disp.accepts_shared_frames = display_get_property(disp.real_display,
+                                DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES, &accepts_shared, &len) && accepts_shared;
 
                 s->common->displays.push_back(std::move(disp));
         }
@@ -166,6 +171,29 @@ static void check_reconf(struct state_multiplier_common *s, struct video_desc de
         }
 }
 
+static void dispose_frame_ref(struct video_frame *ref)
+{
+        delete static_cast<shared_ptr<video_frame> *>(ref->callbacks.dispose_udata);
+        vf_free(ref);
+}
+
+/**
+ * Returns a new frame referencing data of the shared frame. Data are freed
+ * when all the references are disposed.
+ */
+static struct video_frame *get_frame_ref(shared_ptr<video_frame> const & frame)
+{
+        struct video_frame *ref = vf_alloc_desc(video_desc_from_frame(frame.get()));
+        for (unsigned int i = 0; i < ref->tile_count; ++i) {
+                ref->tiles[i].data = frame->tiles[i].data;
+                ref->tiles[i].data_len = frame->tiles[i].data_len;
+        }
+        memcpy(&ref->fec_params, &frame->fec_params, VF_METADATA_SIZE);
+        ref->callbacks.dispose_udata = new shared_ptr<video_frame>(frame);
+        ref->callbacks.dispose = dispose_frame_ref;
+        return ref;
+}
+
 static void display_multiplier_worker(void *state)
 {
         shared_ptr<struct state_multiplier_common> s = ((struct state_multiplier *)state)->common;
@@ -196,13 +224,17 @@ static void display_multiplier_worker(void *state)
 
                 check_reconf(s.get(), video_desc_from_frame(frame));
 
+                // capable displays get the frame itself, the others a copy
+                shared_ptr<video_frame> shared(frame, vf_free);
                 for (auto& disp : s->displays) {
+                        if (disp.accepts_shared_frames) {
+                                display_put_frame(disp.real_display, get_frame_ref(shared), PUTF_BLOCKING);
+                                continue;
+                        }
                         struct video_frame *real_display_frame = display_get_frame(disp.real_display);
                         memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
                         display_put_frame(disp.real_display, real_display_frame, PUTF_BLOCKING);
                 }
-
-                vf_free(frame);
         }
 }
 
@@ -287,6 +319,9 @@ static int display_multiplier_get_property(void *state, int property, void *val,
                 return FALSE;
 
         }
+        if (property == DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES) {
+                return FALSE;
+        }
         //TODO Find common properties, for now just return properties of the first display
         return display_get_property(s->displays[0].real_display, property, val, len);
 }
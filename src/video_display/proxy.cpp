@@ -75,6 +75,7 @@ struct state_proxy_common {
                 }
         }
         struct display *real_display;
+        bool accepts_shared_frames; ///< real display takes over our frames
         struct video_desc display_desc;
 
         uint32_t current_ssrc;
@@ -142,6 +143,10 @@ static void *display_proxy_init(struct module *parent, const char *fmt, unsigned
         s->common = shared_ptr<state_proxy_common>(new state_proxy_common());
         assert (initialize_video_display(parent, requested_display, cfg, flags, NULL, &s->common->real_display) == 0);
         free(fmt_copy);
+        bool accepts_shared = false;
+        size_t len = sizeof accepts_shared;
+        s->common->accepts_shared_frames = display_get_property(s->common->real_display,
+                        DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES, &accepts_shared, &len) && accepts_shared;
 
         int ret = pthread_create(&s->common->thread_id, NULL, (void *(*)(void *)) display_run,
                         s->common->real_display);
@@ -161,6 +166,26 @@ static void check_reconf(struct state_proxy_common *s, struct video_desc desc)
         }
 }
 
+/**
+ * Passes the frame to the real display - directly if it accepts foreign
+ * frames, otherwise copied to the display buffer. Frame is consumed.
+ */
+static void put_frame(struct state_proxy_common *s, struct video_frame *frame)
+{
+        if (s->accepts_shared_frames) {
+                frame->callbacks.dispose = vf_free;
+                frame->ssrc = s->current_ssrc;
+                display_put_frame(s->real_display, frame, PUTF_BLOCKING);
+                return;
+        }
+
+        struct video_frame *real_display_frame = display_get_frame(s->real_display);
+        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
+        vf_free(frame);
+        real_display_frame->ssrc = s->current_ssrc;
+        display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
+}
+
 static void display_proxy_run(void *state)
 {
         shared_ptr<struct state_proxy_common> s = ((struct state_proxy *)state)->common;
@@ -234,12 +259,7 @@ static void display_proxy_run(void *state)
                                         ssrc_list.pop_front();
 
                                         check_reconf(s.get(), video_desc_from_frame(frame));
-
-                                        struct video_frame *real_display_frame = display_get_frame(s->real_display);
-                                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                                        vf_free(frame);
-                                        real_display_frame->ssrc = s->current_ssrc;
-                                        display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
+                                        put_frame(s.get(), frame);
                                 }
                         } else {
                                 auto & old_list = s->frames[s->old_ssrc];
@@ -294,12 +314,7 @@ static void display_proxy_run(void *state)
                                         s->frames[s->current_ssrc].pop_front();
 
                                         check_reconf(s.get(), video_desc_from_frame(frame));
-
-                                        struct video_frame *real_display_frame = display_get_frame(s->real_display);
-                                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                                        vf_free(frame);
-                                        real_display_frame->ssrc = s->current_ssrc;
-                                        display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
+                                        put_frame(s.get(), frame);
                                 }
                         }
                 }
@@ -367,6 +382,8 @@ static int display_proxy_get_property(void *state, int property, void *val, size
                 *len = sizeof(struct multi_sources_supp_info);
                 return TRUE;
 
+        } else if (property == DISPLAY_PROPERTY_ACCEPTS_SHARED_FRAMES) {
+                return FALSE;
         } else {
                 return display_get_property(s->real_display, property, val, len);
         }
@@ -54,16 +54,33 @@
 
 #include <compat/platform_semaphore.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
 
 #include "debug.h"
+#include "host.h"
 #include "video.h"
 #include "video_codec.h"
 #include "video_export.h"
 
 #define MAX_QUEUE_SIZE 300
+#define MOD_NAME "[Video export] "
+
+#define CONTAINER_DEFAULT_POOL_SIZE 16
+#define CONTAINER_PREALLOC_MIN (256 * 1024 * 1024) ///< preallocation step (at least 16 frames)
+
+ADD_TO_PARAM(export_container, "export-container",
+         "* export-container[=<frames>]\n"
+         "  Export video to a single preallocated file " VIDEO_EXPORT_CONTAINER_FILE " (with index\n"
+         "  " VIDEO_EXPORT_INDEX_FILE ") written with direct I/O instead of a file per frame.\n"
+         "  <frames> is the number of frames that can be queued for writing (default 16).\n");
 
 /*
  * we do not need to have possible stalls, so IO is performend in a separate thread
@@ -78,6 +95,12 @@ struct output_entry {
         char *data;
         int data_len;
 
+        // container mode only
+        uint64_t offset;                          ///< position of the frame in the container
+        struct video_export_index_entry *index;   ///< index records of the frame tiles
+        size_t data_capacity;                     ///< allocated size of data
+        unsigned int index_capacity;              ///< allocated count of index records
+
         struct output_entry *next;
 };
 
@@ -95,8 +118,78 @@ struct video_export {
         struct video_desc saved_desc;
 
         pthread_t thread_id;
+
+        // container mode
+        bool container;
+        int container_fd;
+        FILE *index_file;
+        int pool_size;                          ///< maximal number of frame buffers
+        int pool_allocated;
+        struct output_entry *free_entries;      ///< frame buffers ready for reuse, protected by lock
+        uint64_t container_offset;              ///< where the next frame will be stored
+        // used by the writer thread only
+        uint64_t container_end;                 ///< end of the last tile written
+        uint64_t preallocated;
+        uint32_t written;                       ///< frames written including their index
+        uint32_t dropped;
 };
 
+static bool write_all(int fd, const char *data, size_t len, uint64_t offset)
+{
+        while (len > 0) {
+#ifdef WIN32
+                ssize_t ret = -1;
+                if (_lseeki64(fd, offset, SEEK_SET) != -1) {
+                        ret = write(fd, data, len);
+                }
+#else
+                ssize_t ret = pwrite(fd, data, len, offset);
+#endif
+                if (ret < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (ret <= 0) {
+                        return false;
+                }
+                data += ret;
+                len -= ret;
+                offset += ret;
+        }
+        return true;
+}
+
+/**
+ * Writes the frame to the container with a single (direct) write and appends
+ * its index records.
+ */
+static bool container_write(struct video_export *s, struct output_entry *entry)
+{
+#ifdef HAVE_LINUX
+        if (entry->offset + entry->data_len > s->preallocated) {
+                // reserve space ahead to avoid metadata updates and fragmentation
+                uint64_t len = 16 * (uint64_t) entry->data_len;
+                len = len > CONTAINER_PREALLOC_MIN ? len : CONTAINER_PREALLOC_MIN;
+                if (fallocate(s->container_fd, FALLOC_FL_KEEP_SIZE, s->preallocated, len) == 0) {
+                        s->preallocated += len;
+                } else {
+                        s->preallocated = UINT64_MAX; // not supported - don't retry
+                }
+        }
+#endif
+        if (!write_all(s->container_fd, entry->data, entry->data_len, entry->offset)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot write frame: %s\n", strerror(errno));
+                return false;
+        }
+        int tile_count = s->saved_desc.tile_count;
+        if (fwrite(entry->index, sizeof entry->index[0], tile_count, s->index_file) != (size_t) tile_count) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot write frame index: %s\n", strerror(errno));
+        }
+        struct video_export_index_entry *last = &entry->index[tile_count - 1];
+        s->container_end = last->offset + last->length;
+        s->written += 1;
+        return true;
+}
+
 static void *video_export_thread(void *arg)
 {
         struct video_export *s = (struct video_export *) arg;
@@ -118,9 +211,20 @@ static void *video_export_thread(void *arg)
 
                 // poison
                 if(current->data == NULL) {
+                        free(current);
                         return NULL;
                 }
 
+                if (s->container) {
+                        bool ok = container_write(s, current);
+                        pthread_mutex_lock(&s->lock);
+                        s->dropped += ok ? 0 : 1;
+                        current->next = s->free_entries;
+                        s->free_entries = current;
+                        pthread_mutex_unlock(&s->lock);
+                        continue;
+                }
+
                 FILE *out = fopen(current->filename, "wb");
                 if (out == NULL) {
                         perror("fopen");
@@ -138,6 +242,60 @@ static void *video_export_thread(void *arg)
         // never get here
 }
 
+static bool container_open(struct video_export *s)
+{
+        char name[512];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_CONTAINER_FILE, s->path);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef WIN32
+        flags |= O_BINARY;
+#endif
+#ifdef HAVE_LINUX
+        s->container_fd = open(name, flags | O_DIRECT, 0644);
+        if (s->container_fd == -1 && errno == EINVAL) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Direct I/O not supported for %s, using buffered writes.\n", name);
+        }
+#endif
+        if (s->container_fd == -1) {
+                s->container_fd = open(name, flags, 0644);
+        }
+        if (s->container_fd == -1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create %s: %s\n", name, strerror(errno));
+                return false;
+        }
+
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_INDEX_FILE, s->path);
+        s->index_file = fopen(name, "wb");
+        if (s->index_file == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create %s: %s\n", name, strerror(errno));
+                close(s->container_fd);
+                return false;
+        }
+        return true;
+}
+
+static void container_close(struct video_export *s)
+{
+        fclose(s->index_file);
+        // the last frame was padded to the alignment
+        if (ftruncate(s->container_fd, s->container_end) != 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot truncate the container: %s\n", strerror(errno));
+        }
+        close(s->container_fd);
+
+        while (s->free_entries) {
+                struct output_entry *entry = s->free_entries;
+                s->free_entries = entry->next;
+                aligned_free(entry->data);
+                free(entry->index);
+                free(entry);
+        }
+
+        if (s->dropped > 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "%u frames were not exported.\n", s->dropped);
+        }
+}
+
 struct video_export * video_export_init(const char *path)
 {
         struct video_export *s;
@@ -154,6 +312,21 @@ struct video_export * video_export_init(const char *path)
 
         memset(&s->saved_desc, 0, sizeof(s->saved_desc));
 
+        s->container_fd = -1;
+        const char *container_param = get_commandline_param("export-container");
+        if (container_param) {
+                s->container = true;
+                s->pool_size = strlen(container_param) > 0 ? atoi(container_param) : CONTAINER_DEFAULT_POOL_SIZE;
+                if (s->pool_size <= 0 || !container_open(s)) {
+                        if (s->pool_size <= 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong queue length: %s\n", container_param);
+                        }
+                        free(s->path);
+                        free(s);
+                        return NULL;
+                }
+        }
+
         if(pthread_create(&s->thread_id, NULL, video_export_thread, s) != 0) {
                 fprintf(stderr, "[Video exporter] Failed to create thread.\n");
                 free(s);
@@ -182,7 +355,11 @@ void output_summary(struct video_export *s)
         fprintf(summary, "fourcc %.4s\n", (char *) &fourcc);
         fprintf(summary, "fps %.2f\n", s->saved_desc.fps);
         fprintf(summary, "interlacing %d\n", (int) s->saved_desc.interlacing);
-        fprintf(summary, "count %d\n", s->total);
+        fprintf(summary, "count %d\n", s->container ? s->written : s->total);
+        if (s->container) {
+                fprintf(summary, "tiles %d\n", s->saved_desc.tile_count);
+                fprintf(summary, "container %s\n", VIDEO_EXPORT_CONTAINER_FILE);
+        }
 
         fclose(summary);
 }
@@ -208,8 +385,12 @@ void video_export_destroy(struct video_export *s)
                 pthread_join(s->thread_id, NULL);
                 pthread_mutex_destroy(&s->lock);
 
+                if (s->container) {
+                        container_close(s);
+                }
+
                 // write summary
-                if(s->total > 0) {
+                if((s->container ? s->written : s->total) > 0) {
                         output_summary(s);
                 }
 
@@ -218,6 +399,85 @@ void video_export_destroy(struct video_export *s)
         }
 }
 
+static void enqueue(struct video_export *s, struct output_entry *entry)
+{
+        if(s->head) {
+                s->tail->next = entry;
+                s->tail = entry;
+        } else {
+                s->head = s->tail = entry;
+        }
+        s->queue_len += 1;
+}
+
+/**
+ * Copies all tiles of the frame to a pooled aligned buffer and queues it to
+ * be written to the container. Tiles are aligned to
+ * VIDEO_EXPORT_CONTAINER_ALIGN, so that direct I/O can be used.
+ */
+static void container_enqueue(struct video_export *s, struct video_frame *frame)
+{
+        size_t len = 0;
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                len += (frame->tiles[i].data_len + VIDEO_EXPORT_CONTAINER_ALIGN - 1) /
+                        VIDEO_EXPORT_CONTAINER_ALIGN * VIDEO_EXPORT_CONTAINER_ALIGN;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        struct output_entry *entry = s->free_entries;
+        if (entry) {
+                s->free_entries = entry->next;
+        } else if (s->pool_allocated < s->pool_size) {
+                s->pool_allocated += 1;
+        } else {
+                s->dropped += 1;
+                pthread_mutex_unlock(&s->lock);
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "All %d buffers are waiting for write, not saving frame.\n",
+                                s->pool_size);
+                return;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (entry == NULL) { // grow the pool - only until it reaches pool_size
+                entry = calloc(1, sizeof(struct output_entry));
+                assert(entry != NULL);
+        }
+        if (entry->data_capacity < len) {
+                aligned_free(entry->data);
+                entry->data = aligned_malloc(len, VIDEO_EXPORT_CONTAINER_ALIGN);
+                assert(entry->data != NULL);
+                entry->data_capacity = len;
+        }
+        if (entry->index_capacity < frame->tile_count) {
+                free(entry->index);
+                entry->index = calloc(frame->tile_count, sizeof(struct video_export_index_entry));
+                assert(entry->index != NULL);
+                entry->index_capacity = frame->tile_count;
+        }
+        size_t pos = 0;
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                size_t tile_len = frame->tiles[i].data_len;
+                size_t aligned_len = (tile_len + VIDEO_EXPORT_CONTAINER_ALIGN - 1) /
+                        VIDEO_EXPORT_CONTAINER_ALIGN * VIDEO_EXPORT_CONTAINER_ALIGN;
+                memcpy(entry->data + pos, frame->tiles[i].data, tile_len);
+                memset(entry->data + pos + tile_len, 0, aligned_len - tile_len);
+                entry->index[i].offset = s->container_offset + pos;
+                entry->index[i].length = tile_len;
+                pos += aligned_len;
+        }
+        entry->data_len = len;
+        entry->offset = s->container_offset;
+        entry->next = NULL;
+        s->container_offset += len;
+        s->total += 1;
+
+        pthread_mutex_lock(&s->lock);
+        enqueue(s, entry);
+        pthread_mutex_unlock(&s->lock);
+
+        platform_sem_post(&s->semaphore);
+}
+
 void video_export(struct video_export *s, struct video_frame *frame)
 {
         if(!s) {
@@ -235,6 +495,11 @@ void video_export(struct video_export *s, struct video_frame *frame)
                 }
         }
 
+        if (s->container) {
+                container_enqueue(s, frame);
+                return;
+        }
+
         for (unsigned int i = 0; i < frame->tile_count; ++i) {
                 assert(frame->tiles[i].data != NULL && frame->tiles[i].data_len != 0);
 
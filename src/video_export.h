@@ -51,6 +51,12 @@
 
 #define VIDEO_EXPORT_SUMMARY_VERSION 1
 
+#define VIDEO_EXPORT_CONTAINER_FILE "video.ugv"
+#define VIDEO_EXPORT_INDEX_FILE "video.idx"
+#define VIDEO_EXPORT_CONTAINER_ALIGN 4096 ///< alignment of tiles in the container
+
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -58,6 +64,17 @@ extern "C" {
 struct video_export;
 struct video_frame;
 
+/**
+ * Record of the container index (VIDEO_EXPORT_INDEX_FILE). The index holds
+ * tile_count records for every exported frame in frame order, stored in host
+ * byte order.
+ */
+struct video_export_index_entry {
+        uint64_t offset;        ///< position of the tile in VIDEO_EXPORT_CONTAINER_FILE
+        uint32_t length;        ///< tile length in bytes
+        uint32_t reserved;
+};
+
 struct video_export * video_export_init(const char *path);
 void video_export_destroy(struct video_export *state);
 void video_export(struct video_export *state, struct video_frame *frame);
@@ -64,6 +64,7 @@
 #include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
+#include "utils/metrics.h"
 #include "utils/vf_split.h"
 #include "video.h"
 #include "video_compress.h"
@@ -88,6 +89,10 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         m_async_sending = false;
 
         m_control = (struct control_state *) get_module(get_root_module(static_cast<struct module *>(params.at("parent").ptr)), "control");
+
+        m_metric_send_frames = metric_counter("send.frames");
+        m_metric_send_bytes = metric_counter("send.bytes");
+        m_metric_send_ns = metric_histogram("send.frame_ns");
 }
 
 ultragrid_rtp_video_rxtx::~ultragrid_rtp_video_rxtx()
@@ -210,15 +215,25 @@ after_send:
                         control_report_event(m_control, "SEND " + m_port_id + " " +
                                         string("play"));
                 }
-                ostringstream oss;
-                oss << "SEND " << m_port_id << " bufferId " << buffer_id <<
-                        " droppedFrames " << dropped_frames <<
-                        " nanoPerFrameActual " << (m_nano_per_frame_actual_cumul += nano_actual) <<
-                        " nanoPerFrameExpected " << (m_nano_per_frame_expected_cumul += nano_expected) <<
-                        " sendBytesTotal " << (m_send_bytes_total += send_bytes) <<
-                        " timestamp " << now <<
-                        " compressMillis " << (m_compress_millis_cumul += compress_millis);
-                control_report_stats(m_control, oss.str());
+                metric_add(m_metric_send_frames, 1);
+                metric_add(m_metric_send_bytes, send_bytes);
+                metric_record(m_metric_send_ns, nano_actual);
+
+                m_nano_per_frame_actual_cumul += nano_actual;
+                m_nano_per_frame_expected_cumul += nano_expected;
+                m_send_bytes_total += send_bytes;
+                m_compress_millis_cumul += compress_millis;
+                if (control_stats_enabled(m_control)) {
+                        ostringstream oss;
+                        oss << "SEND " << m_port_id << " bufferId " << buffer_id <<
+                                " droppedFrames " << dropped_frames <<
+                                " nanoPerFrameActual " << m_nano_per_frame_actual_cumul <<
+                                " nanoPerFrameExpected " << m_nano_per_frame_expected_cumul <<
+                                " sendBytesTotal " << m_send_bytes_total <<
+                                " timestamp " << now <<
+                                " compressMillis " << m_compress_millis_cumul;
+                        control_report_stats(m_control, oss.str());
+                }
         }
 }
 
@@ -506,6 +521,28 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
         return 0;
 }
 
+/**
+ * Sends the packetized video also to the destination of the socket (the
+ * encoder output is shared), see rtp_add_mirror().
+ */
+void ultragrid_rtp_video_rxtx::add_mirror(struct _socket_udp *s)
+{
+        lock_guard<mutex> lock(m_network_devices_lock);
+        rtp_add_mirror(m_network_devices[0], s);
+}
+
+void ultragrid_rtp_video_rxtx::remove_mirror(struct _socket_udp *s)
+{
+        lock_guard<mutex> lock(m_network_devices_lock);
+        rtp_remove_mirror(m_network_devices[0], s);
+}
+
+void ultragrid_rtp_video_rxtx::set_primary_muted(bool muted)
+{
+        lock_guard<mutex> lock(m_network_devices_lock);
+        rtp_set_primary_muted(m_network_devices[0], muted);
+}
+
 uint32_t ultragrid_rtp_video_rxtx::get_ssrc()
 {
         return rtp_my_ssrc(m_network_devices[0]);
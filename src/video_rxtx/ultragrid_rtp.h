@@ -47,6 +47,7 @@
 #include <mutex>
 #include <string>
 
+struct _socket_udp;
 struct control_state;
 
 class ultragrid_rtp_video_rxtx : public rtp_video_rxtx {
@@ -58,6 +59,9 @@ public:
 
         // transcoder functions
         friend ssize_t hd_rum_decompress_write(void *state, void *buf, size_t count);
+        void add_mirror(struct _socket_udp *s);
+        void remove_mirror(struct _socket_udp *s);
+        void set_primary_muted(bool muted);
 private:
         static void *receiver_thread(void *arg);
         virtual void send_frame(std::shared_ptr<video_frame>);
@@ -93,6 +97,10 @@ private:
         long long int m_nano_per_frame_actual_cumul = 0;
         long long int m_nano_per_frame_expected_cumul = 0;
         long long int m_compress_millis_cumul = 0;
+
+        struct metric *m_metric_send_frames;
+        struct metric *m_metric_send_bytes;
+        struct metric *m_metric_send_ns;
 };
 
 #endif // VIDEO_RXTX_ULTRAGRID_RTP_H_
@@ -0,0 +1,299 @@
+/**
+ * @file   tools/dxt_bench.cpp
+ * @brief  CPU DXT encoder and decoder throughput and quality benchmark
+ *
+ * Measures single-threaded and parallel throughput of the CPU DXT encoder
+ * (utils/dxt_cpu.h) and decoder for all supported formats and reports PSNR
+ * of the decoded frame against the source. It also checks that the AVX2 and
+ * SSE4.1 encoders produce identical streams.
+ *
+ * To compare with the GLSL encoder, pass a raw RGBA frame and the same frame
+ * compressed by RTDXT (eg. saved with "-d dump" from "-c RTDXT:DXT1"). The
+ * reference stream is then decoded with the CPU decoder and both its PSNR
+ * and the ratio of bit-identical blocks with the CPU encoder are reported.
+ *
+ * Build with "make benchmarks".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "host.h"
+#include "utils/dxt_cpu.h"
+#include "video_codec.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern "C" void exit_uv(int status);
+
+void exit_uv(int status)
+{
+        exit(status);
+}
+
+static void usage(const char *progname)
+{
+        printf("Usage:\n\t%s [-s <width>x<height>] [-i <frame.rgba> [-r <reference>:DXT1|DXT5]]\n", progname);
+        printf("\nDefaults: -s 1920x1080 with a synthetic frame.\n");
+        printf("-i - raw RGBA source frame of the given size\n");
+        printf("-r - the source frame compressed by RTDXT (GLSL) for comparison\n");
+}
+
+/// natural-like content - gradients, a moving pattern, sharp edges and noise
+static vector<unsigned char> generate_rgba(int width, int height)
+{
+        vector<unsigned char> frame((size_t) width * height * 4);
+        mt19937 gen(0xcafe);
+        normal_distribution<float> noise(0.0f, 3.0f);
+        for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                        float fx = (float) x / width, fy = (float) y / height;
+                        float pattern = 40.0f * sinf(fx * 23.0f + fy * 7.0f) * cosf(fy * 17.0f);
+                        bool box = ((x / 97) + (y / 61)) % 5 == 0;
+                        float rgb[3] = {
+                                255.0f * fx + pattern,
+                                255.0f * fy - pattern * 0.5f + (box ? 60.0f : 0.0f),
+                                255.0f * (1.0f - fx) * fy + pattern * 0.25f - (box ? 80.0f : 0.0f),
+                        };
+                        unsigned char *pix = &frame[((size_t) y * width + x) * 4];
+                        for (int k = 0; k < 3; ++k) {
+                                pix[k] = min(max(lrintf(rgb[k] + noise(gen)), 0L), 255L);
+                        }
+                        pix[3] = 255;
+                }
+        }
+        return frame;
+}
+
+/// BT.709 limited range with averaged chroma
+static vector<unsigned char> rgba_to_uyvy(const vector<unsigned char> &rgba, int width, int height)
+{
+        vector<unsigned char> frame((size_t) width * height * 2);
+        for (size_t i = 0; i < (size_t) width * height; i += 2) {
+                const unsigned char *p = &rgba[i * 4];
+                float y[2], u = 0.0f, v = 0.0f;
+                for (int j = 0; j < 2; ++j) {
+                        float r = p[4 * j], g = p[4 * j + 1], b = p[4 * j + 2];
+                        y[j] = 16.0f + (0.2126f * r + 0.7152f * g + 0.0722f * b) * 0.8588f;
+                        u += 0.5f * (128.0f + (-0.1145f * r - 0.3854f * g + 0.5f * b) * 0.8784f);
+                        v += 0.5f * (128.0f + (0.5f * r - 0.4541f * g - 0.0458f * b) * 0.8784f);
+                }
+                unsigned char *out = &frame[i * 2];
+                out[0] = lrintf(u);
+                out[1] = lrintf(y[0]);
+                out[2] = lrintf(v);
+                out[3] = lrintf(y[1]);
+        }
+        return frame;
+}
+
+/// PSNR of RGB components of 2 RGBA frames
+static double psnr(const vector<unsigned char> &a, const vector<unsigned char> &b)
+{
+        double sse = 0.0;
+        for (size_t i = 0; i < a.size(); ++i) {
+                if (i % 4 != 3) {
+                        double d = (double) a[i] - b[i];
+                        sse += d * d;
+                }
+        }
+        double mse = sse / (a.size() / 4 * 3);
+        return mse == 0.0 ? INFINITY : 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+/// @returns frames per second
+static double measure(const function<void()> &fn)
+{
+        int iterations = 0;
+        auto t0 = high_resolution_clock::now();
+        duration<double> elapsed;
+        do {
+                fn();
+                iterations += 1;
+                elapsed = high_resolution_clock::now() - t0;
+        } while (elapsed.count() < 0.5);
+        return iterations / elapsed.count();
+}
+
+static vector<unsigned char> decode(codec_t codec, const vector<unsigned char> &compressed, int width, int height)
+{
+        vector<unsigned char> out((size_t) width * height * 4);
+        dxt_cpu_decompress(codec, compressed.data(), width, height, RGBA, out.data(), width * 4, 0, 8, 16);
+        return out;
+}
+
+/// compares reference stream from the GLSL encoder with the CPU one
+static bool compare_reference(const char *ref_spec, const vector<unsigned char> &rgba, int width, int height)
+{
+        string path = ref_spec;
+        codec_t codec = DXT1;
+        auto colon = path.rfind(':');
+        if (colon != string::npos) {
+                codec = get_codec_from_name(path.substr(colon + 1).c_str());
+                path = path.substr(0, colon);
+        }
+        if (codec != DXT1 && codec != DXT5) {
+                fprintf(stderr, "Reference must be DXT1 or DXT5!\n");
+                return false;
+        }
+        ifstream in(path, ios::binary);
+        vector<unsigned char> ref{istreambuf_iterator<char>(in), istreambuf_iterator<char>()};
+        if (ref.size() < dxt_cpu_get_size(width, height, codec)) {
+                fprintf(stderr, "Reference %s too short (%zu B)!\n", path.c_str(), ref.size());
+                return false;
+        }
+        ref.resize(dxt_cpu_get_size(width, height, codec));
+
+        vector<unsigned char> cpu(ref.size());
+        dxt_cpu_compress(codec, RGBA, rgba.data(), width * 4, width, height, cpu.data());
+        size_t block_size = codec == DXT5 ? 16 : 8;
+        size_t identical = 0;
+        for (size_t i = 0; i < ref.size(); i += block_size) {
+                identical += memcmp(&ref[i], &cpu[i], block_size) == 0;
+        }
+        printf("\nComparison with GLSL encoder (%s):\n", get_codec_name(codec));
+        printf("  PSNR GLSL %.2f dB, CPU %.2f dB, identical blocks %.2f %%\n",
+                        psnr(decode(codec, ref, width, height), rgba), psnr(decode(codec, cpu, width, height), rgba),
+                        100.0 * identical / (ref.size() / block_size));
+        return true;
+}
+
+int main(int argc, char *argv[])
+{
+        int width = 1920;
+        int height = 1080;
+        const char *input = nullptr;
+        const char *reference = nullptr;
+
+        for (int i = 1; i < argc; ++i) {
+                if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+                        if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width < 2 || height < 1) {
+                                usage(argv[0]);
+                                return 1;
+                        }
+                } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+                        input = argv[++i];
+                } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+                        reference = argv[++i];
+                } else {
+                        usage(argv[0]);
+                        return strcmp(argv[i], "-h") == 0 ? 0 : 1;
+                }
+        }
+        width = width / 2 * 2; // UYVY
+
+        vector<unsigned char> rgba;
+        if (input) {
+                ifstream in(input, ios::binary);
+                rgba.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+                if (rgba.size() < (size_t) width * height * 4) {
+                        fprintf(stderr, "Input %s too short for %dx%d RGBA!\n", input, width, height);
+                        return 1;
+                }
+                rgba.resize((size_t) width * height * 4);
+                for (size_t i = 3; i < rgba.size(); i += 4) {
+                        rgba[i] = 255;
+                }
+        } else {
+                rgba = generate_rgba(width, height);
+        }
+        vector<unsigned char> uyvy = rgba_to_uyvy(rgba, width, height);
+
+        printf("%dx%d, encoder uses %s, frames per second:\n", width, height, dxt_cpu_simd());
+        printf("%-16s %10s %10s %10s %10s %9s\n", "codecs", "enc 1 thr", "enc", "dec 1 thr", "dec", "PSNR");
+        bool ok = true;
+        for (codec_t in_codec : { RGBA, UYVY }) {
+                for (codec_t out_codec : { DXT1, DXT1_YUV, DXT5 }) {
+                        const vector<unsigned char> &src = in_codec == RGBA ? rgba : uyvy;
+                        int src_linesize = vc_get_linesize(width, in_codec);
+                        int block_rows = (height + 3) / 4;
+                        vector<unsigned char> compressed(dxt_cpu_get_size(width, height, out_codec));
+                        vector<unsigned char> decompressed((size_t) width * height * 4);
+
+                        double enc1 = measure([&]{ dxt_cpu_compress_rows(out_codec, in_codec, src.data(),
+                                                src_linesize, width, height, compressed.data(), 0, block_rows); });
+                        double enc = measure([&]{ dxt_cpu_compress(out_codec, in_codec, src.data(),
+                                                src_linesize, width, height, compressed.data()); });
+                        double dec1 = measure([&]{ dxt_cpu_decompress_rows(out_codec, compressed.data(), width, height,
+                                                RGBA, decompressed.data(), width * 4, 0, 8, 16, 0, block_rows); });
+                        double dec = measure([&]{ dxt_cpu_decompress(out_codec, compressed.data(), width, height,
+                                                RGBA, decompressed.data(), width * 4, 0, 8, 16); });
+
+                        // SSE4.1 must produce the same stream as AVX2
+                        vector<unsigned char> sse(compressed.size());
+                        commandline_params["dxt-cpu-simd"] = "sse4.1";
+                        dxt_cpu_compress(out_codec, in_codec, src.data(), src_linesize, width, height, sse.data());
+                        commandline_params.erase("dxt-cpu-simd");
+                        bool exact = sse == compressed;
+                        ok = ok && exact;
+
+                        char codecs[32];
+                        snprintf(codecs, sizeof codecs, "%s->%s", get_codec_name(in_codec), get_codec_name(out_codec));
+                        printf("%-16s %10.1f %10.1f %10.1f %10.1f %6.2f dB%s\n", codecs, enc1, enc, dec1, dec,
+                                        psnr(decode(out_codec, compressed, width, height), rgba),
+                                        exact ? "" : "  SIMD MISMATCH");
+                }
+        }
+
+        if (reference) {
+                if (!input) {
+                        fprintf(stderr, "Reference requires the source frame (-i)!\n");
+                        return 1;
+                }
+                ok = compare_reference(reference, rgba, width, height) && ok;
+        }
+
+        if (!ok) {
+                fprintf(stderr, "Encoders for different instruction sets do not match!\n");
+                return 1;
+        }
+        return 0;
+}
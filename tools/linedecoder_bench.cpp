@@ -0,0 +1,186 @@
+/**
+ * @file   tools/linedecoder_bench.cpp
+ * @brief  Line decoder throughput benchmark
+ *
+ * Measures throughput of the line decoders returned by get_decoder_from_to()
+ * for the most common codec pairs and compares their output with the scalar
+ * versions (obtained with "line-decoder-simd=none") for a range of line
+ * lengths, including ones not divisible by the vector width.
+ *
+ * Build with "make benchmarks".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "host.h"
+#include "video_codec.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern "C" void exit_uv(int status);
+
+void exit_uv(int status)
+{
+        exit(status);
+}
+
+struct bench_pair {
+        codec_t in;
+        codec_t out;
+        int rshift, gshift, bshift;
+};
+
+static const struct bench_pair pairs[] = {
+        { v210,  UYVY, 0, 8, 16 },
+        { R10k,  RGBA, 0, 8, 16 },
+        { R10k,  RGBA, 16, 8, 0 },
+        { RGBA,  RGBA, 16, 8, 0 },
+        { RGBA,  RGB,  0, 8, 16 },
+        { RGB,   RGBA, 0, 8, 16 },
+        { RGB,   RGBA, 24, 16, 8 },
+        { DPX10, RGBA, 0, 8, 16 },
+        { R12L,  RGBA, 0, 8, 16 },
+        { R12L,  RGBA, 16, 8, 0 },
+        { RGB,   R12L, 0, 8, 16 },
+};
+
+static decoder_t get_decoder(const struct bench_pair *p, const char *simd)
+{
+        if (simd) {
+                commandline_params["line-decoder-simd"] = simd;
+        } else {
+                commandline_params.erase("line-decoder-simd");
+        }
+        return get_decoder_from_to(p->in, p->out, false);
+}
+
+/// checks that both decoders produce identical output for width pixels
+static bool check_exact(const struct bench_pair *p, decoder_t ref, decoder_t dec, int width, mt19937 &gen)
+{
+        int src_len = vc_get_linesize(width, p->in);
+        int dst_len = vc_get_linesize(width, p->out);
+        // guard bytes to detect writes past dst_len
+        vector<unsigned char> src(src_len), out_ref(dst_len + 64, 0xAA), out(dst_len + 64, 0xAA);
+        for (auto &c : src) {
+                c = gen();
+        }
+        ref(out_ref.data(), src.data(), dst_len, p->rshift, p->gshift, p->bshift);
+        dec(out.data(), src.data(), dst_len, p->rshift, p->gshift, p->bshift);
+        return out_ref == out;
+}
+
+static double measure(const struct bench_pair *p, decoder_t dec, int width, int height,
+                vector<unsigned char> const &src, vector<unsigned char> &dst)
+{
+        int src_linesize = vc_get_linesize(width, p->in);
+        int dst_linesize = vc_get_linesize(width, p->out);
+        int iterations = 0;
+        auto t0 = high_resolution_clock::now();
+        duration<double> elapsed;
+        do {
+                for (int y = 0; y < height; ++y) {
+                        dec(dst.data() + y * dst_linesize, src.data() + y * src_linesize,
+                                        dst_linesize, p->rshift, p->gshift, p->bshift);
+                }
+                iterations += 1;
+                elapsed = high_resolution_clock::now() - t0;
+        } while (elapsed.count() < 0.2);
+        return (double) iterations * dst_linesize * height / elapsed.count() / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+                printf("Usage:\n\t%s [width [height]]\n", argv[0]);
+                return 0;
+        }
+        int width = argc > 1 ? atoi(argv[1]) : 3840;
+        int height = argc > 2 ? atoi(argv[2]) : 2160;
+        width = max(width, 6);
+        height = max(height, 1);
+
+        mt19937 gen(0xcafe);
+        bool ok = true;
+
+        printf("%-14s %-12s %10s %10s %8s\n", "codecs", "shifts", "scalar", "best", "speedup");
+        for (auto const &p : pairs) {
+                decoder_t ref = get_decoder(&p, "none");
+                decoder_t dec = get_decoder(&p, nullptr);
+                if (ref == nullptr || dec == nullptr) {
+                        fprintf(stderr, "No decoder from %s to %s!\n", get_codec_name(p.in), get_codec_name(p.out));
+                        return 1;
+                }
+
+                bool exact = true;
+                for (int w = 6; w <= 258; w += 6) {
+                        exact = exact && check_exact(&p, ref, dec, w, gen);
+                }
+                exact = exact && check_exact(&p, ref, dec, width, gen);
+                ok = ok && exact;
+
+                vector<unsigned char> src((size_t) vc_get_linesize(width, p.in) * height);
+                vector<unsigned char> dst((size_t) vc_get_linesize(width, p.out) * height);
+                for (auto &c : src) {
+                        c = gen();
+                }
+                double scalar = measure(&p, ref, width, height, src, dst);
+                double best = dec == ref ? scalar : measure(&p, dec, width, height, src, dst);
+
+                char codecs[32];
+                char shifts[32];
+                snprintf(codecs, sizeof codecs, "%s->%s", get_codec_name(p.in), get_codec_name(p.out));
+                snprintf(shifts, sizeof shifts, "%d,%d,%d", p.rshift, p.gshift, p.bshift);
+                printf("%-14s %-12s %6.2f GB/s %6.2f GB/s %7.2fx%s\n", codecs, shifts, scalar, best,
+                                best / scalar, exact ? "" : "  MISMATCH");
+        }
+
+        if (!ok) {
+                fprintf(stderr, "Vectorized decoders do not match the scalar ones!\n");
+                return 1;
+        }
+        return 0;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file   tools/pbuf_bench.cpp
+ * @brief  Playout buffer microbenchmark
+ *
+ * Feeds a synthetic stream of RTP packets, reordered within a sliding window
+ * and optionally with losses, to the playout buffer and measures time spent
+ * in pbuf_insert(), pbuf_decode() and pbuf_remove(). Decoded frames are
+ * checked to contain all non-lost packets in descending sequence order and
+ * the per-frame loss accounting passed in pbuf_stats is verified.
+ *
+ * Build with "make benchmarks".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "rtp/rtp.h"
+#include "rtp/pbuf.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern "C" void exit_uv(int status);
+
+void exit_uv(int status)
+{
+        exit(status);
+}
+
+struct bench_frame_check {
+        int expected;       ///< packets actually sent to pbuf
+        int frame_pkts;     ///< packets the frame consists of
+        bool first;         ///< first frame - frame length cannot be known
+        bool ok;
+};
+
+static int check_frame(struct coded_data *cdata, void *data, struct pbuf_stats *stats)
+{
+        auto check = (struct bench_frame_check *) data;
+        int count = 0;
+        for (struct coded_data *cd = cdata; cd != NULL; cd = cd->nxt) {
+                if (cd->nxt != NULL && (int16_t) (cd->seqno - cd->nxt->seqno) <= 0) {
+                        check->ok = false;
+                }
+                if (cd->data->seq != cd->seqno) {
+                        check->ok = false;
+                }
+                count += 1;
+        }
+        if (count != check->expected || stats->frame_received_pkts != count) {
+                check->ok = false;
+        }
+        if (check->first ? stats->frame_expected_pkts != -1 : stats->frame_expected_pkts != check->frame_pkts) {
+                check->ok = false;
+        }
+        if (!check->first && PBUF_STATS_FRAME_COMPLETE(stats) != (count == check->frame_pkts)) {
+                check->ok = false;
+        }
+        return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+                printf("Usage:\n\t%s [frames [packets_per_frame [reorder_window [loss_pct]]]]\n", argv[0]);
+                return 0;
+        }
+        int frames = argc > 1 ? atoi(argv[1]) : 1000;
+        int pkts_per_frame = argc > 2 ? atoi(argv[2]) : 3000;
+        int window = argc > 3 ? atoi(argv[3]) : 32;
+        double loss = argc > 4 ? atof(argv[4]) / 100.0 : 0.0;
+        window = max(window, 1);
+
+        log_level = LOG_LEVEL_WARNING; // silence periodic pbuf statistics
+
+        mt19937 gen(0xcafe);
+        uniform_real_distribution<double> loss_dist(0.0, 1.0);
+
+        struct pbuf *pbuf = pbuf_init(NULL);
+        // make all frames playable immediately
+        pbuf_set_playout_delay(pbuf, 0.0);
+
+        uint16_t seq = 65000; // make the stream wrap around
+        uint32_t ts = 0;
+        long long total_pkts = 0;
+        duration<double> insert_time{}, decode_time{}, remove_time{};
+        bool ok = true;
+        vector<rtp_packet *> pkts;
+
+        for (int f = 0; f < frames; ++f) {
+                pkts.clear();
+                for (int i = 0; i < pkts_per_frame; ++i, ++seq) {
+                        bool last = i == pkts_per_frame - 1;
+                        if (!last && loss_dist(gen) < loss) {
+                                continue;
+                        }
+                        auto pkt = (rtp_packet *) calloc(1, sizeof(rtp_packet));
+                        pkt->seq = seq;
+                        pkt->ts = ts;
+                        pkt->m = last;
+                        pkts.push_back(pkt);
+                }
+                for (size_t i = 0; i < pkts.size(); i += window) {
+                        shuffle(pkts.begin() + i, pkts.begin() + min(pkts.size(), i + window), gen);
+                }
+                struct bench_frame_check check = { (int) pkts.size(), pkts_per_frame, f == 0, true };
+                total_pkts += pkts.size();
+
+                auto t0 = high_resolution_clock::now();
+                for (auto pkt : pkts) {
+                        pbuf_insert(pbuf, pkt);
+                }
+                auto t1 = high_resolution_clock::now();
+                pbuf_decode(pbuf, t1 + seconds(1), check_frame, &check);
+                auto t2 = high_resolution_clock::now();
+                pbuf_remove(pbuf, t2 + seconds(1));
+                auto t3 = high_resolution_clock::now();
+
+                insert_time += t1 - t0;
+                decode_time += t2 - t1;
+                remove_time += t3 - t2;
+                ok = ok && check.ok;
+                ts += 1500;
+        }
+
+        struct pbuf_stats stats;
+        pbuf_get_stats(pbuf, &stats);
+        pbuf_destroy(pbuf);
+
+        printf("frames: %d, packets: %lld, reorder window: %d, loss: %.2f%%\n",
+                        frames, total_pkts, window, loss * 100.0);
+        printf("lost: %lld packets, incomplete: %lld frames\n", stats.lost_pkts_cum, stats.incomplete_frames_cum);
+        printf("insert: %8.2f ns/packet\n", insert_time.count() * 1e9 / total_pkts);
+        printf("decode: %8.2f ns/packet\n", decode_time.count() * 1e9 / total_pkts);
+        printf("remove: %8.2f ns/packet\n", remove_time.count() * 1e9 / total_pkts);
+        printf("total:  %8.2f ns/packet, %.2f Mpkt/s\n",
+                        (insert_time + decode_time + remove_time).count() * 1e9 / total_pkts,
+                        total_pkts / (insert_time + decode_time + remove_time).count() / 1e6);
+        if (!ok) {
+                fprintf(stderr, "Decoded frames did not match the input!\n");
+                return 1;
+        }
+        return 0;
+}
@@ -0,0 +1,366 @@
+/**
+ * @file   tools/pipeline_bench.cpp
+ * @brief  End-to-end video pipeline benchmark
+ *
+ * Builds the whole sender and receiver pipeline in a single process -
+ * capture (testcard by default) with capture filters, compression, video
+ * RX/TX (loopback or UltraGrid RTP sending to itself over localhost) and
+ * display (dummy by default) - and runs it for a given time. Sustained FPS,
+ * CPU time per frame and the per-stage latency histograms from
+ * utils/metrics.h are printed as a JSON object. If a result of a previous
+ * run is given, relative change of FPS and CPU time is reported as well,
+ * which allows A/B comparison of two builds. Since the capture loop polls
+ * the device, pipeline_cpu_ms_per_frame excluding the capture thread is
+ * reported in addition to CPU time of the whole process.
+ *
+ * Note that loopback transport passes compressed frames to the display
+ * without decompression, so use "dump" display (or no compression) with it.
+ *
+ * Build with "make benchmarks".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "host.h"
+#include "module.h"
+#include "utils/metrics.h"
+#include "utils/wait_obj.h"
+#include "video.h"
+#include "video_capture.h"
+#include "video_capture_params.h"
+#include "video_display.h"
+#include "video_rxtx.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern "C" void exit_uv(int status);
+
+static volatile int exit_status = EXIT_SUCCESS;
+
+void exit_uv(int status)
+{
+        exit_status = status;
+        should_exit = true;
+}
+
+static void usage(const char *progname)
+{
+        printf("Usage:\n\t%s [-t <capture>] [-F <capture_filter>] [-c <compression>] "
+                        "[-r loopback|ultragrid_rtp] [-d <display>] [-P <port>] [-m <mtu>] "
+                        "[-w <warmup_sec>] [-s <duration_sec>] [-b <baseline.json>] [-o <result.json>]\n", progname);
+        printf("\nDefaults: -t testcard:1920:1080:60:UYVY -c none -r ultragrid_rtp -d dummy -P 5004 -m 9000 -w 2 -s 10\n");
+        printf("\nFPS and CPU time are measured after the warm-up, latency histograms cover the whole run.\n");
+        printf("Modules may print to stdout as well, use -o to get clean JSON.\n");
+}
+
+static double cpu_seconds(int who)
+{
+        struct rusage ru;
+        getrusage(who, &ru);
+        return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 +
+                ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+}
+
+/// naive lookup of a numeric top-level member in a result of a previous run
+static bool json_get_number(string const &json, const char *key, double *val)
+{
+        string needle = string("\"") + key + "\":";
+        auto pos = json.find(needle);
+        if (pos == string::npos) {
+                return false;
+        }
+        *val = atof(json.c_str() + pos + needle.length());
+        return true;
+}
+
+static string json_string(const char *str)
+{
+        string ret = "\"";
+        for (const char *c = str; *c != '\0'; ++c) {
+                if (*c == '"' || *c == '\\') {
+                        ret += '\\';
+                }
+                ret += *c;
+        }
+        return ret + "\"";
+}
+
+int main(int argc, char *argv[])
+{
+        const char *capture_cfg = "testcard:1920:1080:60:UYVY";
+        const char *capture_filter = nullptr;
+        const char *compression = "none";
+        const char *transport = "ultragrid_rtp";
+        const char *display_cfg = "dummy";
+        const char *baseline_file = nullptr;
+        const char *output_file = nullptr;
+        int port = 5004;
+        int mtu = 9000;
+        double warmup = 2.0;
+        double run_time = 10.0;
+
+        int ch;
+        while ((ch = getopt(argc, argv, "t:F:c:r:d:P:m:w:s:b:o:h")) != -1) {
+                switch (ch) {
+                case 't': capture_cfg = optarg; break;
+                case 'F': capture_filter = optarg; break;
+                case 'c': compression = optarg; break;
+                case 'r': transport = optarg; break;
+                case 'd': display_cfg = optarg; break;
+                case 'P': port = atoi(optarg); break;
+                case 'm': mtu = atoi(optarg); break;
+                case 'w': warmup = atof(optarg); break;
+                case 's': run_time = atof(optarg); break;
+                case 'b': baseline_file = optarg; break;
+                case 'o': output_file = optarg; break;
+                default:
+                        usage(argv[0]);
+                        return ch == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+                }
+        }
+
+        log_level = LOG_LEVEL_WARNING; // silence periodic FPS reports of modules
+        if (!common_preinit(argc, argv)) {
+                return EXIT_FAILURE;
+        }
+
+        struct module root_module;
+        module_init_default(&root_module);
+        root_module.cls = MODULE_CLASS_ROOT;
+
+        string display_name = display_cfg;
+        string display_fmt;
+        if (display_name.find(':') != string::npos) {
+                display_fmt = display_name.substr(display_name.find(':') + 1);
+                display_name = display_name.substr(0, display_name.find(':'));
+        }
+
+        struct display *display = nullptr;
+        struct vidcap *capture = nullptr;
+        struct vidcap_params *vidcap_params = vidcap_params_allocate();
+        vidcap_params_set_device(vidcap_params, capture_cfg);
+        if (capture_filter) {
+                vidcap_params_set_capture_filter(vidcap_params, capture_filter);
+        }
+        video_rxtx *rxtx = nullptr;
+        pthread_t receiver_thread_id;
+        bool receiver_thread_started = false;
+        auto start_time = steady_clock::now();
+        int video_offset = 0;
+        struct wait_obj *wait_obj = wait_obj_init();
+
+        struct metric *displayed = metric_counter("display.frames");
+        struct metric *captured = metric_counter("capture.frames");
+        long long displayed_start = 0, captured_start = 0, displayed_end = 0, captured_end = 0;
+        double cpu_start = 0, cpu_end = 0;
+        double capture_cpu_start = 0, capture_cpu_end = 0; // capture loop polls the device
+        steady_clock::time_point t_start, t_end;
+        string metrics;
+
+        try {
+                if (initialize_video_display(&root_module, display_name.c_str(), display_fmt.c_str(), 0, nullptr, &display) != 0) {
+                        throw string("Unable to initialize display ") + display_cfg;
+                }
+                if (initialize_video_capture(&root_module, vidcap_params, &capture) != 0) {
+                        throw string("Unable to initialize capture ") + capture_cfg;
+                }
+
+                map<string, param_u> params;
+                params["parent"].ptr = &root_module;
+                params["exporter"].ptr = nullptr;
+                params["compression"].ptr = const_cast<char *>(compression);
+                params["rxtx_mode"].i = MODE_SENDER | MODE_RECEIVER;
+                params["paused"].b = false;
+                params["display_device"].ptr = display;
+                params["receiver"].ptr = const_cast<char *>("localhost");
+                params["rx_port"].i = port;
+                params["tx_port"].i = port;
+                params["force_ip_version"].i = 0;
+                params["mcast_if"].ptr = nullptr;
+                params["mtu"].i = mtu;
+                params["fec"].ptr = const_cast<char *>("none");
+                params["encryption"].ptr = nullptr;
+                params["bitrate"].ll = RATE_UNLIMITED;
+                params["start_time"].ptr = &start_time;
+                params["video_delay"].ptr = &video_offset;
+                params["decoder_mode"].l = (long) VIDEO_NORMAL;
+
+                rxtx = video_rxtx::create(transport, params);
+                if (!rxtx) {
+                        throw string("Unable to create RX/TX ") + transport;
+                }
+                if (pthread_create(&receiver_thread_id, nullptr, video_rxtx::receiver_thread, rxtx) != 0) {
+                        throw string("Unable to create receiver thread");
+                }
+                receiver_thread_started = true;
+
+                // capture loop, see capture_thread() in main.cpp
+                auto t0 = steady_clock::now();
+                bool measuring = false;
+                while (!should_exit) {
+                        auto now = steady_clock::now();
+                        double elapsed = duration_cast<duration<double>>(now - t0).count();
+                        if (!measuring && elapsed >= warmup) {
+                                measuring = true;
+                                t_start = now;
+                                cpu_start = cpu_seconds(RUSAGE_SELF);
+                                capture_cpu_start = cpu_seconds(RUSAGE_THREAD);
+                                displayed_start = metric_value(displayed);
+                                captured_start = metric_value(captured);
+                        }
+                        if (elapsed >= warmup + run_time) {
+                                break;
+                        }
+
+                        struct audio_frame *audio;
+                        struct video_frame *tx_frame = vidcap_grab(capture, &audio);
+                        if (tx_frame == nullptr) {
+                                continue;
+                        }
+                        bool wait_for_frame = !tx_frame->callbacks.dispose;
+                        shared_ptr<video_frame> frame;
+                        if (wait_for_frame) {
+                                wait_obj_reset(wait_obj);
+                                frame = shared_ptr<video_frame>(tx_frame, [wait_obj](struct video_frame *) {
+                                                wait_obj_notify(wait_obj);
+                                                });
+                        } else {
+                                frame = shared_ptr<video_frame>(tx_frame, tx_frame->callbacks.dispose);
+                        }
+                        rxtx->send(move(frame));
+                        if (wait_for_frame) {
+                                wait_obj_wait(wait_obj);
+                                tx_frame->callbacks.dispose = NULL;
+                                tx_frame->callbacks.dispose_udata = NULL;
+                        }
+                }
+                t_end = steady_clock::now();
+                cpu_end = cpu_seconds(RUSAGE_SELF);
+                capture_cpu_end = cpu_seconds(RUSAGE_THREAD);
+                displayed_end = metric_value(displayed);
+                captured_end = metric_value(captured);
+                metrics = metrics_snapshot_json();
+        } catch (string const &err) {
+                cerr << err << endl;
+                exit_status = EXIT_FAILURE;
+        } catch (exception const &e) {
+                cerr << e.what() << endl;
+                exit_status = EXIT_FAILURE;
+        } catch (int i) {
+                exit_status = i;
+        }
+
+        should_exit = true;
+        if (rxtx) {
+                rxtx->join();
+        }
+        if (receiver_thread_started) {
+                pthread_join(receiver_thread_id, nullptr);
+        }
+        delete rxtx;
+        if (capture) {
+                vidcap_done(capture);
+        }
+        if (display) {
+                display_done(display);
+        }
+        vidcap_params_free_struct(vidcap_params);
+        wait_obj_done(wait_obj);
+        module_done(&root_module);
+
+        if (exit_status != EXIT_SUCCESS || metrics.empty()) {
+                return exit_status != EXIT_SUCCESS ? exit_status : EXIT_FAILURE;
+        }
+
+        double seconds = duration_cast<duration<double>>(t_end - t_start).count();
+        long long frames = displayed_end - displayed_start;
+        double fps = frames / seconds;
+        double cpu_ms_per_frame = frames > 0 ? (cpu_end - cpu_start) * 1000.0 / frames : 0.0;
+        double pipeline_cpu = (cpu_end - cpu_start) - (capture_cpu_end - capture_cpu_start);
+        double pipeline_cpu_ms_per_frame = frames > 0 ? pipeline_cpu * 1000.0 / frames : 0.0;
+
+        ostringstream out;
+        out << "{\"config\":{\"capture\":" << json_string(capture_cfg) <<
+                ",\"capture_filter\":" << json_string(capture_filter ? capture_filter : "") <<
+                ",\"compression\":" << json_string(compression) <<
+                ",\"transport\":" << json_string(transport) <<
+                ",\"display\":" << json_string(display_cfg) <<
+                ",\"mtu\":" << mtu << ",\"duration\":" << seconds << "}" <<
+                ",\"frames\":" << frames <<
+                ",\"fps\":" << fps <<
+                ",\"capture_fps\":" << (captured_end - captured_start) / seconds <<
+                ",\"cpu_ms_per_frame\":" << cpu_ms_per_frame <<
+                ",\"cpu_utilization\":" << (cpu_end - cpu_start) / seconds <<
+                ",\"pipeline_cpu_ms_per_frame\":" << pipeline_cpu_ms_per_frame;
+        if (baseline_file) {
+                ifstream in(baseline_file);
+                string baseline((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+                double base_fps, base_cpu;
+                if (json_get_number(baseline, "fps", &base_fps) && json_get_number(baseline, "cpu_ms_per_frame", &base_cpu)) {
+                        out << ",\"baseline\":{\"fps\":" << base_fps <<
+                                ",\"cpu_ms_per_frame\":" << base_cpu <<
+                                ",\"fps_change_pct\":" << (base_fps > 0 ? (fps / base_fps - 1.0) * 100.0 : 0.0) <<
+                                ",\"cpu_change_pct\":" << (base_cpu > 0 ? (cpu_ms_per_frame / base_cpu - 1.0) * 100.0 : 0.0) << "}";
+                } else {
+                        cerr << "Unable to read baseline from " << baseline_file << endl;
+                }
+        }
+        out << ",\"metrics\":" << metrics << "}\n";
+
+        cout << out.str();
+        if (output_file) {
+                ofstream(output_file) << out.str();
+        }
+        return frames > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,265 @@
+/**
+ * @file   tools/planar_conv_bench.cpp
+ * @brief  Planar conversion (utils/planar_conv.h) throughput benchmark
+ *
+ * Compares output of the SSE4.1 and AVX2 conversions with the scalar one
+ * ("line-decoder-simd=none") for a range of line lengths and measures
+ * single-thread throughput of all of them.
+ *
+ * Build with "make benchmarks".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "host.h"
+#include "utils/planar_conv.h"
+#include "video_codec.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern "C" void exit_uv(int status);
+
+void exit_uv(int status)
+{
+        exit(status);
+}
+
+static const codec_t inputs[] = { UYVY, YUYV, v210, RGB, BGR, RGBA, R10k };
+
+static const struct {
+        enum planar_fmt fmt;
+        const char *name;
+} outputs[] = {
+        { PLANAR_YUV420P, "yuv420p" },
+        { PLANAR_YUV422P, "yuv422p" },
+        { PLANAR_YUV444P, "yuv444p" },
+        { PLANAR_NV12, "nv12" },
+        { PLANAR_YUV420P10LE, "yuv420p10le" },
+        { PLANAR_YUV422P10LE, "yuv422p10le" },
+        { PLANAR_YUV444P10LE, "yuv444p10le" },
+};
+
+static const char *simds[] = { "none", "sse4.1", "avx2" };
+
+static void set_simd(const char *simd)
+{
+        if (strcmp(simd, "avx2") == 0) {
+                commandline_params.erase("line-decoder-simd");
+        } else {
+                commandline_params["line-decoder-simd"] = simd;
+        }
+}
+
+struct planes {
+        planes(enum planar_fmt fmt, int width, int height) {
+                int bps = fmt == PLANAR_YUV420P10LE || fmt == PLANAR_YUV422P10LE || fmt == PLANAR_YUV444P10LE ? 2 : 1;
+                int chroma_height = fmt == PLANAR_YUV420P || fmt == PLANAR_NV12 || fmt == PLANAR_YUV420P10LE ?
+                        (height + 1) / 2 : height;
+                // some padding to detect writes past the line
+                linesize[0] = linesize[1] = linesize[2] = bps * (width + 64);
+                data.resize(3);
+                data[0].resize((size_t) linesize[0] * height, 0xAA);
+                data[1].resize((size_t) linesize[1] * chroma_height, 0xAA);
+                data[2].resize(fmt == PLANAR_NV12 ? 0 : (size_t) linesize[2] * chroma_height, 0xAA);
+                for (int i = 0; i < 3; ++i) {
+                        ptr[i] = data[i].data();
+                }
+        }
+        vector<vector<unsigned char>> data;
+        unsigned char *ptr[3];
+        int linesize[3];
+};
+
+static void convert(codec_t in, enum planar_fmt out, vector<unsigned char> const &src, int width, int height,
+                struct planes &dst)
+{
+        planar_conv_lines(in, out, src.data(), vc_get_linesize(width, in), width, height, dst.ptr, dst.linesize,
+                        0, height);
+}
+
+/// checks that the conversion with given SIMD level matches the scalar one
+static bool check_exact(codec_t in, enum planar_fmt out, const char *simd, int width, int height, mt19937 &gen)
+{
+        vector<unsigned char> src((size_t) vc_get_linesize(width, in) * height);
+        for (auto &c : src) {
+                c = gen();
+        }
+        struct planes ref(out, width, height);
+        struct planes res(out, width, height);
+        set_simd("none");
+        convert(in, out, src, width, height, ref);
+        set_simd(simd);
+        convert(in, out, src, width, height, res);
+        return ref.data == res.data;
+}
+
+/**
+ * checks that RGB inputs of saturated colors (all 8 corners of the RGB cube)
+ * give samples within the limited range
+ */
+static bool check_range(codec_t in, enum planar_fmt out, const char *simd)
+{
+        if (in != RGB && in != BGR && in != RGBA && in != R10k) {
+                return true;
+        }
+        const int width = 64;
+        const int height = 2;
+        vector<unsigned char> src((size_t) vc_get_linesize(width, in) * height);
+        for (int i = 0; i < width * height; ++i) {
+                int r = i & 1 ? 1023 : 0;
+                int g = i & 2 ? 1023 : 0;
+                int b = i & 4 ? 1023 : 0;
+                if (in == R10k) {
+                        uint32_t val = r << 22 | g << 12 | b << 2;
+                        for (int j = 0; j < 4; ++j) {
+                                src[4 * i + j] = val >> (24 - 8 * j);
+                        }
+                } else {
+                        int bpp = in == RGBA ? 4 : 3;
+                        src[bpp * i] = (in == BGR ? b : r) >> 2;
+                        src[bpp * i + 1] = g >> 2;
+                        src[bpp * i + 2] = (in == BGR ? r : b) >> 2;
+                }
+        }
+        struct planes dst(out, width, height);
+        set_simd(simd);
+        convert(in, out, src, width, height, dst);
+
+        bool ten_bit = out == PLANAR_YUV420P10LE || out == PLANAR_YUV422P10LE || out == PLANAR_YUV444P10LE;
+        int chroma_width = out == PLANAR_YUV444P || out == PLANAR_YUV444P10LE ? width : width / 2;
+        int chroma_height = out == PLANAR_YUV420P || out == PLANAR_NV12 || out == PLANAR_YUV420P10LE ? 1 : height;
+        if (out == PLANAR_NV12) {
+                chroma_width *= 2; // interleaved CbCr
+        }
+        for (int plane = 0; plane < (out == PLANAR_NV12 ? 2 : 3); ++plane) {
+                int lo = ten_bit ? 64 : 16;
+                int hi = (plane == 0 ? 235 : 240) << (ten_bit ? 2 : 0);
+                for (int l = 0; l < (plane == 0 ? height : chroma_height); ++l) {
+                        for (int i = 0; i < (plane == 0 ? width : chroma_width); ++i) {
+                                const unsigned char *line = dst.ptr[plane] + l * dst.linesize[plane];
+                                int val = ten_bit ? ((const uint16_t *)(const void *) line)[i] : line[i];
+                                if (val < lo || val > hi) {
+                                        return false;
+                                }
+                        }
+                }
+        }
+        return true;
+}
+
+static double measure(codec_t in, enum planar_fmt out, const char *simd, int width, int height,
+                vector<unsigned char> const &src)
+{
+        struct planes dst(out, width, height);
+        set_simd(simd);
+        int iterations = 0;
+        auto t0 = high_resolution_clock::now();
+        duration<double> elapsed;
+        do {
+                convert(in, out, src, width, height, dst);
+                iterations += 1;
+                elapsed = high_resolution_clock::now() - t0;
+        } while (elapsed.count() < 0.2);
+        return (double) iterations * src.size() / elapsed.count() / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+                printf("Usage:\n\t%s [width [height]]\n", argv[0]);
+                return 0;
+        }
+        int width = argc > 1 ? atoi(argv[1]) : 1920;
+        int height = argc > 2 ? atoi(argv[2]) : 1080;
+        width = max(width, 2);
+        height = max(height, 1);
+
+        mt19937 gen(0xcafe);
+        bool ok = true;
+
+        printf("%-20s %10s %10s %10s\n", "conversion", "none", "sse4.1", "avx2");
+        for (codec_t in : inputs) {
+                for (auto const &out : outputs) {
+                        if (!planar_conv_supports(in, out.fmt)) {
+                                continue;
+                        }
+                        bool in_range = true;
+                        for (const char *simd : simds) {
+                                in_range = in_range && check_range(in, out.fmt, simd);
+                        }
+                        bool exact = true;
+                        for (unsigned i = 1; i < sizeof simds / sizeof simds[0]; ++i) {
+                                for (int w = 2; w <= 258; ++w) {
+                                        exact = exact && check_exact(in, out.fmt, simds[i], w, 3, gen);
+                                }
+                                exact = exact && check_exact(in, out.fmt, simds[i], width, 5, gen);
+                        }
+                        ok = ok && exact && in_range;
+
+                        vector<unsigned char> src((size_t) vc_get_linesize(width, in) * height);
+                        for (auto &c : src) {
+                                c = gen();
+                        }
+                        char name[32];
+                        snprintf(name, sizeof name, "%s->%s", get_codec_name(in), out.name);
+                        printf("%-20s", name);
+                        for (const char *simd : simds) {
+                                printf(" %5.2f GB/s", measure(in, out.fmt, simd, width, height, src));
+                        }
+                        printf("%s%s\n", exact ? "" : "  MISMATCH", in_range ? "" : "  OUT OF RANGE");
+                }
+        }
+        printf("(throughput of the input, single thread)\n");
+
+        if (!ok) {
+                fprintf(stderr, "Vectorized conversions do not match the scalar one or exceed the limited range!\n");
+                return 1;
+        }
+        return 0;
+}
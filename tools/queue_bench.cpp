@@ -0,0 +1,153 @@
+/**
+ * @file   tools/queue_bench.cpp
+ * @brief  Frame queue handoff latency benchmark
+ *
+ * Passes time-stamped messages through a 2-stage pipeline (as fec_queue and
+ * decompress_queue in the video decoder do) and reports p50/p99/max latency
+ * of a single handoff for synchronized_queue and lock_free_queue.
+ *
+ * Build with "make benchmarks".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "host.h"
+#include "utils/lock_free_queue.h"
+#include "utils/synchronized_queue.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern "C" void exit_uv(int status);
+
+void exit_uv(int status)
+{
+        exit(status);
+}
+
+struct stamped_msg {
+        steady_clock::time_point sent;
+        bool quit;
+};
+
+template<typename queue_t>
+static void run(const char *name, int count, int interval_us)
+{
+        queue_t q1, q2;
+        vector<long long> latencies;
+        latencies.reserve(2 * count);
+
+        thread middle([&]() {
+                while (true) {
+                        unique_ptr<stamped_msg> msg = q1.pop();
+                        latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - msg->sent).count());
+                        bool quit = msg->quit;
+                        msg->sent = steady_clock::now();
+                        q2.push(move(msg));
+                        if (quit) {
+                                break;
+                        }
+                }
+        });
+        vector<long long> latencies_last;
+        latencies_last.reserve(count);
+        thread last([&]() {
+                while (true) {
+                        unique_ptr<stamped_msg> msg = q2.pop();
+                        latencies_last.push_back(duration_cast<nanoseconds>(steady_clock::now() - msg->sent).count());
+                        if (msg->quit) {
+                                break;
+                        }
+                }
+        });
+
+        auto next = steady_clock::now();
+        for (int i = 0; i < count; ++i) {
+                if (interval_us > 0) {
+                        next += microseconds(interval_us);
+                        this_thread::sleep_until(next);
+                }
+                unique_ptr<stamped_msg> msg(new stamped_msg{steady_clock::now(), i == count - 1});
+                q1.push(move(msg));
+        }
+        middle.join();
+        last.join();
+
+        latencies.insert(latencies.end(), latencies_last.begin(), latencies_last.end());
+        sort(latencies.begin(), latencies.end());
+        printf("%-28s p50 %8.2f us  p99 %8.2f us  max %9.2f us\n", name,
+                        latencies[latencies.size() / 2] / 1000.0,
+                        latencies[latencies.size() * 99 / 100] / 1000.0,
+                        latencies.back() / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+                printf("Usage:\n\t%s [messages [interval_us]]\n", argv[0]);
+                printf("\tinterval_us 0 means back-to-back handoff\n");
+                return 0;
+        }
+        int count = argc > 1 ? atoi(argv[1]) : 20000;
+        int interval_us = argc > 2 ? atoi(argv[2]) : 100;
+
+        printf("%d messages, %d us apart\n", count, interval_us);
+        run<synchronized_queue<unique_ptr<stamped_msg>, 1>>("synchronized_queue", count, interval_us);
+        commandline_params["lf-queue-spin"] = "0";
+        run<lock_free_queue<unique_ptr<stamped_msg>, 1>>("lock_free_queue (park)", count, interval_us);
+        commandline_params["lf-queue-spin"] = "1000";
+        run<lock_free_queue<unique_ptr<stamped_msg>, 1>>("lock_free_queue (spin+park)", count, interval_us);
+        if (thread::hardware_concurrency() > 1) {
+                commandline_params["lf-queue-spin"] = "1000000";
+                run<lock_free_queue<unique_ptr<stamped_msg>, 1>>("lock_free_queue (spin)", count, interval_us);
+        } else {
+                printf("single CPU - spinning variant skipped\n");
+        }
+
+        return 0;
+}
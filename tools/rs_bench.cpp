@@ -0,0 +1,214 @@
+/**
+ * @file   tools/rs_bench.cpp
+ * @brief  Reed-Solomon FEC throughput benchmark
+ *
+ * Measures rs::encode() and rs::decode() throughput (in GB/s of the
+ * protected frame) for several (k, n) settings and loss patterns. Packets
+ * are dropped from the encoded buffer and the decoded frame is compared with
+ * the original one.
+ *
+ * Build with "make benchmarks".
+ */
+/*
+ * Copyright (c) 2019 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "host.h"
+#include "rtp/rs.h"
+#include "rtp/rtp_callback.h"
+#include "utils/worker.h"
+#include "video.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern "C" void exit_uv(int status);
+
+void exit_uv(int status)
+{
+        exit(status);
+}
+
+#define PACKET_SIZE 8000
+#define MIN_DURATION 0.3
+
+enum loss_type {
+        LOSS_NONE,
+        LOSS_RANDOM,
+        LOSS_BURST,
+};
+
+struct loss_pattern {
+        const char *name;
+        enum loss_type type;
+        double ratio;
+};
+
+/// @returns map offset->length of received packets of a buffer of len bytes
+static map<int, int> received_packets(int len, struct loss_pattern const &loss, mt19937 &gen)
+{
+        map<int, int> ret;
+        int packets = (len + PACKET_SIZE - 1) / PACKET_SIZE;
+        int burst_len = loss.ratio * packets;
+        int burst_start = packets > burst_len ? gen() % (packets - burst_len) : 0;
+        uniform_real_distribution<double> dist(0.0, 1.0);
+        for (int i = 0; i < packets; ++i) {
+                bool lost = false;
+                switch (loss.type) {
+                case LOSS_NONE:
+                        break;
+                case LOSS_RANDOM:
+                        lost = dist(gen) < loss.ratio;
+                        break;
+                case LOSS_BURST:
+                        lost = i >= burst_start && i < burst_start + burst_len;
+                        break;
+                }
+                if (!lost) {
+                        ret[i * PACKET_SIZE] = min(PACKET_SIZE, len - i * PACKET_SIZE);
+                }
+        }
+        return ret;
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+                printf("Usage:\n\t%s [frame_size_MB [threads]]\n", argv[0]);
+                return 0;
+        }
+        size_t frame_size = (argc > 1 ? atof(argv[1]) : 16.0) * 1000 * 1000;
+        if (argc > 2) {
+                commandline_params["worker-threads"] = argv[2];
+        }
+
+        const pair<int, int> codes[] = { { 32, 40 }, { 100, 120 }, { 200, 240 }, { 200, 255 } };
+        const struct loss_pattern losses[] = {
+                { "none", LOSS_NONE, 0.0 },
+                { "random 1%", LOSS_RANDOM, 0.01 },
+                { "random 0.1%", LOSS_RANDOM, 0.001 },
+                { "burst 10%", LOSS_BURST, 0.10 },
+        };
+
+        struct video_desc desc{};
+        desc.width = 3840;
+        desc.height = frame_size / vc_get_linesize(desc.width, UYVY);
+        desc.color_spec = UYVY;
+        desc.fps = 30;
+        desc.interlacing = PROGRESSIVE;
+        desc.tile_count = 1;
+        shared_ptr<video_frame> frame(vf_alloc_desc_data(desc), vf_free);
+        mt19937 gen(0xcafe);
+        for (unsigned int i = 0; i < frame->tiles[0].data_len; ++i) {
+                frame->tiles[0].data[i] = gen();
+        }
+        double frame_gb = frame->tiles[0].data_len / 1e9;
+        bool ok = true;
+
+        printf("frame: %u B, worker threads: %d\n", frame->tiles[0].data_len, task_pool_size());
+        printf("%-10s %-12s %10s\n", "k:n", "loss", "throughput");
+        for (auto const &code : codes) {
+                rs fec(code.first, code.second);
+                char kn[32];
+                snprintf(kn, sizeof kn, "%d:%d", code.first, code.second);
+
+                shared_ptr<video_frame> encoded;
+                int iterations = 0;
+                auto t0 = high_resolution_clock::now();
+                duration<double> elapsed;
+                do {
+                        encoded = fec.encode(frame);
+                        iterations += 1;
+                        elapsed = high_resolution_clock::now() - t0;
+                } while (elapsed.count() < MIN_DURATION);
+                printf("%-10s %-12s %6.2f GB/s\n", kn, "encode", iterations * frame_gb / elapsed.count());
+
+                int enc_len = encoded->tiles[0].data_len;
+                vector<char> buffer(enc_len);
+                for (auto const &loss : losses) {
+                        map<int, int> received = received_packets(enc_len, loss, gen);
+                        duration<double> decode_time{};
+                        iterations = 0;
+                        bool recovered = true;
+                        do {
+                                // lost packets are zeroed, decode repairs the buffer in place
+                                memset(buffer.data(), 0, enc_len);
+                                for (auto const &pkt : received) {
+                                        memcpy(buffer.data() + pkt.first, encoded->tiles[0].data + pkt.first, pkt.second);
+                                }
+                                char *out = nullptr;
+                                int out_len = 0;
+                                auto t0 = high_resolution_clock::now();
+                                fec.decode(buffer.data(), enc_len, &out, &out_len, received);
+                                decode_time += high_resolution_clock::now() - t0;
+                                iterations += 1;
+                                if (out_len == 0) {
+                                        recovered = false;
+                                        break;
+                                }
+                                if (out_len != (int) (frame->tiles[0].data_len + sizeof(video_payload_hdr_t)) ||
+                                                memcmp(out + sizeof(video_payload_hdr_t), frame->tiles[0].data,
+                                                        frame->tiles[0].data_len) != 0) {
+                                        fprintf(stderr, "%s %s: decoded frame differs!\n", kn, loss.name);
+                                        ok = false;
+                                        break;
+                                }
+                        } while (decode_time.count() < MIN_DURATION);
+                        if (recovered) {
+                                printf("%-10s %-12s %6.2f GB/s\n", kn, loss.name, iterations * frame_gb / decode_time.count());
+                        } else {
+                                printf("%-10s %-12s %s\n", kn, loss.name, "unrecoverable");
+                        }
+                }
+        }
+
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "lock_free_queue_test.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "utils/lock_free_queue.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( lock_free_queue_test );
+
+lock_free_queue_test::lock_free_queue_test()
+{
+}
+
+lock_free_queue_test::~lock_free_queue_test()
+{
+}
+
+void
+lock_free_queue_test::setUp()
+{
+}
+
+void
+lock_free_queue_test::tearDown()
+{
+}
+
+void
+lock_free_queue_test::testEmpty()
+{
+        lock_free_queue<unique_ptr<int>, 4> q;
+        unique_ptr<int> val;
+
+        CPPUNIT_ASSERT_EQUAL(0, q.size());
+        CPPUNIT_ASSERT(!q.try_pop(val));
+        CPPUNIT_ASSERT(!q.pop(true));
+
+        // empty again after the single item is taken
+        CPPUNIT_ASSERT(q.try_push(unique_ptr<int>(new int(1))));
+        CPPUNIT_ASSERT(q.try_pop(val));
+        CPPUNIT_ASSERT_EQUAL(1, *val);
+        CPPUNIT_ASSERT_EQUAL(0, q.size());
+        CPPUNIT_ASSERT(!q.try_pop(val));
+}
+
+void
+lock_free_queue_test::testFull()
+{
+        lock_free_queue<int, 4> q;
+
+        for (int i = 1; i <= 4; ++i) {
+                CPPUNIT_ASSERT(q.try_push(int(i)));
+        }
+        CPPUNIT_ASSERT_EQUAL(4, q.size());
+        CPPUNIT_ASSERT(!q.try_push(5));
+        CPPUNIT_ASSERT_EQUAL(4, q.size());
+
+        // a freed slot can be reused, also after the indices wrap around
+        CPPUNIT_ASSERT_EQUAL(1, q.pop());
+        CPPUNIT_ASSERT(q.try_push(5));
+        CPPUNIT_ASSERT(!q.try_push(6));
+
+        // blocking push returns once a consumer makes room
+        thread consumer([&]{ this_thread::sleep_for(chrono::milliseconds(20)); q.pop(); });
+        q.push(6);
+        consumer.join();
+        CPPUNIT_ASSERT_EQUAL(4, q.size());
+}
+
+void
+lock_free_queue_test::testOrder()
+{
+        lock_free_queue<int, 3> q;
+
+        for (int i = 0; i < 100; ++i) {
+                q.push(2 * i);
+                q.push(2 * i + 1);
+                CPPUNIT_ASSERT_EQUAL(2 * i, q.pop());
+                CPPUNIT_ASSERT_EQUAL(2 * i + 1, q.pop());
+        }
+}
+
+/**
+ * Several producers and consumers share a small queue, every item must be
+ * delivered exactly once.
+ */
+void
+lock_free_queue_test::testContention()
+{
+        const int producers = 4;
+        const int consumers = 4;
+        const int items = 20000; // per producer
+        lock_free_queue<int, 8> q;
+        vector<atomic<int>> seen(producers * items);
+        for (auto &s : seen) {
+                s = 0;
+        }
+
+        vector<thread> threads;
+        for (int p = 0; p < producers; ++p) {
+                threads.emplace_back([&, p]{
+                        for (int i = 0; i < items; ++i) {
+                                if (i % 2 == 0) {
+                                        q.push(p * items + i + 1);
+                                } else {
+                                        while (!q.try_push(p * items + i + 1)) {
+                                                this_thread::yield();
+                                        }
+                                }
+                        }
+                });
+        }
+        for (int c = 0; c < consumers; ++c) {
+                threads.emplace_back([&]{
+                        int val;
+                        // 0 is the poison pushed after the producers finish
+                        while ((val = q.pop()) != 0) {
+                                seen[val - 1] += 1;
+                        }
+                });
+        }
+        for (int p = 0; p < producers; ++p) {
+                threads[p].join();
+        }
+        for (int c = 0; c < consumers; ++c) {
+                q.push(0);
+        }
+        for (int c = 0; c < consumers; ++c) {
+                threads[producers + c].join();
+        }
+
+        for (auto &s : seen) {
+                CPPUNIT_ASSERT_EQUAL(1, s.load());
+        }
+        CPPUNIT_ASSERT_EQUAL(0, q.size());
+}
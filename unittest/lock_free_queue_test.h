@@ -0,0 +1,27 @@
+#ifndef LOCK_FREE_QUEUE_TEST_H
+#define LOCK_FREE_QUEUE_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class lock_free_queue_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( lock_free_queue_test );
+  CPPUNIT_TEST( testEmpty );
+  CPPUNIT_TEST( testFull );
+  CPPUNIT_TEST( testOrder );
+  CPPUNIT_TEST( testContention );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  lock_free_queue_test();
+  ~lock_free_queue_test();
+  void setUp();
+  void tearDown();
+
+  void testEmpty();
+  void testFull();
+  void testOrder();
+  void testContention();
+};
+
+#endif //  LOCK_FREE_QUEUE_TEST_H
@@ -0,0 +1,181 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "worker_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils/worker.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( worker_test );
+
+worker_test::worker_test()
+{
+}
+
+worker_test::~worker_test()
+{
+}
+
+void
+worker_test::setUp()
+{
+}
+
+void
+worker_test::tearDown()
+{
+}
+
+static void *square(void *arg)
+{
+        intptr_t val = (intptr_t) arg;
+        return (void *) (val * val);
+}
+
+void
+worker_test::testRunAsync()
+{
+        CPPUNIT_ASSERT(task_pool_size() >= 1);
+
+        vector<task_result_handle_t> handles;
+        for (intptr_t i = 0; i < 100; ++i) {
+                handles.push_back(task_run_async(square, (void *) i));
+        }
+        for (intptr_t i = 0; i < 100; ++i) {
+                CPPUNIT_ASSERT_EQUAL(i * i, (intptr_t) wait_task(handles[i]));
+        }
+}
+
+/**
+ * Every index of [begin, end) must be processed exactly once with chunks
+ * not shorter than min_chunk (except the last one).
+ */
+void
+worker_test::testParallelForCoverage()
+{
+        const struct { int begin, end, min_chunk; } ranges[] = {
+                { 0, 0, 1 }, { 5, 5, 1 }, { 0, 1, 1 }, { 3, 17, 1 }, { 3, 17, 4 },
+                { -10, 10, 3 }, { 0, 1000, 1 }, { 0, 1080, 16 }, { 0, 7, 100 },
+        };
+        for (auto const &r : ranges) {
+                vector<atomic<int>> hits(r.end - r.begin);
+                for (auto &h : hits) {
+                        h = 0;
+                }
+                atomic<int> calls{0};
+                atomic<bool> bad_chunk{false};
+                parallel_for(r.begin, r.end, [&](int b, int e) {
+                        calls += 1;
+                        if (b < r.begin || e > r.end || b >= e ||
+                                        (e - b < r.min_chunk && e != r.end)) {
+                                bad_chunk = true;
+                                return;
+                        }
+                        for (int i = b; i < e; ++i) {
+                                hits[i - r.begin] += 1;
+                        }
+                }, r.min_chunk);
+
+                CPPUNIT_ASSERT(!bad_chunk);
+                CPPUNIT_ASSERT(calls <= task_pool_size());
+                CPPUNIT_ASSERT(r.begin != r.end || calls == 0);
+                for (auto &h : hits) {
+                        CPPUNIT_ASSERT_EQUAL(1, h.load());
+                }
+        }
+}
+
+static void *nested_task(void *arg)
+{
+        int depth = (int) (intptr_t) arg;
+        if (depth == 0) {
+                return (void *) 1;
+        }
+        // waits from inside a pool task - must not deadlock even if all
+        // pool threads are waiting
+        vector<task_result_handle_t> handles;
+        for (int i = 0; i < 3; ++i) {
+                handles.push_back(task_run_async(nested_task, (void *) (intptr_t) (depth - 1)));
+        }
+        atomic<intptr_t> sum{0};
+        parallel_for(0, 4, [&](int b, int e) {
+                for (int i = b; i < e; ++i) {
+                        sum += (intptr_t) wait_task(task_run_async(nested_task, (void *) (intptr_t) (depth - 1)));
+                }
+        });
+        for (auto h : handles) {
+                sum += (intptr_t) wait_task(h);
+        }
+        return (void *) sum.load();
+}
+
+void
+worker_test::testNestedWait()
+{
+        // 3 + 4 children on each level
+        CPPUNIT_ASSERT_EQUAL((intptr_t) 7 * 7 * 7, (intptr_t) wait_task(task_run_async(nested_task, (void *) 3)));
+
+        // more outer tasks than pool threads, all of them waiting
+        vector<task_result_handle_t> handles;
+        for (int i = 0; i < 4 * task_pool_size(); ++i) {
+                handles.push_back(task_run_async(nested_task, (void *) 2));
+        }
+        for (auto h : handles) {
+                CPPUNIT_ASSERT_EQUAL((intptr_t) 7 * 7, (intptr_t) wait_task(h));
+        }
+}
+
+void
+worker_test::testTaskGroup()
+{
+        atomic<int> done{0};
+        {
+                task_group g;
+                for (int i = 0; i < 50; ++i) {
+                        g.run([&]{ done += 1; });
+                }
+                g.wait();
+                CPPUNIT_ASSERT_EQUAL(50, done.load());
+
+                // reusable after wait(), destructor waits for the rest
+                for (int i = 0; i < 50; ++i) {
+                        g.run([&]{ this_thread::sleep_for(chrono::microseconds(100)); done += 1; });
+                }
+        }
+        CPPUNIT_ASSERT_EQUAL(100, done.load());
+}
+
+static void *sleeping_task(void *arg)
+{
+        this_thread::sleep_for(chrono::milliseconds(200));
+        return arg;
+}
+
+/**
+ * Blocking tasks run outside the pool so that they cannot starve it even
+ * if there are more of them than pool threads.
+ */
+void
+worker_test::testBlockingTask()
+{
+        vector<task_result_handle_t> handles;
+        for (intptr_t i = 0; i < task_pool_size() + 1; ++i) {
+                handles.push_back(task_run_async_blocking(sleeping_task, (void *) i));
+        }
+
+        auto start = chrono::steady_clock::now();
+        atomic<int> count{0};
+        parallel_for(0, 100, [&](int b, int e) { count += e - b; });
+        CPPUNIT_ASSERT_EQUAL(100, count.load());
+        CPPUNIT_ASSERT(chrono::steady_clock::now() - start < chrono::milliseconds(150));
+
+        for (intptr_t i = 0; i < (intptr_t) handles.size(); ++i) {
+                CPPUNIT_ASSERT_EQUAL(i, (intptr_t) wait_task(handles[i]));
+        }
+}
@@ -0,0 +1,29 @@
+#ifndef WORKER_TEST_H
+#define WORKER_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class worker_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( worker_test );
+  CPPUNIT_TEST( testRunAsync );
+  CPPUNIT_TEST( testParallelForCoverage );
+  CPPUNIT_TEST( testNestedWait );
+  CPPUNIT_TEST( testTaskGroup );
+  CPPUNIT_TEST( testBlockingTask );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  worker_test();
+  ~worker_test();
+  void setUp();
+  void tearDown();
+
+  void testRunAsync();
+  void testParallelForCoverage();
+  void testNestedWait();
+  void testTaskGroup();
+  void testBlockingTask();
+};
+
+#endif //  WORKER_TEST_H